@@ -0,0 +1,154 @@
+/*
+ * Linux_Loopback.c
+ *
+ *  Created on: 18/10/2026
+ *  Description: In-memory loopback to the simulated bootloader of
+ *               sbl_sim.c, so the whole tool runs in one process
+ *               without a tty. The fd is a timerfd that turns
+ *               readable when the device's answer is ready.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/timerfd.h>
+
+/* Custom Includes */
+#include "Linux_Serial.h"
+#include "sbl_sim.h"
+
+/* Macros */
+#define MIN(x, y) (((x) < (y)) ? (x) : (y))
+
+/* Static variables */
+static tSblSim m_sim;
+
+/* Static functions */
+static int loopOpen(const char *port);
+static int loopConfigure(int fd);
+static int loopWrite(int fd, const uint8_t *pcData, uint32_t ui32Len);
+static int loopRead(int fd, uint8_t *pcData, uint32_t ui32Len, uint64_t ui64DeadlineUs);
+static int loopDrain(int fd);
+static void loopFlush(int fd);
+static int loopLines(int fd, uint32_t ui32Set, uint32_t ui32Clear);
+
+/* Pipelined like TCP, so that path can be exercised in-process */
+const tSerialTransport loopTransport = {
+    .name       = "loop",
+    .prefix     = "loop:",
+    .bPipeline  = true,
+    .bRawFd     = false,
+    .floorMs    = 0,
+    .open       = loopOpen,
+    .configure  = loopConfigure,
+    .write      = loopWrite,
+    .read       = loopRead,
+    .drain      = loopDrain,
+    .flush      = loopFlush,
+    .tune       = NULL,
+    .lines      = loopLines,
+    .close      = close,
+};
+
+/* Powers up a fresh device */
+static int loopOpen(const char *port)
+{
+    int fd;
+
+    (void)port;
+    if((fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) < 0)
+    {
+        perror("LOOP: ERROR CREATING TIMER |");
+        return(-1);
+    }
+    sblSimInit(&m_sim);
+    printf("LOOP: SIMULATED DEVICE READY\r\n");
+    return(fd);
+}
+
+/* Nothing to set */
+static int loopConfigure(int fd)
+{
+    (void)fd;
+    printf("\n  Loopback to simulated device\n\n");
+    return(0);
+}
+
+/* The device takes the bytes right away */
+static int loopWrite(int fd, const uint8_t *pcData, uint32_t ui32Len)
+{
+    (void)fd;
+    sblSimRx(&m_sim, pcData, ui32Len, serialGetTimeUs());
+    return((int)ui32Len);
+}
+
+/* Takes the device's answer, waiting for it until the deadline */
+static int loopRead(int fd, uint8_t *pcData, uint32_t ui32Len, uint64_t ui64DeadlineUs)
+{
+    const uint8_t *pcOut;
+    uint64_t now = serialGetTimeUs();
+    uint32_t n = sblSimTxPending(&m_sim, now, &pcOut);
+
+    if(n == 0)
+    {
+        struct pollfd pfd = { .fd = fd, .events = POLLIN };
+        struct itimerspec its;
+        uint64_t exp;
+
+        /* Busy device: wake up when its answer is ready. Silent
+         * device: sleep out the deadline. */
+        memset(&its, 0, sizeof(its));
+        if(m_sim.outLen > m_sim.outOff)
+        {
+            its.it_value.tv_sec = m_sim.readyUs / 1000000;
+            its.it_value.tv_nsec = (m_sim.readyUs % 1000000) * 1000;
+        }
+        if(timerfd_settime(fd, TFD_TIMER_ABSTIME, &its, NULL) < 0)
+        {
+            perror("LOOP: ERROR ARMING TIMER |");
+            return(-1);
+        }
+        if(now < ui64DeadlineUs &&
+           poll(&pfd, 1, (int)((ui64DeadlineUs - now + 999) / 1000)) > 0 &&
+           read(fd, &exp, sizeof(exp)) < 0 && errno != EAGAIN)
+            perror("LOOP: ERROR READING TIMER |");
+
+        if((n = sblSimTxPending(&m_sim, serialGetTimeUs(), &pcOut)) == 0)
+            return(0);
+    }
+
+    n = MIN(n, ui32Len);
+    memcpy(pcData, pcOut, n);
+    sblSimTxDone(&m_sim, n);
+    return((int)n);
+}
+
+/* Nothing in flight, writes land in the device immediately */
+static int loopDrain(int fd)
+{
+    (void)fd;
+    return(0);
+}
+
+/* Drops what the device is still sending */
+static void loopFlush(int fd)
+{
+    (void)fd;
+    sblSimTxDone(&m_sim, m_sim.outLen - m_sim.outOff);
+}
+
+/* Wired the usual way: RTS holds the device in reset, DTR pulls the
+ * backdoor pin to its bootloader level */
+static int loopLines(int fd, uint32_t ui32Set, uint32_t ui32Clear)
+{
+    static uint32_t lines;
+
+    (void)fd;
+    lines = (lines | ui32Set) & ~ui32Clear;
+    sblSimSetPins(&m_sim, (lines & TIOCM_RTS) != 0, (lines & TIOCM_DTR) != 0);
+    return(0);
+}
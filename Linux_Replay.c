@@ -0,0 +1,354 @@
+/*
+ * Linux_Replay.c
+ *
+ *  Created on: 18/10/2026
+ *  Description: Plays the device side of a wire trace recorded with
+ *               --trace back to the host, so a session captured in
+ *               the field reruns without hardware. What the host
+ *               sends is checked byte for byte against what was
+ *               recorded; each piece of recorded RX is released once
+ *               the host sent everything that preceded it, after the
+ *               gap it had in the recording divided by the speed.
+ *
+ *               replay:<trace>[@<speed>], speed 1 (default) keeps
+ *               the recorded timing, 0 drops it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/timerfd.h>
+
+/* Custom Includes */
+#include "Linux_Serial.h"
+#include "sbl_trace.h"
+
+/* Left out of a small build, its trace is held in memory */
+#ifndef SBL_SMALL
+
+#define REPLAY_PREFIX   "replay:"
+
+/* Macros */
+#define MIN(x, y) (((x) < (y)) ? (x) : (y))
+
+/* Bytes the device sent in one go */
+typedef struct {
+    uint32_t txMark;        /* Host bytes recorded before it */
+    uint64_t delayNs;       /* After the record before it */
+    uint32_t end;           /* End of its bytes in m_pRx */
+} tReplayChunk;
+
+/* Static variables */
+static uint8_t *m_pTx;              /* Host bytes recorded */
+static uint32_t m_txLen;
+static uint32_t m_txPos;            /* Host bytes seen so far */
+static uint8_t *m_pRx;              /* Device bytes recorded */
+static uint32_t m_rxOff;            /* Next byte to hand out */
+static uint32_t m_rxEnd;            /* End of the bytes released */
+static tReplayChunk *m_pChunks;
+static uint32_t m_numChunks;
+static uint32_t m_chunk;            /* Next to release */
+static uint64_t m_anchorUs;         /* Its delay counts from here */
+static bool m_bAnchored;
+static double m_speed;
+static bool m_bDiverged;
+
+/* Static functions */
+static int replayOpen(const char *port);
+static int replayConfigure(int fd);
+static int replayWrite(int fd, const uint8_t *pcData, uint32_t ui32Len);
+static int replayRead(int fd, uint8_t *pcData, uint32_t ui32Len, uint64_t ui64DeadlineUs);
+static int replayDrain(int fd);
+static void replayFlush(int fd);
+static int replayClose(int fd);
+static int replayLines(int fd, uint32_t ui32Set, uint32_t ui32Clear);
+static int loadTrace(const char *pcPath);
+static uint64_t chunkReadyUs(void);
+static void releaseDue(uint64_t nowUs);
+static void anchorNext(uint64_t nowUs);
+
+/* Pipelined, so a trace taken on a pipelined link replays; one taken
+ * without pipelining does too, its ACKs are released as soon as the
+ * command is in */
+const tSerialTransport replayTransport = {
+    .name       = "replay",
+    .prefix     = REPLAY_PREFIX,
+    .bPipeline  = true,
+    .bRawFd     = false,
+    .floorMs    = 0,
+    .open       = replayOpen,
+    .configure  = replayConfigure,
+    .write      = replayWrite,
+    .read       = replayRead,
+    .drain      = replayDrain,
+    .flush      = replayFlush,
+    .tune       = NULL,
+    .lines      = replayLines,
+    .close      = replayClose,
+};
+
+/* Loads replay:<trace>[@<speed>] */
+static int replayOpen(const char *port)
+{
+    char pcPath[4096];
+    char *pcAt, *pcEnd;
+    int fd;
+
+    snprintf(pcPath, sizeof(pcPath), "%s", port + strlen(REPLAY_PREFIX));
+    m_speed = 1.0;
+    if((pcAt = strrchr(pcPath, '@')))
+    {
+        double speed = strtod(pcAt + 1, &pcEnd);
+        if(pcEnd != pcAt + 1 && *pcEnd == '\0' && speed >= 0)
+        {
+            m_speed = speed;
+            *pcAt = '\0';
+        }
+    }
+
+    if(loadTrace(pcPath) < 0)
+        return(-1);
+    if((fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) < 0)
+    {
+        perror("REPLAY: ERROR CREATING TIMER |");
+        return(-1);
+    }
+
+    m_txPos = 0;
+    m_rxOff = m_rxEnd = 0;
+    m_chunk = 0;
+    m_bDiverged = false;
+    anchorNext(serialGetTimeUs());
+    printf("REPLAY: %s, %u HOST BYTES, %u DEVICE CHUNKS\r\n", pcPath, m_txLen, m_numChunks);
+    return(fd);
+}
+
+/* Nothing to set */
+static int replayConfigure(int fd)
+{
+    (void)fd;
+    if(m_speed > 0)
+        printf("\n  Replaying a trace at %gx its recorded timing\n\n", m_speed);
+    else
+        printf("\n  Replaying a trace without its timing\n\n");
+    return(0);
+}
+
+/* Checks the host's bytes against the recording */
+static int replayWrite(int fd, const uint8_t *pcData, uint32_t ui32Len)
+{
+    (void)fd;
+    for(uint32_t i = 0; i < ui32Len && !m_bDiverged; i++, m_txPos++)
+    {
+        if(m_txPos >= m_txLen)
+        {
+            printf("REPLAY: HOST SENT MORE THAN THE %u BYTES RECORDED\r\n", m_txLen);
+            m_bDiverged = true;
+        }
+        else if(pcData[i] != m_pTx[m_txPos])
+        {
+            printf("REPLAY: HOST DIVERGED AT BYTE %u, SENT 0x%02X, RECORDED 0x%02X\r\n",
+                   m_txPos, pcData[i], m_pTx[m_txPos]);
+            m_bDiverged = true;
+        }
+    }
+    if(!m_bAnchored)
+        anchorNext(serialGetTimeUs());
+    return((int)ui32Len);
+}
+
+/* Hands out what the device has sent, waiting for it until the
+ * deadline. A diverged host gets nothing more. */
+static int replayRead(int fd, uint8_t *pcData, uint32_t ui32Len, uint64_t ui64DeadlineUs)
+{
+    uint64_t now = serialGetTimeUs();
+    uint32_t n;
+
+    releaseDue(now);
+    if(m_rxOff == m_rxEnd)
+    {
+        struct pollfd pfd = { .fd = fd, .events = POLLIN };
+        struct itimerspec its;
+        uint64_t readyUs = chunkReadyUs(), exp;
+
+        memset(&its, 0, sizeof(its));
+        if(readyUs != UINT64_MAX && readyUs < ui64DeadlineUs)
+        {
+            its.it_value.tv_sec = readyUs / 1000000;
+            its.it_value.tv_nsec = (readyUs % 1000000) * 1000 + 1;
+        }
+        if(timerfd_settime(fd, TFD_TIMER_ABSTIME, &its, NULL) < 0)
+        {
+            perror("REPLAY: ERROR ARMING TIMER |");
+            return(-1);
+        }
+        if(now < ui64DeadlineUs &&
+           poll(&pfd, 1, (int)((ui64DeadlineUs - now + 999) / 1000)) > 0 &&
+           read(fd, &exp, sizeof(exp)) < 0 && errno != EAGAIN)
+            perror("REPLAY: ERROR READING TIMER |");
+
+        releaseDue(serialGetTimeUs());
+        if(m_rxOff == m_rxEnd)
+            return(0);
+    }
+
+    n = MIN(m_rxEnd - m_rxOff, ui32Len);
+    memcpy(pcData, &m_pRx[m_rxOff], n);
+    m_rxOff += n;
+    return((int)n);
+}
+
+/* Nothing in flight */
+static int replayDrain(int fd)
+{
+    (void)fd;
+    return(0);
+}
+
+/* Drops what the device sent and the host didn't read */
+static void replayFlush(int fd)
+{
+    (void)fd;
+    releaseDue(serialGetTimeUs());
+    m_rxOff = m_rxEnd;
+}
+
+/* Lines aren't recorded, the recording starts in the bootloader */
+static int replayLines(int fd, uint32_t ui32Set, uint32_t ui32Clear)
+{
+    (void)fd;
+    (void)ui32Set;
+    (void)ui32Clear;
+    return(0);
+}
+
+/* Tells how the host did, fails unless it sent exactly what was
+ * recorded */
+static int replayClose(int fd)
+{
+    int rc = 0;
+
+    if(m_bDiverged)
+        rc = -1;
+    else if(m_txPos < m_txLen)
+    {
+        printf("REPLAY: HOST STOPPED AFTER %u OF %u BYTES RECORDED\r\n", m_txPos, m_txLen);
+        rc = -1;
+    }
+    else
+        printf("REPLAY: HOST MATCHED ALL %u BYTES, %u OF %u DEVICE CHUNKS PLAYED\r\n",
+               m_txLen, m_chunk, m_numChunks);
+
+    free(m_pTx);
+    free(m_pRx);
+    free(m_pChunks);
+    m_pTx = m_pRx = NULL;
+    m_pChunks = NULL;
+    close(fd);
+    if(rc < 0)
+        errno = EPROTO;
+    return(rc);
+}
+
+/* Splits a trace into the host's bytes and the device's chunks */
+static int loadTrace(const char *pcPath)
+{
+    const tTraceHdr *pHdr;
+    const tTraceRec *pRecs;
+    uint64_t prevNs, prevRxNs = 0;
+    uint32_t rxLen = 0;
+    size_t mapLen;
+
+    if(!(pHdr = traceMapFile(pcPath, &mapLen)))
+        return(-1);
+    if(pHdr->seq > pHdr->numRecs)
+    {
+        printf("REPLAY: %s WRAPPED, THE START OF THE SESSION IS LOST\r\n", pcPath);
+        munmap((void*)pHdr, mapLen);
+        return(-1);
+    }
+    pRecs = traceRecords(pHdr);
+
+    /* Worst cases: every record all TX, or all RX in its own chunk */
+    m_pTx = malloc((size_t)pHdr->seq * SBL_TRACE_REC_DATA + 1);
+    m_pRx = malloc((size_t)pHdr->seq * SBL_TRACE_REC_DATA + 1);
+    m_pChunks = malloc((size_t)pHdr->seq * sizeof(tReplayChunk) + 1);
+    if(!m_pTx || !m_pRx || !m_pChunks)
+    {
+        printf("REPLAY: OUT OF MEMORY\r\n");
+        munmap((void*)pHdr, mapLen);
+        return(-1);
+    }
+
+    m_txLen = 0;
+    m_numChunks = 0;
+    prevNs = pHdr->startMonoNs;
+    for(uint64_t i = 0; i < pHdr->seq; i++)
+    {
+        const tTraceRec *pRec = &pRecs[i];
+        uint32_t len = MIN(pRec->len, SBL_TRACE_REC_DATA);
+
+        if(pRec->dir == TRACE_TX)
+        {
+            memcpy(&m_pTx[m_txLen], pRec->data, len);
+            m_txLen += len;
+            prevNs = pRec->tNs;
+        }
+        else if(pRec->dir == TRACE_RX)
+        {
+            /* One read split over records shares a timestamp */
+            bool bSameRead = m_numChunks && prevNs == prevRxNs && pRec->tNs == prevRxNs &&
+                             m_pChunks[m_numChunks - 1].txMark == m_txLen;
+            if(!bSameRead)
+            {
+                m_pChunks[m_numChunks].txMark = m_txLen;
+                m_pChunks[m_numChunks].delayNs = (pRec->tNs > prevNs) ? pRec->tNs - prevNs : 0;
+                m_numChunks++;
+            }
+            memcpy(&m_pRx[rxLen], pRec->data, len);
+            rxLen += len;
+            m_pChunks[m_numChunks - 1].end = rxLen;
+            prevNs = prevRxNs = pRec->tNs;
+        }
+    }
+    munmap((void*)pHdr, mapLen);
+    return(0);
+}
+
+/* When the next chunk goes out, UINT64_MAX if it waits for the host */
+static uint64_t chunkReadyUs(void)
+{
+    if(m_bDiverged || m_chunk >= m_numChunks || !m_bAnchored)
+        return(UINT64_MAX);
+    if(m_speed <= 0)
+        return(m_anchorUs);
+    return(m_anchorUs + (uint64_t)(m_pChunks[m_chunk].delayNs / 1000.0 / m_speed));
+}
+
+/* Releases the chunks whose time has come */
+static void releaseDue(uint64_t nowUs)
+{
+    uint64_t readyUs;
+
+    while((readyUs = chunkReadyUs()) <= nowUs)
+    {
+        m_rxEnd = m_pChunks[m_chunk++].end;
+        anchorNext(readyUs);
+    }
+}
+
+/* The next chunk's delay runs once the host has sent what preceded
+ * it in the recording */
+static void anchorNext(uint64_t nowUs)
+{
+    m_bAnchored = (m_chunk < m_numChunks && m_txPos >= m_pChunks[m_chunk].txMark);
+    if(m_bAnchored)
+        m_anchorUs = nowUs;
+}
+
+#endif /* SBL_SMALL */
@@ -6,35 +6,120 @@
  *  Description: Linux based serial port functions
  */
 
+#define _GNU_SOURCE  /* POLLRDHUP */
 #include <stdio.h>   /* Standard input/output definitions */
+#include <stdlib.h>  /* realpath() */
 #include <string.h>  /* String function definitions */
 #include <unistd.h>  /* UNIX standard function definitions */
 #include <fcntl.h>   /* File control definitions */
 #include <errno.h>   /* Error number definitions */
 #include <termios.h> /* POSIX terminal control definitions */
+#include <poll.h>    /* poll() for read deadlines */
+#include <time.h>    /* Monotonic clock */
+#include <pthread.h> /* RX thread */
+#include <stdatomic.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <linux/serial.h> /* ASYNC_LOW_LATENCY */
+#include <limits.h>
+#include <libgen.h>
 
 /* Custom Includes */
 #include "Linux_Serial.h"
+#include "rx_ring.h"
+#include "sbl_trace.h"
+#include "sbl_timeline.h"
+#include "sbl_probes.h"
 
 /* Static variables */
-static int fd = 0;
-static struct termios SerialPortSettings;
+static int fd = -1;
+static const tSerialTransport *m_pTransport = &termiosTransport;
+static char m_portName[PATH_MAX];
+static uint32_t rdTimeoutMs = SERIAL_DEFAULT_TIMEOUT_MS;
+static uint64_t lastRxUs;
+static uint64_t txBytes;
+static uint64_t rxBytes;
+
+/* What termiosTune() changed, put back on close */
+static struct serial_struct m_origSerial;
+static bool m_bSerialTuned = false;
+static char m_latencyPath[PATH_MAX];
+static int m_origLatencyMs = -1;
+
+/* Optional RX thread, drains the port into rxRing */
+static tRxRing rxRing;
+static pthread_t rxThread;
+static bool rxThreadRunning = false;
+static int rxEventFd = -1;              /* Thread -> serialRead(): bytes arrived */
+static int rxStopFd = -1;               /* serialStopRxThread() -> thread */
+static int rxRoomFd = -1;               /* serialRead() -> thread: ring has room */
+static _Atomic bool rxWantRoom;         /* Thread waits for rxRoomFd */
+static _Atomic uint32_t rxMaxBuffered;
+
+/* Transports picked by port name prefix, ttys if none matches */
+static const tSerialTransport *const m_transports[] = {
+    &tcpTransport,
+    &loopTransport,
+#ifndef SBL_SMALL
+    &replayTransport,
+#endif
+};
+#define NUM_TRANSPORTS  (sizeof(m_transports) / sizeof(m_transports[0]))
 
 /* Static functions */
-static void setBaudRate(bautSet_t baud);
+static void setBaudRate(struct termios *pTio, bautSet_t baud);
+static int ringRead(uint8_t *rdPtr, uint8_t rdDataLen);
+static void *rxThreadMain(void *arg);
+static void rxRoomMade(void);
+static int termiosOpen(const char *port);
+static int termiosConfigure(int fd);
+static int termiosWrite(int fd, const uint8_t *pcData, uint32_t ui32Len);
+static int termiosDrain(int fd);
+static void termiosFlush(int fd);
+static int termiosTune(int fd);
+static int termiosLines(int fd, uint32_t ui32Set, uint32_t ui32Clear);
+static int termiosClose(int fd);
+static int readLatencyTimer(const char *pcPath);
+static int writeLatencyTimer(const char *pcPath, int latencyMs);
+static bool usbPortId(const char *pcTty, char *pcId, uint32_t ui32Len);
+
+/* Character devices: USB/UART adapters and ptys */
+const tSerialTransport termiosTransport = {
+    .name       = "tty",
+    .prefix     = NULL,
+    .bPipeline  = false,
+    .bRawFd     = true,
+    .floorMs    = 0,
+    .open       = termiosOpen,
+    .configure  = termiosConfigure,
+    .write      = termiosWrite,
+    .read       = serialFdRead,
+    .drain      = termiosDrain,
+    .flush      = termiosFlush,
+    .tune       = termiosTune,
+    .lines      = termiosLines,
+    .close      = termiosClose,
+};
 
 /****************************************************************
  * Function Name : openPort
- * Description   : Opens the serial port
+ * Description   : Opens the serial port over the transport its
+ *                 name selects, see tSerialTransport
  * Returns       : 0 on success, -1 on failure
  * Params        @port: Path to the serial port
  ****************************************************************/
 int openPort(const char *port)
 {
-    if((fd = open(port, O_RDWR | O_NOCTTY)) < 0)
-        perror("USB: ERROR OPENING PORT |");
-    else
-        printf("USB: PORT OPEN SUCCESSFUL !\r\n");
+    snprintf(m_portName, sizeof(m_portName), "%s", port);
+    m_pTransport = &termiosTransport;
+    for(uint32_t i = 0; i < NUM_TRANSPORTS; i++)
+    {
+        const char *prefix = m_transports[i]->prefix;
+        if(!strncmp(port, prefix, strlen(prefix)))
+            m_pTransport = m_transports[i];
+    }
+
+    fd = m_pTransport->open(port);
     return(fd);
 }
 
@@ -47,10 +132,12 @@ int openPort(const char *port)
 int closePort()
 {
     int rc = 0;
-    if((rc = close(fd)) < 0)
+    serialStopRxThread();
+    if((rc = m_pTransport->close(fd)) < 0)
         perror("USB: ERROR CLOSING PORT |");
     else
         printf("USB: PORT CLOSED SUCCESSFUL !\r\n");
+    fd = -1;
     return(rc);
 }
 /****************************************************************
@@ -61,32 +148,33 @@ int closePort()
  ****************************************************************/
 void clearRxbuffer(void)
 {
-    /* This sleep is required for the flush to work
-     * properly, seems like a bug in the kernel. For
-     * more info refer to the link below:
-     * https://stackoverflow.com/questions/13013387/clearing-the-serial-ports-buffer
-     */
-    sleep(1);
-    tcflush(fd, TCIOFLUSH);
+    m_pTransport->flush(fd);
+    if(rxThreadRunning)
+    {
+        rxRingDiscard(&rxRing);
+        rxRoomMade();
+    }
+    traceBytes(TRACE_FLUSH, NULL, 0);
 }
 
 /****************************************************************
  * Function Name : setBaudRate
  * Description   : Set the baud rate
  * Returns       : None
- * Params        @baud: Baudrate
+ * Params        @pTio: Line settings to set it in
+ *               @baud: Baudrate
  ****************************************************************/
-static void setBaudRate(bautSet_t baud)
+static void setBaudRate(struct termios *pTio, bautSet_t baud)
 {
     switch(baud)
     {
     case B_9600:
-        cfsetispeed(&SerialPortSettings,B9600);
-        cfsetospeed(&SerialPortSettings,B9600);
+        cfsetispeed(pTio,B9600);
+        cfsetospeed(pTio,B9600);
         break;
     case B_115200:
-        cfsetispeed(&SerialPortSettings,B115200);
-        cfsetospeed(&SerialPortSettings,B115200);
+        cfsetispeed(pTio,B115200);
+        cfsetospeed(pTio,B115200);
         break;
     default:
         printf("ERROR: INVALID BAUD\n");
@@ -96,14 +184,30 @@ static void setBaudRate(bautSet_t baud)
 
 /****************************************************************
  * Function Name : configPort
- * Description   : Populate the termios structure
+ * Description   : Sets up the line: 115200 8N1 on a tty, the
+ *                 bridge's own settings over TCP
  * Returns       : None
  * Params        @None
  ****************************************************************/
 void configPort(void)
 {
+    m_pTransport->configure(fd);
+}
+
+/****************************************************************
+ * Function Name : serialConfigLine
+ * Description   : Populates the termios structure of a tty, 115200
+ *                 8N1 raw, without the flush configPort() does.
+ *                 For owners of more than one tty, thread safe.
+ * Returns       : 0 on success, -1 on failure
+ * Params        @fd: The tty
+ ****************************************************************/
+int serialConfigLine(int fd)
+{
+    struct termios SerialPortSettings;
+
     memset(&SerialPortSettings, 0, sizeof(SerialPortSettings));
-    setBaudRate(B_115200);
+    setBaudRate(&SerialPortSettings, B_115200);
 
     SerialPortSettings.c_cflag |= (CLOCAL | CREAD);
     SerialPortSettings.c_cflag &= ~CSIZE;
@@ -117,17 +221,17 @@ void configPort(void)
     SerialPortSettings.c_lflag &= ~(ECHO | ECHONL | ICANON | ISIG | IEXTEN);
     SerialPortSettings.c_oflag &= ~OPOST;
 
-    /* fetch bytes as they become available */
+    /* Never block in read(), serialRead() waits with poll() against
+     * its own deadline, see serialSetTimeout() */
     SerialPortSettings.c_cc[VMIN] = 0;
-    SerialPortSettings.c_cc[VTIME] = 2;
-
-    /* Flush out if there is any previously pending shit* */
-    clearRxbuffer();
+    SerialPortSettings.c_cc[VTIME] = 0;
 
     if((tcsetattr(fd,TCSANOW,&SerialPortSettings)) != 0)
+    {
         perror("ERROR in Setting attributes |");
-    else
-        printf("\n  BaudRate = 115200 \n  StopBits = 1 \n  Parity   = none\n\n");
+        return(-1);
+    }
+    return(0);
 }
 
 /****************************************************************
@@ -139,27 +243,229 @@ void configPort(void)
  ****************************************************************/
 int serialWrite(uint8_t *wrPtr, uint8_t wrDataLen)
 {
-    int wrbytes = write(fd, wrPtr, wrDataLen);
+    uint64_t t0 = timelineNow();
+    SBL_PROBE1(serial__write__start, wrDataLen);
+    int wrbytes = m_pTransport->write(fd, wrPtr, wrDataLen);
+    timelineSpan(TL_PORT, "write", t0, "bytes", wrDataLen);
     /* Be patient until everything is pumped out */
-    tcdrain(fd);
+    t0 = timelineNow();
+    m_pTransport->drain(fd);
+    timelineSpan(TL_PORT, "drain", t0, NULL, 0);
+    SBL_PROBE2(serial__write__done, wrDataLen, wrbytes);
+    if(wrbytes > 0)
+    {
+        txBytes += wrbytes;
+        traceBytes(TRACE_TX, wrPtr, wrbytes);
+    }
     return(wrbytes);
 }
 
 /****************************************************************
  * Function Name : serialRead
- * Description   : Reads bytes on the RX
+ * Description   : Reads bytes on the RX. Keeps reading until
+ *                 \e rdDataLen bytes arrived or the read timeout
+ *                 set by serialSetTimeout() expired.
  * Returns       : Number of bytes read
  * Params        @dataPtr: Pointer to the buffer to be populated
  *               @dataLen: Length of the data
  ****************************************************************/
 int serialRead(uint8_t *rdPtr, uint8_t rdDataLen)
 {
-    int rdbytes = read(fd, rdPtr, rdDataLen);
+    uint64_t t0 = timelineNow();
+
+    SBL_PROBE2(serial__read__start, rdDataLen, rdTimeoutMs);
+    if(rxThreadRunning)
+    {
+        int n = ringRead(rdPtr, rdDataLen);
+        if(n > 0)
+            traceBytes(TRACE_RX, rdPtr, n);
+        timelineSpan(TL_PORT, "read", t0, "bytes", (n > 0) ? n : 0);
+        SBL_PROBE2(serial__read__done, rdDataLen, n);
+        return(n);
+    }
+
+    int rdbytes = 0;
+    uint64_t deadline = serialGetTimeUs() + (uint64_t)rdTimeoutMs*1000;
+
+    while(rdbytes < rdDataLen && serialGetTimeUs() < deadline)
+    {
+        int n = m_pTransport->read(fd, &rdPtr[rdbytes], rdDataLen - rdbytes, deadline);
+        if(n < 0)
+            break;
+        if(n > 0)
+        {
+            lastRxUs = serialGetTimeUs();
+            traceBytes(TRACE_RX, &rdPtr[rdbytes], n);
+        }
+        rdbytes += n;
+    }
+    rxBytes += rdbytes;
+    timelineSpan(TL_PORT, "read", t0, "bytes", rdbytes);
+    SBL_PROBE2(serial__read__done, rdDataLen, rdbytes);
     return(rdbytes);
     /* If read does not return, we are Fuc*** !!!,
      * but should do unless the BL goes numb----*/
 }
 
+/****************************************************************
+ * Function Name : serialFdRead
+ * Description   : Transport read for fds that poll() and read()
+ *                 work on: waits for data until the deadline and
+ *                 takes what is there
+ * Returns       : Number of bytes read, 0 if none came, -1 if
+ *                 the port failed
+ * Params        @fd: The port
+ *               @pcData: Buffer to be populated
+ *               @ui32Len: Its size
+ *               @ui64DeadlineUs: Give up at, see serialGetTimeUs()
+ ****************************************************************/
+int serialFdRead(int fd, uint8_t *pcData, uint32_t ui32Len, uint64_t ui64DeadlineUs)
+{
+    struct pollfd pfd = { .fd = fd, .events = POLLIN | POLLRDHUP };
+    uint64_t now = serialGetTimeUs();
+
+    if(now >= ui64DeadlineUs)
+        return(0);
+
+    /* Round up, a 0 ms poll would spin */
+    int rc = poll(&pfd, 1, (int)((ui64DeadlineUs - now + 999) / 1000));
+    if(rc < 0)
+    {
+        if(errno == EINTR)
+            return(0);
+        perror("USB: ERROR POLLING PORT |");
+        return(-1);
+    }
+    if(rc == 0)
+        return(0);
+
+    int n = read(fd, pcData, ui32Len);
+    if(n < 0)
+    {
+        if(errno == EINTR || errno == EAGAIN)
+            return(0);
+        perror("USB: ERROR READING PORT |");
+        return(-1);
+    }
+    if(n == 0 && (pfd.revents & (POLLHUP | POLLRDHUP)))
+    {
+        printf("USB: PORT HUNG UP\r\n");
+        return(-1);
+    }
+    return(n);
+}
+
+/****************************************************************
+ * Function Name : serialTuneLatency
+ * Description   : Cuts the latency the adapter and its driver add
+ *                 to every response, e.g. the FTDI latency timer.
+ *                 Undone by closePort().
+ * Returns       : 0 if the port is as fast as we can make it, -1
+ *                 if there was nothing to tune
+ * Params        @None
+ ****************************************************************/
+int serialTuneLatency(void)
+{
+    if(!m_pTransport->tune)
+        return(-1);
+    return(m_pTransport->tune(fd));
+}
+
+/****************************************************************
+ * Function Name : serialSetLines
+ * Description   : Asserts and deasserts modem control lines, e.g.
+ *                 DTR and RTS wired to the backdoor pin and reset
+ *                 of the device. Lines in both masks are set.
+ * Returns       : 0 on success, -1 if the port has no such lines
+ * Params        @ui32Set: TIOCM_* lines to assert
+ *               @ui32Clear: TIOCM_* lines to deassert
+ ****************************************************************/
+int serialSetLines(uint32_t ui32Set, uint32_t ui32Clear)
+{
+    if(!m_pTransport->lines)
+    {
+        printf("USB: %s PORTS HAVE NO MODEM LINES\r\n", m_pTransport->name);
+        return(-1);
+    }
+    return(m_pTransport->lines(fd, ui32Set, ui32Clear & ~ui32Set));
+}
+
+/****************************************************************
+ * Function Name : serialGetPortId
+ * Description   : Names the physical port, stable across runs and
+ *                 replugs: "usb:<port path>:<interface>:<serial>"
+ *                 for USB adapters, the port name as given (maybe a
+ *                 udev symlink) for anything else
+ * Returns       : None
+ * Params        @pcId: Populated with the name
+ *               @ui32Len: Its size
+ ****************************************************************/
+void serialGetPortId(char *pcId, uint32_t ui32Len)
+{
+    char pcProc[64], pcLink[PATH_MAX];
+    ssize_t n;
+
+    snprintf(pcId, ui32Len, "%s", m_portName);
+    if(m_pTransport != &termiosTransport)
+        return;
+
+    /* ttyUSB numbers depend on plug order, go by where it sits */
+    snprintf(pcProc, sizeof(pcProc), "/proc/self/fd/%d", fd);
+    if((n = readlink(pcProc, pcLink, sizeof(pcLink) - 1)) <= 0)
+        return;
+    pcLink[n] = '\0';
+    usbPortId(basename(pcLink), pcId, ui32Len);
+}
+
+/****************************************************************
+ * Function Name : serialGetTransport
+ * Description   : Returns the transport of the open port
+ * Returns       : The transport
+ * Params        @None
+ ****************************************************************/
+const tSerialTransport *serialGetTransport(void)
+{
+    return(m_pTransport);
+}
+
+/****************************************************************
+ * Function Name : serialCanPipeline
+ * Description   : Checks if commands may be sent ahead of the
+ *                 answer to the previous one on this port
+ * Returns       : true if they may
+ * Params        @None
+ ****************************************************************/
+bool serialCanPipeline(void)
+{
+    return(m_pTransport->bPipeline);
+}
+
+/****************************************************************
+ * Function Name : serialSetTimeout
+ * Description   : Sets how long serialRead() may wait for the
+ *                 requested bytes
+ * Returns       : None
+ * Params        @ui32TimeoutMs: Timeout in milliseconds
+ ****************************************************************/
+void serialSetTimeout(uint32_t ui32TimeoutMs)
+{
+    rdTimeoutMs = ui32TimeoutMs;
+}
+
+/****************************************************************
+ * Function Name : serialGetTimeUs
+ * Description   : Monotonic time used for read deadlines and
+ *                 latency measurements
+ * Returns       : Time in microseconds
+ * Params        @None
+ ****************************************************************/
+uint64_t serialGetTimeUs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return((uint64_t)ts.tv_sec*1000000 + ts.tv_nsec/1000);
+}
+
 /****************************************************************
  * Function Name : get_filed
  * Description   : Returns fd
@@ -171,4 +477,459 @@ int get_filed(void)
     return(fd);
 }
 
+/****************************************************************
+ * Function Name : serialLastRxUs
+ * Description   : Returns when the last byte handed out by
+ *                 serialRead() arrived. With the RX thread running
+ *                 this is the time it was drained from the port,
+ *                 not the time serialRead() got to it.
+ * Returns       : Time in microseconds, see serialGetTimeUs()
+ * Params        @None
+ ****************************************************************/
+uint64_t serialLastRxUs(void)
+{
+    return(lastRxUs);
+}
+
+/****************************************************************
+ * Function Name : serialStartRxThread
+ * Description   : Starts a thread draining the port continuously
+ *                 into a lock-free ring, serialRead() then consumes
+ *                 from the ring. Call after configPort().
+ * Returns       : 0 on success, -1 on failure
+ * Params        @None
+ ****************************************************************/
+int serialStartRxThread(void)
+{
+    if(rxThreadRunning)
+        return(0);
+
+    if(!m_pTransport->bRawFd)
+    {
+        printf("USB: NO RX THREAD ON %s PORTS\r\n", m_pTransport->name);
+        return(-1);
+    }
+
+    rxRingInit(&rxRing);
+    atomic_store(&rxMaxBuffered, 0);
+    atomic_store(&rxWantRoom, false);
+
+    if((rxEventFd = eventfd(0, EFD_NONBLOCK)) < 0 ||
+       (rxStopFd = eventfd(0, EFD_NONBLOCK)) < 0 ||
+       (rxRoomFd = eventfd(0, EFD_NONBLOCK)) < 0)
+    {
+        perror("USB: ERROR CREATING RX EVENTS |");
+        if(rxEventFd >= 0)
+            close(rxEventFd);
+        if(rxStopFd >= 0)
+            close(rxStopFd);
+        rxEventFd = rxStopFd = -1;
+        return(-1);
+    }
+
+    if(pthread_create(&rxThread, NULL, rxThreadMain, NULL) != 0)
+    {
+        printf("USB: ERROR STARTING RX THREAD\r\n");
+        close(rxEventFd);
+        close(rxStopFd);
+        close(rxRoomFd);
+        rxEventFd = rxStopFd = rxRoomFd = -1;
+        return(-1);
+    }
+
+    rxThreadRunning = true;
+    printf("USB: RX THREAD STARTED\r\n");
+    return(0);
+}
 
+/****************************************************************
+ * Function Name : serialStopRxThread
+ * Description   : Stops the RX thread, bytes still in the ring
+ *                 are dropped
+ * Returns       : None
+ * Params        @None
+ ****************************************************************/
+void serialStopRxThread(void)
+{
+    uint64_t one = 1;
+
+    if(!rxThreadRunning)
+        return;
+
+    if(write(rxStopFd, &one, sizeof(one)) != sizeof(one))
+        perror("USB: ERROR STOPPING RX THREAD |");
+    pthread_join(rxThread, NULL);
+    close(rxEventFd);
+    close(rxStopFd);
+    close(rxRoomFd);
+    rxEventFd = rxStopFd = rxRoomFd = -1;
+    rxThreadRunning = false;
+}
+
+/****************************************************************
+ * Function Name : serialGetStats
+ * Description   : Returns the port counters
+ * Returns       : None
+ * Params        @pStats: Populated with the counters
+ ****************************************************************/
+void serialGetStats(tSerialStats *pStats)
+{
+    pStats->txBytes = txBytes;
+    pStats->rxBytes = rxBytes;
+    pStats->rxBuffered = rxThreadRunning ? rxRingCount(&rxRing) : 0;
+    pStats->rxMaxBuffered = atomic_load(&rxMaxBuffered);
+    pStats->bRxThread = rxThreadRunning;
+}
+
+/****************************************************************
+ * Function Name : printSerialStats
+ * Description   : Prints the port counters
+ * Returns       : None
+ * Params        @None
+ ****************************************************************/
+void printSerialStats(void)
+{
+    tSerialStats stats;
+    serialGetStats(&stats);
+    printf("Serial: TX %llu B, RX %llu B", (unsigned long long)stats.txBytes,
+           (unsigned long long)stats.rxBytes);
+    if(stats.bRxThread)
+        printf(", RX ring %u B buffered, max %u B", stats.rxBuffered, stats.rxMaxBuffered);
+    printf("\n");
+}
+
+/* serialRead() with the RX thread running, waits on rxEventFd */
+static int ringRead(uint8_t *rdPtr, uint8_t rdDataLen)
+{
+    int rdbytes = 0;
+    uint64_t deadline = serialGetTimeUs() + (uint64_t)rdTimeoutMs*1000;
+    struct pollfd pfd = { .fd = rxEventFd, .events = POLLIN };
+
+    for(;;)
+    {
+        uint32_t n = rxRingPop(&rxRing, &rdPtr[rdbytes], rdDataLen - rdbytes, &lastRxUs);
+        if(n)
+            rxRoomMade();
+        rdbytes += n;
+        if(rdbytes >= rdDataLen)
+            break;
+
+        uint64_t now = serialGetTimeUs();
+        if(now >= deadline)
+            break;
+
+        /* The thread bumps the counter after every push, so a push
+         * racing with the pop above still wakes us up */
+        int rc = poll(&pfd, 1, (int)((deadline - now + 999) / 1000));
+        if(rc > 0)
+        {
+            uint64_t cnt;
+            if(read(rxEventFd, &cnt, sizeof(cnt)) < 0 && errno != EAGAIN)
+                perror("USB: ERROR READING RX EVENT |");
+        }
+        else if(rc < 0 && errno != EINTR)
+        {
+            perror("USB: ERROR POLLING RX EVENT |");
+            break;
+        }
+    }
+    rxBytes += rdbytes;
+    return(rdbytes);
+}
+
+/* RX thread, drains the port into the ring until told to stop. It
+ * only reads what the ring has room for: with the ring full the port
+ * isn't polled, its bytes wait in the tty buffer (and flow control
+ * holds the device back) until serialRead() makes room. */
+static void *rxThreadMain(void *arg)
+{
+    uint8_t buf[4096];
+    uint64_t one = 1, cnt;
+    struct pollfd pfd[3] = {
+        { .fd = fd,       .events = POLLIN },
+        { .fd = rxStopFd, .events = POLLIN },
+        { .fd = rxRoomFd, .events = POLLIN },
+    };
+
+    (void)arg;
+    for(;;)
+    {
+        uint32_t room = RX_RING_SIZE - rxRingCount(&rxRing);
+
+        /* Checked again once the flag is up, a pop in between would
+         * not have signalled */
+        if(!room)
+        {
+            atomic_store(&rxWantRoom, true);
+            room = RX_RING_SIZE - rxRingCount(&rxRing);
+        }
+        pfd[0].fd = (room) ? fd : -1;
+
+        if(poll(pfd, 3, -1) < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            perror("USB: ERROR POLLING PORT |");
+            break;
+        }
+        if(pfd[1].revents)
+            break;
+        if((pfd[2].revents & POLLIN) && read(rxRoomFd, &cnt, sizeof(cnt)) < 0 && errno != EAGAIN)
+            perror("USB: ERROR READING RX ROOM EVENT |");
+        if(!room || !pfd[0].revents)
+            continue;
+        if(pfd[0].revents & POLLNVAL)
+            break;
+
+        int n = read(fd, buf, (room < sizeof(buf)) ? room : sizeof(buf));
+        if(n <= 0)
+        {
+            /* Hung up, don't spin on it */
+            if(pfd[0].revents & POLLHUP)
+                usleep(1000);
+            continue;
+        }
+
+        /* Fits, nothing else fills the ring */
+        rxRingPush(&rxRing, buf, n, serialGetTimeUs());
+
+        uint32_t level = rxRingCount(&rxRing);
+        if(level > atomic_load_explicit(&rxMaxBuffered, memory_order_relaxed))
+            atomic_store_explicit(&rxMaxBuffered, level, memory_order_relaxed);
+
+        if(write(rxEventFd, &one, sizeof(one)) < 0)
+            perror("USB: ERROR SIGNALLING RX EVENT |");
+    }
+    return(NULL);
+}
+
+/* The ring has room again, wakes the RX thread if it waits for it */
+static void rxRoomMade(void)
+{
+    uint64_t one = 1;
+
+    if(atomic_exchange(&rxWantRoom, false) &&
+       write(rxRoomFd, &one, sizeof(one)) < 0)
+        perror("USB: ERROR SIGNALLING RX ROOM |");
+}
+
+/* Opens a tty */
+static int termiosOpen(const char *port)
+{
+    int fd;
+    if((fd = open(port, O_RDWR | O_NOCTTY)) < 0)
+        perror("USB: ERROR OPENING PORT |");
+    else
+        printf("USB: PORT OPEN SUCCESSFUL !\r\n");
+    return(fd);
+}
+
+/* Flushes and sets up the line, 115200 8N1 raw */
+static int termiosConfigure(int fd)
+{
+    /* Flush out if there is any previously pending shit* */
+    clearRxbuffer();
+
+    if(serialConfigLine(fd) < 0)
+        return(-1);
+    printf("\n  BaudRate = 115200 \n  StopBits = 1 \n  Parity   = none\n\n");
+    return(0);
+}
+
+/* Write bytes on Tx */
+static int termiosWrite(int fd, const uint8_t *pcData, uint32_t ui32Len)
+{
+    return(write(fd, pcData, ui32Len));
+}
+
+/* Wait until the tty sent everything */
+static int termiosDrain(int fd)
+{
+    return(tcdrain(fd));
+}
+
+/* Discard old data in the tty buffers */
+static void termiosFlush(int fd)
+{
+    /* This sleep is required for the flush to work
+     * properly, seems like a bug in the kernel. For
+     * more info refer to the link below:
+     * https://stackoverflow.com/questions/13013387/clearing-the-serial-ports-buffer
+     */
+    sleep(1);
+    tcflush(fd, TCIOFLUSH);
+}
+
+/* Low latency mode in the serial driver, and the FTDI latency timer
+ * down to 1 ms where its sysfs file is writable */
+static int termiosTune(int fd)
+{
+    struct serial_struct ss;
+    char pcLink[PATH_MAX], pcProc[64];
+    int rc = -1;
+    ssize_t n;
+
+    /* Tells the driver to push RX to the tty layer right away
+     * instead of batching it. ptys and some drivers don't know it. */
+    if(ioctl(fd, TIOCGSERIAL, &ss) == 0)
+    {
+        rc = 0;
+        if(!(ss.flags & ASYNC_LOW_LATENCY))
+        {
+            m_origSerial = ss;
+            ss.flags |= ASYNC_LOW_LATENCY;
+            if(ioctl(fd, TIOCSSERIAL, &ss) == 0)
+            {
+                m_bSerialTuned = true;
+                printf("USB: LOW LATENCY MODE SET\r\n");
+            }
+            else
+            {
+                perror("USB: ERROR SETTING LOW LATENCY |");
+                rc = -1;
+            }
+        }
+    }
+
+    /* FTDI chips hold RX for up to latency_timer ms (16 by default)
+     * hoping to fill a USB packet. Our responses are 2-6 bytes. */
+    snprintf(pcProc, sizeof(pcProc), "/proc/self/fd/%d", fd);
+    if((n = readlink(pcProc, pcLink, sizeof(pcLink) - 1)) <= 0)
+        return(rc);
+    pcLink[n] = '\0';
+    snprintf(m_latencyPath, sizeof(m_latencyPath),
+             "/sys/class/tty/%s/device/latency_timer", basename(pcLink));
+
+    int latencyMs = readLatencyTimer(m_latencyPath);
+    if(latencyMs < 0)
+        return(rc);
+    if(latencyMs <= 1)
+        return(0);
+
+    if(writeLatencyTimer(m_latencyPath, 1) < 0)
+    {
+        printf("USB: LATENCY TIMER IS %d ms, NO PERMISSION TO LOWER IT (%s)\r\n",
+               latencyMs, m_latencyPath);
+        return(rc);
+    }
+    m_origLatencyMs = latencyMs;
+    printf("USB: LATENCY TIMER %d ms -> 1 ms\r\n", latencyMs);
+    return(0);
+}
+
+/* DTR/RTS: one TIOCMSET when lines go both ways, so they change
+ * together, else TIOCMBIS/TIOCMBIC */
+static int termiosLines(int fd, uint32_t ui32Set, uint32_t ui32Clear)
+{
+    int bits = (int)ui32Set;
+
+    if(ui32Set && ui32Clear)
+    {
+        if(ioctl(fd, TIOCMGET, &bits) < 0)
+        {
+            perror("USB: ERROR READING MODEM LINES |");
+            return(-1);
+        }
+        bits = (bits | (int)ui32Set) & ~(int)ui32Clear;
+        if(ioctl(fd, TIOCMSET, &bits) < 0)
+        {
+            perror("USB: ERROR SETTING MODEM LINES |");
+            return(-1);
+        }
+        return(0);
+    }
+
+    if(!ui32Set)
+        bits = (int)ui32Clear;
+    if(bits && ioctl(fd, (ui32Set) ? TIOCMBIS : TIOCMBIC, &bits) < 0)
+    {
+        perror("USB: ERROR SETTING MODEM LINES |");
+        return(-1);
+    }
+    return(0);
+}
+
+/* Puts back what termiosTune() changed and closes the tty */
+static int termiosClose(int fd)
+{
+    if(m_bSerialTuned && ioctl(fd, TIOCSSERIAL, &m_origSerial) < 0)
+        perror("USB: ERROR RESTORING SERIAL FLAGS |");
+    m_bSerialTuned = false;
+
+    if(m_origLatencyMs >= 0)
+    {
+        if(writeLatencyTimer(m_latencyPath, m_origLatencyMs) < 0)
+            printf("USB: ERROR RESTORING LATENCY TIMER (%s)\r\n", m_latencyPath);
+        m_origLatencyMs = -1;
+    }
+    return(close(fd));
+}
+
+/* Reads an FTDI latency_timer file, -1 if there is none */
+static int readLatencyTimer(const char *pcPath)
+{
+    int latencyMs = -1;
+    FILE *pFile = fopen(pcPath, "r");
+
+    if(!pFile)
+        return(-1);
+    if(fscanf(pFile, "%d", &latencyMs) != 1)
+        latencyMs = -1;
+    fclose(pFile);
+    return(latencyMs);
+}
+
+/* Writes an FTDI latency_timer file, usually needs root */
+static int writeLatencyTimer(const char *pcPath, int latencyMs)
+{
+    FILE *pFile = fopen(pcPath, "w");
+    int rc;
+
+    if(!pFile)
+        return(-1);
+    rc = (fprintf(pFile, "%d\n", latencyMs) < 0) ? -1 : 0;
+    if(fclose(pFile) != 0)
+        rc = -1;
+    return(rc);
+}
+
+/* Finds the USB interface a tty hangs off and the adapter's serial
+ * number in sysfs */
+static bool usbPortId(const char *pcTty, char *pcId, uint32_t ui32Len)
+{
+    char pcPath[PATH_MAX], pcDev[PATH_MAX + 16], pcFile[PATH_MAX + 16];
+    char pcIface[NAME_MAX + 1] = "", pcSerial[128] = "";
+
+    snprintf(pcDev, sizeof(pcDev), "/sys/class/tty/%s/device", pcTty);
+    if(!realpath(pcDev, pcPath))
+        return false;
+
+    /* Walk up to the USB device, the last dir named <port>:<cfg>.<if>
+     * on the way is the interface */
+    for(;;)
+    {
+        char *pcSlash = strrchr(pcPath, '/');
+        if(!pcSlash || pcSlash == pcPath)
+            return false;
+
+        snprintf(pcFile, sizeof(pcFile), "%s/idVendor", pcPath);
+        if(access(pcFile, R_OK) == 0)
+            break;
+        if(strchr(pcSlash + 1, ':'))
+            snprintf(pcIface, sizeof(pcIface), "%s", pcSlash + 1);
+        *pcSlash = '\0';
+    }
+
+    snprintf(pcFile, sizeof(pcFile), "%s/serial", pcPath);
+    FILE *pFile = fopen(pcFile, "r");
+    if(pFile)
+    {
+        if(fscanf(pFile, "%127s", pcSerial) != 1)
+            pcSerial[0] = '\0';
+        fclose(pFile);
+    }
+
+    snprintf(pcId, ui32Len, "usb:%s:%s", pcIface[0] ? pcIface : basename(pcPath),
+             pcSerial[0] ? pcSerial : "-");
+    return true;
+}
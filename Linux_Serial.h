@@ -8,17 +8,77 @@
 #ifndef LINUX_SERIAL_H_
 #define LINUX_SERIAL_H_
 #include <stdint.h>
+#include <stdbool.h>
+#include "sbl_small.h"
+
+/* Read timeout used until the protocol layer sets its own */
+#define SERIAL_DEFAULT_TIMEOUT_MS   200
 
 typedef enum {
     B_9600,
     B_115200
 }bautSet_t;
 
+/* Port counters, see serialGetStats() */
+typedef struct {
+    uint64_t txBytes;
+    uint64_t rxBytes;           /* Bytes handed out by serialRead() */
+    uint32_t rxBuffered;        /* Bytes waiting in the RX ring */
+    uint32_t rxMaxBuffered;     /* RX ring high water mark */
+    bool     bRxThread;
+}tSerialStats;
+
+/* A way of reaching the bootloader, picked by openPort() from the
+ * port name: "tcp:<host>:<port>" is a raw TCP serial bridge (ser2net
+ * raw mode), "loop:" a simulated device in this process,
+ * "replay:<trace>" a device played back from a --trace recording,
+ * anything else a tty. */
+typedef struct {
+    const char *name;
+    const char *prefix;         /* Port name prefix, NULL for ttys */
+    bool  bPipeline;            /* See sblEngineSetPipeline() */
+    bool  bRawFd;               /* fd can be poll()ed and read() as is */
+    uint32_t floorMs;           /* Least response timeout, 0 for default */
+    int  (*open)(const char *port);
+    int  (*configure)(int fd);
+    int  (*write)(int fd, const uint8_t *pcData, uint32_t ui32Len);
+    int  (*read)(int fd, uint8_t *pcData, uint32_t ui32Len, uint64_t ui64DeadlineUs);
+    int  (*drain)(int fd);
+    void (*flush)(int fd);
+    int  (*tune)(int fd);       /* Cut adapter latency, NULL if none */
+    int  (*lines)(int fd, uint32_t ui32Set, uint32_t ui32Clear);
+                                /* Modem lines (TIOCM_DTR, TIOCM_RTS),
+                                 * NULL if the port has none */
+    int  (*close)(int fd);
+}tSerialTransport;
+
+extern const tSerialTransport termiosTransport;
+extern const tSerialTransport tcpTransport;
+extern const tSerialTransport loopTransport;
+#ifndef SBL_SMALL
+extern const tSerialTransport replayTransport;
+#endif
+
 extern int openPort(const char *port);
 extern int closePort();
 extern void configPort(void);
+extern int serialConfigLine(int fd);
 extern int serialWrite(uint8_t *wrPtr, uint8_t wrDataLen);
 extern int serialRead(uint8_t *rdPtr, uint8_t rdDataLen);
 extern int get_filed(void);
+extern void serialSetTimeout(uint32_t ui32TimeoutMs);
+extern uint64_t serialGetTimeUs(void);
+extern uint64_t serialLastRxUs(void);
+extern int serialStartRxThread(void);
+extern void serialStopRxThread(void);
+extern void serialGetStats(tSerialStats *pStats);
+extern void printSerialStats(void);
+extern const tSerialTransport *serialGetTransport(void);
+extern bool serialCanPipeline(void);
+extern int serialTuneLatency(void);
+extern int serialSetLines(uint32_t ui32Set, uint32_t ui32Clear);
+extern void serialGetPortId(char *pcId, uint32_t ui32Len);
+extern int serialFdRead(int fd, uint8_t *pcData, uint32_t ui32Len,
+                        uint64_t ui64DeadlineUs);
 
 #endif /* LINUX_SERIAL_H_ */
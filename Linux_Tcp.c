@@ -0,0 +1,153 @@
+/*
+ * Linux_Tcp.c
+ *
+ *  Created on: 18/10/2026
+ *  Description: Serial port behind a raw TCP bridge (ser2net in
+ *               raw mode, terminal servers). The bridge owns the
+ *               line settings and paces the UART, all we see is a
+ *               byte stream.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+/* Custom Includes */
+#include "Linux_Serial.h"
+
+#define TCP_PREFIX      "tcp:"
+
+/* Static functions */
+static int tcpOpen(const char *port);
+static int tcpConfigure(int fd);
+static int tcpWrite(int fd, const uint8_t *pcData, uint32_t ui32Len);
+static int tcpDrain(int fd);
+static void tcpFlush(int fd);
+
+/* The round trip to the bridge dwarfs the device's, so commands are
+ * pipelined with their status checks, and network jitter sets the
+ * least timeout */
+const tSerialTransport tcpTransport = {
+    .name       = "tcp",
+    .prefix     = TCP_PREFIX,
+    .bPipeline  = true,
+    .bRawFd     = true,
+    .floorMs    = 100,
+    .open       = tcpOpen,
+    .configure  = tcpConfigure,
+    .write      = tcpWrite,
+    .read       = serialFdRead,
+    .drain      = tcpDrain,
+    .flush      = tcpFlush,
+    .tune       = NULL,
+    .close      = close,
+};
+
+/* Connects to tcp:<host>:<port>, [<v6 address>] for IPv6 */
+static int tcpOpen(const char *port)
+{
+    char host[256];
+    const char *service;
+    struct addrinfo hints, *pRes, *pAi;
+    int fd = -1, rc, one = 1;
+
+    port += strlen(TCP_PREFIX);
+    if(!(service = strrchr(port, ':')) || service == port ||
+       (size_t)(service - port) >= sizeof(host))
+    {
+        printf("TCP: PORT MUST BE tcp:<host>:<port>\r\n");
+        return(-1);
+    }
+    memcpy(host, port, service - port);
+    host[service - port] = '\0';
+    service++;
+    if(host[0] == '[' && host[strlen(host) - 1] == ']')
+    {
+        memmove(host, &host[1], strlen(host) - 2);
+        host[strlen(host) - 2] = '\0';
+    }
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if((rc = getaddrinfo(host, service, &hints, &pRes)) != 0)
+    {
+        printf("TCP: CAN'T RESOLVE %s:%s | %s\r\n", host, service, gai_strerror(rc));
+        return(-1);
+    }
+
+    for(pAi = pRes; pAi; pAi = pAi->ai_next)
+    {
+        if((fd = socket(pAi->ai_family, pAi->ai_socktype | SOCK_CLOEXEC, pAi->ai_protocol)) < 0)
+            continue;
+        if(connect(fd, pAi->ai_addr, pAi->ai_addrlen) == 0)
+            break;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(pRes);
+
+    if(fd < 0)
+    {
+        perror("TCP: ERROR CONNECTING |");
+        return(-1);
+    }
+
+    /* Packets are small and each one is waited for, never hold one
+     * back to coalesce it with the next */
+    if(setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)) < 0)
+        perror("TCP: ERROR SETTING TCP_NODELAY |");
+
+    printf("TCP: CONNECTED TO %s:%s\r\n", host, service);
+    return(fd);
+}
+
+/* Nothing to set, the bridge owns the line */
+static int tcpConfigure(int fd)
+{
+    tcpFlush(fd);
+    printf("\n  Raw TCP bridge, line settings are the bridge's\n\n");
+    return(0);
+}
+
+/* Sends everything, a socket may take it in pieces */
+static int tcpWrite(int fd, const uint8_t *pcData, uint32_t ui32Len)
+{
+    uint32_t sent = 0;
+
+    while(sent < ui32Len)
+    {
+        ssize_t n = send(fd, &pcData[sent], ui32Len - sent, MSG_NOSIGNAL);
+        if(n < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            perror("TCP: ERROR WRITING |");
+            return(sent ? (int)sent : -1);
+        }
+        sent += n;
+    }
+    return((int)sent);
+}
+
+/* Waiting for the bytes to reach the wire would cost a round trip to
+ * the bridge per packet, the bridge queues and paces them itself */
+static int tcpDrain(int fd)
+{
+    (void)fd;
+    return(0);
+}
+
+/* Discards whatever the bridge already forwarded */
+static void tcpFlush(int fd)
+{
+    uint8_t buf[256];
+
+    while(recv(fd, buf, sizeof(buf), MSG_DONTWAIT) > 0)
+        ;
+}
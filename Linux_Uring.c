@@ -0,0 +1,773 @@
+/*
+ * Linux_Uring.c
+ *
+ *  Created on: 18/10/2026
+ *  Description: io_uring based serial backend. Drives the bootloader
+ *               sessions of many ports from one thread: multishot
+ *               reads into provided buffers where the kernel has
+ *               them, linked write->read submissions otherwise.
+ *               Uses the raw syscalls, no liburing needed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <termios.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+/* Custom Includes */
+#include "Linux_Uring.h"
+#include "Linux_Serial.h"
+#include "sbl_timeout.h"
+
+/* Newer than some installed headers */
+#define URING_OP_READ_MULTISHOT     49
+#define URING_PROBE_OPS             256
+
+/* user_data: port index << 8 | request kind */
+#define URING_UD_WRITE              1
+#define URING_UD_READ               2
+#define URING_UD_WATCH              3       /* Index of the watch */
+#define URING_UD_CANCEL             4
+#define URING_UD(port, kind)        (((uint64_t)(port) << 8) | (kind))
+
+#define URING_BGID                  1
+
+/* Static functions */
+static int uringSetup(uint32_t entries, struct io_uring_params *p);
+static int uringEnter(tUringReactor *pR, uint32_t toSubmit, uint32_t minComplete,
+                      uint64_t timeoutUs);
+static bool probeMultishot(tUringReactor *pR);
+static bool setupBufRing(tUringReactor *pR);
+static struct io_uring_sqe *getSqe(tUringReactor *pR);
+static void flushPort(tUringReactor *pR, tUringPort *pPort);
+static void armRead(tUringReactor *pR, tUringPort *pPort, bool bLinked);
+static void reapCqes(tUringReactor *pR);
+static void recycleBuf(tUringReactor *pR, uint32_t bid);
+static void drainEvents(tUringReactor *pR, tUringPort *pPort);
+static void markDirty(tUringReactor *pR, tUringPort *pPort);
+static void armWatch(tUringReactor *pR, uint32_t ui32Idx);
+static void handleWatch(tUringReactor *pR, uint32_t ui32Idx, int res, uint32_t flags);
+static void releasePort(tUringPort *pPort);
+
+/****************************************************************
+ * Function Name : uringInit
+ * Description   : Creates the ring
+ * Returns       : 0 on success, -1 on failure
+ * Params        @pR: The reactor
+ *               @ui32MaxPorts: Ports that will be added
+ *               @onEvent: Completion callback
+ ****************************************************************/
+int uringInit(tUringReactor *pR, uint32_t ui32MaxPorts, tUringEventCb onEvent)
+{
+    struct io_uring_params p;
+    uint32_t entries = 8;
+
+    memset(pR, 0, sizeof(*pR));
+    pR->ringFd = -1;
+    if(ui32MaxPorts == 0 || ui32MaxPorts > URING_MAX_PORTS)
+    {
+        printf("uringInit(): Port count %d out of range.\n", ui32MaxPorts);
+        return (-1);
+    }
+
+    /* Room for a write and a read per port */
+    while(entries < 2 * ui32MaxPorts)
+        entries <<= 1;
+
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+    if((pR->ringFd = uringSetup(entries, &p)) < 0)
+    {
+        /* Older kernel, plain ring */
+        memset(&p, 0, sizeof(p));
+        pR->ringFd = uringSetup(entries, &p);
+    }
+    if(pR->ringFd < 0)
+    {
+        perror("URING: ERROR SETTING UP RING |");
+        return (-1);
+    }
+    if(!(p.features & IORING_FEAT_EXT_ARG))
+    {
+        printf("uringInit(): Kernel lacks IORING_FEAT_EXT_ARG.\n");
+        uringClose(pR);
+        return (-1);
+    }
+
+    /* Rings */
+    pR->sqMemLen = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+    pR->cqMemLen = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if(p.features & IORING_FEAT_SINGLE_MMAP)
+        pR->sqMemLen = pR->cqMemLen = (pR->sqMemLen > pR->cqMemLen) ? pR->sqMemLen : pR->cqMemLen;
+
+    pR->sqMem = mmap(NULL, pR->sqMemLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     pR->ringFd, IORING_OFF_SQ_RING);
+    if(pR->sqMem == MAP_FAILED)
+        goto fail;
+    if(p.features & IORING_FEAT_SINGLE_MMAP)
+        pR->cqMem = pR->sqMem;
+    else
+    {
+        pR->cqMem = mmap(NULL, pR->cqMemLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         pR->ringFd, IORING_OFF_CQ_RING);
+        if(pR->cqMem == MAP_FAILED)
+            goto fail;
+    }
+    pR->sqesLen = p.sq_entries * sizeof(struct io_uring_sqe);
+    pR->sqes = mmap(NULL, pR->sqesLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    pR->ringFd, IORING_OFF_SQES);
+    if(pR->sqes == MAP_FAILED)
+        goto fail;
+
+    pR->sqHead  = (uint32_t*)((uint8_t*)pR->sqMem + p.sq_off.head);
+    pR->sqTail  = (uint32_t*)((uint8_t*)pR->sqMem + p.sq_off.tail);
+    pR->sqArray = (uint32_t*)((uint8_t*)pR->sqMem + p.sq_off.array);
+    pR->sqMask  = *(uint32_t*)((uint8_t*)pR->sqMem + p.sq_off.ring_mask);
+    pR->sqLocalTail = *pR->sqTail;
+    pR->cqHead  = (uint32_t*)((uint8_t*)pR->cqMem + p.cq_off.head);
+    pR->cqTail  = (uint32_t*)((uint8_t*)pR->cqMem + p.cq_off.tail);
+    pR->cqMask  = *(uint32_t*)((uint8_t*)pR->cqMem + p.cq_off.ring_mask);
+    pR->cqes    = (struct io_uring_cqe*)((uint8_t*)pR->cqMem + p.cq_off.cqes);
+
+    /* Ports */
+    pR->maxPorts = ui32MaxPorts;
+    pR->ports = calloc(ui32MaxPorts, sizeof(tUringPort));
+    pR->dirty = calloc(ui32MaxPorts, sizeof(uint32_t));
+    if(!pR->ports || !pR->dirty)
+        goto fail;
+    pR->onEvent = onEvent;
+
+    pR->bMultishot = probeMultishot(pR) && setupBufRing(pR);
+    return (0);
+
+fail:
+    perror("URING: ERROR MAPPING RING |");
+    uringClose(pR);
+    return (-1);
+}
+
+/****************************************************************
+ * Function Name : uringClose
+ * Description   : Tears the ring down. Port fds stay open, they
+ *                 belong to the caller.
+ * Returns       : None
+ * Params        @pR: The reactor
+ ****************************************************************/
+void uringClose(tUringReactor *pR)
+{
+    if(pR->sqes && pR->sqes != MAP_FAILED)
+        munmap(pR->sqes, pR->sqesLen);
+    if(pR->cqMem && pR->cqMem != MAP_FAILED && pR->cqMem != pR->sqMem)
+        munmap(pR->cqMem, pR->cqMemLen);
+    if(pR->sqMem && pR->sqMem != MAP_FAILED)
+        munmap(pR->sqMem, pR->sqMemLen);
+    if(pR->ringFd >= 0)
+        close(pR->ringFd);
+    free(pR->bufRing);
+    free(pR->bufMem);
+    free(pR->ports);
+    free(pR->dirty);
+    memset(pR, 0, sizeof(*pR));
+    pR->ringFd = -1;
+}
+
+/****************************************************************
+ * Function Name : uringAddPort
+ * Description   : Adds a configured serial port. The port is
+ *                 switched to VMIN=1: a tty read that may return
+ *                 0 bytes would end a multishot read as EOF.
+ * Returns       : The port, NULL on failure
+ * Params        @pR: The reactor
+ *               @fd: Open serial port
+ *               @pUser: Handed back in the port
+ ****************************************************************/
+tUringPort *uringAddPort(tUringReactor *pR, int fd, void *pUser)
+{
+    struct termios tty;
+    tUringPort *pPort;
+
+    /* Slots of removed ports first */
+    for(pPort = pR->ports; pPort < &pR->ports[pR->numPorts]; pPort++)
+    {
+        if(pPort->bFree)
+            break;
+    }
+    if(pPort == &pR->ports[pR->numPorts] && pR->numPorts >= pR->maxPorts)
+    {
+        printf("uringAddPort(): All %d ports in use.\n", pR->maxPorts);
+        return (NULL);
+    }
+
+    if(isatty(fd) && tcgetattr(fd, &tty) == 0)
+    {
+        tty.c_cc[VMIN] = 1;
+        tty.c_cc[VTIME] = 0;
+        tcsetattr(fd, TCSANOW, &tty);
+    }
+
+    if(pPort == &pR->ports[pR->numPorts])
+        pR->numPorts++;
+    memset(pPort, 0, sizeof(*pPort));
+    pPort->fd = fd;
+    pPort->idx = pPort - pR->ports;
+    pPort->pUser = pUser;
+    sblEngineInit(&pPort->eng);
+    markDirty(pR, pPort);
+    return (pPort);
+}
+
+/****************************************************************
+ * Function Name : uringRemovePort
+ * Description   : Takes a port out, e.g. because its device went
+ *                 away. An operation in progress ends with
+ *                 SBL_PORT_ERROR. The fd stays open, close it once
+ *                 this returned; the slot is reused when the
+ *                 kernel is done with it.
+ * Returns       : None
+ * Params        @pR: The reactor
+ *               @pPort: The port
+ ****************************************************************/
+void uringRemovePort(tUringReactor *pR, tUringPort *pPort)
+{
+    if(pPort->bRemoved)
+        return;
+    pPort->bRemoved = true;
+    pPort->bDead = true;
+    sblEngineAbort(&pPort->eng, SBL_PORT_ERROR);
+    drainEvents(pR, pPort);
+
+    /* A read can sit on a quiet tty for ever */
+    if(pPort->bReadArmed)
+    {
+        struct io_uring_sqe *pSqe = getSqe(pR);
+        if(pSqe)
+        {
+            pSqe->opcode = IORING_OP_ASYNC_CANCEL;
+            pSqe->fd = -1;
+            pSqe->addr = URING_UD(pPort->idx, URING_UD_READ);
+            pSqe->user_data = URING_UD(pPort->idx, URING_UD_CANCEL);
+        }
+    }
+    releasePort(pPort);
+}
+
+/****************************************************************
+ * Function Name : uringKick
+ * Description   : Tells the reactor an operation was started on a
+ *                 port outside of the event callback
+ * Returns       : None
+ * Params        @pR: The reactor
+ *               @pPort: The port
+ ****************************************************************/
+void uringKick(tUringReactor *pR, tUringPort *pPort)
+{
+    markDirty(pR, pPort);
+}
+
+/****************************************************************
+ * Function Name : uringWatchFd
+ * Description   : Calls cb from uringRun() whenever fd turns
+ *                 readable, e.g. a listening socket or an inotify
+ *                 fd. cb has to consume what made it readable.
+ * Returns       : 0 on success, -1 on failure
+ * Params        @pR: The reactor
+ *               @fd: The fd
+ *               @cb: The callback
+ *               @pUser: Handed to cb
+ ****************************************************************/
+int uringWatchFd(tUringReactor *pR, int fd, tUringFdCb cb, void *pUser)
+{
+    uint32_t i;
+
+    for(i = 0; i < URING_MAX_WATCHES && pR->watches[i].cb; i++)
+        ;
+    if(i == URING_MAX_WATCHES)
+    {
+        printf("uringWatchFd(): All %d watches in use.\n", URING_MAX_WATCHES);
+        return (-1);
+    }
+    pR->watches[i].fd = fd;
+    pR->watches[i].cb = cb;
+    pR->watches[i].pUser = pUser;
+    pR->watches[i].bRemoving = false;
+    pR->numWatches++;
+    armWatch(pR, i);
+    return (0);
+}
+
+/****************************************************************
+ * Function Name : uringUnwatchFd
+ * Description   : Stops watching fd, its callback isn't called
+ *                 any more. May be called from that callback. The
+ *                 fd may be closed right after.
+ * Returns       : None
+ * Params        @pR: The reactor
+ *               @fd: The fd
+ ****************************************************************/
+void uringUnwatchFd(tUringReactor *pR, int fd)
+{
+    for(uint32_t i = 0; i < URING_MAX_WATCHES; i++)
+    {
+        tUringWatch *pWatch = &pR->watches[i];
+        struct io_uring_sqe *pSqe;
+
+        if(!pWatch->cb || pWatch->bRemoving || pWatch->fd != fd)
+            continue;
+        pWatch->bRemoving = true;
+        if((pSqe = getSqe(pR)) != NULL)
+        {
+            pSqe->opcode = IORING_OP_POLL_REMOVE;
+            pSqe->fd = -1;
+            pSqe->addr = URING_UD(i, URING_UD_WATCH);
+            pSqe->user_data = URING_UD(i, URING_UD_CANCEL);
+        }
+        return;
+    }
+}
+
+/****************************************************************
+ * Function Name : uringRun
+ * Description   : Moves bytes for all ports until no session has
+ *                 an operation in progress. With fds watched it
+ *                 keeps waiting for them until uringStop().
+ * Returns       : 0 on success, -1 on failure
+ * Params        @pR: The reactor
+ ****************************************************************/
+int uringRun(tUringReactor *pR)
+{
+    for(;;)
+    {
+        uint64_t now, deadline = 0;
+        bool bBusy = false;
+
+        /* Queue what the sessions want to send */
+        while(pR->numDirty)
+        {
+            tUringPort *pPort = &pR->ports[pR->dirty[--pR->numDirty]];
+            pPort->bDirty = false;
+            flushPort(pR, pPort);
+        }
+
+        /* Deadlines */
+        now = serialGetTimeUs();
+        for(uint32_t i = 0; i < pR->numPorts; i++)
+        {
+            tUringPort *pPort = &pR->ports[i];
+            uint64_t d;
+
+            if(!sblEngineBusy(&pPort->eng) && !pPort->wrLen)
+                continue;
+            bBusy = true;
+            if((d = sblEngineDeadline(&pPort->eng)) && (!deadline || d < deadline))
+                deadline = d;
+        }
+
+        if(deadline && deadline <= now)
+        {
+            /* Completions are only posted inside io_uring_enter(), a
+             * response may be waiting in the kernel while we were
+             * descheduled. Take those before expiring anybody. */
+            uringEnter(pR, pR->sqToSubmit, 0, 0);
+            reapCqes(pR);
+            now = serialGetTimeUs();
+            for(uint32_t i = 0; i < pR->numPorts; i++)
+            {
+                tUringPort *pPort = &pR->ports[i];
+                uint64_t d = sblEngineDeadline(&pPort->eng);
+
+                if(d && d <= now)
+                {
+                    sblEngineTick(&pPort->eng, now);
+                    drainEvents(pR, pPort);
+                    markDirty(pR, pPort);
+                }
+            }
+            continue;
+        }
+
+        if(!bBusy)
+        {
+            if(pR->numDirty)
+                continue;
+            if(!pR->numWatches || pR->bStop)
+            {
+                pR->bStop = false;
+                return (0);
+            }
+        }
+        if(pR->numDirty)
+            continue;
+
+        if(uringEnter(pR, pR->sqToSubmit, 1, deadline ? (deadline > now ? deadline - now : 1) : 0) < 0)
+        {
+            if(errno != ETIME && errno != EINTR && errno != EBUSY)
+            {
+                perror("URING: ERROR WAITING |");
+                return (-1);
+            }
+        }
+        reapCqes(pR);
+    }
+}
+
+/****************************************************************
+ * Function Name : uringStop
+ * Description   : Makes uringRun() return once no session has an
+ *                 operation in progress, fds watched or not
+ * Returns       : None
+ * Params        @pR: The reactor
+ ****************************************************************/
+void uringStop(tUringReactor *pR)
+{
+    pR->bStop = true;
+}
+
+/* io_uring_setup(2) */
+static int uringSetup(uint32_t entries, struct io_uring_params *p)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+/* io_uring_enter(2), a timeout of 0 waits for ever */
+static int uringEnter(tUringReactor *pR, uint32_t toSubmit, uint32_t minComplete,
+                      uint64_t timeoutUs)
+{
+    struct __kernel_timespec ts = {
+        .tv_sec = timeoutUs / 1000000,
+        .tv_nsec = (timeoutUs % 1000000) * 1000,
+    };
+    struct io_uring_getevents_arg arg = {
+        .ts = (uint64_t)(uintptr_t)&ts,
+    };
+    int rc;
+
+    if(!timeoutUs)
+        arg.ts = 0;
+    atomic_store_explicit((_Atomic uint32_t*)pR->sqTail, pR->sqLocalTail, memory_order_release);
+    pR->enters++;
+    rc = (int)syscall(__NR_io_uring_enter, pR->ringFd, toSubmit, minComplete,
+                      IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+    /* A timed out wait may still have submitted */
+    pR->sqToSubmit = pR->sqLocalTail -
+                     atomic_load_explicit((_Atomic uint32_t*)pR->sqHead, memory_order_acquire);
+    return (rc);
+}
+
+/* READ_MULTISHOT arrived in 6.7 */
+static bool probeMultishot(tUringReactor *pR)
+{
+    size_t len = sizeof(struct io_uring_probe) + URING_PROBE_OPS * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, len);
+    bool bOk = false;
+
+    if(!probe)
+        return false;
+    if(syscall(__NR_io_uring_register, pR->ringFd, IORING_REGISTER_PROBE, probe, URING_PROBE_OPS) == 0)
+        bOk = probe->last_op >= URING_OP_READ_MULTISHOT &&
+              (probe->ops[URING_OP_READ_MULTISHOT].flags & IO_URING_OP_SUPPORTED);
+    free(probe);
+    return bOk;
+}
+
+/* One provided buffer group shared by all ports */
+static bool setupBufRing(tUringReactor *pR)
+{
+    struct io_uring_buf_reg reg;
+    uint32_t entries = 64;
+
+    while(entries < 4 * pR->maxPorts)
+        entries <<= 1;
+
+    if(posix_memalign((void**)&pR->bufRing, sysconf(_SC_PAGESIZE),
+                      entries * sizeof(struct io_uring_buf)) != 0)
+    {
+        pR->bufRing = NULL;
+        return false;
+    }
+    memset(pR->bufRing, 0, entries * sizeof(struct io_uring_buf));
+    if(!(pR->bufMem = malloc((size_t)entries * URING_BUF_SIZE)))
+        return false;
+
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)pR->bufRing;
+    reg.ring_entries = entries;
+    reg.bgid = URING_BGID;
+    if(syscall(__NR_io_uring_register, pR->ringFd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0)
+        return false;
+
+    pR->bufEntries = entries;
+    for(uint32_t i = 0; i < entries; i++)
+        recycleBuf(pR, i);
+    atomic_store_explicit((_Atomic uint16_t*)&pR->bufRing->tail, pR->bufTail, memory_order_release);
+    return true;
+}
+
+/* Next free SQE, submitting to make room if needed */
+static struct io_uring_sqe *getSqe(tUringReactor *pR)
+{
+    struct io_uring_sqe *pSqe;
+    uint32_t head = atomic_load_explicit((_Atomic uint32_t*)pR->sqHead, memory_order_acquire);
+
+    if(pR->sqLocalTail - head > pR->sqMask)
+    {
+        uringEnter(pR, pR->sqToSubmit, 0, 0);
+        head = atomic_load_explicit((_Atomic uint32_t*)pR->sqHead, memory_order_acquire);
+        if(pR->sqLocalTail - head > pR->sqMask)
+            return (NULL);
+    }
+
+    pSqe = &pR->sqes[pR->sqLocalTail & pR->sqMask];
+    pR->sqArray[pR->sqLocalTail & pR->sqMask] = pR->sqLocalTail & pR->sqMask;
+    pR->sqLocalTail++;
+    pR->sqToSubmit++;
+    memset(pSqe, 0, sizeof(*pSqe));
+    return (pSqe);
+}
+
+/* Queue a port's pending write and make sure a read is armed */
+static void flushPort(tUringReactor *pR, tUringPort *pPort)
+{
+    const uint8_t *p;
+    uint32_t len;
+
+    if(pPort->bDead)
+        return;
+
+    if(!pPort->wrLen && (len = sblEngineTxPending(&pPort->eng, &p)) != 0)
+    {
+        struct io_uring_sqe *pSqe = getSqe(pR);
+        if(!pSqe)
+        {
+            markDirty(pR, pPort);
+            return;
+        }
+
+        /* The engine may compact its queue while this is in flight */
+        memcpy(pPort->wr, p, len);
+        pPort->wrLen = len;
+        pSqe->opcode = IORING_OP_WRITE;
+        pSqe->fd = pPort->fd;
+        pSqe->addr = (uint64_t)(uintptr_t)pPort->wr;
+        pSqe->len = len;
+        pSqe->off = (uint64_t)-1;
+        pSqe->user_data = URING_UD(pPort->idx, URING_UD_WRITE);
+
+        /* The response can only follow the write */
+        if(!pR->bMultishot && !pPort->bReadArmed)
+        {
+            pSqe->flags |= IOSQE_IO_LINK;
+            armRead(pR, pPort, true);
+        }
+    }
+
+    if(!pPort->bReadArmed && (pR->bMultishot || sblEngineRxWanted(&pPort->eng)))
+        armRead(pR, pPort, false);
+}
+
+/* Multishot into the buffer group, or one read into the port */
+static void armRead(tUringReactor *pR, tUringPort *pPort, bool bLinked)
+{
+    struct io_uring_sqe *pSqe = getSqe(pR);
+
+    if(!pSqe)
+    {
+        markDirty(pR, pPort);
+        return;
+    }
+
+    pSqe->fd = pPort->fd;
+    pSqe->off = (uint64_t)-1;
+    pSqe->user_data = URING_UD(pPort->idx, URING_UD_READ);
+    if(pR->bMultishot && !bLinked)
+    {
+        pSqe->opcode = URING_OP_READ_MULTISHOT;
+        pSqe->flags = IOSQE_BUFFER_SELECT;
+        pSqe->buf_group = URING_BGID;
+    }
+    else
+    {
+        pSqe->opcode = IORING_OP_READ;
+        pSqe->addr = (uint64_t)(uintptr_t)pPort->rd;
+        pSqe->len = sizeof(pPort->rd);
+    }
+    pPort->bReadArmed = true;
+}
+
+/* Hand completions to the sessions */
+static void reapCqes(tUringReactor *pR)
+{
+    uint32_t head = *pR->cqHead;
+    uint32_t tail = atomic_load_explicit((_Atomic uint32_t*)pR->cqTail, memory_order_acquire);
+    uint16_t bufTail = pR->bufTail;
+    uint64_t now = serialGetTimeUs();
+
+    for(; head != tail; head++)
+    {
+        struct io_uring_cqe *pCqe = &pR->cqes[head & pR->cqMask];
+        uint32_t kind = pCqe->user_data & 0xFF;
+        tUringPort *pPort = &pR->ports[pCqe->user_data >> 8];
+        int res = pCqe->res;
+
+        pR->cqesSeen++;
+        if(kind == URING_UD_WATCH)
+        {
+            handleWatch(pR, pCqe->user_data >> 8, res, pCqe->flags);
+            continue;
+        }
+        if(kind == URING_UD_CANCEL)
+            continue;
+
+        if(kind == URING_UD_WRITE)
+        {
+            uint32_t done = (res > 0) ? (uint32_t)res : 0;
+            if(res < 0)
+            {
+                printf("Port %d: write failed (%s).\n", pPort->idx, strerror(-res));
+                pPort->bDead = true;
+                sblEngineAbort(&pPort->eng, SBL_PORT_ERROR);
+            }
+            else
+            {
+                /* The tty took the bytes, the UART still has to send
+                 * them before the device can answer */
+                sblEngineTxDone(&pPort->eng, done, now + getWireTimeUs(done));
+            }
+            pPort->txBytes += done;
+            pPort->wrLen = 0;
+        }
+        else
+        {
+            if(res > 0)
+            {
+                const uint8_t *p = pPort->rd;
+                if(pCqe->flags & IORING_CQE_F_BUFFER)
+                {
+                    uint32_t bid = pCqe->flags >> IORING_CQE_BUFFER_SHIFT;
+                    p = &pR->bufMem[(size_t)bid * URING_BUF_SIZE];
+                    sblEngineRx(&pPort->eng, p, res, now);
+                    recycleBuf(pR, bid);
+                }
+                else
+                    sblEngineRx(&pPort->eng, p, res, now);
+                pPort->rxBytes += res;
+            }
+            else if(!pPort->bRemoved &&
+                    (res == 0 || (res < 0 && res != -ENOBUFS && res != -ECANCELED && res != -EINTR)))
+            {
+                printf("Port %d: read failed (%s).\n", pPort->idx, res ? strerror(-res) : "hang up");
+                pPort->bDead = true;
+                sblEngineAbort(&pPort->eng, SBL_PORT_ERROR);
+            }
+
+            if(!(pCqe->flags & IORING_CQE_F_MORE))
+                pPort->bReadArmed = false;
+        }
+
+        drainEvents(pR, pPort);
+        markDirty(pR, pPort);
+        releasePort(pPort);
+    }
+
+    atomic_store_explicit((_Atomic uint32_t*)pR->cqHead, head, memory_order_release);
+    if(pR->bufTail != bufTail)
+        atomic_store_explicit((_Atomic uint16_t*)&pR->bufRing->tail, pR->bufTail, memory_order_release);
+}
+
+/* Give a provided buffer back to the kernel, published by the caller */
+static void recycleBuf(tUringReactor *pR, uint32_t bid)
+{
+    struct io_uring_buf *pBuf = &pR->bufRing->bufs[pR->bufTail & (pR->bufEntries - 1)];
+
+    pBuf->addr = (uint64_t)(uintptr_t)&pR->bufMem[(size_t)bid * URING_BUF_SIZE];
+    pBuf->len = URING_BUF_SIZE;
+    pBuf->bid = bid;
+    pR->bufTail++;
+}
+
+/* Completed operations to the owner */
+static void drainEvents(tUringReactor *pR, tUringPort *pPort)
+{
+    tSblEvent event;
+
+    while(sblEngineEvent(&pPort->eng, &event))
+    {
+        if(pR->onEvent)
+            pR->onEvent(pPort, &event);
+        markDirty(pR, pPort);
+    }
+}
+
+static void markDirty(tUringReactor *pR, tUringPort *pPort)
+{
+    if(pPort->bDirty)
+        return;
+    pPort->bDirty = true;
+    pR->dirty[pR->numDirty++] = pPort->idx;
+}
+
+/* Poll a watched fd, multishot where the kernel has it (5.13) */
+static void armWatch(tUringReactor *pR, uint32_t ui32Idx)
+{
+    struct io_uring_sqe *pSqe = getSqe(pR);
+
+    if(!pSqe)
+    {
+        printf("Watch %d: no room to arm.\n", ui32Idx);
+        return;
+    }
+    pSqe->opcode = IORING_OP_POLL_ADD;
+    pSqe->fd = pR->watches[ui32Idx].fd;
+    pSqe->poll32_events = POLLIN;
+    pSqe->len = (pR->bPollOneshot) ? 0 : IORING_POLL_ADD_MULTI;
+    pSqe->user_data = URING_UD(ui32Idx, URING_UD_WATCH);
+}
+
+/* A watched fd turned readable, or its poll ended */
+static void handleWatch(tUringReactor *pR, uint32_t ui32Idx, int res, uint32_t flags)
+{
+    tUringWatch *pWatch = &pR->watches[ui32Idx];
+    bool bArmed = (flags & IORING_CQE_F_MORE) != 0;
+    bool bRearm = true;
+
+    if(res == -EINVAL && !pR->bPollOneshot)
+    {
+        /* Older kernel, rejects the multishot flag */
+        pR->bPollOneshot = true;
+        bArmed = false;
+    }
+    else if(res < 0 && res != -ECANCELED && res != -EINTR)
+    {
+        printf("Watch %d: poll failed (%s).\n", ui32Idx, strerror(-res));
+        bRearm = false;
+    }
+    else if(res > 0 && !pWatch->bRemoving)
+        pWatch->cb(pWatch->fd, pWatch->pUser);
+
+    if(bArmed)
+        return;
+    if(pWatch->bRemoving)
+    {
+        /* Its last completion, the slot is free */
+        memset(pWatch, 0, sizeof(*pWatch));
+        pR->numWatches--;
+        return;
+    }
+    if(bRearm)
+        armWatch(pR, ui32Idx);
+}
+
+/* A removed port's slot is free once nothing is in flight on it */
+static void releasePort(tUringPort *pPort)
+{
+    if(pPort->bRemoved && !pPort->bReadArmed && !pPort->wrLen)
+    {
+        pPort->bFree = true;
+        pPort->fd = -1;
+    }
+}
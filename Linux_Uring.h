@@ -0,0 +1,116 @@
+/*
+ * Linux_Uring.h
+ *
+ *  Created on: 18/10/2026
+ */
+
+#ifndef LINUX_URING_H_
+#define LINUX_URING_H_
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <linux/io_uring.h>
+#include "sbl_engine.h"
+
+/* Read buffer size, one provided buffer or one port read */
+#define URING_BUF_SIZE          256
+#define URING_MAX_PORTS         1024
+/* Other fds the owner wants to hear about, see uringWatchFd() */
+#define URING_MAX_WATCHES       64
+
+typedef struct tUringPort tUringPort;
+
+/* Called from uringRun() when an operation on a port completed. The
+ * callback may start the next operation on pPort->eng right away. */
+typedef void (*tUringEventCb)(tUringPort *pPort, const tSblEvent *pEvent);
+
+/* Called from uringRun() when a watched fd turned readable */
+typedef void (*tUringFdCb)(int fd, void *pUser);
+
+/* A watched fd, free while cb is NULL */
+typedef struct {
+    int         fd;
+    tUringFdCb  cb;
+    void       *pUser;
+    bool        bRemoving;              /* Until its poll ended */
+} tUringWatch;
+
+/* One serial port and its bootloader session */
+struct tUringPort {
+    int         fd;
+    uint32_t    idx;
+    tSblEngine  eng;
+    void       *pUser;
+    uint8_t     wr[SBL_ENGINE_TX_MAX];  /* Copy of the write in flight */
+    uint32_t    wrLen;                  /* 0 if none */
+    uint8_t     rd[URING_BUF_SIZE];     /* One-shot reads only */
+    bool        bReadArmed;
+    bool        bDirty;
+    bool        bDead;                  /* fd failed or hung up */
+    bool        bRemoved;               /* uringRemovePort() called */
+    bool        bFree;                  /* Slot can be reused */
+    uint64_t    txBytes;
+    uint64_t    rxBytes;
+};
+
+/* Many ports, one thread, one ring */
+typedef struct {
+    int         ringFd;
+
+    /* Submission queue */
+    void       *sqMem;
+    size_t      sqMemLen;
+    uint32_t   *sqHead;
+    uint32_t   *sqTail;
+    uint32_t   *sqArray;
+    uint32_t    sqMask;
+    uint32_t    sqLocalTail;
+    uint32_t    sqToSubmit;
+    struct io_uring_sqe *sqes;
+    size_t      sqesLen;
+
+    /* Completion queue */
+    void       *cqMem;
+    size_t      cqMemLen;
+    uint32_t   *cqHead;
+    uint32_t   *cqTail;
+    uint32_t    cqMask;
+    struct io_uring_cqe *cqes;
+
+    /* Provided buffers for multishot reads */
+    bool        bMultishot;
+    struct io_uring_buf_ring *bufRing;
+    uint8_t    *bufMem;
+    uint32_t    bufEntries;
+    uint16_t    bufTail;
+
+    /* Ports */
+    tUringPort *ports;
+    uint32_t    numPorts;
+    uint32_t    maxPorts;
+    uint32_t   *dirty;
+    uint32_t    numDirty;
+    tUringEventCb onEvent;
+
+    /* Watched fds, uringRun() keeps going while there are any */
+    tUringWatch watches[URING_MAX_WATCHES];
+    uint32_t    numWatches;
+    bool        bPollOneshot;           /* Kernel lacks multishot poll */
+    bool        bStop;
+
+    /* Counters */
+    uint64_t    enters;
+    uint64_t    cqesSeen;
+} tUringReactor;
+
+extern int uringInit(tUringReactor *pR, uint32_t ui32MaxPorts, tUringEventCb onEvent);
+extern void uringClose(tUringReactor *pR);
+extern tUringPort *uringAddPort(tUringReactor *pR, int fd, void *pUser);
+extern void uringRemovePort(tUringReactor *pR, tUringPort *pPort);
+extern void uringKick(tUringReactor *pR, tUringPort *pPort);
+extern int uringWatchFd(tUringReactor *pR, int fd, tUringFdCb cb, void *pUser);
+extern void uringUnwatchFd(tUringReactor *pR, int fd);
+extern int uringRun(tUringReactor *pR);
+extern void uringStop(tUringReactor *pR);
+
+#endif /* LINUX_URING_H_ */
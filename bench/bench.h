@@ -0,0 +1,19 @@
+/*
+ * bench.h
+ *
+ *  Created on: 18/10/2026
+ */
+
+#ifndef BENCH_H_
+#define BENCH_H_
+#include <stdint.h>
+
+/* Scaling of the io_uring backend, 1..ui32MaxPorts simulated devices
+ * on a ui32Baud line, 0 for no wire time */
+extern int runUringBench(uint32_t ui32MaxPorts, uint32_t ui32Baud);
+
+/* Peak RSS and startup of sbl_out builds flashing a simulated device,
+ * the first (the -DSBL_SMALL build) against its budgets */
+extern int runFootprintBench(int argc, char **argv);
+
+#endif /* BENCH_H_ */
@@ -0,0 +1,261 @@
+/*
+ * footprint_bench.c
+ *
+ *  Created on: 18/10/2026
+ *  Description: Footprint of a built sbl_out. It is run to flash a
+ *               full-size image into a simulated device behind a
+ *               pty, image cache off, and measured: peak RSS of the
+ *               process (VmHWM read at its exit under ptrace; the
+ *               rusage of a child also counts what it was before
+ *               exec) and startup, from exec until it opens the
+ *               port. The first byte comes a second later, after the
+ *               settle of the port flush. The small build (-DSBL_SMALL) is held to
+ *               the budgets below.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <termios.h>
+#include <time.h>
+#include <sys/ptrace.h>
+#include <sys/wait.h>
+#include <sys/inotify.h>
+#include "bench.h"
+#include "sbl_sim.h"
+#include "sbl_device_cc2640.h"
+
+/* Budgets of the small build, see README */
+#define FOOTPRINT_RSS_BUDGET_KB     2048
+#define FOOTPRINT_STARTUP_BUDGET_MS 5
+
+#define FOOTPRINT_IMAGE_SIZE        SBL_CC2650_MAX_FLASH_SIZE
+#define FOOTPRINT_TIMEOUT_MS        30000
+
+/* One run of a binary */
+typedef struct {
+    bool     bOk;
+    uint32_t rssKb;
+    double   startupMs;
+    double   totalMs;
+} tFootprint;
+
+/* Static functions */
+static bool runBinary(const char *pcBinary, const char *pcImage, tFootprint *pResult);
+static void serveDevice(int master, int watch, pid_t pid, uint64_t ui64ExecNs,
+                        tFootprint *pResult);
+static uint32_t readHwm(pid_t pid);
+static uint64_t wallNs(void);
+
+static tSblSim m_sim;
+static uint8_t m_image[FOOTPRINT_IMAGE_SIZE];
+
+/****************************************************************
+ * Function Name : runFootprintBench
+ * Description   : Measures peak RSS and startup of sbl_out builds
+ *                 flashing a 128 KB image, the first one against
+ *                 the small build budgets
+ * Returns       : 0 if every run flashed and the first is within
+ *                 budget, 1 if not
+ * Params        @argc, argv: Binaries, the small build first
+ ****************************************************************/
+int runFootprintBench(int argc, char **argv)
+{
+    char pcImage[] = "/tmp/sbl_footprint_XXXXXX";
+    bool bOk = true;
+    int fd;
+
+    for(uint32_t i = 0; i < sizeof(m_image); i++)
+        m_image[i] = rand();
+    m_image[FOOTPRINT_IMAGE_SIZE - SBL_CC2650_PAGE_ERASE_SIZE +
+            SBL_CC2650_BL_CONFIG_PAGE_OFFSET] = SBL_CC2650_BL_CONFIG_ENABLED_BM;
+    if((fd = mkstemp(pcImage)) < 0 || write(fd, m_image, sizeof(m_image)) != sizeof(m_image))
+    {
+        printf("Could not write the image.\n");
+        return (1);
+    }
+    close(fd);
+
+    printf("Flash of a %d KB image into a simulated device, image cache off\n",
+           FOOTPRINT_IMAGE_SIZE / 1024);
+    printf("%-32s %12s %12s %12s\n", "binary", "peak RSS KB", "startup ms", "total ms");
+    for(int i = 0; i < argc; i++)
+    {
+        tFootprint result;
+        bool bBudget = true;
+
+        if(!runBinary(argv[i], pcImage, &result))
+        {
+            printf("%-32s %12s\n", argv[i], "FAILED");
+            bOk = false;
+            continue;
+        }
+        if(i == 0)
+            bBudget = (result.rssKb <= FOOTPRINT_RSS_BUDGET_KB &&
+                       result.startupMs <= FOOTPRINT_STARTUP_BUDGET_MS);
+        printf("%-32s %12u %12.2f %12.1f%s\n", argv[i], result.rssKb, result.startupMs,
+               result.totalMs, bBudget ? "" : "  OVER BUDGET");
+        bOk = bOk && bBudget;
+    }
+    printf("Budgets of the first: %d KB peak RSS, %d ms startup\n",
+           FOOTPRINT_RSS_BUDGET_KB, FOOTPRINT_STARTUP_BUDGET_MS);
+    unlink(pcImage);
+    return (bOk) ? 0 : 1;
+}
+
+/* Flashes the image with one binary, measured */
+static bool runBinary(const char *pcBinary, const char *pcImage, tFootprint *pResult)
+{
+    struct termios tty;
+    int master, slave, watch, status;
+    uint64_t execNs;
+    pid_t pid;
+
+    memset(pResult, 0, sizeof(*pResult));
+    if((master = posix_openpt(O_RDWR | O_NOCTTY)) < 0 || grantpt(master) || unlockpt(master))
+        return (false);
+    sblSimInit(&m_sim);
+
+    /* Raw before the flasher sees it, like an adapter would be. Kept
+     * open on our side too, so the pty doesn't hang up between the
+     * flasher's open and close */
+    slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+    tcgetattr(slave, &tty);
+    cfmakeraw(&tty);
+    tcsetattr(slave, TCSANOW, &tty);
+    watch = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    inotify_add_watch(watch, ptsname(master), IN_OPEN);
+
+    if((pid = fork()) == 0)
+    {
+        char *childArgv[] = { (char*)pcBinary, "--no-profile", ptsname(master), "flash",
+                              (char*)pcImage, NULL };
+        int devNull = open("/dev/null", O_WRONLY);
+
+        close(master);
+        close(slave);
+        close(watch);
+        dup2(devNull, STDOUT_FILENO);
+        setenv("SBL_IMAGE_CACHE_MAX", "0", 1);
+        ptrace(PTRACE_TRACEME, 0, NULL, NULL);
+        execv(pcBinary, childArgv);
+        _exit(127);
+    }
+
+    /* Stopped right after exec */
+    if(pid > 0 && waitpid(pid, &status, 0) == pid && WIFSTOPPED(status))
+    {
+        ptrace(PTRACE_SETOPTIONS, pid, NULL, PTRACE_O_TRACEEXIT | PTRACE_O_EXITKILL);
+        execNs = wallNs();
+        ptrace(PTRACE_CONT, pid, NULL, NULL);
+        serveDevice(master, watch, pid, execNs, pResult);
+        pResult->bOk = pResult->bOk && !memcmp(m_sim.flash, m_image, sizeof(m_image));
+    }
+    close(watch);
+    close(slave);
+    close(master);
+    return (pResult->bOk);
+}
+
+/* Plays the device until the flasher exits, reading its peak RSS
+ * at the exit stop */
+static void serveDevice(int master, int watch, pid_t pid, uint64_t ui64ExecNs,
+                        tFootprint *pResult)
+{
+    uint8_t buf[1024];
+
+    for(;;)
+    {
+        struct pollfd pfd[2] = { { .fd = master, .events = POLLIN },
+                                 { .fd = watch, .events = POLLIN } };
+        uint64_t now;
+        int status;
+        pid_t rc;
+
+        if((rc = waitpid(pid, &status, WNOHANG)) == pid)
+        {
+            if(WIFEXITED(status))
+            {
+                pResult->bOk = pResult->bOk && WEXITSTATUS(status) == 0;
+                return;
+            }
+            if(WIFSIGNALED(status))
+            {
+                pResult->bOk = false;
+                return;
+            }
+            if(status >> 8 == (SIGTRAP | (PTRACE_EVENT_EXIT << 8)))
+            {
+                pResult->rssKb = readHwm(pid);
+                pResult->totalMs = (wallNs() - ui64ExecNs) / 1e6;
+                pResult->bOk = true;
+                ptrace(PTRACE_CONT, pid, NULL, NULL);
+            }
+            else
+                ptrace(PTRACE_CONT, pid, NULL, WSTOPSIG(status));
+            continue;
+        }
+        if((wallNs() - ui64ExecNs) / 1000000 > FOOTPRINT_TIMEOUT_MS)
+        {
+            kill(pid, SIGKILL);
+            pResult->bOk = false;
+            waitpid(pid, &status, 0);
+            return;
+        }
+
+        poll(pfd, 2, 1);
+        now = wallNs();
+        if((pfd[1].revents & POLLIN) && read(watch, buf, sizeof(buf)) > 0 &&
+           pResult->startupMs == 0)
+            pResult->startupMs = (now - ui64ExecNs) / 1e6;
+        if(pfd[0].revents & POLLIN)
+        {
+            ssize_t rd = read(master, buf, sizeof(buf));
+            if(rd > 0)
+                sblSimRx(&m_sim, buf, rd, now / 1000);
+        }
+
+        while(m_sim.outLen != m_sim.outOff)
+        {
+            const uint8_t *p;
+            uint32_t len = sblSimTxPending(&m_sim, now / 1000, &p);
+            ssize_t wr;
+
+            if(!len || (wr = write(master, p, len)) <= 0)
+                break;
+            sblSimTxDone(&m_sim, wr);
+        }
+    }
+}
+
+/* VmHWM of a stopped process, KB */
+static uint32_t readHwm(pid_t pid)
+{
+    char pcPath[64], pcLine[256];
+    uint32_t kb = 0;
+    FILE *pFile;
+
+    snprintf(pcPath, sizeof(pcPath), "/proc/%d/status", (int)pid);
+    if(!(pFile = fopen(pcPath, "r")))
+        return (0);
+    while(fgets(pcLine, sizeof(pcLine), pFile))
+    {
+        if(sscanf(pcLine, "VmHWM: %u kB", &kb) == 1)
+            break;
+    }
+    fclose(pFile);
+    return (kb);
+}
+
+static uint64_t wallNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
@@ -0,0 +1,313 @@
+/*
+ * sbl_bench.c
+ *
+ *  Created on: 18/10/2026
+ *  Description: CPU cost of the protocol engine per operation. The
+ *               engine talks to a simulated device in memory, so
+ *               nothing here waits for a wire or a flash.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "sbl_engine.h"
+#include "sbl_sim.h"
+#include "sbl_device_cc2640.h"
+#include "bench.h"
+
+#define BENCH_FLASH_SIZE        SBL_SIM_FLASH_SIZE
+#define BENCH_RAM_SIZE          (20 * 1024)
+#define BENCH_READ_SIZE         (4 * 1024)
+#define BENCH_MIN_NS            200000000ULL    /* Run each case this long */
+
+/* Device timing for the page check run */
+#define BENCH_TURNAROUND_US     50
+#define BENCH_CRC_NS_PER_BYTE   40
+
+typedef tSblStatus (*tBenchStart)(tSblEngine *pEng);
+
+typedef struct {
+    const char  *name;
+    tBenchStart  start;
+    uint32_t     bytes;         /* Payload per op, 0 if not meaningful */
+} tBenchCase;
+
+/* Static functions */
+static tSblStatus startPing(tSblEngine *pEng);
+static tSblStatus startChipId(tSblEngine *pEng);
+static tSblStatus startEraseRange(tSblEngine *pEng);
+static tSblStatus startWriteRange(tSblEngine *pEng);
+static tSblStatus startCrc32(tSblEngine *pEng);
+static tSblStatus startReadMemory(tSblEngine *pEng);
+static tSblStatus startWriteGroup(tSblEngine *pEng);
+static tSblStatus startCrcGroup(tSblEngine *pEng);
+static int runPageCheckBench(uint32_t ui32Baud);
+static tSblStatus runOp(tBenchStart start, uint64_t *pEngineNs);
+static uint64_t cpuNs(void);
+static uint64_t nowNs(void);
+
+static tSblEngine m_eng;
+static tSblSim m_sim;
+static uint64_t m_nowUs;
+static uint8_t m_image[BENCH_FLASH_SIZE];
+static uint8_t m_readBuf[BENCH_READ_SIZE];
+static uint32_t m_groupAddr;            /* Range of startWriteGroup()/startCrcGroup() */
+static uint32_t m_groupLen;
+
+static const tBenchCase m_cases[] = {
+    { "ping",           startPing,          0 },
+    { "chip_id",        startChipId,        0 },
+    { "erase_range",    startEraseRange,    BENCH_FLASH_SIZE },
+    { "write_range",    startWriteRange,    BENCH_FLASH_SIZE },
+    { "crc32",          startCrc32,         BENCH_FLASH_SIZE },
+    { "read_memory",    startReadMemory,    BENCH_READ_SIZE },
+};
+
+int main(int argc, char **argv)
+{
+    const char *only = (argc > 1) ? argv[1] : NULL;
+    uint64_t engineNs;
+
+    srand(1);
+    if(only && !strcmp(only, "uring"))
+        return runUringBench((argc > 2) ? strtoul(argv[2], NULL, 0) : 256,
+                             (argc > 3) ? strtoul(argv[3], NULL, 0) : 115200);
+    if(only && !strcmp(only, "footprint") && argc > 2)
+        return runFootprintBench(argc - 2, &argv[2]);
+
+    for(uint32_t i = 0; i < sizeof(m_image); i++)
+        m_image[i] = rand();
+    /* Keep the bootloader enabled in the image's CCFG */
+    m_image[BENCH_FLASH_SIZE - SBL_CC2650_PAGE_ERASE_SIZE +
+            SBL_CC2650_BL_CONFIG_PAGE_OFFSET] = SBL_CC2650_BL_CONFIG_ENABLED_BM;
+
+    sblSimInit(&m_sim);
+    sblEngineInit(&m_eng);
+    sblEngineSetSizes(&m_eng, BENCH_FLASH_SIZE, BENCH_RAM_SIZE);
+    if(runOp(sblEngineAutobaud, &engineNs) != SBL_SUCCESS)
+    {
+        printf("Autobaud with simulated device failed.\n");
+        return (1);
+    }
+
+    if(only && !strcmp(only, "pagecheck"))
+        return runPageCheckBench((argc > 2) ? strtoul(argv[2], NULL, 0) : 115200);
+
+    printf("%-14s %10s %12s %12s %10s\n",
+           "op", "ops", "us/op", "engine us/op", "ns/byte");
+    for(uint32_t c = 0; c < sizeof(m_cases)/sizeof(m_cases[0]); c++)
+    {
+        const tBenchCase *pCase = &m_cases[c];
+        uint64_t ops = 0, startNs, totalNs = 0, engineTotalNs = 0;
+
+        if(only && strcmp(only, pCase->name))
+            continue;
+
+        startNs = cpuNs();
+        do
+        {
+            if(runOp(pCase->start, &engineNs) != SBL_SUCCESS)
+            {
+                printf("%s failed.\n", pCase->name);
+                return (1);
+            }
+            engineTotalNs += engineNs;
+            ops++;
+            totalNs = cpuNs() - startNs;
+        } while(totalNs < BENCH_MIN_NS);
+
+        printf("%-14s %10llu %12.2f %12.2f", pCase->name, (unsigned long long)ops,
+               totalNs / 1000.0 / ops, engineTotalNs / 1000.0 / ops);
+        if(pCase->bytes)
+            printf(" %10.2f\n", (double)engineTotalNs / ops / pCase->bytes);
+        else
+            printf(" %10s\n", "-");
+    }
+
+    return (0);
+}
+
+static tSblStatus startPing(tSblEngine *pEng)
+{
+    return sblEnginePing(pEng);
+}
+
+static tSblStatus startChipId(tSblEngine *pEng)
+{
+    return sblEngineChipId(pEng);
+}
+
+static tSblStatus startEraseRange(tSblEngine *pEng)
+{
+    return sblEngineEraseRange(pEng, 0, BENCH_FLASH_SIZE);
+}
+
+static tSblStatus startWriteRange(tSblEngine *pEng)
+{
+    /* The simulated flash only clears bits, erase it behind the
+     * engine's back so every write starts from blank */
+    memset(m_sim.flash, 0xFF, sizeof(m_sim.flash));
+    return sblEngineWriteRange(pEng, 0, BENCH_FLASH_SIZE, m_image);
+}
+
+static tSblStatus startCrc32(tSblEngine *pEng)
+{
+    return sblEngineCrc32(pEng, 0, BENCH_FLASH_SIZE);
+}
+
+static tSblStatus startReadMemory(tSblEngine *pEng)
+{
+    return sblEngineReadMemory(pEng, 0, BENCH_READ_SIZE / 4, 4, m_readBuf);
+}
+
+static tSblStatus startWriteGroup(tSblEngine *pEng)
+{
+    return sblEngineWriteRange(pEng, m_groupAddr, m_groupLen, &m_image[m_groupAddr]);
+}
+
+static tSblStatus startCrcGroup(tSblEngine *pEng)
+{
+    return sblEngineCrc32(pEng, m_groupAddr, m_groupLen);
+}
+
+/****************************************************************
+ * Function Name : runPageCheckBench
+ * Description   : What checking the pages while writing costs
+ *                 (--check-pages, writeFlashRangeChecked()) over
+ *                 the single CRC32 at the end, in simulated wire
+ *                 and device time: the whole flash is written in
+ *                 groups of N pages, each followed by its CRC32.
+ * Returns       : 0 on success
+ * Params        @ui32Baud: Line speed, 0 for no wire time
+ ****************************************************************/
+static int runPageCheckBench(uint32_t ui32Baud)
+{
+    static const uint32_t pcGroups[] = { 0, 1, 2, 4, 8, 32 };
+    const uint32_t numPages = BENCH_FLASH_SIZE / SBL_CC2650_PAGE_ERASE_SIZE;
+    uint64_t baseUs = 0, engineNs;
+
+    m_sim.turnaroundUs = BENCH_TURNAROUND_US;
+    m_sim.crcNsPerByte = BENCH_CRC_NS_PER_BYTE;
+    m_sim.wireNsPerByte = (ui32Baud) ? 10000000000ULL / ui32Baud : 0;
+
+    printf("%u KB at %u baud, %u us turnaround, CRC32 %u ns/byte\n",
+           BENCH_FLASH_SIZE / 1024, ui32Baud, BENCH_TURNAROUND_US, BENCH_CRC_NS_PER_BYTE);
+    printf("%-14s %10s %12s %10s\n", "pages/check", "commands", "ms", "overhead");
+    for(uint32_t g = 0; g < sizeof(pcGroups)/sizeof(pcGroups[0]); g++)
+    {
+        uint32_t groupPages = (pcGroups[g]) ? pcGroups[g] : numPages;
+        uint64_t startUs = m_nowUs;
+        uint32_t startCmds = m_sim.cmds;
+
+        memset(m_sim.flash, 0xFF, sizeof(m_sim.flash));
+        for(uint32_t page = 0; page < numPages; page += groupPages)
+        {
+            m_groupAddr = page * SBL_CC2650_PAGE_ERASE_SIZE;
+            m_groupLen = groupPages * SBL_CC2650_PAGE_ERASE_SIZE;
+            if(runOp(startWriteGroup, &engineNs) != SBL_SUCCESS ||
+               runOp(startCrcGroup, &engineNs) != SBL_SUCCESS)
+            {
+                printf("pagecheck failed.\n");
+                return (1);
+            }
+        }
+
+        uint64_t us = m_nowUs - startUs;
+        if(!pcGroups[g])
+            baseUs = us;
+        if(pcGroups[g])
+            printf("%-14u %10u %12.1f %9.1f%%\n", pcGroups[g], m_sim.cmds - startCmds,
+                   us / 1000.0, (baseUs) ? 100.0 * ((double)us - baseUs) / baseUs : 0.0);
+        else
+            printf("%-14s %10u %12.1f %10s\n", "end only", m_sim.cmds - startCmds,
+                   us / 1000.0, "-");
+    }
+    return (0);
+}
+
+/****************************************************************
+ * Function Name : runOp
+ * Description   : Runs one operation to completion, moving bytes
+ *                 between engine and simulated device. Time jumps
+ *                 ahead whenever the device is busy.
+ * Returns       : Status of the operation
+ * Params        @start: Starts the operation
+ *               @pEngineNs: Populated with CPU time spent inside
+ *                           the engine
+ ****************************************************************/
+static tSblStatus runOp(tBenchStart start, uint64_t *pEngineNs)
+{
+    const uint8_t *p;
+    uint32_t len;
+    tSblEvent event;
+    bool bDone = false;
+    uint64_t t0 = nowNs();
+
+    if(start(&m_eng) != SBL_SUCCESS)
+        return (SBL_ERROR);
+    *pEngineNs = nowNs() - t0;
+
+    while(!bDone || sblEngineTxPending(&m_eng, &p))
+    {
+        bool bMoved = false;
+
+        t0 = nowNs();
+        if((len = sblEngineTxPending(&m_eng, &p)) != 0)
+        {
+            *pEngineNs += nowNs() - t0;
+            sblSimRx(&m_sim, p, len, m_nowUs);
+            t0 = nowNs();
+            sblEngineTxDone(&m_eng, len, m_nowUs);
+            bMoved = true;
+        }
+        *pEngineNs += nowNs() - t0;
+
+        if((len = sblSimTxPending(&m_sim, m_nowUs, &p)) != 0)
+        {
+            t0 = nowNs();
+            sblEngineRx(&m_eng, p, len, m_nowUs);
+            *pEngineNs += nowNs() - t0;
+            sblSimTxDone(&m_sim, len);
+            bMoved = true;
+        }
+
+        if(!bDone && sblEngineEvent(&m_eng, &event))
+        {
+            bDone = true;
+            continue;
+        }
+
+        if(!bMoved)
+        {
+            /* Device busy: jump to when it answers, or time out */
+            if(m_sim.outLen && m_sim.readyUs > m_nowUs)
+                m_nowUs = m_sim.readyUs;
+            else if(sblEngineDeadline(&m_eng))
+            {
+                m_nowUs = sblEngineDeadline(&m_eng);
+                sblEngineTick(&m_eng, m_nowUs);
+            }
+            else
+                return (SBL_ERROR);
+        }
+    }
+
+    return (event.status);
+}
+
+static uint64_t cpuNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+/* Engine sections are too short for the process CPU clock, which is
+ * a syscall; the monotonic clock is vDSO and the loop never sleeps */
+static uint64_t nowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
@@ -0,0 +1,341 @@
+/*
+ * uring_bench.c
+ *
+ *  Created on: 18/10/2026
+ *  Description: Scaling of the io_uring backend. Every port is a pty
+ *               whose other end is served by a simulated device; all
+ *               sessions run from the calling thread, the devices
+ *               from a few others.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <pthread.h>
+#include <time.h>
+#include <stdatomic.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include "bench.h"
+#include "Linux_Uring.h"
+#include "sbl_sim.h"
+#include "sbl_timeout.h"
+
+#define UBENCH_IMAGE_SIZE       (16 * 1024)
+#define UBENCH_ROUNDS           2       /* erase + write + CRC per port */
+#define UBENCH_FLASH_SIZE       SBL_SIM_FLASH_SIZE
+#define UBENCH_RAM_SIZE         (20 * 1024)
+#define UBENCH_DEVS_PER_THREAD  32      /* Real boards don't queue behind each other */
+#define UBENCH_MAX_DEV_THREADS  64
+/* Device timing, shortened from a real CC2640 but nonzero so a port
+ * waits on its board like it would in the rack */
+#define UBENCH_TURNAROUND_US    100
+#define UBENCH_ERASE_US_PER_PAGE 1000
+#define UBENCH_CRC_NS_PER_BYTE  50
+/* The simulated devices share the host's CPU(s), their scheduling
+ * delays add to the host's own */
+#define UBENCH_TIMEOUT_FLOOR_MS 250
+
+/* Device side of one port */
+typedef struct {
+    int      fd;            /* pty master */
+    tSblSim  sim;
+} tBenchDev;
+
+/* Host side of one port */
+typedef struct {
+    uint32_t round;
+    uint32_t step;
+    bool     bFailed;
+} tBenchHost;
+
+/* Static functions */
+static void onEvent(tUringPort *pPort, const tSblEvent *pEvent);
+static void nextStep(tUringPort *pPort);
+static void *devThreadMain(void *arg);
+static int openPty(int *pMaster, int *pSlave);
+static uint64_t threadCpuNs(void);
+static uint64_t wallNs(void);
+
+static uint8_t m_image[UBENCH_IMAGE_SIZE];
+static tBenchDev *m_devs;
+static uint32_t m_numDevs;
+static int m_stopFd = -1;
+static uint32_t m_numDevThreads;
+static _Atomic uint64_t m_devCpuNs;
+
+/****************************************************************
+ * Function Name : runUringBench
+ * Description   : Runs the same per-port workload over 1, 2, 4 ...
+ *                 ports and prints CPU per port and throughput
+ * Returns       : 0 on success, 1 on failure
+ * Params        @ui32MaxPorts: Largest port count
+ *               @ui32Baud: Simulated line rate, 0 for none
+ ****************************************************************/
+int runUringBench(uint32_t ui32MaxPorts, uint32_t ui32Baud)
+{
+    uint32_t wireNs = ui32Baud ? (uint32_t)(10 * 1000000000ULL / ui32Baud) : 0;
+
+    setTimeoutBaudRate(ui32Baud);
+    setTimeoutFloor(UBENCH_TIMEOUT_FLOOR_MS);
+    for(uint32_t i = 0; i < sizeof(m_image); i++)
+        m_image[i] = rand();
+
+    printf("Up to %d simulated ports at %d baud, %d x %d KB erase/write/CRC each\n",
+           ui32MaxPorts, ui32Baud, UBENCH_ROUNDS, UBENCH_IMAGE_SIZE / 1024);
+    printf("%6s %10s %14s %14s %14s %8s\n", "ports", "wall ms",
+           "host us/port", "dev us/port", "payload KB/s", "multi");
+
+    for(uint32_t n = 1; n <= ui32MaxPorts; n *= 2)
+    {
+        tUringReactor reactor;
+        tBenchHost *hosts;
+        int *slaves;
+        pthread_t devThreads[UBENCH_MAX_DEV_THREADS];
+        uint64_t t0, cpu0, wall, cpu;
+        bool bOk = true;
+
+        m_devs = calloc(n, sizeof(tBenchDev));
+        hosts = calloc(n, sizeof(tBenchHost));
+        slaves = calloc(n, sizeof(int));
+        if(!m_devs || !hosts || !slaves || uringInit(&reactor, n, onEvent) != 0)
+            return (1);
+
+        m_numDevs = n;
+        for(uint32_t i = 0; i < n; i++)
+        {
+            tUringPort *pPort;
+
+            if(openPty(&m_devs[i].fd, &slaves[i]) != 0)
+            {
+                printf("Could not open %d ptys.\n", n);
+                return (1);
+            }
+            /* Sessions start past autobaud */
+            sblSimInit(&m_devs[i].sim);
+            m_devs[i].sim.bSynced = true;
+            m_devs[i].sim.turnaroundUs = UBENCH_TURNAROUND_US;
+            m_devs[i].sim.eraseUsPerPage = UBENCH_ERASE_US_PER_PAGE;
+            m_devs[i].sim.crcNsPerByte = UBENCH_CRC_NS_PER_BYTE;
+            m_devs[i].sim.wireNsPerByte = wireNs;
+
+            pPort = uringAddPort(&reactor, slaves[i], &hosts[i]);
+            sblEngineSetSizes(&pPort->eng, UBENCH_FLASH_SIZE, UBENCH_RAM_SIZE);
+        }
+
+        m_stopFd = eventfd(0, 0);
+        m_devCpuNs = 0;
+        m_numDevThreads = (n + UBENCH_DEVS_PER_THREAD - 1) / UBENCH_DEVS_PER_THREAD;
+        if(m_numDevThreads > UBENCH_MAX_DEV_THREADS)
+            m_numDevThreads = UBENCH_MAX_DEV_THREADS;
+        for(uintptr_t t = 0; t < m_numDevThreads; t++)
+            pthread_create(&devThreads[t], NULL, devThreadMain, (void*)t);
+
+        t0 = wallNs();
+        cpu0 = threadCpuNs();
+        for(uint32_t i = 0; i < n; i++)
+        {
+            nextStep(&reactor.ports[i]);
+            uringKick(&reactor, &reactor.ports[i]);
+        }
+        if(uringRun(&reactor) != 0)
+            bOk = false;
+        cpu = threadCpuNs() - cpu0;
+        wall = wallNs() - t0;
+
+        eventfd_write(m_stopFd, 1);
+        for(uint32_t t = 0; t < m_numDevThreads; t++)
+            pthread_join(devThreads[t], NULL);
+
+        for(uint32_t i = 0; i < n; i++)
+        {
+            bOk = bOk && !hosts[i].bFailed && hosts[i].round == UBENCH_ROUNDS &&
+                  !memcmp(m_devs[i].sim.flash, m_image, sizeof(m_image));
+        }
+
+        printf("%6d %10.1f %14.1f %14.1f %14.0f %8s%s\n", n, wall / 1e6,
+               cpu / 1e3 / n, m_devCpuNs / 1e3 / n,
+               (double)n * UBENCH_ROUNDS * UBENCH_IMAGE_SIZE / 1024 / (wall / 1e9),
+               reactor.bMultishot ? "yes" : "no", bOk ? "" : "  FAILED");
+
+        uringClose(&reactor);
+        for(uint32_t i = 0; i < n; i++)
+        {
+            close(slaves[i]);
+            close(m_devs[i].fd);
+        }
+        close(m_stopFd);
+        free(m_devs);
+        free(hosts);
+        free(slaves);
+        if(!bOk)
+            return (1);
+    }
+
+    return (0);
+}
+
+/* One operation done, start the next */
+static void onEvent(tUringPort *pPort, const tSblEvent *pEvent)
+{
+    tBenchHost *pHost = pPort->pUser;
+
+    if(pEvent->status != SBL_SUCCESS)
+    {
+        printf("Port %d: %s failed, status %d.\n", pPort->idx,
+               getOpString(pEvent->op), pEvent->status);
+        pHost->bFailed = true;
+        return;
+    }
+    if(pEvent->op == SBL_OP_CRC32 &&
+       pEvent->value != calcCrcLikeChip(m_image, sizeof(m_image)))
+    {
+        printf("Port %d: CRC mismatch.\n", pPort->idx);
+        pHost->bFailed = true;
+        return;
+    }
+
+    if(++pHost->step == 3)
+    {
+        pHost->step = 0;
+        pHost->round++;
+    }
+    nextStep(pPort);
+}
+
+static void nextStep(tUringPort *pPort)
+{
+    tBenchHost *pHost = pPort->pUser;
+
+    if(pHost->round == UBENCH_ROUNDS)
+        return;
+
+    switch(pHost->step)
+    {
+    case 0:
+        sblEngineEraseRange(&pPort->eng, 0, sizeof(m_image));
+        break;
+    case 1:
+        sblEngineWriteRange(&pPort->eng, 0, sizeof(m_image), m_image);
+        break;
+    default:
+        sblEngineCrc32(&pPort->eng, 0, sizeof(m_image));
+        break;
+    }
+}
+
+/* Serves every m_numDevThreads'th simulated device until told to
+ * stop. Responses go out once the device is done, a timerfd wakes
+ * the thread for the earliest one. */
+static void *devThreadMain(void *arg)
+{
+    int ep = epoll_create1(0);
+    int tfd = timerfd_create(CLOCK_MONOTONIC, 0);
+    struct epoll_event ev, events[64];
+    uint8_t buf[1024];
+    uint64_t cpu0 = threadCpuNs();
+    bool bRun = true;
+
+    ev.events = EPOLLIN;
+    ev.data.u32 = UINT32_MAX;
+    epoll_ctl(ep, EPOLL_CTL_ADD, m_stopFd, &ev);
+    ev.data.u32 = UINT32_MAX - 1;
+    epoll_ctl(ep, EPOLL_CTL_ADD, tfd, &ev);
+    for(uint32_t i = (uintptr_t)arg; i < m_numDevs; i += m_numDevThreads)
+    {
+        ev.data.u32 = i;
+        epoll_ctl(ep, EPOLL_CTL_ADD, m_devs[i].fd, &ev);
+    }
+
+    while(bRun)
+    {
+        int n = epoll_wait(ep, events, 64, -1);
+        uint64_t now = wallNs() / 1000, next = 0;
+
+        for(int e = 0; e < n; e++)
+        {
+            uint32_t id = events[e].data.u32;
+            ssize_t rd;
+
+            if(id == UINT32_MAX)
+                bRun = false;
+            else if(id == UINT32_MAX - 1)
+                rd = read(tfd, buf, sizeof(uint64_t));
+            else if((rd = read(m_devs[id].fd, buf, sizeof(buf))) > 0)
+                sblSimRx(&m_devs[id].sim, buf, rd, now);
+        }
+
+        /* Send what is due, arm the timer for the rest */
+        for(uint32_t i = (uintptr_t)arg; i < m_numDevs; i += m_numDevThreads)
+        {
+            tBenchDev *pDev = &m_devs[i];
+            const uint8_t *p;
+            uint32_t len;
+
+            if(pDev->sim.outLen == pDev->sim.outOff)
+                continue;
+            if((len = sblSimTxPending(&pDev->sim, now, &p)) != 0)
+            {
+                ssize_t wr = write(pDev->fd, p, len);
+                if(wr > 0)
+                    sblSimTxDone(&pDev->sim, wr);
+                /* The pty may take only part, retry soon */
+                if(pDev->sim.outLen != pDev->sim.outOff)
+                    next = (!next || now + 100 < next) ? now + 100 : next;
+            }
+            else if(!next || pDev->sim.readyUs < next)
+                next = pDev->sim.readyUs;
+        }
+        if(next)
+        {
+            struct itimerspec its = {
+                .it_value.tv_sec = next / 1000000,
+                .it_value.tv_nsec = (next % 1000000) * 1000,
+            };
+            timerfd_settime(tfd, TFD_TIMER_ABSTIME, &its, NULL);
+        }
+    }
+
+    m_devCpuNs += threadCpuNs() - cpu0;
+    close(tfd);
+    close(ep);
+    return (NULL);
+}
+
+/* A raw pty pair, the slave end plays the serial port */
+static int openPty(int *pMaster, int *pSlave)
+{
+    struct termios tty;
+
+    if((*pMaster = posix_openpt(O_RDWR | O_NOCTTY)) < 0)
+        return (-1);
+    if(grantpt(*pMaster) || unlockpt(*pMaster) ||
+       (*pSlave = open(ptsname(*pMaster), O_RDWR | O_NOCTTY)) < 0)
+    {
+        close(*pMaster);
+        return (-1);
+    }
+    tcgetattr(*pSlave, &tty);
+    cfmakeraw(&tty);
+    tcsetattr(*pSlave, TCSANOW, &tty);
+    return (0);
+}
+
+static uint64_t threadCpuNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+static uint64_t wallNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
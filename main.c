@@ -10,19 +10,31 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <getopt.h>
 
 /* Custom Includes */
 #include "Linux_Serial.h"
 #include "sbl_device.h"
 #include "sbl_device_cc2640.h"
 #include "myFile.h"
+#include "sbl_timeout.h"
+#include "sbl_cli.h"
+#include "sbl_calibrate.h"
+#include "sbl_profile.h"
+#include "sbl_station.h"
+#include "sbl_trace.h"
+#include "sbl_timeline.h"
+#include "sbl_metrics.h"
+#include "sbl_unit.h"
+#include "sbl_lines.h"
+#include "sbl_scan.h"
 
 /* read only variables */
 const char *portName = NULL;
 const char *filename = NULL; //Path of .bin to be flashed
-static FILE *fPtr = NULL;
 
 /* CMD line cases */
 enum cmdArgs{
@@ -31,6 +43,50 @@ enum cmdArgs{
     THREE = 3
 };
 
+/* Options given before the port */
+static bool bRxThread = false;
+static uint32_t calPings = 0;           /* --calibrate, 0 if not asked */
+static bool bUseProfile = true;
+static const char *pcTraceFile = NULL;  /* --trace */
+static const char *pcTimelineFile = NULL;   /* --timeline */
+static const char *pcMetricsFile = NULL;    /* --metrics */
+#ifndef SBL_SMALL
+static const char *pcStationSocket = NULL;  /* --station */
+static uint32_t scanBudgetMs = 0;       /* --scan, 0 if not asked */
+#endif
+static uint64_t sessionStartUs;
+static char sessionPortId[256];         /* Metrics label, taken while open */
+
+/* Profile of the port, see sbl_profile.c. Empty key until open. */
+static tPortProfile portProfile;
+
+/* The device on it, see sbl_unit.c. Empty key until identified. */
+static tUnitState unitState;
+
+static const struct option longOpts[] = {
+    { "rx-thread", no_argument, NULL, 'r' },
+    { "calibrate", optional_argument, NULL, 'c' },
+    { "no-profile", no_argument, NULL, 'p' },
+#ifndef SBL_SMALL
+    { "station", required_argument, NULL, 's' },
+    { "scan", optional_argument, NULL, 'S' },
+#endif
+    { "trace", required_argument, NULL, 't' },
+    { "timeline", required_argument, NULL, 'T' },
+    { "metrics", required_argument, NULL, 'm' },
+    { "check-pages", optional_argument, NULL, 'k' },
+    { "bl-enter", optional_argument, NULL, 'e' },
+    { "bl-release", optional_argument, NULL, 'l' },
+    { NULL, 0, NULL, 0 }
+};
+
+/* Static functions */
+static tSblStatus openSession(void);
+static void loadSessionProfile(void);
+static void saveSessionProfile(bool bOk);
+static tSblStatus identifyUnit(void);
+static void recordSession(bool bOk);
+static bool isReplay(void);
 
 int main(int argc, char **argv)
 {
@@ -40,209 +96,451 @@ int main(int argc, char **argv)
     printf("Compiler: GCC                       \n");
     printf("+-----------------------------------------------------------------------------------------------\n\n");
 
-    /* Do some initial command line checks */
-    switch(argc)
+    char *legacyOps[3];
+    char **ops = NULL;
+    int numOps = 0;
+    int opt;
+
+    /* Options end at the port name ('+': don't touch the ops) */
+    while((opt = getopt_long(argc, argv, "+", longOpts, NULL)) != -1)
+    {
+        switch(opt)
+        {
+        case 'r':
+            bRxThread = true;
+            break;
+        case 'c':
+            calPings = (optarg) ? strtoul(optarg, NULL, 0) : SBL_CAL_DEFAULT_PINGS;
+            if(calPings == 0 || calPings > SBL_CAL_MAX_PINGS)
+            {
+                printf("ERROR: --calibrate takes 1 to %d pings\n", SBL_CAL_MAX_PINGS);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'p':
+            bUseProfile = false;
+            break;
+        case 't':
+            pcTraceFile = optarg;
+            break;
+        case 'T':
+            pcTimelineFile = optarg;
+            break;
+        case 'm':
+            pcMetricsFile = optarg;
+            break;
+        case 'k':
+            cliSetPageCheck((optarg) ? strtoul(optarg, NULL, 0) : 1);
+            break;
+        case 'e':
+            if(linesSetEnter(optarg) != SBL_SUCCESS)
+                exit(EXIT_FAILURE);
+            break;
+        case 'l':
+            if(linesSetRelease(optarg) != SBL_SUCCESS)
+                exit(EXIT_FAILURE);
+            break;
+#ifndef SBL_SMALL
+        case 's':
+            pcStationSocket = optarg;
+            break;
+        case 'S':
+            scanBudgetMs = (optarg) ? strtoul(optarg, NULL, 0) : SCAN_DEFAULT_BUDGET_MS;
+            if(scanBudgetMs == 0)
+            {
+                printf("ERROR: --scan takes a budget in ms\n");
+                exit(EXIT_FAILURE);
+            }
+            break;
+#endif
+        default:
+            printCliUsage();
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    /* Counters, added to the file on exit (and after every station job) */
+    if(pcMetricsFile)
     {
+        if(metricsOpen(pcMetricsFile) < 0)
+            exit(EXIT_FAILURE);
+        atexit(metricsClose);
+    }
+
+#ifndef SBL_SMALL
+    /* Daemon mode, ports come and go by themselves */
+    if(pcStationSocket)
+        exit((runStation(pcStationSocket) == SBL_SUCCESS) ? EXIT_SUCCESS : EXIT_FAILURE);
 
-    case THREE:
+    /* Who is out there, the rest of the line are ports to probe */
+    if(scanBudgetMs)
+        exit((runScan(scanBudgetMs, argc - optind, &argv[optind]) == SBL_SUCCESS) ? EXIT_SUCCESS : EXIT_FAILURE);
+#endif
+
+    /* Drop the options, argv[1] is the port from here on */
+    argc -= optind - 1;
+    argv += optind - 1;
+
+    /* Do some initial command line checks */
+    if(argc == THREE && !isCliOp(argv[2]))
+    {
+        /* Classic usage: flash the whole image and reset */
         portName = argv[1];
         filename = argv[2];
         printf("SBL Port i/p: %s\r\n", portName);
         printf("Firmware i/p: %s\r\n\n", filename);
         printf("All Good :)\r\n");
-        break;
 
-    default:
+        legacyOps[0] = "flash";
+        legacyOps[1] = (char*)filename;
+        legacyOps[2] = "reset";
+        ops = legacyOps;
+        numOps = 3;
+    }
+    else if(argc > THREE || (argc == THREE && isCliOp(argv[2])))
+    {
+        portName = argv[1];
+        ops = &argv[2];
+        numOps = argc - 2;
+        printf("SBL Port i/p: %s\r\n\n", portName);
+    }
+    else
+    {
         printf("INVALID ARG'S...EXITING :(\r\n");
+        printCliUsage();
+        exit(EXIT_FAILURE);
+    }
+
+    /* Record the wire, kept if we crash or fail */
+    if(pcTraceFile)
+    {
+        if(traceOpen(pcTraceFile, SBL_TRACE_DEFAULT_RECORDS, portName) < 0)
+            exit(EXIT_FAILURE);
+        atexit(traceClose);
+    }
+
+    /* Where the time goes, written out on exit */
+    if(pcTimelineFile)
+    {
+        if(timelineOpen(pcTimelineFile, portName) < 0)
+            exit(EXIT_FAILURE);
+        atexit(timelineClose);
+    }
+
+    /* Images load while the port opens and the device syncs */
+    cliPrefetchImages(numOps, ops);
+
+    /* One session for everything that follows */
+    uint64_t t0 = timelineNow();
+    sessionStartUs = serialGetTimeUs();
+    tSblStatus retCode = openSession();
+    serialGetPortId(sessionPortId, sizeof(sessionPortId));
+    if(!sessionPortId[0])
+        snprintf(sessionPortId, sizeof(sessionPortId), "%s", portName);
+    timelineSpan(TL_SESSION, "open session", t0, NULL, 0);
+    if(retCode != SBL_SUCCESS)
+    {
+        saveSessionProfile(false);
+        if(unitState.key[0])
+            saveUnitState(&unitState);
+        recordSession(false);
+        closePort();
         exit(EXIT_FAILURE);
-        break;
     }
 
-    uint8_t *memPtr = NULL;         /* Ptr to hold read data */
-    long fileSz = 0;                /* Holds the size of the .bin file, in bytes */
-    uint32_t fileCrc, devCrc;       /* Variables to save CRC checksum */
+    t0 = timelineNow();
+    retCode = runCliOps(numOps, ops);
+    timelineSpan(TL_SESSION, "operations", t0, NULL, 0);
+    if(retCode != SBL_SUCCESS)
+    {
+        saveSessionProfile(false);
+        if(unitState.key[0])
+            saveUnitState(&unitState);
+        recordSession(false);
+        closePort();
+        exit(EXIT_FAILURE);
+    }
+
+    /* Show what the session learned about the device timing */
+    printCmdTimeouts();
+    printSerialStats();
+
+    /* If we got here, means all succeeded */
+    printf("+-----------------------------------\n");
+    printf("CC2640 FIRMWARE UPGRADE COMPLETED !-\n");
+    printf("+-----------------------------------\n\n");
+
+    /* Close all, a replay only passes here if the host matched it */
+    t0 = timelineNow();
+    saveSessionProfile(true);
+    if(unitState.key[0])
+        saveUnitState(&unitState);
+    int rc = closePort();
+    recordSession(rc == 0);
+    timelineSpan(TL_SESSION, "close", t0, NULL, 0);
+    if(rc < 0)
+        exit(EXIT_FAILURE);
+
+    /* exit on success */
+    exit(EXIT_SUCCESS);
+}
+
+/****************************************************************
+ * Function Name : openSession
+ * Description   : Opens the port and brings up the bootloader
+ *                 session: autobaud, ping, device identity, flash and
+ *                 RAM size.
+ * Returns       : SBL_SUCCESS, ...
+ * Params        @None
+ ****************************************************************/
+static tSblStatus openSession(void)
+{
     uint32_t tmp = 0;
-    bool ackChk = false;
+    uint64_t t0 = timelineNow(), connectUs = serialGetTimeUs(), linesUs = 0;
 
     /* Open the port */
-    openPort(portName);
+    if(openPort(portName) < 0)
+        return (SBL_PORT_ERROR);
 
     /* Configure port */
     configPort();
 
+    /* Bridged ports jitter more than the device ever does */
+    if(serialGetTransport()->floorMs)
+        setTimeoutFloor(serialGetTransport()->floorMs);
+
+    /* Start from what earlier sessions learned about this port */
+    loadSessionProfile();
+
+    /* Run on a tuned link, measure it first if asked to */
+    if(!calPings)
+        serialTuneLatency();
+
+    /* Drain RX continuously from here on if asked to */
+    if(bRxThread && serialStartRxThread() < 0)
+        return (SBL_PORT_ERROR);
+    timelineSpan(TL_SESSION, "open port", t0, NULL, 0);
+
     /* Setup callbacks */
     setupCallbacks();
 
     /* Set flash base for cc2640 */
     setDeviceFlashBase(CC26XX_FLASH_BASE);
 
+    /* Into the ROM bootloader by DTR/RTS, if wired and asked to */
+    if(linesHaveEnter())
+    {
+        uint64_t u0 = serialGetTimeUs();
+        if(linesEnter() != SBL_SUCCESS)
+        {
+            printf("ERROR: bootloader entry sequence failed\n");
+            return (SBL_PORT_ERROR);
+        }
+        linesUs = serialGetTimeUs() - u0;
+    }
+
     /* Detect baud rate */
-    if(detectAutoBaud() != SBL_SUCCESS)
+    t0 = timelineNow();
+    tSblStatus retCode = detectAutoBaud();
+    timelineSpan(TL_SESSION, "autobaud", t0, NULL, 0);
+    if(retCode != SBL_SUCCESS)
     {
         printf("ERROR: baud detect  failed\n");
-        closePort();
-        exit(EXIT_FAILURE);
+        return (SBL_PORT_ERROR);
     }
     else
-        printf("Baudrate detected !\n");
+        printf("Baudrate detected ! %.1f ms from opening the port (entry lines %.1f ms)\n",
+               (serialGetTimeUs() - connectUs) / 1000.0, linesUs / 1000.0);
 
     /* Check if the host is reachable */
-    if(ping() != SBL_SUCCESS)
+    t0 = timelineNow();
+    retCode = ping();
+    timelineSpan(TL_SESSION, "ping", t0, NULL, 0);
+    if(retCode != SBL_SUCCESS)
     {
         printf("ERROR: Host unreachable\n");
-        closePort();
-        exit(EXIT_FAILURE);
+        return (SBL_PORT_ERROR);
     }
     else
         printf("PING: Host detected !\n");
 
-    if(readFlashSize(&tmp) != SBL_SUCCESS)
+    if(calPings)
+    {
+        tLinkRtt before, after;
+        t0 = timelineNow();
+        retCode = calibrateLink(calPings, &before, &after);
+        timelineSpan(TL_SESSION, "calibrate", t0, "pings", calPings);
+        if(retCode != SBL_SUCCESS)
+        {
+            printf("ERROR: Link calibration failed\n");
+            return (SBL_PORT_ERROR);
+        }
+        portProfile.rttP50Us = after.p50Us;
+        portProfile.rttP90Us = after.p90Us;
+        portProfile.rttP99Us = after.p99Us;
+    }
+
+    /* Which unit this is, a known one has its sizes cached */
+    t0 = timelineNow();
+    retCode = identifyUnit();
+    timelineSpan(TL_SESSION, "identify", t0, NULL, 0);
+    if(retCode != SBL_SUCCESS)
+    {
+        printf("ERROR: Unable to identify the device\n");
+        return (SBL_ERROR);
+    }
+    if(unitState.flashSize)
+    {
+        setDeviceSizes(unitState.flashSize, unitState.ramSize);
+        printf("Flash size: %u, RAM size: %u (known unit)\n", getFlashSize(), getRamSize());
+        return (SBL_SUCCESS);
+    }
+
+    t0 = timelineNow();
+    retCode = readFlashSize(&tmp);
+    timelineSpan(TL_SESSION, "flash size", t0, NULL, 0);
+    if(retCode != SBL_SUCCESS)
     {
         printf("ERROR: Unable to read flash size\n");
-        closePort();
-        exit(EXIT_FAILURE);
+        return (SBL_ERROR);
     }
     else
         printf("Flash size: %u\n",getFlashSize());
 
-    if(readRamSize(&tmp) != SBL_SUCCESS)
+    t0 = timelineNow();
+    retCode = readRamSize(&tmp);
+    timelineSpan(TL_SESSION, "ram size", t0, NULL, 0);
+    if(retCode != SBL_SUCCESS)
     {
         printf("ERROR: Unable to read RAM size\n");
-        closePort();
-        exit(EXIT_FAILURE);
+        return (SBL_ERROR);
     }
     else
         printf("RAM size: %u\n",getRamSize());
 
-    /* Open the file */
-    if((fPtr = openFile(filename)) == NULL)
-    {
-        printf("ERROR: opening file\n");
-        closePort();
-        exit(EXIT_FAILURE);
-    }
-    else
-    {
-        printf("FILE open OK\n");
-        if(!(fileSz = getFileSize(fPtr)))
-        {
-            printf("ERROR: getting file size\n");
-            closePort();
-            closeFile(fPtr);
-            exit(EXIT_FAILURE);
-        }
-        else
-        {
-            printf("FILE size OK, fileSz: %lu\n",fileSz);
+    /* Saved with the unit, if it is kept */
+    unitState.flashSize = getFlashSize();
+    unitState.ramSize = getRamSize();
+    return (SBL_SUCCESS);
+}
 
-            /* Allocate memory to read the file */
-            memPtr = (uint8_t*)calloc(fileSz, sizeof(uint8_t));
-            if(memPtr)
-            {
-                uint32_t fileRd = 0;
-
-                printf("CALLOC OK\n");
-                if((fileRd = fread(memPtr,1 , fileSz, fPtr)) != fileSz)
-                {
-                    printf("ERROR: File read failed\n");
-                    free(memPtr);
-                    closePort();
-                    closeFile(fPtr);
-                    exit(EXIT_FAILURE);
-                }
-                else
-                    printf("FILE read OK, fileRd: %u \n", fileRd);
-            }
-            else
-            {
-                printf("ERROR: calloc failed\n");
-                closePort();
-                closeFile(fPtr);
-                exit(EXIT_FAILURE);
-            }
-        }
-    }// End of all file operations
+/****************************************************************
+ * Function Name : identifyUnit
+ * Description   : Reads the chip ID (which also sets the device
+ *                 revision the RAM size depends on) and the IEEE
+ *                 address, and looks the unit up in the unit cache.
+ *                 Not with --no-profile, --trace or a replay: the
+ *                 cache changes what a session sends, and a trace
+ *                 must replay without it.
+ * Returns       : SBL_SUCCESS, ...
+ * Params        @None
+ ****************************************************************/
+static tSblStatus identifyUnit(void)
+{
+    tSblStatus retCode;
+    uint32_t chipId;
+    uint64_t ieee;
 
-    /* Calculate file CRC checksum */
-    fileCrc = calcCrcLikeChip(memPtr, fileSz);
-    printf("fileCrc: %u\n", fileCrc);
+    if((retCode = readDeviceId(&chipId)) != SBL_SUCCESS ||
+       (retCode = readIeeeAddress(&ieee)) != SBL_SUCCESS)
+        return (retCode);
+    printf("Chip ID: 0x%08X, IEEE address: %016llX\n", chipId, (unsigned long long)ieee);
 
-    /* Erase as much flash needed to program the new firmware */
-    printf("Erasing flash ...\n");
-    if(eraseFlashRange(getDeviceFlashBase(), fileSz) != SBL_SUCCESS)
-    {
-        printf("ERROR: Erase failed\n");
-        free(memPtr);
-        closePort();
-        closeFile(fPtr);
-        exit(EXIT_FAILURE);
-    }
-    else
-        printf("ERASE OK\n");
+    if(!bUseProfile || pcTraceFile || isReplay())
+        return (SBL_SUCCESS);
 
-    /* Write file to device flash memory */
-    printf("Writing flash ...\n");
-    if(writeFlashRange(getDeviceFlashBase(), fileSz, (char*)memPtr) != SBL_SUCCESS)
-    {
-        printf("ERROR: Write failed\n");
-        free(memPtr);
-        closePort();
-        closeFile(fPtr);
-        exit(EXIT_FAILURE);
-    }
-    else
-        printf("WRITE OK\n");
+    makeUnitKey(chipId, ieee, &unitState);
+    if(loadUnitState(&unitState) == SBL_SUCCESS)
+        printf("Known unit %s: %u sessions%s\n", unitState.key, unitState.sessions,
+               unitState.imageSize ? ", last image cached" : "");
+    unitState.sessions++;
+    cliSetUnit(&unitState);
+    return (SBL_SUCCESS);
+}
 
-    /* Calculate CRC checksum of flashed content */
-    printf("Calculating CRC of flashed content ...\n");
-    if(calculateCrc32(getDeviceFlashBase(), fileSz, &devCrc) != SBL_SUCCESS)
-    {
-        printf("ERROR: CRC failed\n");
-        free(memPtr);
-        closePort();
-        closeFile(fPtr);
-        exit(EXIT_FAILURE);
-    }
-    printf("devCrc: %u\n", devCrc);
+/****************************************************************
+ * Function Name : loadSessionProfile
+ * Description   : Looks up the profile of the open port and seeds
+ *                 the link timing from it. A port seen for the
+ *                 first time gets calibrated instead. Not with
+ *                 --no-profile, --trace or a replay: a trace must
+ *                 replay without the calibration and seeding.
+ * Returns       : None
+ * Params        @None
+ ****************************************************************/
+static void loadSessionProfile(void)
+{
+    char pcKey[SBL_PROFILE_KEY_MAX];
 
-    /* Comparing the CRC checksums */
-    if(fileCrc == devCrc)
-    {
-        printf("CRC OK, devCrc = fileCrc = %u\n", fileCrc);
-    }
-    else
+    if(!bUseProfile || pcTraceFile || isReplay())
+        return;
+
+    serialGetPortId(pcKey, sizeof(pcKey));
+    if(loadPortProfile(pcKey, &portProfile) != SBL_SUCCESS)
     {
-        printf("ERROR: CRC mismatch!\n");
-        free(memPtr);
-        closePort();
-        closeFile(fPtr);
-        exit(EXIT_FAILURE);
+        memset(&portProfile, 0, sizeof(portProfile));
+        snprintf(portProfile.key, sizeof(portProfile.key), "%s", pcKey);
+        printf("New port %s, calibrating\n", pcKey);
+        if(!calPings)
+            calPings = SBL_CAL_DEFAULT_PINGS;
+        return;
     }
 
-    /* Reset the device */
-    if(reset() != SBL_SUCCESS)
+    printPortProfile(&portProfile);
+    if(portProfile.linkSrttUs)
+        seedLinkTiming(portProfile.linkSrttUs, portProfile.linkVarUs);
+}
+
+/****************************************************************
+ * Function Name : saveSessionProfile
+ * Description   : Adds what this session learned to the profile
+ *                 of the port and stores it
+ * Returns       : None
+ * Params        @bOk: The session succeeded
+ ****************************************************************/
+static void saveSessionProfile(bool bOk)
+{
+    tLinkTiming timing;
+
+    if(!bUseProfile || !portProfile.key[0])
+        return;
+
+    getLinkTiming(&timing);
+    portProfile.sessions++;
+    portProfile.failures += (bOk) ? 0 : 1;
+    portProfile.timeouts += timing.timeouts;
+    if(timing.samples)
     {
-        printf("ERROR: RST failed!\n");
-        free(memPtr);
-        closePort();
-        closeFile(fPtr);
-        exit(EXIT_FAILURE);
+        portProfile.linkSrttUs = timing.srttUs;
+        portProfile.linkVarUs = timing.varUs;
     }
-    else
-        printf("RST OK\n");
 
-    /* If we got here, means all succeeded */
-    printf("+-----------------------------------\n");
-    printf("CC2640 FIRMWARE UPGRADE COMPLETED !-\n");
-    printf("+-----------------------------------\n\n");
+    if(savePortProfile(&portProfile) != SBL_SUCCESS)
+        printf("WARNING: Port profile not saved (%s)\n", getProfileDbPath());
+}
 
-    /* De-allocate the memory */
-    free(memPtr);
+/****************************************************************
+ * Function Name : recordSession
+ * Description   : Counts the session and what went over its port
+ *                 in the --metrics file
+ * Returns       : None
+ * Params        @bOk: The session succeeded
+ ****************************************************************/
+static void recordSession(bool bOk)
+{
+    tSerialStats stats;
 
-    /* Close all */
-    closeFile(fPtr);
-    closePort();
+    serialGetStats(&stats);
+    metricsPortBytes(sessionPortId, stats.txBytes, stats.rxBytes);
+    metricsSession(bOk, (serialGetTimeUs() - sessionStartUs) / 1e6);
+}
 
-    /* exit on success */
-    exit(EXIT_SUCCESS);
+/* Is the port a trace played back, never in a small build */
+static bool isReplay(void)
+{
+#ifndef SBL_SMALL
+    return (serialGetTransport() == &replayTransport);
+#else
+    return (false);
+#endif
 }
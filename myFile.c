@@ -10,6 +10,10 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include "sbl_small.h"
 
 /****************************************************************
  * Function Name : openFile
@@ -55,3 +59,73 @@ int closeFile(FILE *fp)
     return(fclose(fp));
 }
 
+
+/****************************************************************
+ * Function Name : readFile
+ * Description   : Reads a whole file into the caller's buffer
+ * Returns       : true on success, false on failure or if it
+ *                 doesn't fit
+ * Params        @file: Path to the file to be read
+ *               @pcBuf: Where the contents go
+ *               @ui32Max: Room in the buffer
+ *               @pSize: Populated with the file size
+ ****************************************************************/
+bool readFile(const char *file, uint8_t *pcBuf, uint32_t ui32Max, uint32_t *pSize)
+{
+    FILE *fp = NULL;
+    long int sz = 0;
+
+    if((fp = openFile(file)) == NULL)
+    {
+        printf("ERROR: opening file %s\n", file);
+        return (false);
+    }
+
+    if(!(sz = getFileSize(fp)))
+    {
+        printf("ERROR: getting file size\n");
+        closeFile(fp);
+        return (false);
+    }
+
+    if((unsigned long)sz > ui32Max)
+    {
+        printf("ERROR: %s is larger than %u bytes\n", file, ui32Max);
+        closeFile(fp);
+        return (false);
+    }
+
+    if(fread(pcBuf, 1, sz, fp) != (size_t)sz)
+    {
+        printf("ERROR: File read failed\n");
+        closeFile(fp);
+        return (false);
+    }
+
+    closeFile(fp);
+    *pSize = sz;
+    return (true);
+}
+
+/****************************************************************
+ * Function Name : makeParentDirs
+ * Description   : Creates the directories leading to a path,
+ *                 like mkdir -p on its dirname
+ * Returns       : None
+ * Params        @pcPath: The path
+ ****************************************************************/
+void makeParentDirs(const char *pcPath)
+{
+    char pcDir[PATH_MAX];
+
+    snprintf(pcDir, sizeof(pcDir), "%s", pcPath);
+    for(char *p = pcDir + 1; *p; p++)
+    {
+        if(*p != '/')
+            continue;
+        *p = '\0';
+        if(mkdir(pcDir, 0755) < 0 && errno != EEXIST)
+            return;
+        *p = '/';
+    }
+}
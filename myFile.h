@@ -8,9 +8,13 @@
 #ifndef MYFILE_H_
 #define MYFILE_H_
 #include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
 
 extern FILE *openFile(const char *file);
 extern int closeFile(FILE *fp);
 extern long int getFileSize(FILE *fp);
+extern bool readFile(const char *file, uint8_t *pcBuf, uint32_t ui32Max, uint32_t *pSize);
+extern void makeParentDirs(const char *pcPath);
 
 #endif /* MYFILE_H_ */
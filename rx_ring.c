@@ -0,0 +1,107 @@
+/*
+ * rx_ring.c
+ *
+ *  Created on: 18/10/2026
+ *  Description: Lock-free SPSC ring between the RX thread and
+ *               serialRead()
+ */
+
+#include <string.h>
+#include "rx_ring.h"
+
+#define RING_MASK   (RX_RING_SIZE - 1)
+
+/****************************************************************
+ * Function Name : rxRingInit
+ * Description   : Empties the ring. Not thread safe, call before
+ *                 the producer starts.
+ * Returns       : None
+ * Params        @pRing: The ring
+ ****************************************************************/
+void rxRingInit(tRxRing *pRing)
+{
+    atomic_store_explicit(&pRing->head, 0, memory_order_relaxed);
+    atomic_store_explicit(&pRing->tail, 0, memory_order_relaxed);
+}
+
+/****************************************************************
+ * Function Name : rxRingPush
+ * Description   : Producer side, appends as many bytes as fit
+ * Returns       : Number of bytes appended
+ * Params        @pRing: The ring
+ *               @pData: Bytes received
+ *               @ui32Len: Number of bytes
+ *               @ui64StampUs: Time they were received
+ ****************************************************************/
+uint32_t rxRingPush(tRxRing *pRing, const uint8_t *pData,
+                    uint32_t ui32Len, uint64_t ui64StampUs)
+{
+    uint32_t head = atomic_load_explicit(&pRing->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&pRing->tail, memory_order_acquire);
+    uint32_t space = RX_RING_SIZE - (head - tail);
+    uint32_t n = (ui32Len < space) ? ui32Len : space;
+
+    for(uint32_t i = 0; i < n; i++)
+    {
+        pRing->data[(head + i) & RING_MASK] = pData[i];
+        pRing->stampUs[(head + i) & RING_MASK] = ui64StampUs;
+    }
+
+    /* Publish the bytes */
+    atomic_store_explicit(&pRing->head, head + n, memory_order_release);
+    return (n);
+}
+
+/****************************************************************
+ * Function Name : rxRingPop
+ * Description   : Consumer side, takes up to \e ui32Len bytes
+ * Returns       : Number of bytes taken
+ * Params        @pRing: The ring
+ *               @pData: Destination
+ *               @ui32Len: Max number of bytes
+ *               @pui64LastStampUs: Populated with the receive time
+ *                                  of the last byte taken, may be
+ *                                  NULL
+ ****************************************************************/
+uint32_t rxRingPop(tRxRing *pRing, uint8_t *pData, uint32_t ui32Len,
+                   uint64_t *pui64LastStampUs)
+{
+    uint32_t tail = atomic_load_explicit(&pRing->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&pRing->head, memory_order_acquire);
+    uint32_t avail = head - tail;
+    uint32_t n = (ui32Len < avail) ? ui32Len : avail;
+
+    for(uint32_t i = 0; i < n; i++)
+        pData[i] = pRing->data[(tail + i) & RING_MASK];
+
+    if(n && pui64LastStampUs)
+        *pui64LastStampUs = pRing->stampUs[(tail + n - 1) & RING_MASK];
+
+    /* Hand the space back */
+    atomic_store_explicit(&pRing->tail, tail + n, memory_order_release);
+    return (n);
+}
+
+/****************************************************************
+ * Function Name : rxRingCount
+ * Description   : Bytes waiting in the ring
+ * Returns       : Number of bytes
+ * Params        @pRing: The ring
+ ****************************************************************/
+uint32_t rxRingCount(tRxRing *pRing)
+{
+    return (atomic_load_explicit(&pRing->head, memory_order_acquire) -
+            atomic_load_explicit(&pRing->tail, memory_order_acquire));
+}
+
+/****************************************************************
+ * Function Name : rxRingDiscard
+ * Description   : Consumer side, drops everything buffered
+ * Returns       : None
+ * Params        @pRing: The ring
+ ****************************************************************/
+void rxRingDiscard(tRxRing *pRing)
+{
+    uint32_t head = atomic_load_explicit(&pRing->head, memory_order_acquire);
+    atomic_store_explicit(&pRing->tail, head, memory_order_release);
+}
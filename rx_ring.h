@@ -0,0 +1,32 @@
+/*
+ * rx_ring.h
+ *
+ *  Created on: 18/10/2026
+ */
+
+#ifndef RX_RING_H_
+#define RX_RING_H_
+#include <stdint.h>
+#include <stdatomic.h>
+
+/* Must be a power of two */
+#define RX_RING_SIZE    65536
+
+/* Single producer/single consumer byte ring. Every byte carries the
+ * time it was drained from the port. */
+typedef struct {
+    _Atomic uint32_t head;          /* Written by the producer only */
+    _Atomic uint32_t tail;          /* Written by the consumer only */
+    uint8_t  data[RX_RING_SIZE];
+    uint64_t stampUs[RX_RING_SIZE];
+} tRxRing;
+
+extern void rxRingInit(tRxRing *pRing);
+extern uint32_t rxRingPush(tRxRing *pRing, const uint8_t *pData,
+                           uint32_t ui32Len, uint64_t ui64StampUs);
+extern uint32_t rxRingPop(tRxRing *pRing, uint8_t *pData, uint32_t ui32Len,
+                          uint64_t *pui64LastStampUs);
+extern uint32_t rxRingCount(tRxRing *pRing);
+extern void rxRingDiscard(tRxRing *pRing);
+
+#endif /* RX_RING_H_ */
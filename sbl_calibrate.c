@@ -0,0 +1,127 @@
+/*
+ * sbl_calibrate.c
+ *
+ *  Created on: 18/10/2026
+ *  Description: Link latency calibration. A burst of pings measures
+ *               the round trip, which on USB adapters is mostly the
+ *               adapter holding back RX, then the port is tuned and
+ *               measured again.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "sbl_calibrate.h"
+#include "sbl_device_cc2640.h"
+#include "sbl_timeout.h"
+#include "Linux_Serial.h"
+
+/* Macros */
+#define MIN(x, y) (((x) < (y)) ? (x) : (y))
+
+/* Static variables */
+static uint32_t m_samples[SBL_CAL_MAX_PINGS];
+
+/* Static functions */
+static int compareU32(const void *pA, const void *pB);
+static uint32_t percentile(const uint32_t *pui32Sorted, uint32_t ui32Count,
+                           uint32_t ui32Pct);
+
+/****************************************************************
+ * Function Name : measureLinkRtt
+ * Description   : Pings the device back to back and takes the
+ *                 round trip time distribution
+ * Returns       : SBL_SUCCESS if any ping was answered
+ * Params        @ui32Pings: Number of pings, at most
+ *                           SBL_CAL_MAX_PINGS
+ *               @pRtt: Populated with the distribution
+ ****************************************************************/
+tSblStatus measureLinkRtt(uint32_t ui32Pings, tLinkRtt *pRtt)
+{
+    memset(pRtt, 0, sizeof(*pRtt));
+    ui32Pings = MIN(ui32Pings, SBL_CAL_MAX_PINGS);
+
+    for(uint32_t i = 0; i < ui32Pings; i++)
+    {
+        uint64_t startUs = serialGetTimeUs();
+        if(ping() != SBL_SUCCESS)
+        {
+            pRtt->lost++;
+            continue;
+        }
+        m_samples[pRtt->pings++] = (uint32_t)(serialGetTimeUs() - startUs);
+    }
+
+    if(!pRtt->pings)
+        return (SBL_TIMEOUT_ERROR);
+
+    qsort(m_samples, pRtt->pings, sizeof(m_samples[0]), compareU32);
+    pRtt->minUs = m_samples[0];
+    pRtt->p50Us = percentile(m_samples, pRtt->pings, 50);
+    pRtt->p90Us = percentile(m_samples, pRtt->pings, 90);
+    pRtt->p99Us = percentile(m_samples, pRtt->pings, 99);
+    pRtt->maxUs = m_samples[pRtt->pings - 1];
+    return (SBL_SUCCESS);
+}
+
+/****************************************************************
+ * Function Name : calibrateLink
+ * Description   : Measures the link, tunes the port for latency
+ *                 (see serialTuneLatency()) and measures it again.
+ *                 Response timeouts relearn the link turnaround.
+ * Returns       : SBL_SUCCESS, ...
+ * Params        @ui32Pings: Pings per measurement
+ *               @pBefore: Populated with the untuned distribution
+ *               @pAfter: Populated with the tuned one
+ ****************************************************************/
+tSblStatus calibrateLink(uint32_t ui32Pings, tLinkRtt *pBefore,
+                         tLinkRtt *pAfter)
+{
+    tSblStatus retCode;
+
+    if((retCode = measureLinkRtt(ui32Pings, pBefore)) != SBL_SUCCESS)
+        return (retCode);
+    printLinkRtt("Link RTT before tuning", pBefore);
+
+    if(serialTuneLatency() < 0)
+        printf("Nothing to tune on this port.\n");
+    resetLinkLatency();
+
+    if((retCode = measureLinkRtt(ui32Pings, pAfter)) != SBL_SUCCESS)
+        return (retCode);
+    printLinkRtt("Link RTT after tuning ", pAfter);
+    return (SBL_SUCCESS);
+}
+
+/****************************************************************
+ * Function Name : printLinkRtt
+ * Description   : Prints a round trip time distribution
+ * Returns       : None
+ * Params        @pcLabel: What was measured
+ *               @pRtt: The distribution
+ ****************************************************************/
+void printLinkRtt(const char *pcLabel, const tLinkRtt *pRtt)
+{
+    printf("%s: min %u us, p50 %u us, p90 %u us, p99 %u us, max %u us (%u pings",
+           pcLabel, pRtt->minUs, pRtt->p50Us, pRtt->p90Us, pRtt->p99Us,
+           pRtt->maxUs, pRtt->pings);
+    if(pRtt->lost)
+        printf(", %u lost", pRtt->lost);
+    printf(")\n");
+}
+
+/* qsort() order of uint32_t */
+static int compareU32(const void *pA, const void *pB)
+{
+    uint32_t a = *(const uint32_t*)pA, b = *(const uint32_t*)pB;
+    return (a > b) - (a < b);
+}
+
+/* Nearest rank percentile of sorted samples */
+static uint32_t percentile(const uint32_t *pui32Sorted, uint32_t ui32Count,
+                           uint32_t ui32Pct)
+{
+    uint32_t rank = (ui32Count * ui32Pct + 99) / 100;
+    return pui32Sorted[(rank ? rank : 1) - 1];
+}
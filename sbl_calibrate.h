@@ -0,0 +1,32 @@
+/*
+ * sbl_calibrate.h
+ *
+ *  Created on: 18/10/2026
+ */
+
+#ifndef SBL_CALIBRATE_H_
+#define SBL_CALIBRATE_H_
+#include <stdint.h>
+#include "sbl_device.h"
+
+/* Pings per measurement */
+#define SBL_CAL_DEFAULT_PINGS   32
+#define SBL_CAL_MAX_PINGS       1024
+
+/* Round trip time distribution of a ping burst */
+typedef struct {
+    uint32_t pings;         /* Answered */
+    uint32_t lost;          /* Timed out or NAKed */
+    uint32_t minUs;
+    uint32_t p50Us;
+    uint32_t p90Us;
+    uint32_t p99Us;
+    uint32_t maxUs;
+} tLinkRtt;
+
+extern tSblStatus measureLinkRtt(uint32_t ui32Pings, tLinkRtt *pRtt);
+extern tSblStatus calibrateLink(uint32_t ui32Pings, tLinkRtt *pBefore,
+                                tLinkRtt *pAfter);
+extern void printLinkRtt(const char *pcLabel, const tLinkRtt *pRtt);
+
+#endif /* SBL_CALIBRATE_H_ */
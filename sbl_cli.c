@@ -0,0 +1,1371 @@
+/*
+ * sbl_cli.c
+ *
+ *  Created on: 18/10/2026
+ *  Description: Operations that can be chained on the command line
+ *               or read from a script, all over the one bootloader
+ *               session opened by main().
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <limits.h>
+#include <errno.h>
+#include <libgen.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/signalfd.h>
+
+/* Custom Includes */
+#include "sbl_cli.h"
+#include "sbl_device_cc2640.h"
+#include "sbl_timeout.h"
+#include "sbl_image.h"
+#include "sbl_timeline.h"
+#include "sbl_metrics.h"
+#include "Linux_Serial.h"
+#include "myFile.h"
+#include "sbl_layout.h"
+#include "sbl_unit.h"
+#include "sbl_lines.h"
+
+#define MIN(x, y) (((x) < (y)) ? (x) : (y))
+#define MAX(x, y) (((x) > (y)) ? (x) : (y))
+
+/* watch: quiet time after the last event on the file before it is
+ * taken, builds write it in several goes */
+#define CLI_WATCH_SETTLE_MS     50
+
+/* Handler of one operation, gets the op's own arguments */
+typedef tSblStatus (*tCliOpFPTR)(int argc, char **argv);
+
+typedef struct {
+    const char *name;
+    int         minArgs;
+    int         maxArgs;
+    tCliOpFPTR  handler;
+    const char *usage;
+} tCliOp;
+
+/* An image prepared ahead by the helper thread */
+typedef struct {
+    const char     *pcPath;
+    tPreparedImage  image;
+    tSblStatus      retCode;
+    bool            bTaken;
+    uint64_t        startUs;        /* timelineNow() */
+    uint64_t        endUs;
+} tCliPrefetch;
+
+/* Set once the device left the bootloader */
+static bool m_bSessionReset;
+
+/* CRC the written pages every this many pages, 0: only at the end */
+static uint32_t m_pagesPerCheck;
+
+/* The device of the session if the unit cache is on, else NULL */
+static tUnitState *m_pUnit;
+
+/* Scripts being run by the script op, see opScript() */
+static uint32_t m_scriptDepth;
+
+/* Images named on the command line, see cliPrefetchImages() */
+static tCliPrefetch m_prefetch[SBL_CLI_MAX_PREFETCH];
+static uint32_t m_numPrefetch;
+static pthread_t m_prefetchThread;
+static bool m_bPrefetching;             /* Thread not joined yet */
+static uint64_t m_prefetchUs;           /* Its run time */
+
+/* Bytes of the running operation's patches, see parseBytes(). They
+ * all land in flash, so one flash holds them; the operation gives
+ * them all back when it ends. */
+static uint8_t m_patchBytes[SBL_CC2650_MAX_FLASH_SIZE];
+static uint32_t m_patchUsed;
+
+/* Static functions */
+static const tCliOp *findOp(const char *name);
+static tSblStatus opInfo(int argc, char **argv);
+static tSblStatus opErase(int argc, char **argv);
+static tSblStatus opWrite(int argc, char **argv);
+static tSblStatus opVerify(int argc, char **argv);
+static tSblStatus opFlash(int argc, char **argv);
+static tSblStatus opRead(int argc, char **argv);
+static tSblStatus opCrc(int argc, char **argv);
+static tSblStatus opCcfg(int argc, char **argv);
+static tSblStatus opUpdate(int argc, char **argv);
+static tSblStatus opLayout(int argc, char **argv);
+static tSblStatus opPersonalize(int argc, char **argv);
+static tSblStatus opWatch(int argc, char **argv);
+static tSblStatus watchReflash(uint32_t ui32Addr, const char *pcPath, tPreparedImage *pLast,
+                               uint64_t ui64ChangeUs);
+static bool waitFileChange(int inotifyFd, int signalFd, const char *pcName, uint64_t *pui64ChangeUs);
+static tSblStatus opReset(int argc, char **argv);
+static tSblStatus opScript(int argc, char **argv);
+static tSblStatus loadImage(const char *pcPath, tPreparedImage *pImage);
+#ifndef SBL_SMALL
+static void *prefetchMain(void *arg);
+#endif
+static void joinPrefetch(void);
+static tSblStatus flashImage(uint32_t ui32Addr, const tPreparedImage *pImage);
+static tSblStatus flashUnitDelta(uint32_t ui32Addr, const tPreparedImage *pImage, bool *pbDone);
+static tSblStatus reflashChangedPages(uint32_t ui32Addr, const tPreparedImage *pImage,
+                                      uint32_t ui32OldSize, const uint32_t *pui32OldPageCrc,
+                                      uint32_t ui32OldPages, uint32_t *pui32Changed);
+static bool pageUnchanged(const tPreparedImage *pImage, uint32_t ui32Page, uint32_t ui32OldSize,
+                          const uint32_t *pui32OldPageCrc, uint32_t ui32OldPages);
+static void rememberUnitImage(uint32_t ui32Addr, const tPreparedImage *pImage);
+static void forgetUnitImage(void);
+static tSblStatus writeImage(uint32_t ui32Addr, const tPreparedImage *pImage);
+static tSblStatus writeSpan(uint32_t ui32Addr, uint32_t ui32Len, const uint8_t *pData,
+                            const uint32_t *pui32PageCrc);
+static tSblStatus parsePatchTable(const char *pcPath, tImagePatch *pPatches, uint32_t *pNum);
+static uint8_t *parseBytes(const char *str, uint32_t *pLen);
+
+static const tCliOp m_ops[] = {
+    { "info",   0, 0, opInfo,   "info                         chip ID, flash and RAM size" },
+    { "erase",  1, 2, opErase,  "erase <addr> <len> | all     erase pages / whole bank" },
+    { "write",  1, 2, opWrite,  "write <file> [addr]          program (no erase)" },
+    { "verify", 1, 2, opVerify, "verify <file> [addr]         compare device CRC32 with file" },
+    { "flash",  1, 2, opFlash,  "flash <file> [addr]          erase + write + verify" },
+    { "read",   3, 3, opRead,   "read <addr> <len> <outfile>  dump device memory" },
+    { "crc",    2, 2, opCrc,    "crc <addr> <len>             device CRC32 of a range" },
+    { "ccfg",   2, 2, opCcfg,   "ccfg <field> <value>         set a CCFG field" },
+    { "update", 2, SBL_CLI_MAX_PATCHES*2, opUpdate,
+                                "update <addr> <hex|@file> ... patch flash, only the pages touched" },
+    { "layout", 1, 1, opLayout, "layout <file>                program/erase/keep ranges, see README" },
+    { "personalize", 2, 3, opPersonalize,
+                                "personalize <file> <patches> [addr] flash with per-unit patches, see README" },
+    { "watch",  1, 2, opWatch,  "watch <file> [addr]          flash, then reflash the changed pages on every rebuild" },
+    { "reset",  0, 0, opReset,  "reset                        leave the bootloader" },
+    { "script", 1, 1, opScript, "script <file|->              run ops from a file, one per line" },
+};
+#define NUM_OPS (sizeof(m_ops) / sizeof(m_ops[0]))
+
+/****************************************************************
+ * Function Name : isCliOp
+ * Description   : Checks if a token names an operation
+ * Returns       : true if it does
+ * Params        @name: Token from the command line
+ ****************************************************************/
+bool isCliOp(const char *name)
+{
+    return (findOp(name) != NULL);
+}
+
+/****************************************************************
+ * Function Name : cliSetPageCheck
+ * Description   : Makes write and flash have the device CRC the
+ *                 pages they programmed as they go, see
+ *                 writeFlashRangeChecked()
+ * Returns       : None
+ * Params        @ui32Pages: Pages per check, 0 to turn it off
+ ****************************************************************/
+void cliSetPageCheck(uint32_t ui32Pages)
+{
+    m_pagesPerCheck = ui32Pages;
+}
+
+/****************************************************************
+ * Function Name : cliSetUnit
+ * Description   : Gives the ops the cached state of the session's
+ *                 device: flash reflashes only the pages that
+ *                 changed since its last image, and records the new
+ *                 one. Ops changing flash otherwise forget it.
+ * Returns       : None
+ * Params        @pUnit: The unit, kept until the session ends
+ ****************************************************************/
+void cliSetUnit(tUnitState *pUnit)
+{
+    m_pUnit = pUnit;
+}
+
+/****************************************************************
+ * Function Name : cliPrefetchImages
+ * Description   : Starts preparing the images named by write,
+ *                 verify and flash (read, CRC, page CRCs, blank
+ *                 pages, segments) on a helper thread, so it
+ *                 overlaps opening the port and the handshake.
+ *                 The first op needing an image waits for it.
+ *                 Images in scripts are loaded when they're met.
+ *                 A small build loads every image when it's met,
+ *                 its few image slots are kept for the ops.
+ * Returns       : None
+ * Params        @argc: Number of tokens, as for runCliOps()
+ *               @argv: The tokens
+ ****************************************************************/
+void cliPrefetchImages(int argc, char **argv)
+{
+#ifndef SBL_SMALL
+    int i = 0;
+
+    while(i < argc && m_numPrefetch < SBL_CLI_MAX_PREFETCH)
+    {
+        const tCliOp *pOp = findOp(argv[i]);
+        int nArgs = 0;
+
+        if(!pOp)
+            return;
+        while((i + 1 + nArgs) < argc && nArgs < pOp->maxArgs &&
+              !isCliOp(argv[i + 1 + nArgs]))
+            nArgs++;
+
+        if(nArgs > 0 && (pOp->handler == opWrite || pOp->handler == opVerify ||
+                         pOp->handler == opFlash || pOp->handler == opPersonalize ||
+                         pOp->handler == opWatch))
+        {
+            bool bDup = false;
+            for(uint32_t j = 0; j < m_numPrefetch && !bDup; j++)
+                bDup = !strcmp(m_prefetch[j].pcPath, argv[i + 1]);
+            if(!bDup)
+                m_prefetch[m_numPrefetch++].pcPath = argv[i + 1];
+        }
+        i += 1 + nArgs;
+    }
+
+    if(!m_numPrefetch)
+        return;
+    if(pthread_create(&m_prefetchThread, NULL, prefetchMain, NULL) != 0)
+    {
+        /* Loaded when needed then */
+        m_numPrefetch = 0;
+        return;
+    }
+    m_bPrefetching = true;
+    atexit(cliFinishPrefetch);
+#else
+    (void)argc;
+    (void)argv;
+#endif
+}
+
+/****************************************************************
+ * Function Name : cliFinishPrefetch
+ * Description   : Waits for the helper thread and drops the images
+ *                 no operation took
+ * Returns       : None
+ * Params        @None
+ ****************************************************************/
+void cliFinishPrefetch(void)
+{
+    joinPrefetch();
+    for(uint32_t i = 0; i < m_numPrefetch; i++)
+    {
+        if(!m_prefetch[i].bTaken && m_prefetch[i].retCode == SBL_SUCCESS)
+            releaseImage(&m_prefetch[i].image);
+        m_prefetch[i].bTaken = true;
+    }
+}
+
+/****************************************************************
+ * Function Name : runCliOps
+ * Description   : Runs a chain of operations, e.g.
+ *                 "erase all write fw.bin verify fw.bin reset".
+ *                 Stops at the first one failing.
+ * Returns       : SBL_SUCCESS if all of them succeeded
+ * Params        @argc: Number of tokens
+ *               @argv: The tokens
+ ****************************************************************/
+tSblStatus runCliOps(int argc, char **argv)
+{
+    tSblStatus retCode = SBL_SUCCESS;
+    int i = 0;
+
+    while(i < argc)
+    {
+        const tCliOp *pOp = findOp(argv[i]);
+        if(!pOp)
+        {
+            printf("ERROR: unknown operation '%s'\n", argv[i]);
+            return (SBL_ARGUMENT_ERROR);
+        }
+
+        /* Arguments run up to the next op name or the op's max */
+        int nArgs = 0;
+        while((i + 1 + nArgs) < argc && nArgs < pOp->maxArgs &&
+              !isCliOp(argv[i + 1 + nArgs]))
+            nArgs++;
+
+        if(nArgs < pOp->minArgs)
+        {
+            printf("ERROR: usage: %s\n", pOp->usage);
+            return (SBL_ARGUMENT_ERROR);
+        }
+
+        if(m_bSessionReset && pOp->handler != opScript)
+        {
+            printf("ERROR: %s: device was reset, bootloader session is gone\n", pOp->name);
+            return (SBL_PORT_ERROR);
+        }
+
+        uint64_t startUs = serialGetTimeUs(), t0 = timelineNow();
+        retCode = pOp->handler(nArgs, &argv[i + 1]);
+        timelineSpan(TL_SESSION, pOp->name, t0, NULL, 0);
+        if(retCode != SBL_SUCCESS)
+        {
+            printf("ERROR: %s failed (%d)\n", pOp->name, retCode);
+            return (retCode);
+        }
+        printf("%s OK (%llu ms)\n", pOp->name,
+               (unsigned long long)(serialGetTimeUs() - startUs) / 1000);
+
+        i += 1 + nArgs;
+    }
+
+    return (SBL_SUCCESS);
+}
+
+/****************************************************************
+ * Function Name : runCliScript
+ * Description   : Runs the operations listed in a script. Each
+ *                 line holds one or more ops, '#' starts a comment.
+ * Returns       : SBL_SUCCESS if all of them succeeded
+ * Params        @path: Script file, "-" for stdin
+ ****************************************************************/
+tSblStatus runCliScript(const char *path)
+{
+    tSblStatus retCode = SBL_SUCCESS;
+    char line[512];
+    char *tokens[SBL_CLI_MAX_TOKENS];
+    FILE *fp = strcmp(path, "-") ? fopen(path, "r") : stdin;
+
+    if(!fp)
+    {
+        printf("ERROR: opening script %s\n", path);
+        return (SBL_ARGUMENT_ERROR);
+    }
+
+    while(retCode == SBL_SUCCESS && fgets(line, sizeof(line), fp))
+    {
+        int nTokens = 0;
+        char *hash = strchr(line, '#');
+        if(hash)
+            *hash = '\0';
+
+        for(char *tok = strtok(line, " \t\r\n"); tok && nTokens < SBL_CLI_MAX_TOKENS;
+            tok = strtok(NULL, " \t\r\n"))
+            tokens[nTokens++] = tok;
+
+        if(nTokens)
+            retCode = runCliOps(nTokens, tokens);
+    }
+
+    if(fp != stdin)
+        fclose(fp);
+    return (retCode);
+}
+
+/****************************************************************
+ * Function Name : printCliUsage
+ * Description   : Lists the operations
+ * Returns       : None
+ * Params        @None
+ ****************************************************************/
+void printCliUsage(void)
+{
+    printf("Usage: sbl_out [options] <port> <binfile>\n");
+    printf("       sbl_out [options] <port> <op> [args] [<op> [args] ...]\n");
+    printf("       sbl_out [--metrics=<file.prom>] --station=<socket>  (programming station daemon)\n");
+    printf("       sbl_out --scan[=ms] [port ...]                      (who is in the bootloader)\n");
+    printf("Ports: /dev/tty..., tcp:<host>:<port> (raw bridge), loop: (simulated),\n");
+    printf("       replay:<trace>[@speed] (device played back from --trace)\n");
+    printf("Options:\n");
+    printf("  --rx-thread                  drain RX on a dedicated thread\n");
+    printf("  --calibrate[=pings]          measure ping RTT before and after tuning the port\n");
+    printf("  --no-profile                 don't load or save the port's link profile or the unit cache\n");
+    printf("  --trace=<file>               record every byte on the wire, see sbl_tracedump\n");
+    printf("  --timeline=<file.json>       write a Chrome/Perfetto timeline of the session\n");
+    printf("  --metrics=<file.prom>        add the session's counters to a Prometheus textfile\n");
+    printf("  --check-pages[=N]            device CRC of every N written pages (default 1) as they're written\n");
+    printf("  --bl-enter[=seq]             DTR/RTS sequence into the bootloader before autobaud\n");
+    printf("  --bl-release[=seq]           DTR/RTS sequence into the application after reset\n");
+    printf("Operations:\n");
+    for(uint32_t i = 0; i < NUM_OPS; i++)
+        printf("  %s\n", m_ops[i].usage);
+}
+
+/* Look up an operation by name */
+static const tCliOp *findOp(const char *name)
+{
+    for(uint32_t i = 0; i < NUM_OPS; i++)
+    {
+        if(!strcmp(m_ops[i].name, name))
+            return &m_ops[i];
+    }
+    return NULL;
+}
+
+/****************************************************************
+ * Function Name : parseNum
+ * Description   : Parses an address, length or CCFG value: decimal
+ *                 or 0x prefixed hex, no sign, fitting 32 bits
+ * Returns       : true if it is one
+ * Params        @str: The token
+ *               @pVal: Populated with the number
+ ****************************************************************/
+bool parseNum(const char *str, uint32_t *pVal)
+{
+    char *end = NULL;
+    unsigned long val;
+
+    errno = 0;
+    val = strtoul(str, &end, 0);
+    if(!*str || *end || strchr(str, '-') || errno == ERANGE || val > UINT32_MAX)
+    {
+        printf("ERROR: '%s' is not a 32 bit number\n", str);
+        return false;
+    }
+    *pVal = (uint32_t)val;
+    return true;
+}
+
+/* info */
+static tSblStatus opInfo(int argc, char **argv)
+{
+    tSblStatus retCode = SBL_SUCCESS;
+    uint32_t chipId = 0;
+
+    (void)argc;
+    (void)argv;
+    if((retCode = readDeviceId(&chipId)) != SBL_SUCCESS)
+        return (retCode);
+
+    printf("Chip ID:    0x%08X\n", chipId);
+    printf("Flash size: %u\n", getFlashSize());
+    printf("RAM size:   %u\n", getRamSize());
+    printCmdTimeouts();
+    return (SBL_SUCCESS);
+}
+
+/* erase <addr> <len> | erase all */
+static tSblStatus opErase(int argc, char **argv)
+{
+    uint32_t addr, len;
+
+    forgetUnitImage();
+    if(argc == 1 && !strcmp(argv[0], "all"))
+        return eraseFlashBank();
+
+    if(argc != 2 || !parseNum(argv[0], &addr) || !parseNum(argv[1], &len))
+        return (SBL_ARGUMENT_ERROR);
+
+    return eraseFlashRange(addr, len);
+}
+
+/* write <file> [addr] */
+static tSblStatus opWrite(int argc, char **argv)
+{
+    tSblStatus retCode = SBL_SUCCESS;
+    uint32_t addr = getDeviceFlashBase();
+    tPreparedImage image;
+
+    if(argc > 1 && !parseNum(argv[1], &addr))
+        return (SBL_ARGUMENT_ERROR);
+
+    if(loadImage(argv[0], &image) != SBL_SUCCESS)
+        return (SBL_ARGUMENT_ERROR);
+
+    forgetUnitImage();
+    retCode = writeImage(addr, &image);
+    releaseImage(&image);
+    return (retCode);
+}
+
+/* verify <file> [addr] */
+static tSblStatus opVerify(int argc, char **argv)
+{
+    tSblStatus retCode = SBL_SUCCESS;
+    uint32_t addr = getDeviceFlashBase();
+    uint32_t size, fileCrc, devCrc;
+    tPreparedImage image;
+
+    if(argc > 1 && !parseNum(argv[1], &addr))
+        return (SBL_ARGUMENT_ERROR);
+
+    if(loadImage(argv[0], &image) != SBL_SUCCESS)
+        return (SBL_ARGUMENT_ERROR);
+
+    fileCrc = image.crc;
+    size = image.size;
+    releaseImage(&image);
+
+    if((retCode = calculateCrc32(addr, size, &devCrc)) != SBL_SUCCESS)
+        return (retCode);
+
+    if(fileCrc != devCrc)
+    {
+        printf("ERROR: CRC mismatch! fileCrc = %u, devCrc = %u\n", fileCrc, devCrc);
+        return (SBL_ERROR);
+    }
+    printf("CRC OK, devCrc = fileCrc = %u\n", fileCrc);
+    return (SBL_SUCCESS);
+}
+
+/* flash <file> [addr] */
+static tSblStatus opFlash(int argc, char **argv)
+{
+    tSblStatus retCode;
+    uint32_t addr = getDeviceFlashBase();
+    tPreparedImage image;
+    char pcPort[256];
+    uint64_t t0;
+
+    if(argc > 1 && !parseNum(argv[1], &addr))
+        return (SBL_ARGUMENT_ERROR);
+
+    if(loadImage(argv[0], &image) != SBL_SUCCESS)
+        return (SBL_ARGUMENT_ERROR);
+
+    t0 = serialGetTimeUs();
+    retCode = flashImage(addr, &image);
+    serialGetPortId(pcPort, sizeof(pcPort));
+    metricsFlashed(pcPort, retCode == SBL_SUCCESS, image.size, (serialGetTimeUs() - t0) / 1e6);
+    releaseImage(&image);
+    return (retCode);
+}
+
+/* Erase, write and verify of a loaded image */
+static tSblStatus flashImage(uint32_t ui32Addr, const tPreparedImage *pImage)
+{
+    tSblStatus retCode;
+    uint32_t devCrc;
+    bool bDone;
+
+    printf("fileCrc: %u\n", pImage->crc);
+
+    /* A unit flashed before gets the pages that changed */
+    if((retCode = flashUnitDelta(ui32Addr, pImage, &bDone)) != SBL_SUCCESS || bDone)
+        return (retCode);
+    forgetUnitImage();
+
+    printf("Erasing flash ...\n");
+    if((retCode = eraseFlashRange(ui32Addr, pImage->size)) != SBL_SUCCESS)
+    {
+        printf("ERROR: Erase failed\n");
+        return (retCode);
+    }
+    printf("ERASE OK\n");
+
+    printf("Writing flash ...\n");
+    if((retCode = writeImage(ui32Addr, pImage)) != SBL_SUCCESS)
+    {
+        printf("ERROR: Write failed\n");
+        return (retCode);
+    }
+    printf("WRITE OK\n");
+
+    printf("Calculating CRC of flashed content ...\n");
+    if((retCode = calculateCrc32(ui32Addr, pImage->size, &devCrc)) != SBL_SUCCESS)
+    {
+        printf("ERROR: CRC failed\n");
+        return (retCode);
+    }
+
+    if(pImage->crc != devCrc)
+    {
+        printf("ERROR: CRC mismatch!\n");
+        return (SBL_ERROR);
+    }
+    printf("CRC OK, devCrc = fileCrc = %u\n", devCrc);
+    rememberUnitImage(ui32Addr, pImage);
+    return (SBL_SUCCESS);
+}
+
+/* Reflash of a unit whose last image is cached: one CRC32 over what
+ * it should hold, then only the pages whose CRC differs are erased
+ * and programmed. *pbDone stays false (flash it all) if the unit is
+ * new, its flash isn't that image any more or the image doesn't
+ * start on a page. */
+static tSblStatus flashUnitDelta(uint32_t ui32Addr, const tPreparedImage *pImage, bool *pbDone)
+{
+    tSblStatus retCode = SBL_SUCCESS;
+    uint32_t devCrc, changed = 0;
+
+    *pbDone = false;
+    if(!m_pUnit || !m_pUnit->imageSize || m_pUnit->imageAddr != ui32Addr ||
+       ui32Addr % SBL_CC2650_PAGE_ERASE_SIZE)
+        return (SBL_SUCCESS);
+
+    if((retCode = calculateCrc32(ui32Addr, m_pUnit->imageSize, &devCrc)) != SBL_SUCCESS)
+        return (retCode);
+    if(devCrc != m_pUnit->imageCrc)
+    {
+        printf("Unit flash changed since its last image, flashing all of it\n");
+        return (SBL_SUCCESS);
+    }
+    *pbDone = true;
+
+    retCode = reflashChangedPages(ui32Addr, pImage, m_pUnit->imageSize, m_pUnit->pageCrc,
+                                  m_pUnit->numPages, &changed);
+    if(retCode == SBL_SUCCESS && (changed || pImage->size != m_pUnit->imageSize))
+        retCode = calculateCrc32(ui32Addr, pImage->size, &devCrc);
+    if(retCode == SBL_SUCCESS && devCrc != pImage->crc)
+    {
+        printf("ERROR: CRC mismatch!\n");
+        retCode = SBL_ERROR;
+    }
+    if(retCode != SBL_SUCCESS)
+    {
+        forgetUnitImage();
+        return (retCode);
+    }
+    printf("Known unit: %u of %u pages reflashed, CRC OK, devCrc = fileCrc = %u\n",
+           changed, pImage->numPages, devCrc);
+    rememberUnitImage(ui32Addr, pImage);
+    return (SBL_SUCCESS);
+}
+
+/* Erases and programs the runs of pages of an image whose length or
+ * CRC differs from the image the device holds (ui32OldSize bytes,
+ * its page CRCs). No verify. *pui32Changed counts the pages. Image
+ * pages must be device pages: ui32Addr on a page boundary. */
+static tSblStatus reflashChangedPages(uint32_t ui32Addr, const tPreparedImage *pImage,
+                                      uint32_t ui32OldSize, const uint32_t *pui32OldPageCrc,
+                                      uint32_t ui32OldPages, uint32_t *pui32Changed)
+{
+    tSblStatus retCode = SBL_SUCCESS;
+
+    *pui32Changed = 0;
+    if(ui32Addr % SBL_CC2650_PAGE_ERASE_SIZE)
+        return (SBL_ARGUMENT_ERROR);
+
+    /* Runs of changed pages: erase, program their non-blank part */
+    for(uint32_t p = 0, run = 0; p <= pImage->numPages && retCode == SBL_SUCCESS; p++)
+    {
+        uint32_t runOff = run * SBL_IMAGE_PAGE_SIZE, runEnd = MIN(p * SBL_IMAGE_PAGE_SIZE, pImage->size);
+
+        if(p < pImage->numPages &&
+           !pageUnchanged(pImage, p, ui32OldSize, pui32OldPageCrc, ui32OldPages))
+            continue;
+        if(run < p)
+        {
+            *pui32Changed += p - run;
+            printf("Reflashing pages %u-%u ...\n", run, p - 1);
+            retCode = eraseFlashRange(ui32Addr + runOff, runEnd - runOff);
+            for(uint32_t i = 0; i < pImage->numSegments && retCode == SBL_SUCCESS; i++)
+            {
+                const tImageSegment *pSeg = &pImage->pSegments[i];
+                uint32_t from = MAX(pSeg->offset, runOff), to = MIN(pSeg->offset + pSeg->len, runEnd);
+                if(from < to)
+                    retCode = writeSpan(ui32Addr + from, to - from, &pImage->pData[from],
+                                        &pImage->pPageCrc[from / SBL_IMAGE_PAGE_SIZE]);
+            }
+        }
+        run = p + 1;
+    }
+    return (retCode);
+}
+
+/* The old image's page has the new image's length and CRC */
+static bool pageUnchanged(const tPreparedImage *pImage, uint32_t ui32Page, uint32_t ui32OldSize,
+                          const uint32_t *pui32OldPageCrc, uint32_t ui32OldPages)
+{
+    uint32_t off = ui32Page * SBL_IMAGE_PAGE_SIZE;
+
+    return (ui32Page < ui32OldPages &&
+            MIN(SBL_IMAGE_PAGE_SIZE, ui32OldSize - off) == MIN(SBL_IMAGE_PAGE_SIZE, pImage->size - off) &&
+            pui32OldPageCrc[ui32Page] == pImage->pPageCrc[ui32Page]);
+}
+
+/* The unit holds this image now. Off a page boundary its pages
+ * can't be reflashed on their own, the next flash is a full one. */
+static void rememberUnitImage(uint32_t ui32Addr, const tPreparedImage *pImage)
+{
+    if(!m_pUnit)
+        return;
+    if(pImage->numPages > SBL_UNIT_MAX_PAGES || ui32Addr % SBL_CC2650_PAGE_ERASE_SIZE)
+    {
+        forgetUnitImage();
+        return;
+    }
+    m_pUnit->imageAddr = ui32Addr;
+    m_pUnit->imageSize = pImage->size;
+    m_pUnit->imageCrc = pImage->crc;
+    m_pUnit->numPages = pImage->numPages;
+    memcpy(m_pUnit->pageCrc, pImage->pPageCrc, pImage->numPages * sizeof(uint32_t));
+}
+
+/* Flash changes by other means than flashImage() */
+static void forgetUnitImage(void)
+{
+    if(!m_pUnit)
+        return;
+    m_pUnit->imageSize = 0;
+    m_pUnit->numPages = 0;
+}
+
+/* prepareImage(), which is host time on the timeline, unless the
+ * helper thread did it already */
+static tSblStatus loadImage(const char *pcPath, tPreparedImage *pImage)
+{
+    uint64_t t0;
+    tSblStatus retCode;
+
+    joinPrefetch();
+    for(uint32_t i = 0; i < m_numPrefetch; i++)
+    {
+        tCliPrefetch *pPre = &m_prefetch[i];
+        if(pPre->bTaken || strcmp(pPre->pcPath, pcPath))
+            continue;
+
+        pPre->bTaken = true;
+        *pImage = pPre->image;
+        timelineSpanAt(TL_CALLS, "prepareImage (helper)", pPre->startUs, pPre->endUs, "bytes",
+                       (pPre->retCode == SBL_SUCCESS) ? pImage->size : 0);
+        return (pPre->retCode);
+    }
+
+    t0 = timelineNow();
+    retCode = prepareImage(pcPath, pImage);
+    timelineSpan(TL_CALLS, "prepareImage", t0, "bytes", (retCode == SBL_SUCCESS) ? pImage->size : 0);
+    return (retCode);
+}
+
+#ifndef SBL_SMALL
+/* Helper thread, prepares the images in command line order. Touches
+ * nothing but its slots until joined. */
+static void *prefetchMain(void *arg)
+{
+    uint64_t startUs = serialGetTimeUs();
+
+    (void)arg;
+    for(uint32_t i = 0; i < m_numPrefetch; i++)
+    {
+        tCliPrefetch *pPre = &m_prefetch[i];
+        pPre->startUs = timelineNow();
+        pPre->retCode = prepareImage(pPre->pcPath, &pPre->image);
+        pPre->endUs = timelineNow();
+    }
+    m_prefetchUs = serialGetTimeUs() - startUs;
+    return (NULL);
+}
+#endif
+
+/* Joins the helper thread once, telling how much of its work hid
+ * behind the port setup and handshake */
+static void joinPrefetch(void)
+{
+    uint64_t t0, tl0, waitUs;
+
+    if(!m_bPrefetching)
+        return;
+    m_bPrefetching = false;
+
+    t0 = serialGetTimeUs();
+    tl0 = timelineNow();
+    pthread_join(m_prefetchThread, NULL);
+    waitUs = serialGetTimeUs() - t0;
+    timelineSpan(TL_SESSION, "wait for images", tl0, NULL, 0);
+    printf("Images prepared in %.1f ms on a helper thread, %.1f ms of it hidden behind the handshake\n",
+           m_prefetchUs / 1000.0, (m_prefetchUs > waitUs) ? (m_prefetchUs - waitUs) / 1000.0 : 0.0);
+}
+
+/* Programs the non-blank segments of an image, 0xFF pages are left
+ * as they are (programming 1s never changes a flash bit) */
+static tSblStatus writeImage(uint32_t ui32Addr, const tPreparedImage *pImage)
+{
+    tSblStatus retCode = SBL_SUCCESS;
+
+    for(uint32_t i = 0; i < pImage->numSegments && retCode == SBL_SUCCESS; i++)
+    {
+        const tImageSegment *pSeg = &pImage->pSegments[i];
+        retCode = writeSpan(ui32Addr + pSeg->offset, pSeg->len, &pImage->pData[pSeg->offset],
+                            &pImage->pPageCrc[pSeg->offset / SBL_IMAGE_PAGE_SIZE]);
+    }
+    return (retCode);
+}
+
+/* One writeFlashRange(), CRC checked as --check-pages asks. Page
+ * CRCs may be NULL (computed then), e.g. for patched pages. */
+static tSblStatus writeSpan(uint32_t ui32Addr, uint32_t ui32Len, const uint8_t *pData,
+                            const uint32_t *pui32PageCrc)
+{
+    if(m_pagesPerCheck)
+        return writeFlashRangeChecked(ui32Addr, ui32Len, (const char*)pData, pui32PageCrc,
+                                      m_pagesPerCheck);
+    return writeFlashRange(ui32Addr, ui32Len, (const char*)pData);
+}
+
+/* read <addr> <len> <outfile>, a page at a time */
+static tSblStatus opRead(int argc, char **argv)
+{
+    static uint8_t buf[SBL_CC2650_PAGE_ERASE_SIZE];
+    tSblStatus retCode = SBL_SUCCESS;
+    uint32_t addr, len;
+    FILE *fp = NULL;
+
+    (void)argc;
+    if(!parseNum(argv[0], &addr) || !parseNum(argv[1], &len) || !len)
+        return (SBL_ARGUMENT_ERROR);
+
+    if((fp = fopen(argv[2], "wb")) == NULL)
+    {
+        printf("ERROR: writing %s\n", argv[2]);
+        return (SBL_ERROR);
+    }
+
+    for(uint32_t off = 0; off < len && retCode == SBL_SUCCESS; off += sizeof(buf))
+    {
+        uint32_t n = MIN(len - off, sizeof(buf));
+
+        if((retCode = readMemory8(addr + off, n, buf)) == SBL_SUCCESS &&
+           fwrite(buf, 1, n, fp) != n)
+        {
+            printf("ERROR: writing %s\n", argv[2]);
+            retCode = SBL_ERROR;
+        }
+    }
+
+    fclose(fp);
+    if(retCode != SBL_SUCCESS)
+        unlink(argv[2]);
+    return (retCode);
+}
+
+/* crc <addr> <len> */
+static tSblStatus opCrc(int argc, char **argv)
+{
+    tSblStatus retCode = SBL_SUCCESS;
+    uint32_t addr, len, devCrc;
+
+    (void)argc;
+    if(!parseNum(argv[0], &addr) || !parseNum(argv[1], &len))
+        return (SBL_ARGUMENT_ERROR);
+
+    if((retCode = calculateCrc32(addr, len, &devCrc)) != SBL_SUCCESS)
+        return (retCode);
+
+    printf("devCrc: %u (0x%08X)\n", devCrc, devCrc);
+    return (SBL_SUCCESS);
+}
+
+/* update <addr> <hex|@file> [<addr> <hex|@file> ...] */
+static tSblStatus opUpdate(int argc, char **argv)
+{
+    tFlashPatch patches[SBL_CLI_MAX_PATCHES] = { { 0 } };
+    tSblStatus retCode = SBL_SUCCESS;
+    uint32_t numPatches = 0;
+
+    if(argc % 2)
+    {
+        printf("ERROR: update takes address/bytes pairs\n");
+        return (SBL_ARGUMENT_ERROR);
+    }
+
+    for(int i = 0; i < argc && retCode == SBL_SUCCESS; i += 2)
+    {
+        tFlashPatch *pPatch = &patches[numPatches];
+        if(!parseNum(argv[i], &pPatch->addr) ||
+           !(pPatch->pData = parseBytes(argv[i + 1], &pPatch->len)))
+            retCode = SBL_ARGUMENT_ERROR;
+        else
+            numPatches++;
+    }
+
+    if(retCode == SBL_SUCCESS)
+    {
+        forgetUnitImage();
+        retCode = updateFlashRegion(patches, numPatches);
+    }
+
+    m_patchUsed = 0;
+    return (retCode);
+}
+
+/* layout <file>: erases the pages of its erase and program ranges
+ * (never a kept one), programs and verifies each program range */
+static tSblStatus opLayout(int argc, char **argv)
+{
+    static tFlashLayout layout;
+    tPreparedImage images[SBL_LAYOUT_MAX_ENTRIES];
+    bool pbErase[SBL_LAYOUT_MAX_PAGES];
+    tSblStatus retCode;
+    uint32_t numLoaded = 0, numPages = getFlashSize() / SBL_CC2650_PAGE_ERASE_SIZE;
+    uint32_t erased = 0, kept = 0;
+
+    (void)argc;
+    if((retCode = parseLayout(argv[0], &layout)) != SBL_SUCCESS)
+        return (retCode);
+
+    for(uint32_t i = 0; i < layout.numEntries && retCode == SBL_SUCCESS; i++)
+    {
+        tLayoutEntry *pEntry = &layout.entries[i];
+        if(pEntry->kind != LAYOUT_PROGRAM)
+            continue;
+        if((retCode = loadImage(pEntry->path, &images[i])) != SBL_SUCCESS)
+            break;
+        pEntry->len = images[i].size;
+        numLoaded = i + 1;
+    }
+    if(retCode == SBL_SUCCESS)
+        retCode = planLayoutErase(&layout, getFlashSize(), pbErase);
+    if(retCode == SBL_SUCCESS)
+        forgetUnitImage();
+
+    /* Erase runs of pages, one command sequence each */
+    for(uint32_t p = 0; p < numPages && retCode == SBL_SUCCESS; )
+    {
+        uint32_t end = p;
+        while(end < numPages && pbErase[end])
+            end++;
+        if(end == p)
+        {
+            p++;
+            continue;
+        }
+        printf("Erasing pages %u-%u ...\n", p, end - 1);
+        retCode = eraseFlashRange(SBL_CC2650_FLASH_START_ADDRESS + p * SBL_CC2650_PAGE_ERASE_SIZE,
+                                  (end - p) * SBL_CC2650_PAGE_ERASE_SIZE);
+        erased += end - p;
+        p = end;
+    }
+
+    for(uint32_t i = 0; i < layout.numEntries && retCode == SBL_SUCCESS; i++)
+    {
+        const tLayoutEntry *pEntry = &layout.entries[i];
+        uint32_t devCrc;
+
+        if(pEntry->kind == LAYOUT_KEEP)
+        {
+            kept += (pEntry->addr % SBL_CC2650_PAGE_ERASE_SIZE + pEntry->len +
+                     SBL_CC2650_PAGE_ERASE_SIZE - 1) / SBL_CC2650_PAGE_ERASE_SIZE;
+            continue;
+        }
+        if(pEntry->kind != LAYOUT_PROGRAM)
+            continue;
+
+        printf("Programming %s at 0x%08X ...\n", pEntry->path, pEntry->addr);
+        if((retCode = writeImage(pEntry->addr, &images[i])) != SBL_SUCCESS ||
+           (retCode = calculateCrc32(pEntry->addr, images[i].size, &devCrc)) != SBL_SUCCESS)
+            break;
+        if(devCrc != images[i].crc)
+        {
+            printf("ERROR: CRC mismatch for %s at 0x%08X\n", pEntry->path, pEntry->addr);
+            retCode = SBL_ERROR;
+        }
+    }
+    if(retCode == SBL_SUCCESS)
+        printf("Layout: %u pages erased, %u kept untouched\n", erased, kept);
+
+    for(uint32_t i = 0; i < numLoaded; i++)
+    {
+        if(layout.entries[i].kind == LAYOUT_PROGRAM)
+            releaseImage(&images[i]);
+    }
+    return (retCode);
+}
+
+/* personalize <file> <patches> [addr]: the golden image with this
+ * unit's patches (serial number, keys, calibration) applied on the
+ * way to the device. Untouched pages go straight from the image, only
+ * patched pages are copied; the expected CRC comes from the image's
+ * CRC and the patches alone, so host work per unit is the patches. */
+static tSblStatus opPersonalize(int argc, char **argv)
+{
+    static tImagePatch patches[SBL_CLI_MAX_UNIT_PATCHES];
+    static uint8_t pcPage[SBL_IMAGE_PAGE_SIZE];
+    tSblStatus retCode;
+    tPreparedImage image;
+    uint32_t addr = getDeviceFlashBase(), numPatches = 0, patchedBytes = 0;
+    uint32_t expectedCrc = 0, devCrc, run = 0, runLen = 0;
+    uint64_t t0;
+
+    if(argc > 2 && !parseNum(argv[2], &addr))
+        return (SBL_ARGUMENT_ERROR);
+    if(loadImage(argv[0], &image) != SBL_SUCCESS)
+        return (SBL_ARGUMENT_ERROR);
+
+    t0 = serialGetTimeUs();
+    if((retCode = parsePatchTable(argv[1], patches, &numPatches)) != SBL_SUCCESS ||
+       (retCode = imagePatchedCrc(&image, patches, numPatches, &expectedCrc)) != SBL_SUCCESS)
+        goto done;
+    for(uint32_t i = 0; i < numPatches; i++)
+        patchedBytes += patches[i].len;
+    printf("%u patches, %u bytes, expected CRC 0x%08X (golden 0x%08X) in %.1f us\n",
+           numPatches, patchedBytes, expectedCrc, image.crc, (double)(serialGetTimeUs() - t0));
+
+    forgetUnitImage();
+    printf("Erasing flash ...\n");
+    if((retCode = eraseFlashRange(addr, image.size)) != SBL_SUCCESS)
+        goto done;
+
+    /* Runs of untouched pages from the image, patched pages one by one */
+    printf("Writing flash ...\n");
+    for(uint32_t p = 0; p <= image.numPages && retCode == SBL_SUCCESS; p++)
+    {
+        uint32_t off = p * SBL_IMAGE_PAGE_SIZE;
+        uint32_t len = (p < image.numPages) ? MIN(SBL_IMAGE_PAGE_SIZE, image.size - off) : 0;
+        bool bPatched = false, bBlank = true;
+
+        for(uint32_t i = 0; i < numPatches && len; i++)
+        {
+            const tImagePatch *pPatch = &patches[i];
+            if(pPatch->offset >= off + len || pPatch->offset + pPatch->len <= off)
+                continue;
+            if(!bPatched)
+                memcpy(pcPage, &image.pData[off], len);
+            bPatched = true;
+            uint32_t from = MAX(pPatch->offset, off), to = MIN(pPatch->offset + pPatch->len, off + len);
+            memcpy(&pcPage[from - off], &pPatch->pData[from - pPatch->offset], to - from);
+        }
+
+        if(len && !bPatched && !imagePageBlank(&image, p))
+        {
+            if(!runLen)
+                run = off;
+            runLen += len;
+            continue;
+        }
+        if(runLen)
+            retCode = writeSpan(addr + run, runLen, &image.pData[run],
+                                &image.pPageCrc[run / SBL_IMAGE_PAGE_SIZE]);
+        runLen = 0;
+
+        for(uint32_t i = 0; bPatched && i < len && bBlank; i++)
+            bBlank = (pcPage[i] == 0xFF);
+        if(bPatched && !bBlank && retCode == SBL_SUCCESS)
+            retCode = writeSpan(addr + off, len, pcPage, NULL);
+    }
+    if(retCode != SBL_SUCCESS)
+        goto done;
+
+    if((retCode = calculateCrc32(addr, image.size, &devCrc)) != SBL_SUCCESS)
+        goto done;
+    if(devCrc != expectedCrc)
+    {
+        printf("ERROR: CRC mismatch, device 0x%08X, expected 0x%08X\n", devCrc, expectedCrc);
+        retCode = SBL_ERROR;
+    }
+    else
+        printf("CRC OK, devCrc = patched image CRC = %u\n", devCrc);
+
+done:
+    m_patchUsed = 0;
+    releaseImage(&image);
+    return (retCode);
+}
+
+/* A unit's patch table, one "<offset> <hex|@file>" per line with the
+ * offset from the image start, '#' starts a comment */
+static tSblStatus parsePatchTable(const char *pcPath, tImagePatch *pPatches, uint32_t *pNum)
+{
+    tSblStatus retCode = SBL_SUCCESS;
+    char line[PATH_MAX + 64];
+    uint32_t lineNo = 0;
+    FILE *fp;
+
+    *pNum = 0;
+    if(!(fp = fopen(pcPath, "r")))
+    {
+        printf("ERROR: opening patch table %s\n", pcPath);
+        return (SBL_ARGUMENT_ERROR);
+    }
+
+    while(retCode == SBL_SUCCESS && fgets(line, sizeof(line), fp))
+    {
+        char *pcOff, *pcBytes, *hash = strchr(line, '#');
+        tImagePatch *pPatch = &pPatches[*pNum];
+
+        lineNo++;
+        if(hash)
+            *hash = '\0';
+        if(!(pcOff = strtok(line, " \t\r\n")))
+            continue;
+        pcBytes = strtok(NULL, " \t\r\n");
+
+        if(*pNum == SBL_CLI_MAX_UNIT_PATCHES)
+        {
+            printf("ERROR: %s:%u: more than %d patches\n", pcPath, lineNo, SBL_CLI_MAX_UNIT_PATCHES);
+            retCode = SBL_ARGUMENT_ERROR;
+        }
+        else if(!pcBytes || strtok(NULL, " \t\r\n") || !parseNum(pcOff, &pPatch->offset))
+        {
+            printf("ERROR: %s:%u: expected '<offset> <hex|@file>'\n", pcPath, lineNo);
+            retCode = SBL_ARGUMENT_ERROR;
+        }
+        else if(!(pPatch->pData = parseBytes(pcBytes, &pPatch->len)))
+            retCode = SBL_ARGUMENT_ERROR;
+        else
+            (*pNum)++;
+    }
+
+    fclose(fp);
+    return (retCode);
+}
+
+/* Bytes of an update: hex digits in memory order ("c5ff0102"), or
+ * the contents of a file ("@cal.bin"). Taken from m_patchBytes. */
+static uint8_t *parseBytes(const char *str, uint32_t *pLen)
+{
+    uint32_t numDigits = strlen(str), room = sizeof(m_patchBytes) - m_patchUsed;
+    uint8_t *buf = &m_patchBytes[m_patchUsed];
+
+    if(str[0] == '@')
+    {
+        if(!readFile(&str[1], buf, room, pLen))
+            return (NULL);
+        m_patchUsed += *pLen;
+        return (buf);
+    }
+
+    if(!numDigits || numDigits % 2 || strspn(str, "0123456789abcdefABCDEF") != numDigits)
+    {
+        printf("ERROR: '%s' is not hex bytes\n", str);
+        return (NULL);
+    }
+    if(numDigits / 2 > room)
+    {
+        printf("ERROR: patches larger than %u bytes\n", (uint32_t)sizeof(m_patchBytes));
+        return (NULL);
+    }
+    for(uint32_t i = 0; i < numDigits / 2; i++)
+    {
+        char pcByte[3] = { str[2*i], str[2*i + 1], '\0' };
+        buf[i] = (uint8_t)strtoul(pcByte, NULL, 16);
+    }
+    *pLen = numDigits / 2;
+    m_patchUsed += *pLen;
+    return (buf);
+}
+
+/* ccfg <field> <value> */
+static tSblStatus opCcfg(int argc, char **argv)
+{
+    uint32_t field, value;
+
+    (void)argc;
+    if(!parseNum(argv[0], &field) || !parseNum(argv[1], &value))
+        return (SBL_ARGUMENT_ERROR);
+
+    forgetUnitImage();
+    return setCCFG(field, value);
+}
+
+/* watch <file> [addr]: flashes the file, then keeps the session and
+ * reflashes the pages that changed each time the file is rewritten,
+ * until SIGINT/SIGTERM. The directory is watched, builds often
+ * replace the file rather than rewrite it. */
+static tSblStatus opWatch(int argc, char **argv)
+{
+    tSblStatus retCode;
+    uint32_t addr = getDeviceFlashBase(), changes = 0;
+    tPreparedImage last;
+    char pcDirBuf[PATH_MAX], pcNameBuf[PATH_MAX];
+    const char *pcDir, *pcName;
+    int inotifyFd, signalFd;
+    struct signalfd_siginfo sigInfo;
+    sigset_t sigs, oldSigs;
+    uint64_t changeUs = 0;
+
+    if(argc > 1 && !parseNum(argv[1], &addr))
+        return (SBL_ARGUMENT_ERROR);
+
+    snprintf(pcDirBuf, sizeof(pcDirBuf), "%s", argv[0]);
+    snprintf(pcNameBuf, sizeof(pcNameBuf), "%s", argv[0]);
+    pcDir = dirname(pcDirBuf);
+    pcName = basename(pcNameBuf);
+
+    /* Watching before the first flash, a rebuild meanwhile counts */
+    if((inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0 ||
+       inotify_add_watch(inotifyFd, pcDir, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0)
+    {
+        perror("Watch: ERROR WATCHING DIRECTORY |");
+        if(inotifyFd >= 0)
+            close(inotifyFd);
+        return (SBL_ARGUMENT_ERROR);
+    }
+
+    /* Ctrl-C ends the watch, the ops after it still run. Blocked
+     * before the first flash, which a Ctrl-C lets finish. */
+    sigemptyset(&sigs);
+    sigaddset(&sigs, SIGINT);
+    sigaddset(&sigs, SIGTERM);
+    sigprocmask(SIG_BLOCK, &sigs, &oldSigs);
+    if((signalFd = signalfd(-1, &sigs, SFD_NONBLOCK | SFD_CLOEXEC)) < 0)
+    {
+        perror("Watch: ERROR CREATING SIGNALFD |");
+        sigprocmask(SIG_SETMASK, &oldSigs, NULL);
+        close(inotifyFd);
+        return (SBL_ERROR);
+    }
+
+    memset(&last, 0, sizeof(last));
+    if(loadImage(argv[0], &last) != SBL_SUCCESS)
+        retCode = SBL_ARGUMENT_ERROR;
+    else if((retCode = flashImage(addr, &last)) == SBL_SUCCESS)
+    {
+        printf("Watching %s, Ctrl-C to stop\n", argv[0]);
+        while(waitFileChange(inotifyFd, signalFd, pcName, &changeUs))
+        {
+            printf("Change %u: %s\n", ++changes, argv[0]);
+            if((retCode = watchReflash(addr, argv[0], &last, changeUs)) != SBL_SUCCESS)
+                printf("ERROR: change %u not flashed (%d), waiting for the next one\n", changes, retCode);
+        }
+        printf("Watch ended after %u changes\n", changes);
+        retCode = SBL_SUCCESS;
+    }
+
+    /* A Ctrl-C not taken by the watch is dropped with it */
+    while(read(signalFd, &sigInfo, sizeof(sigInfo)) == sizeof(sigInfo))
+        ;
+    close(signalFd);
+    sigprocmask(SIG_SETMASK, &oldSigs, NULL);
+    close(inotifyFd);
+    releaseImage(&last);
+    return (retCode);
+}
+
+/* One change: the new image against *pLast page by page, only the
+ * pages that differ go to the device, then the whole image is
+ * verified; a device that didn't hold *pLast any more is flashed in
+ * full. *pLast becomes the new image if it made it, or is cleared
+ * (next change flashes everything) if the device is in an unknown
+ * state. */
+static tSblStatus watchReflash(uint32_t ui32Addr, const char *pcPath, tPreparedImage *pLast,
+                               uint64_t ui64ChangeUs)
+{
+    tSblStatus retCode;
+    tPreparedImage image;
+    uint32_t devCrc, changed = 0;
+    uint64_t startUs = serialGetTimeUs(), preparedUs, writtenUs, t0 = timelineNow();
+    /* Off a page boundary image pages aren't device pages, only a
+     * full flash keeps the pages around a change */
+    bool bFull = !pLast->size || ui32Addr % SBL_CC2650_PAGE_ERASE_SIZE;
+    char pcPort[256];
+
+    /* The file may be mid-rewrite, the next event brings it back */
+    if(prepareImage(pcPath, &image) != SBL_SUCCESS)
+        return (SBL_ARGUMENT_ERROR);
+    preparedUs = serialGetTimeUs();
+
+    if(pLast->size && image.size == pLast->size && image.crc == pLast->crc)
+    {
+        printf("Image unchanged (crc %08X), nothing to flash\n", image.crc);
+        releaseImage(&image);
+        return (SBL_SUCCESS);
+    }
+
+    if(!bFull)
+    {
+        retCode = reflashChangedPages(ui32Addr, &image, pLast->size, pLast->pPageCrc,
+                                      pLast->numPages, &changed);
+        if(retCode == SBL_SUCCESS &&
+           (retCode = calculateCrc32(ui32Addr, image.size, &devCrc)) == SBL_SUCCESS &&
+           devCrc != image.crc)
+        {
+            /* Something else wrote the device meanwhile */
+            printf("Device doesn't hold the last image, flashing all of it\n");
+            bFull = true;
+        }
+    }
+    if(bFull)
+    {
+        changed = image.numPages;
+        if((retCode = eraseFlashRange(ui32Addr, image.size)) == SBL_SUCCESS &&
+           (retCode = writeImage(ui32Addr, &image)) == SBL_SUCCESS &&
+           (retCode = calculateCrc32(ui32Addr, image.size, &devCrc)) == SBL_SUCCESS &&
+           devCrc != image.crc)
+        {
+            printf("ERROR: CRC mismatch!\n");
+            retCode = SBL_ERROR;
+        }
+    }
+    writtenUs = serialGetTimeUs();
+
+    releaseImage(pLast);
+    memset(pLast, 0, sizeof(*pLast));
+    forgetUnitImage();
+    serialGetPortId(pcPort, sizeof(pcPort));
+    metricsFlashed(pcPort, retCode == SBL_SUCCESS, image.size, (serialGetTimeUs() - preparedUs) / 1e6);
+    timelineSpan(TL_SESSION, "watch reflash", t0, "pages", changed);
+    if(retCode != SBL_SUCCESS)
+    {
+        releaseImage(&image);
+        return (retCode);
+    }
+
+    printf("%u of %u pages reflashed, CRC OK (%08X), %.1f ms from file change to device "
+           "(settle %.1f, prepare %.1f, program and verify %.1f)\n",
+           changed, image.numPages, devCrc, (writtenUs - ui64ChangeUs) / 1000.0,
+           (startUs - ui64ChangeUs) / 1000.0, (preparedUs - startUs) / 1000.0,
+           (writtenUs - preparedUs) / 1000.0);
+    rememberUnitImage(ui32Addr, &image);
+    *pLast = image;
+    return (SBL_SUCCESS);
+}
+
+/* Waits until the file named pcName in the watched directory was
+ * written and left alone for CLI_WATCH_SETTLE_MS. *pui64ChangeUs is
+ * the time of its first event. false on a signal. */
+static bool waitFileChange(int inotifyFd, int signalFd, const char *pcName, uint64_t *pui64ChangeUs)
+{
+    struct pollfd fds[2] = {
+        { .fd = inotifyFd, .events = POLLIN },
+        { .fd = signalFd, .events = POLLIN },
+    };
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    bool bChanged = false;
+
+    for(;;)
+    {
+        ssize_t len;
+
+        if(poll(fds, 2, (bChanged) ? CLI_WATCH_SETTLE_MS : -1) == 0)
+            return (true);
+        if(fds[1].revents)
+            return (false);
+
+        while((len = read(inotifyFd, buf, sizeof(buf))) > 0)
+        {
+            for(char *p = buf; p < buf + len; )
+            {
+                const struct inotify_event *pEv = (const struct inotify_event*)p;
+                if(pEv->len && !strcmp(pEv->name, pcName) && !bChanged)
+                {
+                    bChanged = true;
+                    *pui64ChangeUs = serialGetTimeUs();
+                }
+                p += sizeof(*pEv) + pEv->len;
+            }
+        }
+    }
+}
+
+/* reset */
+static tSblStatus opReset(int argc, char **argv)
+{
+    tSblStatus retCode;
+
+    (void)argc;
+    (void)argv;
+    retCode = reset();
+    if(retCode == SBL_SUCCESS)
+    {
+        m_bSessionReset = true;
+        retCode = linesRelease();
+    }
+    return (retCode);
+}
+
+/* script <file|->, a script may run scripts SBL_CLI_MAX_SCRIPT_DEPTH
+ * deep, so one running itself fails instead of running out of stack */
+static tSblStatus opScript(int argc, char **argv)
+{
+    tSblStatus retCode;
+
+    (void)argc;
+    if(m_scriptDepth == SBL_CLI_MAX_SCRIPT_DEPTH)
+    {
+        printf("ERROR: scripts nested more than %d deep\n", SBL_CLI_MAX_SCRIPT_DEPTH);
+        return (SBL_ARGUMENT_ERROR);
+    }
+    m_scriptDepth++;
+    retCode = runCliScript(argv[0]);
+    m_scriptDepth--;
+    return (retCode);
+}
@@ -0,0 +1,35 @@
+/*
+ * sbl_cli.h
+ *
+ *  Created on: 18/10/2026
+ */
+
+#ifndef SBL_CLI_H_
+#define SBL_CLI_H_
+#include <stdbool.h>
+#include <stdint.h>
+#include "sbl_device.h"
+#include "sbl_unit.h"
+
+/* Max tokens on one script line */
+#define SBL_CLI_MAX_TOKENS      16
+/* Address/bytes pairs one update takes */
+#define SBL_CLI_MAX_PATCHES     8
+/* Lines of one personalize patch table */
+#define SBL_CLI_MAX_UNIT_PATCHES 64
+/* Distinct images prepared ahead of the session */
+#define SBL_CLI_MAX_PREFETCH    8
+/* Scripts running scripts, deepest nesting */
+#define SBL_CLI_MAX_SCRIPT_DEPTH 8
+
+extern bool isCliOp(const char *name);
+extern bool parseNum(const char *str, uint32_t *pVal);
+extern void cliSetPageCheck(uint32_t ui32Pages);
+extern void cliSetUnit(tUnitState *pUnit);
+extern void cliPrefetchImages(int argc, char **argv);
+extern void cliFinishPrefetch(void);
+extern tSblStatus runCliOps(int argc, char **argv);
+extern tSblStatus runCliScript(const char *path);
+extern void printCliUsage(void);
+
+#endif /* SBL_CLI_H_ */
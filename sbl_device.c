@@ -18,6 +18,7 @@ static tProgressFPTR    sm_pProgressFunction;
 static tStatusFPTR      sm_pStatusFunction;
 static  void appStatus(char *pcText, bool bError);
 static  void appProgress(uint32_t progress);
+static uint32_t crcMultModP(uint32_t a, uint32_t b);
 
 /* Application callback - 1 */
 static void setCallBackStatusFunction(tStatusFPTR pSf)
@@ -32,255 +33,148 @@ static void setCallBackProgressFunction(tProgressFPTR pPf)
 }
 
 /****************************************************************
- * Function Name : getCmdResponse
- * Description   : Get ACK/NAK from the boot loader.
- * Returns       : Returns SBL_SUCCESS, ...
- * Params        @bAck: True if response is ACK, false if response
- *                      is NAK.
- *               @maxRetries: How many times ComPort::
- *               readBytes() can time out before fail is issued.
+ * Function Name : generateCheckSum
+ * Description   : This function generates the bootloader protocol
+ *                 checksum.
+ * Returns       : Returns the generated checksum.
+ * Params        @ui32Cmd: The bootloader command
+ *               @pcData: Pointer to the command data.
+ *               @ui32DataLen: Data length in bytes.
  ****************************************************************/
-tSblStatus getCmdResponse(bool *bAck, uint8_t maxRetries)
+uint8_t generateCheckSum(cmd_t cmdType, const char *pcData,
+                               uint32_t ui32DataLen)
 {
-    uint8_t pIn[2];
-    memset(pIn, 0, 2);
-    *bAck = false;
-    uint32_t bytesRecv = 0;
-
-    if(get_filed() < 0)
-        return (SBL_PORT_ERROR);
-
-    /* Expect 2 bytes */
-    bytesRecv = serialRead(pIn, 2);
-
-    if(bytesRecv < 2)
-        return (SBL_TIMEOUT_ERROR);
-    else
+    uint8_t ui8CheckSum = cmdType;
+    for(uint32_t i = 0; i < ui32DataLen; i++)
     {
-        if(pIn[0] == 0x00 && pIn[1] == 0xCC)
-        {
-            *bAck = true;
-            //printf("ACK received 0x%02X 0x%02X.\n", pIn[0], pIn[1]);
-            return (SBL_SUCCESS);
-        }
-        else if(pIn[0] == 0x00 && pIn[1] == 0x33)
-        {
-            printf("NACK received 0x%02X 0x%02X.\n", pIn[0], pIn[1]);
-            return (SBL_SUCCESS);
-        }
-        else
-        {
-            printf("ACK/NAK not received. Expected 0x00 0xCC or 0x00 0x33, received 0x%02X 0x%02X.\n", pIn[0], pIn[1]);
-            return SBL_ERROR;
-        }
+        ui8CheckSum += pcData[i];
     }
+    return ui8CheckSum;
 }
 
-/****************************************************************
- * Function Name : sendAutoBaud
- * Description   : Send auto baud.
- * Returns       : Returns SBL_SUCCESS, ...
- * Params        @bBaudSetOk: True if response is ACK, false otherwise
- ****************************************************************/
-tSblStatus sendAutoBaud(bool *bBaudSetOk)
+/* CRC32 (reflected 0xEDB88320) a nibble at a time, as the ROM does */
+static const uint32_t ulCrcRand32Lut[] =
 {
-    *bBaudSetOk = false;
-
-    /* Send 0x55 0x55 and expect ACK */
-    uint8_t pData[2];
-    memset(pData, 0x55, 2);
-    if(serialWrite(pData, 2) != 2)
-    {
-        printf("Communication init failed. Failed to Auto baud data.\n");
-        return (SBL_PORT_ERROR);
-    }
-
-    if(getCmdResponse(bBaudSetOk, 2) != SBL_SUCCESS)
-    {
-        // No response received. Invalid baud rate?
-        printf("No response from device. Device may not be in bootloader mode. Reset device and try again.\nIf problem persists, check connection and baud rate.\n");
-        return (SBL_PORT_ERROR);
-    }
-
-    return (SBL_SUCCESS);
-}
+ 0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC,
+ 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+ 0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+ 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+};
+#define CRC_POLY    0xEDB88320
 
 /****************************************************************
- * Function Name : sendCmdResponse
- * Description   : Send command response (ACK/NAK).
- * Returns       : Returns SBL_SUCCESS, ...
- * Params        @bAck: True if response is ACK, false if response
- *                      is NAK.
+ * Function Name : calcCrcLikeChip
+ * Description   : Calculate crc32 checksum the way CC2650 does it.
+ * Returns       : Checksum
+ * Params        :
  ****************************************************************/
-tSblStatus sendCmdResponse(bool bAck)
+uint32_t calcCrcLikeChip(const uint8_t *pData, uint32_t ulByteCount)
 {
-    if(get_filed() < 0)
-        return (SBL_PORT_ERROR);
+    uint32_t d, ind;
+    uint32_t acc = 0xFFFFFFFF;
 
-    uint8_t pData[2];
-    pData[0] = 0x00;
-    pData[1] = (bAck) ? 0xCC : 0x33;
-    if(serialWrite(pData, 2) != 2)
+    while (ulByteCount--)
     {
-        printf("Communication init failed. Failed to send ACK/NAK response.\n");
-        return (SBL_PORT_ERROR);
+        d = *pData++;
+        ind = (acc & 0x0F) ^ (d & 0x0F);
+        acc = (acc >> 4) ^ ulCrcRand32Lut[ind];
+        ind = (acc & 0x0F) ^ (d >> 4);
+        acc = (acc >> 4) ^ ulCrcRand32Lut[ind];
     }
-    return (SBL_SUCCESS);
+
+    return (acc ^ 0xFFFFFFFF);
 }
 
 /****************************************************************
- * Function Name : getResponseData
- * Description   : Get response data from device.
- * Returns       : Returns SBL_SUCCESS, ...
- * Params        @pcData: Pointer to where received data will be
- *                        stored.
- *               @ui32MaxLen: Max number of bytes that can be received.
- *                            Is populated with the actual number
- *                            of bytes received.
- *               @ui32MaxRetries: Not used
+ * Function Name : calcCrcDelta
+ * Description   : What changing \e pOld into \e pNew does to the
+ *                 CRC32 of anything that ends right after them:
+ *                 the CRC is linear, so the new CRC is the old one
+ *                 XOR this. Shift it with crcShift() for the bytes
+ *                 that follow the change.
+ * Returns       : CRC contribution of the change
+ * Params        @pOld: Bytes before
+ *               @pNew: Bytes after
+ *               @ulByteCount: Their length
  ****************************************************************/
-tSblStatus getResponseData(uint8_t *pcData, uint32_t *ui32MaxLen,
-                           uint32_t ui32MaxRetries)
+uint32_t calcCrcDelta(const uint8_t *pOld, const uint8_t *pNew, uint32_t ulByteCount)
 {
-    uint8_t pcHdr[2];
-    uint32_t numPayloadBytes;
-    uint8_t hdrChecksum, dataChecksum;
-    uint32_t bytesRecv = 0;
-
-    if(get_filed() < 0)
-        return (SBL_PORT_ERROR);
-
-    /* Read length and checksum */
-    memset(pcHdr, 0, 2);
-    bytesRecv = serialRead(&pcHdr[bytesRecv], 2-bytesRecv);
-
-    if(bytesRecv < 2)
-        return (SBL_TIMEOUT_ERROR);
-
-    numPayloadBytes = pcHdr[0]-2;
-    hdrChecksum = pcHdr[1];
-
-    /* Check if length byte is too long. */
-    if(numPayloadBytes > *ui32MaxLen)
-    {
-        printf("Error: Device sending more data than expected. \nMax expected was %d, sent was %d.\n", *ui32MaxLen, (numPayloadBytes+2));
-        return SBL_ERROR;
-    }
-
-    /* Read the payload data */
-    bytesRecv = 0;
-    bytesRecv = serialRead(&pcData[bytesRecv], (numPayloadBytes-bytesRecv));
-
-    /* Have we received what we expected */
-    if(bytesRecv < numPayloadBytes)
-    {
-        *ui32MaxLen = bytesRecv;
-        return (SBL_TIMEOUT_ERROR);
-    }
+    uint32_t d, ind;
+    uint32_t acc = 0;
 
-    /* Verify data checksum */
-    dataChecksum = generateCheckSum(0, (const char*)pcData, numPayloadBytes);
-    if(dataChecksum != hdrChecksum)
+    while (ulByteCount--)
     {
-        printf("Checksum verification error. Expected 0x%02X, got 0x%02X.\n", hdrChecksum, dataChecksum);
-        return (SBL_ERROR);
+        d = *pOld++ ^ *pNew++;
+        ind = (acc & 0x0F) ^ (d & 0x0F);
+        acc = (acc >> 4) ^ ulCrcRand32Lut[ind];
+        ind = (acc & 0x0F) ^ (d >> 4);
+        acc = (acc >> 4) ^ ulCrcRand32Lut[ind];
     }
 
-    *ui32MaxLen = bytesRecv;
-    return SBL_SUCCESS;
+    return (acc);
 }
 
 /****************************************************************
- * Function Name : sendCmd
- * Description   : Send command.
- * Returns       : Returns SBL_SUCCESS, ...
- * Params        @ui32Cmd: The command to send.
- *               @pcSendData: Pointer to the data to send with the
- *               command.
- *               @ui32SendLen: The number of bytes to send from
- *               \e pcSendData.
+ * Function Name : crcShift
+ * Description   : Moves a CRC contribution past \e ulByteCount
+ *                 bytes (times x^(8n) mod P), in log(n) steps
+ * Returns       : Shifted contribution
+ * Params        @ui32Crc: Contribution, see calcCrcDelta()
+ *               @ulByteCount: Bytes it moves past
  ****************************************************************/
-tSblStatus sendCmd(cmd_t cmdType, const uint8_t *pcSendData,
-                   uint32_t ui32SendLen)
+uint32_t crcShift(uint32_t ui32Crc, uint32_t ulByteCount)
 {
+    static uint32_t x2n[32];    /* x^(2^k) mod P */
+    uint32_t p = 1u << 31;      /* x^0 */
+    uint32_t k = 3;             /* 8 bits a byte */
 
-    if(get_filed() < 0)
-        return (SBL_PORT_ERROR);
-
-    uint8_t pktLen = ui32SendLen + 3; // +3 => <1b Length>, <1B cksum>, <1B cmd>
-    uint8_t* cmdPkt = (uint8_t*)calloc(pktLen, sizeof(uint8_t));
-
-    if(!cmdPkt)
-        return (SBL_MALLOC_ERROR);
-
-    uint8_t pktSum = generateCheckSum(cmdType, (const char*)pcSendData, ui32SendLen);
-    cmdPkt[0] = pktLen;
-    cmdPkt[1] = pktSum;
-    cmdPkt[2] = cmdType;
-
-    if(ui32SendLen)
-        memcpy(&cmdPkt[3], pcSendData, ui32SendLen);
-
-    /* Send the packet */
-    if(serialWrite(cmdPkt, pktLen) != pktLen)
+    if(!x2n[0])
     {
-        printf("Writing to device failed [CMD: 0x%2x]\n",(uint8_t)cmdType);
-        free(cmdPkt);
-        return (SBL_PORT_ERROR);
+        uint32_t x = 1u << 30;  /* x^1 */
+        x2n[0] = x;
+        for(uint32_t i = 1; i < 32; i++)
+            x2n[i] = x = crcMultModP(x, x);
     }
 
-    free(cmdPkt);
-    return (SBL_SUCCESS);
+    for(; ulByteCount; ulByteCount >>= 1, k++)
+    {
+        if(ulByteCount & 1)
+            p = crcMultModP(x2n[k & 31], p);
+    }
+    return (crcMultModP(p, ui32Crc));
 }
 
 /****************************************************************
- * Function Name : generateCheckSum
- * Description   : This function generates the bootloader protocol
- *                 checksum.
- * Returns       : Returns the generated checksum.
- * Params        @ui32Cmd: The bootloader command
- *               @pcData: Pointer to the command data.
- *               @ui32DataLen: Data length in bytes.
+ * Function Name : crcCombine
+ * Description   : CRC32 of A followed by B from the CRC32 of each,
+ *                 without their bytes
+ * Returns       : calcCrcLikeChip() of A|B
+ * Params        @ui32CrcA: calcCrcLikeChip() of A
+ *               @ui32CrcB: calcCrcLikeChip() of B
+ *               @ulLenB: Length of B
  ****************************************************************/
-uint8_t generateCheckSum(cmd_t cmdType, const char *pcData,
-                               uint32_t ui32DataLen)
+uint32_t crcCombine(uint32_t ui32CrcA, uint32_t ui32CrcB, uint32_t ulLenB)
 {
-    uint8_t ui8CheckSum = cmdType;
-    for(uint32_t i = 0; i < ui32DataLen; i++)
-    {
-        ui8CheckSum += pcData[i];
-    }
-    return ui8CheckSum;
+    return (crcShift(ui32CrcA, ulLenB) ^ ui32CrcB);
 }
 
-/****************************************************************
- * Function Name : calcCrcLikeChip
- * Description   : Calculate crc32 checksum the way CC2650 does it.
- * Returns       : Checksum
- * Params        :
- ****************************************************************/
-uint32_t calcCrcLikeChip(const uint8_t *pData, uint32_t ulByteCount)
+/* a * b mod P, polynomials in reflected bit order */
+static uint32_t crcMultModP(uint32_t a, uint32_t b)
 {
-    uint32_t d, ind;
-    uint32_t acc = 0xFFFFFFFF;
-    const uint32_t ulCrcRand32Lut[] =
-    {
-     0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC,
-     0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
-     0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
-     0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
-    };
+    uint32_t m = 1u << 31, p = 0;
 
-    while (ulByteCount--)
+    for(;;)
     {
-        d = *pData++;
-        ind = (acc & 0x0F) ^ (d & 0x0F);
-        acc = (acc >> 4) ^ ulCrcRand32Lut[ind];
-        ind = (acc & 0x0F) ^ (d >> 4);
-        acc = (acc >> 4) ^ ulCrcRand32Lut[ind];
+        if(a & m)
+        {
+            p ^= b;
+            if(!(a & (m - 1)))
+                break;
+        }
+        m >>= 1;
+        b = (b & 1) ? (b >> 1) ^ CRC_POLY : b >> 1;
     }
-
-    return (acc ^ 0xFFFFFFFF);
+    return (p);
 }
 
 /****************************************************************
@@ -356,48 +250,6 @@ uint32_t charArrayToUL(const char *pcSrc)
     return (ui32Val);
 }
 
-/****************************************************************
- * Function Name : readStatus
- * Description   : This function gets status from device.
- * Returns       : Returns SBL_SUCCESS, ...
- * Params        @pui32Status: Pointer to where status is stored.
- ****************************************************************/
-tSblStatus readStatus(uint32_t *pui32Status)
-{
-    tSblStatus retCode = SBL_SUCCESS;
-    bool bSuccess = false;
-
-    if(get_filed() < 0)
-        return (SBL_PORT_ERROR);
-
-    /* Send command */
-    if((retCode = sendCmd(CMD_GET_STATUS, NULL, 0)) != SBL_SUCCESS)
-        return retCode;
-
-    /* Receive command response */
-    if((retCode = getCmdResponse(&bSuccess, 0)) != SBL_SUCCESS)
-        return retCode;
-
-    if(!bSuccess)
-        return SBL_ERROR;
-
-    /* Receive command response data */
-    uint8_t status = 0;
-    uint32_t ui32NumBytes = 1;
-    if((retCode = getResponseData(&status, &ui32NumBytes, 0)) != SBL_SUCCESS)
-    {
-        /* Respond with NAK */
-        sendCmdResponse(false);
-        return retCode;
-    }
-
-    /* Respond with ACK */
-    sendCmdResponse(true);
-
-    *pui32Status = status;
-    return SBL_SUCCESS;
-}
-
 /****************************************************************
  * Function Name : getCmdStatusString
  * Description   : This function returns a string with the device
@@ -438,6 +290,10 @@ char *getCmdString(cmd_t ui32Cmd)
     case CMD_MEMORY_READ:      return "CMD_MEMORY_READ"; break;
     case CMD_MEMORY_WRITE:     return "CMD_MEMORY_WRITE"; break;
     case CMD_RESET:            return "CMD_RESET"; break;
+    case CMD_SEND_DATA:        return "CMD_SEND_DATA"; break;
+    case CMD_SECTOR_ERASE:     return "CMD_SECTOR_ERASE"; break;
+    case CMD_BANK_ERASE:       return "CMD_BANK_ERASE"; break;
+    case CMD_SET_CCFG:         return "CMD_SET_CCFG"; break;
     default: return "Unknown command"; break;
     }
 }
@@ -456,8 +312,12 @@ void appStatus(char *pcText, bool bError)
  * (used as SBL progress callback) */
 void appProgress(uint32_t progress)
 {
+#ifndef SBL_SMALL
     fprintf(stdout, "\r%d%% ", progress);
     fflush(stdout);
+#else
+    (void)progress;
+#endif
 }
 
 /****************************************************************
@@ -54,18 +54,13 @@ typedef enum {
     CMD_RET_FLASH_FAIL   = 0x44,
 }cmdRespStatus_t;
 
-extern tSblStatus sendAutoBaud(bool *bBaudSetOk);
-extern tSblStatus getCmdResponse(bool *bAck, uint8_t maxRetries);
-extern tSblStatus sendCmdResponse(bool bAck);
-extern tSblStatus getResponseData(uint8_t *pcData, uint32_t *ui32MaxLen,
-                                  uint32_t ui32MaxRetries);
 extern uint8_t generateCheckSum(cmd_t cmdType, const char *pcData,
                                       uint32_t ui32DataLen);
 extern uint32_t calcCrcLikeChip(const uint8_t *pData, uint32_t ulByteCount);
+extern uint32_t calcCrcDelta(const uint8_t *pOld, const uint8_t *pNew, uint32_t ulByteCount);
+extern uint32_t crcShift(uint32_t ui32Crc, uint32_t ulByteCount);
+extern uint32_t crcCombine(uint32_t ui32CrcA, uint32_t ui32CrcB, uint32_t ulLenB);
 extern tSblStatus setProgress(uint32_t ui32Progress);
-extern tSblStatus sendCmd(cmd_t cmdType, const uint8_t *pcSendData/* = NULL*/,
-                   uint32_t ui32SendLen/* = 0*/);
-extern tSblStatus readStatus(uint32_t *pui32Status);
 extern char *getCmdStatusString(cmdRespStatus_t ui32Status);
 extern char *getCmdString(cmd_t ui32Cmd);
 extern void byteSwap(uint8_t *pcArray);
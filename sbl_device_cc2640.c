@@ -12,17 +12,14 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include "sbl_device_cc2640.h"
+#include "sbl_engine.h"
+#include "sbl_timeout.h"
+#include "sbl_timeline.h"
+#include "sbl_metrics.h"
 
 /* Macros */
 #define MIN(x, y) (((x) < (y)) ? (x) : (y))
-
-/* Struct used when splitting long transfers */
-typedef struct {
-    uint32_t startAddr;
-    uint32_t byteCount;
-    uint32_t startOffset;
-    bool     bExpectAck;
-} tTransfer;
+#define MAX(x, y) (((x) > (y)) ? (x) : (y))
 
 /* Static Var's */
 static uint32_t m_flashSize;
@@ -37,9 +34,12 @@ static bool m_bCommInitialized;
  */
 static uint32_t m_deviceRev;
 
+/* The protocol engine behind the blocking API below */
+static tSblEngine m_engine;
+
 /* Static functions */
-static tSblStatus cmdDownload(uint32_t ui32Address, uint32_t ui32Size);
-static uint32_t addressToPage(uint32_t ui32Address);
+static tSblEngine *engine(void);
+static tSblStatus runEngine(tSblEvent *pEvent, bool bProgress);
 
 /* Some small functions. Lets save some file space */
 uint32_t getFlashSize() { return (m_flashSize);}
@@ -56,21 +56,16 @@ uint32_t getDeviceFlashBase() { return(devFlashBase);}
  ****************************************************************/
 tSblStatus eraseFlashBank()
 {
+    tSblEvent event;
     tSblStatus retCode = SBL_SUCCESS;
-    bool bResponse = false;
 
     if(get_filed() < 0)
         return (SBL_PORT_ERROR);
 
-    /* Send the command */
-    if((retCode = sendCmd(CMD_BANK_ERASE, NULL, 0)) != SBL_SUCCESS)
-        return retCode;
-
-    /* Get the response */
-    if((retCode = getCmdResponse(&bResponse, 0)) != SBL_SUCCESS)
-        return retCode;
+    if((retCode = sblEngineBankErase(engine())) != SBL_SUCCESS)
+        return (retCode);
 
-    return (bResponse) ? SBL_SUCCESS : SBL_ERROR;
+    return runEngine(&event, false);
 }
 
 /****************************************************************
@@ -87,48 +82,19 @@ tSblStatus eraseFlashBank()
 tSblStatus eraseFlashRange(uint32_t ui32StartAddress,
                               uint32_t ui32ByteCount)
 {
+    tSblEvent event;
     tSblStatus retCode = SBL_SUCCESS;
-    bool bSuccess = false;
-    uint8_t pcPayload[4];
-    uint32_t devStatus;
 
     if(get_filed() < 0)
         return (SBL_PORT_ERROR);
 
-    /*Calculate retry count */
-    uint32_t ui32PageCount = ui32ByteCount / SBL_CC2650_PAGE_ERASE_SIZE;
-    if( ui32ByteCount % SBL_CC2650_PAGE_ERASE_SIZE) ui32PageCount ++;
-    setProgress( 0 );
-
-    for(uint32_t i = 0; i < ui32PageCount; i++)
-    {
-        /* Build payload - 4B address (MSB first) */
-        ulToCharArray(ui32StartAddress + i*(4096), &pcPayload[0]);
-
-        /* Send command */
-        if((retCode = sendCmd(CMD_SECTOR_ERASE, pcPayload, 4)) != SBL_SUCCESS)
-            return (retCode);
-
-        /* Receive command response (ACK/NAK) */
-        if((retCode = getCmdResponse(&bSuccess, 0)) != SBL_SUCCESS)
-            return (retCode);
-
-        if(!bSuccess)
-            return (SBL_ERROR);
-
-        /* Check device status (Flash failed if page(s) locked) */
-
-        readStatus(&devStatus);
-        if(devStatus != CMD_RET_SUCCESS)
-        {
-            printf("Flash erase failed. (Status 0x%02X = %s). Flash pages may be locked.\n", devStatus, getCmdStatusString(devStatus));
-            return (SBL_ERROR);
-        }
-
-        setProgress( 100*(i+1)/ui32PageCount );
-    }
+    uint64_t t0 = timelineNow();
+    if((retCode = sblEngineEraseRange(engine(), ui32StartAddress, ui32ByteCount)) != SBL_SUCCESS)
+        return (retCode);
 
-    return (SBL_SUCCESS);
+    retCode = runEngine(&event, true);
+    timelineSpan(TL_CALLS, "eraseFlashRange", t0, "bytes", ui32ByteCount);
+    return (retCode);
 }
 
 /****************************************************************
@@ -146,83 +112,17 @@ tSblStatus eraseFlashRange(uint32_t ui32StartAddress,
 tSblStatus readMemory32(uint32_t ui32StartAddress, uint32_t ui32UnitCount,
                         uint32_t *pui32Data)
 {
+    tSblEvent event;
     tSblStatus retCode = SBL_SUCCESS;
-    bool bSuccess = false;
-
-    /* Check input arguments */
-    if((ui32StartAddress & 0x03))
-    {
-        printf("readMemory32(): Start address (0x%08X) must be a multiple of 4.\n", ui32StartAddress);
-        return (SBL_ARGUMENT_ERROR);
-    }
-
-    setProgress(0);
 
     if(get_filed() < 0)
         return (SBL_PORT_ERROR);
 
-    uint8_t pcPayload[6];
-    uint32_t responseData[SBL_CC2650_MAX_MEMREAD_WORDS];
-    uint32_t chunkCount = ui32UnitCount / SBL_CC2650_MAX_MEMREAD_WORDS;
-    if(ui32UnitCount % SBL_CC2650_MAX_MEMREAD_WORDS) chunkCount++;
-    uint32_t remainingCount = ui32UnitCount;
-
-    for(uint32_t i = 0; i < chunkCount; i++)
-    {
-        uint32_t dataOffset = (i * SBL_CC2650_MAX_MEMREAD_WORDS);
-        uint32_t chunkStart = ui32StartAddress + dataOffset;
-        uint32_t chunkSize  = MIN(remainingCount, SBL_CC2650_MAX_MEMREAD_WORDS);
-        remainingCount -= chunkSize;
-
-        /*
-         * Build payload
-        - 4B address (MSB first)
-        - 1B access width
-        - 1B Number of accesses (in words)
-         */
-        ulToCharArray(chunkStart, (uint8_t *)&pcPayload[0]);
-        pcPayload[4] = SBL_CC2650_ACCESS_WIDTH_32B;
-        pcPayload[5] = chunkSize;
-
-        setProgress(((i * 100) / chunkCount));
-
-        /* Send Command */
-        if((retCode = sendCmd(CMD_MEMORY_READ,pcPayload, 6)) != SBL_SUCCESS)
-            return retCode;
-
-        /* Receive command response (ACK/NAK) */
-        if((retCode = getCmdResponse(&bSuccess, 0)) != SBL_SUCCESS)
-            return retCode;
-        if(!bSuccess)
-            return (SBL_ERROR);
-
-        /* Receive 4B response */
-        uint32_t expectedBytes = chunkSize * 4;
-        uint32_t recvBytes = expectedBytes;
-        if((retCode = getResponseData((uint8_t*)responseData, &recvBytes, 0)) != SBL_SUCCESS)
-        {
-            /* Respond with NAK */
-            sendCmdResponse(false);
-            return retCode;
-        }
-
-        if(recvBytes != expectedBytes)
-        {
-            /* Respond with NAK */
-            sendCmdResponse(false);
-            printf("Didn't receive 4 B.\n");
-            return (SBL_ERROR);
-        }
-
-        memcpy(&pui32Data[dataOffset], responseData, expectedBytes);
-
-        /* Respond with ACK */
-        sendCmdResponse(true);
-    }
-    /* Set progress */
-    setProgress(100);
+    if((retCode = sblEngineReadMemory(engine(), ui32StartAddress, ui32UnitCount, 4,
+                                      (uint8_t*)pui32Data)) != SBL_SUCCESS)
+        return (retCode);
 
-    return SBL_SUCCESS;
+    return runEngine(&event, true);
 }
 
 /****************************************************************
@@ -233,21 +133,16 @@ tSblStatus readMemory32(uint32_t ui32StartAddress, uint32_t ui32UnitCount,
  ****************************************************************/
 tSblStatus ping()
 {
+    tSblEvent event;
     tSblStatus retCode = SBL_SUCCESS;
-    bool bResponse = false;
 
     if(get_filed() < 0)
         return (SBL_PORT_ERROR);
 
-    /* Send command */
-    if((retCode = sendCmd(CMD_PING, NULL, 0)) != SBL_SUCCESS)
-        return retCode;
-
-    /* Get response */
-    if((retCode = getCmdResponse(&bResponse, 0)) != SBL_SUCCESS)
-        return retCode;
+    if((retCode = sblEnginePing(engine())) != SBL_SUCCESS)
+        return (retCode);
 
-    return (bResponse) ? SBL_SUCCESS : SBL_ERROR;
+    return runEngine(&event, false);
 }
 
 /****************************************************************
@@ -279,47 +174,20 @@ uint32_t getDeviceRev(uint32_t deviceId)
  ****************************************************************/
 tSblStatus readDeviceId(uint32_t *pui32DeviceId)
 {
-    int retCode = SBL_SUCCESS;
-    bool bSuccess = false;
+    tSblEvent event;
+    tSblStatus retCode = SBL_SUCCESS;
 
     if(get_filed() < 0)
         return (SBL_PORT_ERROR);
 
-    /* Send command */
-    if((retCode = sendCmd(CMD_GET_CHIP_ID, NULL, 0)) != SBL_SUCCESS)
-        return retCode;
-
-    /* Receive command response (ACK/NAK) */
-    if((retCode = getCmdResponse(&bSuccess, 0)) != SBL_SUCCESS)
-        return retCode;
-
-    if(!bSuccess)
-        return (SBL_ERROR);
-
-    /* Receive response data */
-    uint8_t pId[4];
-    memset(pId, 0, 4);
-    uint32_t numBytes = 4;
-    if((retCode = getResponseData(pId, &numBytes, 0)) != SBL_SUCCESS)
-    {
-        /* Respond with NAK */
-        sendCmdResponse(false);
-        return retCode;
-    }
-
-    if(numBytes != 4)
-    {
-        /* Respond with NAK */
-        sendCmdResponse(false);
-        printf("Didn't receive 4 B.\n");
-        return (SBL_ERROR);
-    }
+    if((retCode = sblEngineChipId(engine())) != SBL_SUCCESS)
+        return (retCode);
 
-    /* Respond with ACK */
-    sendCmdResponse(true);
+    if((retCode = runEngine(&event, false)) != SBL_SUCCESS)
+        return (retCode);
 
     /* Store retrieved ID and report success */
-    *pui32DeviceId = charArrayToUL((const char*)pId);
+    *pui32DeviceId = event.value;
     m_deviceId = *pui32DeviceId;
 
     /* Store device revision (used internally, see sbl_device_cc2650.h) */
@@ -328,6 +196,44 @@ tSblStatus readDeviceId(uint32_t *pui32DeviceId)
     return (SBL_SUCCESS);
 }
 
+/****************************************************************
+ * Function Name : readIeeeAddress
+ * Description   : Reads the IEEE 802.15.4 address TI programs into
+ *                 FCFG1 of every chip. With the chip ID it tells one
+ *                 unit from another.
+ * Returns       : Returns SBL_SUCCESS, ...
+ * Params        : @pui64Ieee: Pointer to where the address is stored
+ ****************************************************************/
+tSblStatus readIeeeAddress(uint64_t *pui64Ieee)
+{
+    tSblStatus retCode = SBL_SUCCESS;
+    uint32_t pui32Mac[2];
+
+    /* MAC_15_4_0 is the low word */
+    if((retCode = readMemory32(SBL_CC2650_FCFG1_MAC_15_4, 2, pui32Mac)) != SBL_SUCCESS)
+    {
+        printf("Failed to read device IEEE address\n");
+        return (retCode);
+    }
+    *pui64Ieee = ((uint64_t)pui32Mac[1] << 32) | pui32Mac[0];
+    return (SBL_SUCCESS);
+}
+
+/****************************************************************
+ * Function Name : setDeviceSizes
+ * Description   : Takes flash and RAM size from an earlier session
+ *                 on the same unit instead of reading them
+ * Returns       : None
+ * Params        : @ui32FlashSize: Flash size in bytes
+ *                 @ui32RamSize: RAM size in bytes
+ ****************************************************************/
+void setDeviceSizes(uint32_t ui32FlashSize, uint32_t ui32RamSize)
+{
+    m_flashSize = ui32FlashSize;
+    m_ramSize = ui32RamSize;
+    setTimeoutFlashSize(m_flashSize);
+}
+
 /****************************************************************
  * Function Name : readFlashSize
  * Description   : This function reads device FLASH size in bytes.
@@ -354,6 +260,9 @@ tSblStatus readFlashSize(uint32_t *pui32FlashSize)
 
     m_flashSize = *pui32FlashSize;
 
+    /* Bank erase timeout scales with the number of pages */
+    setTimeoutFlashSize(m_flashSize);
+
     return (SBL_SUCCESS);
 }
 
@@ -377,36 +286,52 @@ tSblStatus readRamSize(uint32_t *pui32RamSize)
         return (retCode);
     }
 
+    *pui32RamSize = decodeRamSize(m_deviceId, value);
+
+    /* Save RAM size internally */
+    m_ramSize = *pui32RamSize;
+
+    return (retCode);
+}
+
+/****************************************************************
+ * Function Name : decodeRamSize
+ * Description   : RAM size of a device from its chip ID and the
+ *                 word at SBL_CC2650_RAM_SIZE_CFG
+ * Returns       : RAM size in bytes
+ * Params        : @ui32DeviceId: GET_CHIP_ID, early samples have
+ *                   less RAM
+ *                 @ui32RamCfg: The config word
+ ****************************************************************/
+uint32_t decodeRamSize(uint32_t ui32DeviceId, uint32_t ui32RamCfg)
+{
+    uint32_t value = ui32RamCfg & 0x03, ramSize;
+
     /* Calculate RAM size in bytes (Ram size bits are at bits [1:0]) */
-    value &= 0x03;
-    if(m_deviceRev == 1)
+    if(getDeviceRev(ui32DeviceId) == 1)
     {
         /* Early samples has less RAM */
         switch(value)
         {
-        case 3: *pui32RamSize = 0x4000; break;    // 16 KB
-        case 2: *pui32RamSize = 0x2000; break;    // 8 KB
-        case 1: *pui32RamSize = 0x1000; break;    // 4 KB
+        case 3: ramSize = 0x4000; break;    // 16 KB
+        case 2: ramSize = 0x2000; break;    // 8 KB
+        case 1: ramSize = 0x1000; break;    // 4 KB
         case 0:                                   // 2 KB
-        default:*pui32RamSize = 0x0800; break;    // All invalid values are interpreted as 2 KB
+        default:ramSize = 0x0800; break;    // All invalid values are interpreted as 2 KB
         }
     }
     else
     {
         switch(value)
         {
-        case 3: *pui32RamSize = 0x5000; break;    // 20 KB
-        case 2: *pui32RamSize = 0x4000; break;    // 16 KB
-        case 1: *pui32RamSize = 0x2800; break;    // 10 KB
+        case 3: ramSize = 0x5000; break;    // 20 KB
+        case 2: ramSize = 0x4000; break;    // 16 KB
+        case 1: ramSize = 0x2800; break;    // 10 KB
         case 0:                                   // 4 KB
-        default:*pui32RamSize = 0x1000; break;    // All invalid values are interpreted as 4 KB
+        default:ramSize = 0x1000; break;    // All invalid values are interpreted as 4 KB
         }
     }
-
-    /* Save RAM size internally */
-    m_ramSize = *pui32RamSize;
-
-    return (retCode);
+    return (ramSize);
 }
 
 /****************************************************************
@@ -419,25 +344,17 @@ tSblStatus readRamSize(uint32_t *pui32RamSize)
  ****************************************************************/
 tSblStatus reset()
 {
+    tSblEvent event;
     tSblStatus retCode = SBL_SUCCESS;
-    bool bSuccess = false;
 
     if(get_filed() < 0)
         return (SBL_PORT_ERROR);
 
-    /* Send CMD */
-    if((retCode = sendCmd(CMD_RESET, NULL, 0)) != SBL_SUCCESS)
-        return retCode;
-
-    /* Receive command response (ACK/NAK) */
-    if((retCode = getCmdResponse(&bSuccess, 0)) != SBL_SUCCESS)
-        return retCode;
+    if((retCode = sblEngineReset(engine())) != SBL_SUCCESS)
+        return (retCode);
 
-    if(!bSuccess)
-    {
-        printf("Reset command NAKed by device.\n");
-        return (SBL_ERROR);
-    }
+    if((retCode = runEngine(&event, false)) != SBL_SUCCESS)
+        return (retCode);
 
     m_bCommInitialized = false;
     return (SBL_SUCCESS);
@@ -453,8 +370,8 @@ tSblStatus reset()
 tSblStatus readMemory8(uint32_t ui32StartAddress, uint32_t ui32UnitCount,
                        uint8_t *pcData)
 {
-    int retCode = SBL_SUCCESS;
-    bool bSuccess = false;
+    tSblEvent event;
+    tSblStatus retCode = SBL_SUCCESS;
 
     /* Check input arguments */
     if(ui32UnitCount == 0)
@@ -466,484 +383,249 @@ tSblStatus readMemory8(uint32_t ui32StartAddress, uint32_t ui32UnitCount,
     if(get_filed() < 0)
         return (SBL_PORT_ERROR);
 
-    uint8_t pcPayload[6];
-    uint32_t chunkCount = ui32UnitCount / SBL_CC2650_MAX_MEMREAD_BYTES;
-    if(ui32UnitCount % SBL_CC2650_MAX_MEMREAD_BYTES) chunkCount++;
-    uint32_t remainingCount = ui32UnitCount;
-
-    for(uint32_t i = 0; i < chunkCount; i++)
-    {
-        uint32_t dataOffset = (i * SBL_CC2650_MAX_MEMREAD_BYTES);
-        uint32_t chunkStart = ui32StartAddress + dataOffset;
-        uint32_t chunkSize  = MIN(remainingCount, SBL_CC2650_MAX_MEMREAD_BYTES);
-        remainingCount -= chunkSize;
-
-        /*
-         * Build payload
-            - 4B address (MSB first)
-            - 1B access width
-            - 1B number of accesses (in bytes)
-         */
-        ulToCharArray(chunkStart, &pcPayload[0]);
-        pcPayload[4] = SBL_CC2650_ACCESS_WIDTH_8B;
-        pcPayload[5] = chunkSize;
-
-        /* Set progress */
-        setProgress(((i*100) / chunkCount));
-
-        /* Send command */
-        if((retCode = sendCmd(CMD_MEMORY_READ, pcPayload, 6)) != SBL_SUCCESS)
-            return (retCode);
-
-        /* Receive command response (ACK/NAK) */
-        if((retCode = getCmdResponse(&bSuccess, 0)) != SBL_SUCCESS)
-            return retCode;
-
-        if(!bSuccess)
-            return (SBL_ERROR);
-
-        /* Receive response */
-        uint32_t expectedBytes = chunkSize;
-        if((retCode = getResponseData(&pcData[dataOffset], &chunkSize, 0)) != SBL_SUCCESS)
-        {
-            /* Respond with NAK */
-            sendCmdResponse(false);
-            return retCode;
-        }
-
-        if(chunkSize != expectedBytes)
-        {
-            /* Respond with NAK */
-            sendCmdResponse(false);
-            printf("readMemory8(): Received %d bytes (%d B expected) in iteration %d.\n", chunkSize, expectedBytes, i);
-            return (SBL_ERROR);
-        }
-
-        /* Respond with ACK */
-        sendCmdResponse(true);
-    }
-
-    /* Set progress */
-    setProgress(100);
+    if((retCode = sblEngineReadMemory(engine(), ui32StartAddress, ui32UnitCount, 1,
+                                      pcData)) != SBL_SUCCESS)
+        return (retCode);
 
-    return (SBL_SUCCESS);
+    return runEngine(&event, true);
 }
 
 /****************************************************************
- * Function Name : addressInBLWorkMemory
- * Description   : This function checks if the specified \e
-                     ui32StartAddress (and range) overlaps the
-                     bootloader's working memory or stack area.
-
-    The bootloader does not protect against writing to these ranges,
-    but doing so is almost guaranteed to crash the bootloader and
-    requires a reboot. SRAM ranges used by the bootloader:
-       \li Work memory @ 0x20000000-0x2000016F
-       \li Stack area  @ 0x20000FC0-0x20000FFF
-
- * Returns       : Returns true if the address/range is within
-                     the device RAM.
- * Params        @ui32StartAddress:The start address of the range
- *               @ui32ByteCount: (Optional) The number of bytes
- *               in the range.
- ****************************************************************/
-bool addressInBLWorkMemory(uint32_t ui32StartAddress,
-                           uint32_t ui32ByteCount/* = 1*/)
-{
-    uint32_t ui32EndAddr = ui32StartAddress + ui32ByteCount;
-
-    if(ui32StartAddress <= SBL_CC2650_BL_WORK_MEMORY_END)
-        return true;
-
-    if((ui32StartAddress >= SBL_CC2650_BL_STACK_MEMORY_START) &&
-            (ui32StartAddress <= SBL_CC2650_BL_STACK_MEMORY_END))
-        return true;
-
-    if((ui32EndAddr >= SBL_CC2650_BL_STACK_MEMORY_START) &&
-            (ui32EndAddr <= SBL_CC2650_BL_STACK_MEMORY_END))
-        return true;
-
-    return false;
-}
-/****************************************************************
- * Function Name : writeMemory32
- * Description   : This function writes \e unitCount words of
-                   data to device SRAM.vMax 61 32-bit words
-                   supported. Source array is 32 bit wide. \e
-                   ui32StartAddress must be 4 byte aligned.
+ * Function Name : writeFlashRange
+ * Description   : Write \e unitCount words of data to device FLASH.
+                   Source array is 8 bit wide. Parameters \e
+                   startAddress and \e unitCount must be a a
+                   multiple of 4. This function does not erase the
+                   flash before writing data, this must be done
+                   using e.g. eraseFlashRange().
  * Returns       : Returns SBL_SUCCESS, ...
- * Params        : @ui32StartAddress: Start address in device.
- *                 @ui32UnitCount: Number of data words (32bit)
- *                 to write.
- *                 @pui32Data: Pointer to source data.
+ * Params        : @ui32StartAddress: Start address in device. Must
+                     be a multiple of 4.
+ *                 @ui32UnitCount: Must be a multiple of 4.
+ *                 @pcData:Pointer to source data.
  ****************************************************************/
-tSblStatus writeMemory32(uint32_t ui32StartAddress,
-                         uint32_t ui32UnitCount,
-                         const uint32_t *pui32Data)
+tSblStatus writeFlashRange(uint32_t ui32StartAddress,
+                           uint32_t ui32ByteCount, const char *pcData)
 {
+    tSblEvent event;
     tSblStatus retCode = SBL_SUCCESS;
-    bool bSuccess = false;
-
-    /* Check input arguments */
-    if((ui32StartAddress & 0x03))
-    {
-        printf("writeMemory32(): Start address (0x%08X) must 4 byte aligned.\n", ui32StartAddress);
-        return (SBL_ARGUMENT_ERROR);
-    }
-    if(addressInBLWorkMemory(ui32StartAddress, ui32UnitCount * 4))
-    {
-        // Issue warning
-        printf("writeMemory32(): Writing to bootloader work memory/stack:\n(0x%08X-0x%08X, 0x%08X-0x%08X)\n",
-               SBL_CC2650_BL_WORK_MEMORY_START,SBL_CC2650_BL_WORK_MEMORY_END, SBL_CC2650_BL_STACK_MEMORY_START,SBL_CC2650_BL_STACK_MEMORY_END);
-        return (SBL_ARGUMENT_ERROR);
-    }
 
     if(get_filed() < 0)
         return (SBL_PORT_ERROR);
 
-    uint32_t chunkCount = (ui32UnitCount / SBL_CC2650_MAX_MEMWRITE_WORDS);
-    if(ui32UnitCount % SBL_CC2650_MAX_MEMWRITE_WORDS) chunkCount++;
-    uint32_t remainingCount = ui32UnitCount;
-    uint8_t* pcPayload = (uint8_t*)calloc((5 + (SBL_CC2650_MAX_MEMWRITE_WORDS*4)), sizeof(uint8_t));
-
-    if(!pcPayload)
-        return (SBL_MALLOC_ERROR);
-
-    for(uint32_t i = 0; i < chunkCount; i++)
-    {
-        uint32_t chunkOffset = i * SBL_CC2650_MAX_MEMWRITE_WORDS;
-        uint32_t chunkStart  = ui32StartAddress + (chunkOffset * 4);
-        uint32_t chunkSize   = MIN(remainingCount, SBL_CC2650_MAX_MEMWRITE_WORDS);
-        remainingCount -= chunkSize;
-
-        /*
-         *  Build payload
-         - 4B address (MSB first)
-         - 1B access width
-         - 1-SBL_CC2650_MAX_MEMWRITE_WORDS data (MSB first)
-         */
-        ulToCharArray(chunkStart, &pcPayload[0]);
-        pcPayload[4] = SBL_CC2650_ACCESS_WIDTH_32B;
-        for(uint32_t j = 0; j < chunkSize; j++)
-            ulToCharArray(pui32Data[j + chunkOffset], &pcPayload[5 + j*4]);
-
-        /* Set progress */
-        setProgress( ((i * 100) / chunkCount) );
-
-        /* Send CMD */
-        if((retCode = sendCmd(CMD_MEMORY_WRITE, pcPayload, 5 + chunkSize*4)) != SBL_SUCCESS)
-            return (retCode);
-
-        /* Receive command response (ACK/NAK) */
-        if((retCode = getCmdResponse(&bSuccess, 5)) != SBL_SUCCESS)
-            return (retCode);
-
-        if(!bSuccess)
-        {
-            printf("writeMemory32(): Device NAKed command for address 0x%08X.\n", chunkStart);
-            return (SBL_ERROR);
-        }
-    }
-
-    /* Set progress */
-    setProgress(100);
-
-    /* Cleanup */
-    free(pcPayload);
+    uint64_t t0 = timelineNow();
+    if((retCode = sblEngineWriteRange(engine(), ui32StartAddress, ui32ByteCount,
+                                      (const uint8_t*)pcData)) != SBL_SUCCESS)
+        return (retCode);
 
-    return (SBL_SUCCESS);
+    retCode = runEngine(&event, true);
+    timelineSpan(TL_CALLS, "writeFlashRange", t0, "bytes", ui32ByteCount);
+    return (retCode);
 }
 
 /****************************************************************
- * Function Name : writeMemory8
- * Description   : Write \e unitCount words of data to device SRAM.
-                   Source array is 8 bit wide. Max 244 bytes of
-                   data. Source array is 32 bit wide. Parameters \e
-                   startAddress and \e unitCount must be a a multiple
-                   of 4.
- * Returns       : Returns SBL_SUCCESS, ...
- * Params        : @ui32StartAddress: Start address in device.
- *                 @ui32UnitCount: Number of bytes to write.
- *                 @pcData:Pointer to source data.
+ * Function Name : writeFlashRangeChecked
+ * Description   : writeFlashRange() that has the device CRC every
+ *                 \e ui32PagesPerCheck pages as soon as they are
+ *                 written, so a bad transfer is caught where it
+ *                 happened instead of by the final verify. Pages
+ *                 that don't match are erased and written once
+ *                 more (page aligned ranges only) before giving up.
+ * Returns       : Returns SBL_SUCCESS, SBL_ERROR on a mismatch that
+ *                 survived the rewrite, ...
+ * Params        : @ui32StartAddress: Start address in device. Must
+ *                   be a multiple of 4.
+ *                 @ui32ByteCount: Must be a multiple of 4.
+ *                 @pcData: Pointer to source data.
+ *                 @pui32PageCrc: calcCrcLikeChip() of every 4 KB of
+ *                   pcData, NULL to have it computed here
+ *                 @ui32PagesPerCheck: Pages per CRC32, at least 1
  ****************************************************************/
-tSblStatus writeMemory8(uint32_t ui32StartAddress,
-                        uint32_t ui32UnitCount,
-                        const uint8_t *pcData)
+tSblStatus writeFlashRangeChecked(uint32_t ui32StartAddress, uint32_t ui32ByteCount,
+                                  const char *pcData, const uint32_t *pui32PageCrc,
+                                  uint32_t ui32PagesPerCheck)
 {
+    const uint32_t groupLen = MAX(ui32PagesPerCheck, 1) * SBL_CC2650_PAGE_ERASE_SIZE;
+    const bool bCanRepair = !(ui32StartAddress % SBL_CC2650_PAGE_ERASE_SIZE);
+    tSblEvent event;
     tSblStatus retCode = SBL_SUCCESS;
-    bool bSuccess = false;
-
-    /* Check input arguments */
-    if(addressInBLWorkMemory(ui32StartAddress, ui32UnitCount))
-    {
-        /* Issue warning */
-        printf("writeMemory8(): Writing to bootloader work memory/stack:\n(0x%08X-0x%08X, 0x%08X-0x%08X)\n",
-               SBL_CC2650_BL_WORK_MEMORY_START,SBL_CC2650_BL_WORK_MEMORY_END, SBL_CC2650_BL_STACK_MEMORY_START,SBL_CC2650_BL_STACK_MEMORY_END);
-        return (SBL_ARGUMENT_ERROR);
-    }
+    uint32_t offset = 0, repairs = 0;
 
     if(get_filed() < 0)
         return (SBL_PORT_ERROR);
 
-    uint32_t chunkCount = (ui32UnitCount / SBL_CC2650_MAX_MEMWRITE_BYTES);
-    if(ui32UnitCount % SBL_CC2650_MAX_MEMWRITE_BYTES) chunkCount++;
-    uint32_t remainingCount = ui32UnitCount;
-
-    uint8_t* pcPayload = (uint8_t*)calloc((5 + (SBL_CC2650_MAX_MEMWRITE_WORDS*4)), sizeof(uint8_t));
-
-    if(!pcPayload)
-        return (SBL_MALLOC_ERROR);
-
-    for(uint32_t i = 0; i < chunkCount; i++)
+    uint64_t t0 = timelineNow();
+    setProgress(0);
+    while(offset < ui32ByteCount && retCode == SBL_SUCCESS)
     {
-        uint32_t chunkOffset = i * SBL_CC2650_MAX_MEMWRITE_BYTES;
-        uint32_t chunkStart  = ui32StartAddress + chunkOffset;
-        uint32_t chunkSize   = MIN(remainingCount, SBL_CC2650_MAX_MEMWRITE_BYTES);
-        remainingCount -= chunkSize;
-        /*
-         * Build payload
-             - 4B address (MSB first)
-             - 1B access width
-             - 1-SBL_CC2650_MAX_MEMWRITE_BYTES bytes data
-         */
-
-        ulToCharArray(chunkStart, &pcPayload[0]);
-        pcPayload[4] = SBL_CC2650_ACCESS_WIDTH_8B;
-        memcpy(&pcPayload[5], &pcData[chunkOffset], chunkSize);
-
-        /* Set progress */
-        setProgress( ((i * 100) / chunkCount) );
-
-        /* Send CMD */
-        if((retCode = sendCmd(CMD_MEMORY_WRITE, pcPayload, 5 + chunkSize)) != SBL_SUCCESS)
-            return (retCode);
-
-
-        /* Receive command response (ACK/NAK) */
-        if((retCode = getCmdResponse(&bSuccess, 5)) != SBL_SUCCESS)
-            return (retCode);
-
-        if(!bSuccess)
+        uint32_t len = MIN(groupLen, ui32ByteCount - offset);
+        uint32_t addr = ui32StartAddress + offset;
+        const uint8_t *pcGroup = (const uint8_t*)&pcData[offset];
+        uint32_t expected;
+
+        /* The image's page CRCs, combined for groups of pages */
+        if(pui32PageCrc)
         {
-            printf("writeMemory8(): Device NAKed command for address 0x%08X.\n", chunkStart);
-            return (SBL_ERROR);
+            const uint32_t *pCrc = &pui32PageCrc[offset / SBL_CC2650_PAGE_ERASE_SIZE];
+            expected = *pCrc++;
+            for(uint32_t pos = SBL_CC2650_PAGE_ERASE_SIZE; pos < len; pos += SBL_CC2650_PAGE_ERASE_SIZE)
+                expected = crcCombine(expected, *pCrc++, MIN(SBL_CC2650_PAGE_ERASE_SIZE, len - pos));
         }
-    }
+        else
+            expected = calcCrcLikeChip(pcGroup, len);
 
-    /* Set progress */
-    setProgress(100);
+        for(uint32_t attempt = 0; ; attempt++)
+        {
+            if((retCode = sblEngineWriteRange(engine(), addr, len, pcGroup)) != SBL_SUCCESS ||
+               (retCode = runEngine(&event, false)) != SBL_SUCCESS ||
+               (retCode = sblEngineCrc32(engine(), addr, len)) != SBL_SUCCESS ||
+               (retCode = runEngine(&event, false)) != SBL_SUCCESS)
+                break;
+            if(event.value == expected)
+                break;
+
+            printf("Page CRC mismatch at 0x%08X (+%u bytes): device 0x%08X, expected 0x%08X\n",
+                   addr, len, event.value, expected);
+            if(attempt > 0 || !bCanRepair)
+            {
+                retCode = SBL_ERROR;
+                break;
+            }
 
-    /* Clean up */
-    free(pcPayload);
+            /* Programming only clears bits, start the pages over */
+            repairs++;
+            if((retCode = sblEngineEraseRange(engine(), addr, len)) != SBL_SUCCESS ||
+               (retCode = runEngine(&event, false)) != SBL_SUCCESS)
+                break;
+        }
 
-    return SBL_SUCCESS;
+        offset += len;
+        setProgress((uint32_t)((100ULL*offset)/ui32ByteCount));
+    }
+    timelineSpan(TL_CALLS, "writeFlashRangeChecked", t0, "bytes", ui32ByteCount);
+    if(repairs)
+        printf("%u page group(s) rewritten after a CRC mismatch\n", repairs);
+    return (retCode);
 }
 
 /****************************************************************
- * Function Name : cmdSendData
- * Description   : This function sends the CC2650 SendData command
-                     and handles the device response.
- * Returns       :  Returns SBL_SUCCESS if command and response was
-                     successful.
- * Params        : @pcData: Pointer to the data to send.
- *                 @ui32ByteCount: The number of bytes to send.
+ * Function Name : updateFlashRegion
+ * Description   : Puts a few bytes into flash without reflashing
+ *                 the image around them: every page a patch
+ *                 touches is read back, patched in host memory,
+ *                 erased and programmed again, then CRC checked.
+ *                 A patch that only clears bits is programmed over
+ *                 the page as it is, without the erase.
+ * Returns       : Returns SBL_SUCCESS, SBL_ARGUMENT_ERROR if a
+ *                 patch isn't in flash, SBL_ERROR on a CRC
+ *                 mismatch, ...
+ * Params        : @pPatches: Address/bytes pairs, any order, may
+ *                   cross pages
+ *                 @ui32NumPatches: Number of patches
  ****************************************************************/
-tSblStatus cmdSendData(const uint8_t *pcData, uint32_t ui32ByteCount)
+tSblStatus updateFlashRegion(const tFlashPatch *pPatches, uint32_t ui32NumPatches)
 {
+    static uint32_t pui32Page[SBL_CC2650_PAGE_ERASE_SIZE / 4];
+    static uint8_t pcNew[SBL_CC2650_PAGE_ERASE_SIZE];
+    const uint8_t *pcOld = (const uint8_t*)pui32Page;
+    uint32_t firstPage = UINT32_MAX, lastPage = 0;
     tSblStatus retCode = SBL_SUCCESS;
-    bool bSuccess = false;
 
-    /* Check input arg's */
-    if(ui32ByteCount > SBL_CC2650_MAX_BYTES_PER_TRANSFER)
-    {
-        printf("Error: Byte count (%d) exceeds maximum transfer size %d.\n", ui32ByteCount, SBL_CC2650_MAX_BYTES_PER_TRANSFER);
-        return (SBL_ERROR);
-    }
-
-    /* Send CMD */
-    if((retCode = sendCmd(CMD_SEND_DATA, pcData, ui32ByteCount)) != SBL_SUCCESS)
-        return (retCode);
-
-    /* Receive command response (ACK/NAK) */
-    if((retCode = getCmdResponse(&bSuccess, 3)) != SBL_SUCCESS)
-        return (retCode);
-
-    if(!bSuccess)
-        return (SBL_ERROR);
-
-    return (SBL_SUCCESS);
-}
+    if(get_filed() < 0)
+        return (SBL_PORT_ERROR);
+    if(!ui32NumPatches)
+        return (SBL_SUCCESS);
 
-/****************************************************************
- * Function Name : writeFlashRange
- * Description   : Write \e unitCount words of data to device FLASH.
-                   Source array is 8 bit wide. Parameters \e
-                   startAddress and \e unitCount must be a a
-                   multiple of 4. This function does not erase the
-                   flash before writing data, this must be done
-                   using e.g. eraseFlashRange().
- * Returns       : Returns SBL_SUCCESS, ...
- * Params        : @ui32StartAddress: Start address in device. Must
-                     be a multiple of 4.
- *                 @ui32UnitCount: Must be a multiple of 4.
- *                 @pcData:Pointer to source data.
- ****************************************************************/
-tSblStatus writeFlashRange(uint32_t ui32StartAddress,
-                           uint32_t ui32ByteCount, const char *pcData)
-{
-    uint32_t devStatus = CMD_RET_UNKNOWN_CMD;
-    tSblStatus retCode = SBL_SUCCESS;
-    uint32_t bytesLeft, dataIdx, bytesInTransfer;
-    uint32_t transferNumber = 1;
-    bool bIsRetry = false;
-    bool bBlToBeDisabled = false;
-    tTransfer pvTransfer[2];
-    uint32_t ui32TotChunks = (ui32ByteCount / SBL_CC2650_MAX_BYTES_PER_TRANSFER);
-    if(ui32ByteCount % SBL_CC2650_MAX_BYTES_PER_TRANSFER) ui32TotChunks++;
-    uint32_t ui32CurrChunk = 0;
-
-    /* Calculate BL configuration address (depends on flash size) */
-    uint32_t ui32BlCfgAddr = SBL_CC2650_FLASH_START_ADDRESS +      \
-            getFlashSize() -                                            \
-            SBL_CC2650_PAGE_ERASE_SIZE +                                \
-            SBL_CC2650_BL_CONFIG_PAGE_OFFSET;
-
-    /* Calculate BL configuration buffer index */
-    uint32_t ui32BlCfgDataIdx = ui32BlCfgAddr - ui32StartAddress;
-
-    /* Is BL configuration part of buffer? */
-    if(ui32BlCfgDataIdx <= ui32ByteCount)
+    for(uint32_t i = 0; i < ui32NumPatches; i++)
     {
-        if(((pcData[ui32BlCfgDataIdx]) & 0xFF) != SBL_CC2650_BL_CONFIG_ENABLED_BM)
+        const tFlashPatch *pPatch = &pPatches[i];
+        if(!pPatch->len ||
+           (uint64_t)pPatch->addr + pPatch->len > SBL_CC2650_FLASH_START_ADDRESS + (uint64_t)m_flashSize)
         {
-            bBlToBeDisabled = false;
-            printf("Warning: CC2650 bootloader will be disabled.\n");
+            printf("Update: 0x%08X + %u bytes is not in flash\n", pPatch->addr, pPatch->len);
+            return (SBL_ARGUMENT_ERROR);
         }
+        firstPage = MIN(firstPage, (pPatch->addr - SBL_CC2650_FLASH_START_ADDRESS) / SBL_CC2650_PAGE_ERASE_SIZE);
+        lastPage = MAX(lastPage, (pPatch->addr + pPatch->len - 1 - SBL_CC2650_FLASH_START_ADDRESS) /
+                                 SBL_CC2650_PAGE_ERASE_SIZE);
     }
 
-    if(bBlToBeDisabled)
+    uint64_t t0 = timelineNow();
+    for(uint32_t page = firstPage; page <= lastPage && retCode == SBL_SUCCESS; page++)
     {
-        /*
-         * Make two split transfers.
-         * Make transfer (before lock bit )
-         */
-        pvTransfer[0].bExpectAck  = true;
-        pvTransfer[0].startAddr   = ui32StartAddress;
-        pvTransfer[0].byteCount   = (ui32BlCfgAddr - ui32StartAddress) & (~0x03);
-        pvTransfer[0].startOffset = 0;
-
-        /* The transfer locking the backdoor */
-        pvTransfer[1].bExpectAck  = false;
-        pvTransfer[1].startAddr   = ui32BlCfgAddr - (ui32BlCfgAddr % 4);
-        pvTransfer[1].byteCount   = ui32ByteCount - pvTransfer[0].byteCount;
-        pvTransfer[1].startOffset = ui32BlCfgDataIdx - (ui32BlCfgDataIdx % 4);
-    }
-    else
-    {
-        pvTransfer[0].bExpectAck  = true;
-        pvTransfer[0].byteCount = ui32ByteCount;
-        pvTransfer[0].startAddr = ui32StartAddress;
-        pvTransfer[0].startOffset = 0;
-    }
-
-    /* For each transfer */
-    for(uint32_t i = 0; i < 1; i++)
-    {
-        /* Sanity check */
-        if(pvTransfer[i].byteCount == 0)
+        uint32_t pageAddr = SBL_CC2650_FLASH_START_ADDRESS + page * SBL_CC2650_PAGE_ERASE_SIZE;
+        uint32_t first = SBL_CC2650_PAGE_ERASE_SIZE, last = 0, devCrc;
+        bool bTouched = false, bClearOnly = true;
+
+        for(uint32_t i = 0; i < ui32NumPatches && !bTouched; i++)
+            bTouched = pPatches[i].addr < pageAddr + SBL_CC2650_PAGE_ERASE_SIZE &&
+                       pPatches[i].addr + pPatches[i].len > pageAddr;
+        if(!bTouched)
             continue;
 
-        /* Set progress */
-        setProgress(addressToPage(pvTransfer[i].startAddr));
-
-        /* Send download command */
-        if((retCode = cmdDownload(pvTransfer[i].startAddr,
-                                  pvTransfer[i].byteCount)) != SBL_SUCCESS)
-            return (retCode);
+        if((retCode = readMemory32(pageAddr, SBL_CC2650_PAGE_ERASE_SIZE / 4, pui32Page)) != SBL_SUCCESS)
+            break;
+        memcpy(pcNew, pcOld, SBL_CC2650_PAGE_ERASE_SIZE);
+        for(uint32_t i = 0; i < ui32NumPatches; i++)
+        {
+            const tFlashPatch *pPatch = &pPatches[i];
+            uint32_t from = MAX(pPatch->addr, pageAddr);
+            uint32_t to = MIN(pPatch->addr + pPatch->len, pageAddr + SBL_CC2650_PAGE_ERASE_SIZE);
+            if(from < to)
+                memcpy(&pcNew[from - pageAddr], &pPatch->pData[from - pPatch->addr], to - from);
+        }
 
-        /* Check status after download command */
-        retCode = readStatus(&devStatus);
-        if(retCode != SBL_SUCCESS)
+        /* What changes, and whether programming alone gets there */
+        for(uint32_t b = 0; b < SBL_CC2650_PAGE_ERASE_SIZE; b++)
         {
-            printf("Error during download initialization. Failed to read device status after sending download command.\n");
-            return (retCode);
+            if(pcNew[b] == pcOld[b])
+                continue;
+            first = MIN(first, b);
+            last = b;
+            if((pcOld[b] & pcNew[b]) != pcNew[b])
+                bClearOnly = false;
         }
-        if(devStatus != CMD_RET_SUCCESS)
+        if(first == SBL_CC2650_PAGE_ERASE_SIZE)
         {
-            printf("Error during download initialization. Device returned status %d (%s).\n", devStatus, getCmdStatusString(devStatus));
-            return (SBL_ERROR);
+            printf("Update: page %u already up to date\n", page);
+            continue;
         }
 
-        /* Send data in chunks */
-        bytesLeft = pvTransfer[i].byteCount;
-        dataIdx   = pvTransfer[i].startOffset;
-        while(bytesLeft)
+        if(bClearOnly)
         {
-            /* Set progress */
-            //setProgress(addressToPage(ui32StartAddress + dataIdx));
-            setProgress( ((100*(++ui32CurrChunk))/ui32TotChunks) );
-
-            /* Limit transfer count */
-            bytesInTransfer = MIN(SBL_CC2650_MAX_BYTES_PER_TRANSFER, bytesLeft);
-
-            /* Send Data command */
-            if((retCode = cmdSendData((const uint8_t*)&pcData[dataIdx], bytesInTransfer)) != SBL_SUCCESS)
-            {
-                printf("Error during flash download. \n- Start address 0x%08X (page %d). \n- Tried to transfer %d bytes. \n- This was transfer %d.\n",
-                       (ui32StartAddress+dataIdx),
-                       addressToPage(ui32StartAddress+dataIdx),
-                       bytesInTransfer,
-                       (transferNumber));
-                return (retCode);
-            }
-
-            if(pvTransfer[i].bExpectAck)
-            {
-                /* Check status after send data command */
-                devStatus = 0;
-                retCode = readStatus(&devStatus);
-                if(retCode != SBL_SUCCESS)
-                {
-                    printf("Error during flash download. Failed to read device status.\n- Start address 0x%08X (page %d). \n- Tried to transfer %d bytes. \n- This was transfer %d in chunk %d.\n",
-                           (ui32StartAddress+dataIdx),
-                           addressToPage(ui32StartAddress + dataIdx),
-                           (bytesInTransfer), (transferNumber),
-                           (i));
-                    return (retCode);
-                }
-                if(devStatus != CMD_RET_SUCCESS)
-                {
-                    printf("Device returned status %s\n", getCmdStatusString(devStatus));
-                    if(bIsRetry)
-                    {
-                        /* We have failed a second time. Aborting. */
-                        printf("Error retrying flash download.\n- Start address 0x%08X (page %d). \n- Tried to transfer %d bytes. \n- This was transfer %d in chunk %d.\n",
-                               (ui32StartAddress+dataIdx),
-                               addressToPage(ui32StartAddress + dataIdx),
-                               (bytesInTransfer), (transferNumber),
-                               (i));
-                        return (SBL_ERROR);
-                    }
-
-                    /* Retry to send data one more time. */
-                    bIsRetry = true;
-                    continue;
-                }
-            }
-            else
-            {
-                /* We're locking device and will lose access */
-                m_bCommInitialized = false;
-            }
+            /* Unchanged bytes in the span are programmed to what they
+             * already are, which leaves them alone */
+            first &= ~3u;
+            last = (last | 3u) + 1;
+            printf("Update: page %u, programming %u bytes at 0x%08X\n", page, last - first, pageAddr + first);
+        }
+        else
+        {
+            /* Erase, then program all but the blank words at the ends */
+            first = 0;
+            last = SBL_CC2650_PAGE_ERASE_SIZE;
+            while(first < last && *(const uint32_t*)&pcNew[first] == 0xFFFFFFFF)
+                first += 4;
+            while(last > first && *(const uint32_t*)&pcNew[last - 4] == 0xFFFFFFFF)
+                last -= 4;
+            printf("Update: page %u, erasing and programming %u bytes\n", page, last - first);
+            if((retCode = eraseFlashRange(pageAddr, SBL_CC2650_PAGE_ERASE_SIZE)) != SBL_SUCCESS)
+                break;
+        }
 
-            /* Update index and bytesLeft */
-            bytesLeft -= bytesInTransfer;
-            dataIdx += bytesInTransfer;
-            transferNumber++;
-            bIsRetry = false;
+        if(last > first &&
+           (retCode = writeFlashRange(pageAddr + first, last - first, (const char*)&pcNew[first])) != SBL_SUCCESS)
+            break;
+        if((retCode = calculateCrc32(pageAddr, SBL_CC2650_PAGE_ERASE_SIZE, &devCrc)) != SBL_SUCCESS)
+            break;
+        if(devCrc != calcCrcLikeChip(pcNew, SBL_CC2650_PAGE_ERASE_SIZE))
+        {
+            printf("Update: page %u CRC mismatch after programming\n", page);
+            retCode = SBL_ERROR;
         }
     }
-    return (SBL_SUCCESS);
+    timelineSpan(TL_CALLS, "updateFlashRegion", t0, "pages", lastPage - firstPage + 1);
+    return (retCode);
 }
 
 /****************************************************************
@@ -958,146 +640,16 @@ tSblStatus writeFlashRange(uint32_t ui32StartAddress,
  ****************************************************************/
 tSblStatus setCCFG(uint32_t ui32Field, uint32_t ui32FieldValue)
 {
+    tSblEvent event;
     tSblStatus retCode = SBL_SUCCESS;
-    bool bSuccess = false;
 
     if(get_filed() < 0)
         return (SBL_PORT_ERROR);
 
-    //
-    // Generate payload
-    // - 4B Field ID
-    // - 4B Field value
-    //
-    char pcPayload[8];
-    ulToCharArray(ui32Field, (uint8_t*)&pcPayload[0]);
-    ulToCharArray(ui32FieldValue, (uint8_t*)&pcPayload[4]);
-
-    /* Send command */
-    if((retCode = sendCmd(CMD_SET_CCFG, (const uint8_t*)pcPayload, 8)) != SBL_SUCCESS)
+    if((retCode = sblEngineSetCcfg(engine(), ui32Field, ui32FieldValue)) != SBL_SUCCESS)
         return (retCode);
 
-    /* Receive command response (ACK/NAK) */
-    if((retCode = getCmdResponse(&bSuccess, 0)) != SBL_SUCCESS)
-        return (retCode);
-
-    if(!bSuccess)
-    {
-        printf("Set CCFG command NAKed by device.\n");
-        return (SBL_ERROR);
-    }
-
-    return (SBL_SUCCESS);
-}
-
-/****************************************************************
- * Function Name : addressToPage
- * Description   : This function returns the page within which
- *                  address \e ui32Address is located.
- * Returns       :  Returns the flash page within which an address
- *                  is located.
- * Params        : @ui32Address: The address.
- ****************************************************************/
-uint32_t addressToPage(uint32_t ui32Address)
-{
-    return ((ui32Address - SBL_CC2650_FLASH_START_ADDRESS) /                  \
-            SBL_CC2650_PAGE_ERASE_SIZE);
-}
-
-/****************************************************************
- * Function Name : addressInRam
- * Description   : This function checks if the specified \e
-                     ui32StartAddress (and range)is located within
-                     the device RAM area.
- * Returns       :  Returns true if the address/range is within
- *                  the device RAM.
- * Params        : @ui32Address: The start address of the range.
- *                 @pui32Bytecount:The number of bytes in the range.
- ****************************************************************/
-bool addressInRam(uint32_t ui32StartAddress,
-                  uint32_t ui32ByteCount/* = 1*/)
-{
-    uint32_t ui32EndAddr = ui32StartAddress + ui32ByteCount;
-
-    if(ui32StartAddress < SBL_CC2650_RAM_START_ADDRESS)
-        return false;
-
-    if(ui32EndAddr > (SBL_CC2650_RAM_START_ADDRESS + getRamSize()))
-        return false;
-
-    return true;
-}
-
-/****************************************************************
- * Function Name : addressInFlash
- * Description   : This function checks if the specified \e
- *                  ui32StartAddress (and range) is located within
- *                  the device FLASH area.
- * Returns       :  Returns true if the address/range is within the
- *                  device flash.
- * Params        : @ui32Address: The start address of the range
- *                 @pui32Bytecount:The number of bytes in the range.
- ****************************************************************/
-bool addressInFlash(uint32_t ui32StartAddress,
-                    uint32_t ui32ByteCount/* = 1*/)
-{
-    uint32_t ui32EndAddr = ui32StartAddress + ui32ByteCount;
-
-    if(ui32StartAddress < SBL_CC2650_FLASH_START_ADDRESS)
-        return false;
-
-    if(ui32EndAddr > (SBL_CC2650_FLASH_START_ADDRESS + getFlashSize()))
-        return false;
-
-    return true;
-}
-
-/****************************************************************
- * Function Name : cmdDownload
- * Description   : This function sends the CC2650 download command
- *                  and handles the device response.
- * Returns       :  Returns SBL_SUCCESS if command and response was
- *                  successful.
- * Params        : @ui32Address:  The start address in CC2650 flash.
- *                 @pui32Bytecount:The total number of bytes to
- *                 program on the device.
- ****************************************************************/
-tSblStatus cmdDownload(uint32_t ui32Address, uint32_t ui32Size)
-{
-    int retCode = SBL_SUCCESS;
-    bool bSuccess = false;
-
-    // Check input arguments
-    if(!addressInFlash(ui32Address, ui32Size))
-    {
-        printf("Flash download: Address range (0x%08X + %d bytes) is not in device FLASH nor RAM.\n", ui32Address, ui32Size);
-        return (SBL_ARGUMENT_ERROR);
-    }
-    if(ui32Size & 0x03)
-    {
-        printf("Flash download: Byte count must be a multiple of 4\n");
-        return (SBL_ARGUMENT_ERROR);
-    }
-
-    //
-    // Generate payload
-    // - 4B Program address
-    // - 4B Program size
-    //
-    char pcPayload[8];
-    ulToCharArray(ui32Address, (uint8_t*)&pcPayload[0]);
-    ulToCharArray(ui32Size, (uint8_t*)&pcPayload[4]);
-
-    /* Send command */
-    if((retCode = sendCmd(CMD_DOWNLOAD, (const uint8_t*)pcPayload, 8)) != SBL_SUCCESS)
-        return retCode;
-
-    /* Receive command response (ACK/NAK) */
-    if((retCode = getCmdResponse(&bSuccess, 0)) != SBL_SUCCESS)
-        return retCode;
-
-    /* Return command response */
-    return (bSuccess) ? SBL_SUCCESS : SBL_ERROR;
+    return runEngine(&event, false);
 }
 
 /****************************************************************
@@ -1114,69 +666,23 @@ tSblStatus cmdDownload(uint32_t ui32Address, uint32_t ui32Size)
 tSblStatus calculateCrc32(uint32_t ui32StartAddress,
                           uint32_t ui32ByteCount, uint32_t *pui32Crc)
 {
+    tSblEvent event;
     tSblStatus retCode = SBL_SUCCESS;
-    bool bSuccess = false;
-    char pcPayload[12];
-    uint32_t ui32RecvCount = 0;
-
-    /* Check input arguments */
-    if(!addressInFlash(ui32StartAddress, ui32ByteCount) &&
-            !addressInRam(ui32StartAddress, ui32ByteCount))
-    {
-        printf("Specified address range (0x%08X + %d bytes) is not in device FLASH nor RAM.\n", ui32StartAddress, ui32ByteCount);
-        return (SBL_ARGUMENT_ERROR);
-    }
 
     if(get_filed() < 0)
         return (SBL_PORT_ERROR);
 
-    /* Set progress */
-    setProgress(0);
-
-    //
-    // Build payload
-    // - 4B address (MSB first)
-    // - 4B byte count(MSB first)
-    //
-    ulToCharArray(ui32StartAddress, (uint8_t*)&pcPayload[0]);
-    ulToCharArray(ui32ByteCount, (uint8_t*)&pcPayload[4]);
-    pcPayload[8] = 0x00;
-    pcPayload[9] = 0x00;
-    pcPayload[10] = 0x00;
-    pcPayload[11] = 0x00;
-
-    /* Send command */
-    if((retCode = sendCmd(CMD_CRC32, (const uint8_t*)pcPayload, 12)) != SBL_SUCCESS)
+    uint64_t t0 = timelineNow();
+    if((retCode = sblEngineCrc32(engine(), ui32StartAddress, ui32ByteCount)) != SBL_SUCCESS)
         return (retCode);
 
-    /* Receive command response (ACK/NAK) */
-    if((retCode = getCmdResponse(&bSuccess, 5)) != SBL_SUCCESS)
+    retCode = runEngine(&event, true);
+    timelineSpan(TL_CALLS, "calculateCrc32", t0, "bytes", ui32ByteCount);
+    if(retCode != SBL_SUCCESS)
         return (retCode);
 
-    if(!bSuccess)
-    {
-        printf("Device NAKed CRC32 command.\n");
-        return (SBL_ERROR);
-    }
-
-    /* Get data response */
-    ui32RecvCount = 4;
-    if((retCode = getResponseData((uint8_t*)pcPayload, &ui32RecvCount, 0)) != SBL_SUCCESS)
-    {
-        sendCmdResponse(false);
-        return (retCode);
-    }
-
-    *pui32Crc = charArrayToUL(pcPayload);
-
-    /* Send ACK/NAK to command */
-    bool bAck = (ui32RecvCount == 4) ? true : false;
-    sendCmdResponse(bAck);
-
-    /* Set progress */
-    setProgress(100);
-
-    return SBL_SUCCESS;
+    *pui32Crc = event.value;
+    return (SBL_SUCCESS);
 }
 
 /****************************************************************
@@ -1187,27 +693,96 @@ tSblStatus calculateCrc32(uint32_t ui32StartAddress,
  ****************************************************************/
 tSblStatus detectAutoBaud(void)
 {
-    uint8_t wrPkt[2] = {0x55, 0x55};
-    uint8_t rdPkt[2] = {0, 0};
-    if(serialWrite(wrPkt, 2) != 2)
-        return (SBL_ERROR);
-
-    if(serialRead(rdPkt, 2) != 2)
-        return(SBL_ERROR);
-
-    if(rdPkt[0] == 0x00 && rdPkt[1] == 0xCC)
-      {
-          printf("Auto baud detected 0x%02X 0x%02X.\n", rdPkt[0], rdPkt[1]);
-          return (SBL_SUCCESS);
-      }
-      else if(rdPkt[0] == 0x00 && rdPkt[1] == 0x33)
-      {
-          printf("NACK received 0x%02X 0x%02X.\n", rdPkt[0], rdPkt[1]);
-          return (SBL_SUCCESS);
-      }
-      else
-      {
-          printf("ACK/NAK not received. Expected 0x00 0xCC or 0x00 0x33, received 0x%02X 0x%02X.\n", rdPkt[0], rdPkt[1]);
-          return (SBL_ERROR);
-      }
+    tSblEvent event;
+    tSblStatus retCode = SBL_SUCCESS;
+
+    if((retCode = sblEngineAutobaud(engine())) != SBL_SUCCESS)
+        return (retCode);
+
+    return runEngine(&event, false);
+}
+
+/* The engine, with the sizes read so far, pipelining where the
+ * port allows it */
+static tSblEngine *engine(void)
+{
+    sblEngineSetSizes(&m_engine, m_flashSize, m_ramSize);
+    sblEngineSetPipeline(&m_engine, serialCanPipeline());
+    return (&m_engine);
+}
+
+/****************************************************************
+ * Function Name : runEngine
+ * Description   : Blocking driver of the protocol engine. Moves
+ *                 bytes between the engine and the serial port
+ *                 until the operation started on it completed.
+ * Returns       : Status of the operation
+ * Params        : @pEvent: Populated with the completion
+ *                 @bProgress: Report progress through setProgress()
+ ****************************************************************/
+static tSblStatus runEngine(tSblEvent *pEvent, bool bProgress)
+{
+    const uint8_t *pcTx;
+    uint8_t pcRx[SBL_ENGINE_RX_MAX];
+    uint32_t lastProgress = 0;
+    uint32_t txLen;
+    uint64_t startUs = serialGetTimeUs();
+
+    if(bProgress)
+        setProgress(0);
+
+    for(;;)
+    {
+        /* Send whatever the engine queued, ACKs included */
+        while((txLen = sblEngineTxPending(&m_engine, &pcTx)) > 0)
+        {
+            uint8_t wrLen = MIN(txLen, 255);
+            if(serialWrite((uint8_t*)pcTx, wrLen) != wrLen)
+            {
+                printf("Writing to device failed [CMD: 0x%2x]\n", (uint8_t)m_engine.cmd);
+                sblEngineAbort(&m_engine, SBL_PORT_ERROR);
+                break;
+            }
+            sblEngineTxDone(&m_engine, wrLen, serialGetTimeUs());
+        }
+
+        if(bProgress && m_engine.progress != lastProgress)
+        {
+            lastProgress = m_engine.progress;
+            setProgress(lastProgress);
+        }
+
+        if(sblEngineEvent(&m_engine, pEvent))
+        {
+            metricsOp(getOpString(pEvent->op), pEvent->status == SBL_SUCCESS,
+                      (serialGetTimeUs() - startUs) / 1e6);
+            return (pEvent->status);
+        }
+
+        /* Read exactly what completes the awaited response */
+        uint32_t rxWanted = sblEngineRxWanted(&m_engine);
+        uint64_t deadline = sblEngineDeadline(&m_engine);
+        uint64_t now = serialGetTimeUs();
+        if(!rxWanted || !deadline)
+        {
+            sblEngineAbort(&m_engine, SBL_ERROR);
+            continue;
+        }
+
+        serialSetTimeout((deadline > now) ? (uint32_t)((deadline - now + 999) / 1000) : 0);
+        int rdLen = serialRead(pcRx, MIN(rxWanted, sizeof(pcRx)));
+        if(rdLen > 0)
+        {
+            /* Each read completes at most one answer: the command it
+             * answers went round trip from its TX to now */
+            const char *pcCmd = (m_engine.op == SBL_OP_AUTOBAUD) ? "AUTOBAUD" :
+                                getCmdString(m_engine.cmd);
+            uint64_t sentUs = m_engine.txDoneUs, ackUs = m_engine.ackUs;
+
+            sblEngineRx(&m_engine, pcRx, rdLen, serialLastRxUs());
+            if(m_engine.ackUs != ackUs)
+                timelineSpanAt(TL_COMMANDS, pcCmd, sentUs, m_engine.ackUs, NULL, 0);
+        }
+        sblEngineTick(&m_engine, serialGetTimeUs());
+    }
 }
@@ -13,6 +13,7 @@
 
 #define CC26XX_FLASH_BASE                   0x00000000
 #define SBL_CC2650_PAGE_ERASE_SIZE          4096
+#define SBL_CC2650_MAX_FLASH_SIZE           0x20000     // Largest CC26x0/CC13x0, 128 KB
 #define SBL_CC2650_FLASH_START_ADDRESS      0x00000000
 #define SBL_CC2650_RAM_START_ADDRESS        0x20000000
 #define SBL_CC2650_ACCESS_WIDTH_32B         1
@@ -25,6 +26,7 @@
 #define SBL_CC2650_MAX_MEMREAD_WORDS        63
 #define SBL_CC2650_FLASH_SIZE_CFG           0x4003002C
 #define SBL_CC2650_RAM_SIZE_CFG             0x40082250
+#define SBL_CC2650_FCFG1_MAC_15_4           0x500012F0
 #define SBL_CC2650_BL_CONFIG_PAGE_OFFSET    0xFDB
 #define SBL_CC2650_BL_CONFIG_ENABLED_BM     0xC5
 #define SBL_CC2650_BL_WORK_MEMORY_START     0x20000000
@@ -32,6 +34,13 @@
 #define SBL_CC2650_BL_STACK_MEMORY_START    0x20000FC0
 #define SBL_CC2650_BL_STACK_MEMORY_END      0x20000FFF
 
+/* Bytes to put at an address in flash, see updateFlashRegion() */
+typedef struct {
+    uint32_t       addr;
+    uint32_t       len;
+    const uint8_t *pData;
+} tFlashPatch;
+
 extern tSblStatus eraseFlashBank();
 extern tSblStatus ping();
 extern tSblStatus reset();
@@ -39,8 +48,12 @@ extern void setDeviceFlashBase(uint32_t valFlashBase);
 extern uint32_t getDeviceFlashBase();
 extern uint32_t getFlashSize();
 extern uint32_t getRamSize();
+extern void setDeviceSizes(uint32_t ui32FlashSize, uint32_t ui32RamSize);
 extern tSblStatus writeFlashRange(uint32_t ui32StartAddress,
                            uint32_t ui32ByteCount, const char *pcData);
+extern tSblStatus writeFlashRangeChecked(uint32_t ui32StartAddress, uint32_t ui32ByteCount,
+                                         const char *pcData, const uint32_t *pui32PageCrc,
+                                         uint32_t ui32PagesPerCheck);
 extern tSblStatus eraseFlashRange(uint32_t ui32StartAddress,
                               uint32_t ui32ByteCount);
 extern tSblStatus calculateCrc32(uint32_t ui32StartAddress,
@@ -48,5 +61,15 @@ extern tSblStatus calculateCrc32(uint32_t ui32StartAddress,
 extern tSblStatus detectAutoBaud(void);
 extern tSblStatus readFlashSize(uint32_t *pui32FlashSize);
 extern tSblStatus readRamSize(uint32_t *pui32RamSize);
+extern tSblStatus readDeviceId(uint32_t *pui32DeviceId);
+extern uint32_t getDeviceRev(uint32_t deviceId);
+extern tSblStatus readIeeeAddress(uint64_t *pui64Ieee);
+extern uint32_t decodeRamSize(uint32_t ui32DeviceId, uint32_t ui32RamCfg);
+extern tSblStatus readMemory32(uint32_t ui32StartAddress, uint32_t ui32UnitCount,
+                               uint32_t *pui32Data);
+extern tSblStatus readMemory8(uint32_t ui32StartAddress, uint32_t ui32UnitCount,
+                              uint8_t *pcData);
+extern tSblStatus setCCFG(uint32_t ui32Field, uint32_t ui32FieldValue);
+extern tSblStatus updateFlashRegion(const tFlashPatch *pPatches, uint32_t ui32NumPatches);
 
 #endif /* SBL_DEVICE_CC2640_H_ */
@@ -0,0 +1,1126 @@
+/*
+ * sbl_engine.c
+ *
+ *  Created on: 18/10/2026
+ *  Description: Sans-IO bootloader protocol engine. A session is a
+ *               state machine that takes received bytes, hands out
+ *               bytes to transmit and reports completion of high
+ *               level operations. Which fd, thread or event loop
+ *               moves the bytes is up to the owner.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "sbl_engine.h"
+#include "sbl_device_cc2640.h"
+#include "sbl_timeout.h"
+#include "sbl_probes.h"
+#include "sbl_metrics.h"
+
+/* Macros */
+#define MIN(x, y) (((x) < (y)) ? (x) : (y))
+
+/* Command transaction states */
+enum {
+    XS_IDLE = 0,
+    XS_TX,          /* Command queued, not drained yet */
+    XS_ACK,         /* Waiting for ACK/NAK */
+    XS_HDR,         /* Waiting for <len> <cksum> of the data response */
+    XS_DATA,        /* Waiting for the data response payload */
+};
+
+/* Steps shared by several operations */
+enum {
+    STEP_CMD = 0,
+    STEP_STATUS,
+    STEP_DATA,
+    STEP_DATA_STATUS,
+};
+
+/* Static functions */
+static tSblStatus startOp(tSblEngine *pEng, tSblOp op);
+static bool queueBytes(tSblEngine *pEng, const uint8_t *pcData, uint32_t ui32Len);
+static void queueCmd(tSblEngine *pEng, cmd_t cmdType, const uint8_t *pcPayload,
+                     uint32_t ui32Len, uint32_t ui32DataMax);
+static void queueCmdStatus(tSblEngine *pEng, cmd_t cmdType, const uint8_t *pcPayload,
+                           uint32_t ui32Len);
+static void requestStatus(tSblEngine *pEng);
+static void failCmd(tSblEngine *pEng);
+static void queueAck(tSblEngine *pEng, bool bAck);
+static bool takeStatus(tSblEngine *pEng);
+static void finish(tSblEngine *pEng, tSblStatus status);
+static void cmdComplete(tSblEngine *pEng);
+static void rxByte(tSblEngine *pEng, uint8_t byte, uint64_t ui64NowUs);
+static void stepEraseRange(tSblEngine *pEng);
+static void stepWriteRange(tSblEngine *pEng);
+static void stepReadMemory(tSblEngine *pEng);
+static void nextReadChunk(tSblEngine *pEng);
+static bool rangeInFlash(const tSblEngine *pEng, uint32_t ui32StartAddress,
+                         uint32_t ui32ByteCount);
+static bool rangeInRam(const tSblEngine *pEng, uint32_t ui32StartAddress,
+                       uint32_t ui32ByteCount);
+static uint32_t addressToPage(uint32_t ui32Address);
+
+/****************************************************************
+ * Function Name : sblEngineInit
+ * Description   : Puts a session in its initial idle state
+ * Returns       : None
+ * Params        @pEng: The session
+ ****************************************************************/
+void sblEngineInit(tSblEngine *pEng)
+{
+    memset(pEng, 0, sizeof(*pEng));
+}
+
+/****************************************************************
+ * Function Name : sblEngineSetSizes
+ * Description   : Tells the session the device memory sizes, used
+ *                 to check address ranges
+ * Returns       : None
+ * Params        @pEng: The session
+ *               @ui32FlashSize: Flash size in bytes
+ *               @ui32RamSize: RAM size in bytes
+ ****************************************************************/
+void sblEngineSetSizes(tSblEngine *pEng, uint32_t ui32FlashSize,
+                       uint32_t ui32RamSize)
+{
+    pEng->flashSize = ui32FlashSize;
+    pEng->ramSize = ui32RamSize;
+}
+
+/****************************************************************
+ * Function Name : sblEngineSetPipeline
+ * Description   : Lets the session send the GET_STATUS checking a
+ *                 DOWNLOAD, SEND_DATA or SECTOR_ERASE right behind
+ *                 it instead of after its ACK. Saves a round trip
+ *                 per chunk on links with a long one (TCP bridges).
+ *                 Takes effect with the next operation.
+ * Returns       : None
+ * Params        @pEng: The session
+ *               @bPipeline: true to pipeline
+ ****************************************************************/
+void sblEngineSetPipeline(tSblEngine *pEng, bool bPipeline)
+{
+    pEng->bPipeline = bPipeline;
+}
+
+/****************************************************************
+ * Function Name : sblEngineSetSyncTimeout
+ * Description   : Sets how long autobaud waits for the ACK. Short
+ *                 when polling for a device that may not be in the
+ *                 bootloader yet, 0 for the default.
+ * Returns       : None
+ * Params        @pEng: The session
+ *               @ui32Ms: Timeout in ms
+ ****************************************************************/
+void sblEngineSetSyncTimeout(tSblEngine *pEng, uint32_t ui32Ms)
+{
+    pEng->syncMs = ui32Ms;
+}
+
+/****************************************************************
+ * Function Name : sblEngineBusy
+ * Description   : Checks if an operation is in progress
+ * Returns       : true if one is
+ * Params        @pEng: The session
+ ****************************************************************/
+bool sblEngineBusy(const tSblEngine *pEng)
+{
+    return (pEng->op != SBL_OP_NONE);
+}
+
+/****************************************************************
+ * Function Name : sblEngineAutobaud
+ * Description   : Starts sending 0x55 0x55 and waiting for the
+ *                 ACK. A NAK counts as success, the device is
+ *                 talking to us at that baud rate.
+ * Returns       : SBL_SUCCESS if started
+ * Params        @pEng: The session
+ ****************************************************************/
+tSblStatus sblEngineAutobaud(tSblEngine *pEng)
+{
+    static const uint8_t pcSync[2] = {0x55, 0x55};
+    tSblStatus retCode;
+
+    if((retCode = startOp(pEng, SBL_OP_AUTOBAUD)) != SBL_SUCCESS)
+        return (retCode);
+
+    if(!queueBytes(pEng, pcSync, 2))
+        return (SBL_ERROR);
+
+    /* Time the ACK like a PING */
+    pEng->cmd = CMD_PING;
+    pEng->cmdUnits = 0;
+    pEng->bExpectData = false;
+    pEng->xstate = XS_TX;
+    pEng->rxLen = 0;
+    pEng->rxWant = 2;
+    return (SBL_SUCCESS);
+}
+
+/****************************************************************
+ * Function Name : sblEnginePing
+ * Description   : Starts a PING
+ * Returns       : SBL_SUCCESS if started
+ * Params        @pEng: The session
+ ****************************************************************/
+tSblStatus sblEnginePing(tSblEngine *pEng)
+{
+    tSblStatus retCode;
+    if((retCode = startOp(pEng, SBL_OP_PING)) != SBL_SUCCESS)
+        return (retCode);
+    queueCmd(pEng, CMD_PING, NULL, 0, 0);
+    return (SBL_SUCCESS);
+}
+
+/****************************************************************
+ * Function Name : sblEngineChipId
+ * Description   : Starts reading the chip ID, reported in the
+ *                 event's value
+ * Returns       : SBL_SUCCESS if started
+ * Params        @pEng: The session
+ ****************************************************************/
+tSblStatus sblEngineChipId(tSblEngine *pEng)
+{
+    tSblStatus retCode;
+    if((retCode = startOp(pEng, SBL_OP_CHIP_ID)) != SBL_SUCCESS)
+        return (retCode);
+    queueCmd(pEng, CMD_GET_CHIP_ID, NULL, 0, 4);
+    return (SBL_SUCCESS);
+}
+
+/****************************************************************
+ * Function Name : sblEngineReset
+ * Description   : Starts a reset. The session has to start over
+ *                 with autobaud afterwards.
+ * Returns       : SBL_SUCCESS if started
+ * Params        @pEng: The session
+ ****************************************************************/
+tSblStatus sblEngineReset(tSblEngine *pEng)
+{
+    tSblStatus retCode;
+    if((retCode = startOp(pEng, SBL_OP_RESET)) != SBL_SUCCESS)
+        return (retCode);
+    queueCmd(pEng, CMD_RESET, NULL, 0, 0);
+    return (SBL_SUCCESS);
+}
+
+/****************************************************************
+ * Function Name : sblEngineBankErase
+ * Description   : Starts erasing all customer accessible flash
+ *                 sectors not protected by FCFG1
+ * Returns       : SBL_SUCCESS if started
+ * Params        @pEng: The session
+ ****************************************************************/
+tSblStatus sblEngineBankErase(tSblEngine *pEng)
+{
+    tSblStatus retCode;
+    if((retCode = startOp(pEng, SBL_OP_BANK_ERASE)) != SBL_SUCCESS)
+        return (retCode);
+    queueCmd(pEng, CMD_BANK_ERASE, NULL, 0, 0);
+    return (SBL_SUCCESS);
+}
+
+/****************************************************************
+ * Function Name : sblEngineEraseRange
+ * Description   : Starts erasing the pages from the one holding
+ *                 \e ui32StartAddress up to the one holding
+ *                 <startAddress + byteCount>, checking the device
+ *                 status after every page
+ * Returns       : SBL_SUCCESS if started
+ * Params        @pEng: The session
+ *               @ui32StartAddress: The start address in flash.
+ *               @ui32ByteCount: The number of bytes to erase.
+ ****************************************************************/
+tSblStatus sblEngineEraseRange(tSblEngine *pEng, uint32_t ui32StartAddress,
+                               uint32_t ui32ByteCount)
+{
+    tSblStatus retCode;
+    if((retCode = startOp(pEng, SBL_OP_ERASE_RANGE)) != SBL_SUCCESS)
+        return (retCode);
+
+    pEng->addr = ui32StartAddress;
+    pEng->count = ui32ByteCount;
+    pEng->numChunks = ui32ByteCount / SBL_CC2650_PAGE_ERASE_SIZE;
+    if(ui32ByteCount % SBL_CC2650_PAGE_ERASE_SIZE) pEng->numChunks++;
+
+    if(!pEng->numChunks)
+    {
+        finish(pEng, SBL_SUCCESS);
+        return (SBL_SUCCESS);
+    }
+
+    stepEraseRange(pEng);
+    return (SBL_SUCCESS);
+}
+
+/****************************************************************
+ * Function Name : sblEngineWriteRange
+ * Description   : Starts programming flash: DOWNLOAD, then
+ *                 SEND_DATA chunks each followed by a status
+ *                 check, a failed chunk is retried once. The flash
+ *                 must have been erased.
+ * Returns       : SBL_SUCCESS if started
+ * Params        @pEng: The session
+ *               @ui32StartAddress: Start address, multiple of 4
+ *               @ui32ByteCount: Multiple of 4
+ *               @pcData: Source data, must stay valid until the
+ *                        operation completed
+ ****************************************************************/
+tSblStatus sblEngineWriteRange(tSblEngine *pEng, uint32_t ui32StartAddress,
+                               uint32_t ui32ByteCount, const uint8_t *pcData)
+{
+    tSblStatus retCode;
+
+    if(!rangeInFlash(pEng, ui32StartAddress, ui32ByteCount))
+    {
+        printf("Flash download: Address range (0x%08X + %d bytes) is not in device FLASH nor RAM.\n", ui32StartAddress, ui32ByteCount);
+        return (SBL_ARGUMENT_ERROR);
+    }
+    if(ui32ByteCount & 0x03)
+    {
+        printf("Flash download: Byte count must be a multiple of 4\n");
+        return (SBL_ARGUMENT_ERROR);
+    }
+
+    if((retCode = startOp(pEng, SBL_OP_WRITE_RANGE)) != SBL_SUCCESS)
+        return (retCode);
+
+    /* Calculate BL configuration address (depends on flash size) */
+    uint32_t ui32BlCfgAddr = SBL_CC2650_FLASH_START_ADDRESS + pEng->flashSize -
+            SBL_CC2650_PAGE_ERASE_SIZE + SBL_CC2650_BL_CONFIG_PAGE_OFFSET;
+    uint32_t ui32BlCfgDataIdx = ui32BlCfgAddr - ui32StartAddress;
+
+    /* Is BL configuration part of buffer? */
+    if(ui32BlCfgDataIdx < ui32ByteCount &&
+       pcData[ui32BlCfgDataIdx] != SBL_CC2650_BL_CONFIG_ENABLED_BM)
+        printf("Warning: CC2650 bootloader will be disabled.\n");
+
+    pEng->addr = ui32StartAddress;
+    pEng->count = ui32ByteCount;
+    pEng->pSrc = pcData;
+    pEng->step = STEP_CMD;
+
+    /* Generate payload - 4B program address, 4B program size */
+    uint8_t pcPayload[8];
+    ulToCharArray(ui32StartAddress, &pcPayload[0]);
+    ulToCharArray(ui32ByteCount, &pcPayload[4]);
+    queueCmdStatus(pEng, CMD_DOWNLOAD, pcPayload, 8);
+    return (SBL_SUCCESS);
+}
+
+/****************************************************************
+ * Function Name : sblEngineCrc32
+ * Description   : Starts a device side CRC32, reported in the
+ *                 event's value
+ * Returns       : SBL_SUCCESS if started
+ * Params        @pEng: The session
+ *               @ui32StartAddress: Start address in device
+ *               @ui32ByteCount: Number of bytes
+ ****************************************************************/
+tSblStatus sblEngineCrc32(tSblEngine *pEng, uint32_t ui32StartAddress,
+                          uint32_t ui32ByteCount)
+{
+    tSblStatus retCode;
+
+    if(!rangeInFlash(pEng, ui32StartAddress, ui32ByteCount) &&
+       !rangeInRam(pEng, ui32StartAddress, ui32ByteCount))
+    {
+        printf("Specified address range (0x%08X + %d bytes) is not in device FLASH nor RAM.\n", ui32StartAddress, ui32ByteCount);
+        return (SBL_ARGUMENT_ERROR);
+    }
+
+    if((retCode = startOp(pEng, SBL_OP_CRC32)) != SBL_SUCCESS)
+        return (retCode);
+
+    /* 4B address, 4B byte count (MSB first), 4B read repeat count */
+    uint8_t pcPayload[12];
+    ulToCharArray(ui32StartAddress, &pcPayload[0]);
+    ulToCharArray(ui32ByteCount, &pcPayload[4]);
+    memset(&pcPayload[8], 0, 4);
+
+    pEng->addr = ui32StartAddress;
+    pEng->count = ui32ByteCount;
+    queueCmd(pEng, CMD_CRC32, pcPayload, 12, 4);
+    return (SBL_SUCCESS);
+}
+
+/****************************************************************
+ * Function Name : sblEngineReadMemory
+ * Description   : Starts reading device memory in chunks
+ * Returns       : SBL_SUCCESS if started
+ * Params        @pEng: The session
+ *               @ui32StartAddress: Start address, multiple of 4
+ *                                  for 32 bit access
+ *               @ui32UnitCount: Number of bytes or words
+ *               @ui32Width: 1 for 8 bit, 4 for 32 bit access
+ *               @pcData: Destination, ui32UnitCount*ui32Width bytes
+ ****************************************************************/
+tSblStatus sblEngineReadMemory(tSblEngine *pEng, uint32_t ui32StartAddress,
+                               uint32_t ui32UnitCount, uint32_t ui32Width,
+                               uint8_t *pcData)
+{
+    tSblStatus retCode;
+
+    if(ui32Width == 4 && (ui32StartAddress & 0x03))
+    {
+        printf("readMemory32(): Start address (0x%08X) must be a multiple of 4.\n", ui32StartAddress);
+        return (SBL_ARGUMENT_ERROR);
+    }
+    if(ui32UnitCount == 0 || (ui32Width != 1 && ui32Width != 4))
+    {
+        printf("readMemory(): Read count is zero. Must be at least 1.\n");
+        return (SBL_ARGUMENT_ERROR);
+    }
+
+    if((retCode = startOp(pEng, SBL_OP_READ_MEMORY)) != SBL_SUCCESS)
+        return (retCode);
+
+    uint32_t maxUnits = (ui32Width == 4) ? SBL_CC2650_MAX_MEMREAD_WORDS : SBL_CC2650_MAX_MEMREAD_BYTES;
+    pEng->addr = ui32StartAddress;
+    pEng->count = ui32UnitCount;
+    pEng->width = ui32Width;
+    pEng->pDst = pcData;
+    pEng->numChunks = (ui32UnitCount + maxUnits - 1) / maxUnits;
+    nextReadChunk(pEng);
+    return (SBL_SUCCESS);
+}
+
+/****************************************************************
+ * Function Name : sblEngineSetCcfg
+ * Description   : Starts writing a CCFG field
+ * Returns       : SBL_SUCCESS if started
+ * Params        @pEng: The session
+ *               @ui32Field: CCFG field ID
+ *               @ui32FieldValue: Field value to be programmed
+ ****************************************************************/
+tSblStatus sblEngineSetCcfg(tSblEngine *pEng, uint32_t ui32Field,
+                            uint32_t ui32FieldValue)
+{
+    tSblStatus retCode;
+    if((retCode = startOp(pEng, SBL_OP_SET_CCFG)) != SBL_SUCCESS)
+        return (retCode);
+
+    /* 4B field ID, 4B field value */
+    uint8_t pcPayload[8];
+    ulToCharArray(ui32Field, &pcPayload[0]);
+    ulToCharArray(ui32FieldValue, &pcPayload[4]);
+    queueCmd(pEng, CMD_SET_CCFG, pcPayload, 8, 0);
+    return (SBL_SUCCESS);
+}
+
+/****************************************************************
+ * Function Name : sblEngineTxPending
+ * Description   : Bytes waiting to be transmitted
+ * Returns       : Number of bytes
+ * Params        @pEng: The session
+ *               @ppData: Populated with where they are
+ ****************************************************************/
+uint32_t sblEngineTxPending(const tSblEngine *pEng, const uint8_t **ppData)
+{
+    *ppData = &pEng->tx[pEng->txOff];
+    return (pEng->txLen - pEng->txOff);
+}
+
+/****************************************************************
+ * Function Name : sblEngineTxDone
+ * Description   : Reports bytes as transmitted (drained to the
+ *                 wire). Once a command is out completely its
+ *                 response deadline starts.
+ * Returns       : None
+ * Params        @pEng: The session
+ *               @ui32Len: Number of bytes gone
+ *               @ui64NowUs: Current time
+ ****************************************************************/
+void sblEngineTxDone(tSblEngine *pEng, uint32_t ui32Len, uint64_t ui64NowUs)
+{
+    uint32_t sent;
+
+    pEng->txOff = MIN(pEng->txOff + ui32Len, pEng->txLen);
+    if(pEng->txOff < pEng->txLen)
+        return;
+
+    sent = pEng->txLen;
+    pEng->txOff = pEng->txLen = 0;
+    if(pEng->xstate == XS_TX)
+    {
+        pEng->xstate = XS_ACK;
+        pEng->txDoneUs = ui64NowUs;
+        SBL_PROBE3(cmd__sent, pEng->cmd, sent, SBL_SUCCESS);
+        /* The sync ACK is timed like a PING's, on the learned link */
+        if(pEng->op == SBL_OP_AUTOBAUD)
+            pEng->deadlineUs = ui64NowUs + (uint64_t)((pEng->syncMs) ? pEng->syncMs :
+                                                       getCmdTimeoutMs(CMD_PING, 0))*1000;
+        else
+            pEng->deadlineUs = ui64NowUs + (uint64_t)getCmdTimeoutMs(pEng->cmd, pEng->cmdUnits)*1000;
+    }
+}
+
+/****************************************************************
+ * Function Name : sblEngineRxWanted
+ * Description   : How many bytes complete what the session is
+ *                 currently waiting for. Blocking owners can read
+ *                 exactly that many.
+ * Returns       : Number of bytes, 0 if nothing is expected
+ * Params        @pEng: The session
+ ****************************************************************/
+uint32_t sblEngineRxWanted(const tSblEngine *pEng)
+{
+    if(pEng->xstate == XS_IDLE)
+        return (0);
+    return (pEng->rxWant - pEng->rxLen);
+}
+
+/****************************************************************
+ * Function Name : sblEngineRx
+ * Description   : Feeds received bytes
+ * Returns       : None
+ * Params        @pEng: The session
+ *               @pcData: Bytes received
+ *               @ui32Len: Number of bytes
+ *               @ui64NowUs: When they were received
+ ****************************************************************/
+void sblEngineRx(tSblEngine *pEng, const uint8_t *pcData, uint32_t ui32Len,
+                 uint64_t ui64NowUs)
+{
+    for(uint32_t i = 0; i < ui32Len; i++)
+        rxByte(pEng, pcData[i], ui64NowUs);
+}
+
+/****************************************************************
+ * Function Name : sblEngineDeadline
+ * Description   : When the response being waited for times out
+ * Returns       : Time in microseconds, 0 if there is no deadline
+ * Params        @pEng: The session
+ ****************************************************************/
+uint64_t sblEngineDeadline(const tSblEngine *pEng)
+{
+    return (pEng->xstate == XS_IDLE || pEng->xstate == XS_TX) ? 0 : pEng->deadlineUs;
+}
+
+/****************************************************************
+ * Function Name : sblEngineTick
+ * Description   : Lets the session check its deadline
+ * Returns       : None
+ * Params        @pEng: The session
+ *               @ui64NowUs: Current time
+ ****************************************************************/
+void sblEngineTick(tSblEngine *pEng, uint64_t ui64NowUs)
+{
+    uint64_t deadline = sblEngineDeadline(pEng);
+    if(!deadline || ui64NowUs < deadline)
+        return;
+
+    if(pEng->xstate == XS_ACK)
+        backoffCmdTimeout(pEng->cmd);
+    if(pEng->op != SBL_OP_AUTOBAUD)
+        metricsCommand(pEng->cmd, "timeout");
+    pEng->event.failAddr = pEng->addr + pEng->offset;
+    finish(pEng, SBL_TIMEOUT_ERROR);
+}
+
+/****************************************************************
+ * Function Name : sblEngineAbort
+ * Description   : Ends the operation in progress, e.g. because
+ *                 the port failed
+ * Returns       : None
+ * Params        @pEng: The session
+ *               @status: Status to report
+ ****************************************************************/
+void sblEngineAbort(tSblEngine *pEng, tSblStatus status)
+{
+    pEng->txOff = pEng->txLen = 0;
+    if(pEng->op != SBL_OP_NONE)
+        finish(pEng, status);
+}
+
+/****************************************************************
+ * Function Name : sblEngineEvent
+ * Description   : Takes the completion of the last operation
+ * Returns       : true if there was one
+ * Params        @pEng: The session
+ *               @pEvent: Populated with the completion
+ ****************************************************************/
+bool sblEngineEvent(tSblEngine *pEng, tSblEvent *pEvent)
+{
+    if(!pEng->bEventPending)
+        return false;
+    *pEvent = pEng->event;
+    pEng->bEventPending = false;
+    return true;
+}
+
+/****************************************************************
+ * Function Name : getOpString
+ * Description   : Name of an operation
+ * Returns       : String with the name
+ * Params        @op: The operation
+ ****************************************************************/
+const char *getOpString(tSblOp op)
+{
+    switch(op)
+    {
+    case SBL_OP_AUTOBAUD:       return "autobaud"; break;
+    case SBL_OP_PING:           return "ping"; break;
+    case SBL_OP_CHIP_ID:        return "chip_id"; break;
+    case SBL_OP_RESET:          return "reset"; break;
+    case SBL_OP_BANK_ERASE:     return "bank_erase"; break;
+    case SBL_OP_ERASE_RANGE:    return "erase_range"; break;
+    case SBL_OP_WRITE_RANGE:    return "write_range"; break;
+    case SBL_OP_CRC32:          return "crc32"; break;
+    case SBL_OP_READ_MEMORY:    return "read_memory"; break;
+    case SBL_OP_SET_CCFG:       return "set_ccfg"; break;
+    default:                    return "none"; break;
+    }
+}
+
+/* Claim the session for an operation */
+static tSblStatus startOp(tSblEngine *pEng, tSblOp op)
+{
+    if(pEng->op != SBL_OP_NONE)
+        return (SBL_ERROR);
+
+    pEng->op = op;
+    pEng->idx = 0;
+    pEng->offset = 0;
+    pEng->step = STEP_CMD;
+    pEng->bIsRetry = false;
+    pEng->progress = 0;
+    pEng->bEventPending = false;
+    memset(&pEng->event, 0, sizeof(pEng->event));
+    return (SBL_SUCCESS);
+}
+
+/* Append raw bytes to the transmit queue */
+static bool queueBytes(tSblEngine *pEng, const uint8_t *pcData, uint32_t ui32Len)
+{
+    /* Compact what is still pending to the front */
+    if(pEng->txOff)
+    {
+        memmove(pEng->tx, &pEng->tx[pEng->txOff], pEng->txLen - pEng->txOff);
+        pEng->txLen -= pEng->txOff;
+        pEng->txOff = 0;
+    }
+
+    if(pEng->txLen + ui32Len > SBL_ENGINE_TX_MAX)
+    {
+        printf("Engine: transmit queue overflow\n");
+        return false;
+    }
+
+    memcpy(&pEng->tx[pEng->txLen], pcData, ui32Len);
+    pEng->txLen += ui32Len;
+    return true;
+}
+
+/* Queue <len> <cksum> <cmd> <payload> and wait for its ACK */
+static void queueCmd(tSblEngine *pEng, cmd_t cmdType, const uint8_t *pcPayload,
+                     uint32_t ui32Len, uint32_t ui32DataMax)
+{
+    uint8_t pcHdr[3];
+    pcHdr[0] = ui32Len + 3;
+    pcHdr[1] = generateCheckSum(cmdType, (const char*)pcPayload, ui32Len);
+    pcHdr[2] = cmdType;
+
+    if(!queueBytes(pEng, pcHdr, 3) || !queueBytes(pEng, pcPayload, ui32Len))
+    {
+        finish(pEng, SBL_ERROR);
+        return;
+    }
+
+    SBL_PROBE3(cmd__send, cmdType, pEng->addr + pEng->offset, ui32Len);
+    pEng->cmd = cmdType;
+    pEng->cmdUnits = getCmdUnits(cmdType, pcPayload, ui32Len);
+    pEng->bChained = false;
+    pEng->bExpectData = (ui32DataMax != 0);
+    pEng->dataMax = ui32DataMax;
+    pEng->xstate = XS_TX;
+    pEng->rxLen = 0;
+    pEng->rxWant = 2;
+}
+
+/* Queue a command checked with GET_STATUS once answered. When
+ * pipelining, the GET_STATUS goes out right behind it. Only one: the
+ * device keeps a failed chunk's place, so later chunks must wait. */
+static void queueCmdStatus(tSblEngine *pEng, cmd_t cmdType, const uint8_t *pcPayload,
+                           uint32_t ui32Len)
+{
+    uint8_t pcStatus[3] = { 3, 0, CMD_GET_STATUS };
+
+    queueCmd(pEng, cmdType, pcPayload, ui32Len, 0);
+    if(!pEng->bPipeline || pEng->xstate != XS_TX)
+        return;
+
+    pcStatus[1] = generateCheckSum(CMD_GET_STATUS, NULL, 0);
+    if(queueBytes(pEng, pcStatus, 3))
+    {
+        SBL_PROBE3(cmd__send, CMD_GET_STATUS, 0, 0);
+        pEng->bStatusSent = true;
+    }
+}
+
+/* The command was answered, get the device status */
+static void requestStatus(tSblEngine *pEng)
+{
+    if(!pEng->bStatusSent)
+    {
+        queueCmd(pEng, CMD_GET_STATUS, NULL, 0, 1);
+        return;
+    }
+
+    /* Already sent, its answer follows the one just taken */
+    pEng->bStatusSent = false;
+    pEng->bChained = true;
+    pEng->cmd = CMD_GET_STATUS;
+    pEng->cmdUnits = getCmdUnits(CMD_GET_STATUS, NULL, 0);
+    pEng->bExpectData = true;
+    pEng->dataMax = 1;
+    pEng->xstate = XS_ACK;
+    pEng->rxLen = 0;
+    pEng->rxWant = 2;
+    pEng->txDoneUs = pEng->ackUs;
+    pEng->deadlineUs = pEng->ackUs + (uint64_t)getCmdTimeoutMs(CMD_GET_STATUS, pEng->cmdUnits)*1000;
+}
+
+/* The command was NAKed. A GET_STATUS sent behind it is answered
+ * anyway, take that before failing so it can't be mistaken for the
+ * answer to whatever comes next. */
+static void failCmd(tSblEngine *pEng)
+{
+    if(!pEng->bStatusSent)
+    {
+        finish(pEng, SBL_ERROR);
+        return;
+    }
+    pEng->bFailPending = true;
+    requestStatus(pEng);
+}
+
+/* Answer a data response */
+static void queueAck(tSblEngine *pEng, bool bAck)
+{
+    uint8_t pcData[2] = { 0x00, (bAck) ? 0xCC : 0x33 };
+    queueBytes(pEng, pcData, 2);
+}
+
+/* Data response of GET_STATUS arrived, ACK it and keep the status */
+static bool takeStatus(tSblEngine *pEng)
+{
+    if(!pEng->bAck)
+    {
+        printf("Failed to read device status.\n");
+        finish(pEng, SBL_ERROR);
+        return false;
+    }
+    queueAck(pEng, true);
+    pEng->devStatus = pEng->rsp[0];
+    pEng->event.devStatus = pEng->devStatus;
+    return true;
+}
+
+/* Complete the operation and post its event */
+static void finish(tSblEngine *pEng, tSblStatus status)
+{
+    pEng->event.op = pEng->op;
+    pEng->event.status = status;
+    pEng->bEventPending = true;
+    pEng->op = SBL_OP_NONE;
+    pEng->xstate = XS_IDLE;
+    pEng->rxLen = 0;
+    pEng->rxWant = 0;
+    pEng->deadlineUs = 0;
+    pEng->bStatusSent = false;
+    pEng->bChained = false;
+    pEng->bFailPending = false;
+    if(status == SBL_SUCCESS)
+        pEng->progress = 100;
+}
+
+/* A command transaction (ACK and data response if any) completed */
+static void cmdComplete(tSblEngine *pEng)
+{
+    pEng->xstate = XS_IDLE;
+    pEng->deadlineUs = 0;
+
+    if(pEng->bFailPending)
+    {
+        if(pEng->bAck)
+            queueAck(pEng, true);
+        finish(pEng, SBL_ERROR);
+        return;
+    }
+
+    switch(pEng->op)
+    {
+    case SBL_OP_AUTOBAUD:
+        if(pEng->bAck)
+            printf("Auto baud detected 0x00 0xCC.\n");
+        finish(pEng, SBL_SUCCESS);
+        break;
+
+    case SBL_OP_PING:
+    case SBL_OP_BANK_ERASE:
+        finish(pEng, (pEng->bAck) ? SBL_SUCCESS : SBL_ERROR);
+        break;
+
+    case SBL_OP_RESET:
+        if(!pEng->bAck)
+            printf("Reset command NAKed by device.\n");
+        finish(pEng, (pEng->bAck) ? SBL_SUCCESS : SBL_ERROR);
+        break;
+
+    case SBL_OP_SET_CCFG:
+        if(!pEng->bAck)
+            printf("Set CCFG command NAKed by device.\n");
+        finish(pEng, (pEng->bAck) ? SBL_SUCCESS : SBL_ERROR);
+        break;
+
+    case SBL_OP_CHIP_ID:
+    case SBL_OP_CRC32:
+        if(!pEng->bAck)
+        {
+            if(pEng->op == SBL_OP_CRC32)
+                printf("Device NAKed CRC32 command.\n");
+            finish(pEng, SBL_ERROR);
+            break;
+        }
+        if(pEng->rspLen != 4)
+        {
+            queueAck(pEng, false);
+            printf("Didn't receive 4 B.\n");
+            finish(pEng, SBL_ERROR);
+            break;
+        }
+        queueAck(pEng, true);
+        pEng->event.value = charArrayToUL((const char*)pEng->rsp);
+        finish(pEng, SBL_SUCCESS);
+        break;
+
+    case SBL_OP_ERASE_RANGE:
+        stepEraseRange(pEng);
+        break;
+
+    case SBL_OP_WRITE_RANGE:
+        stepWriteRange(pEng);
+        break;
+
+    case SBL_OP_READ_MEMORY:
+        stepReadMemory(pEng);
+        break;
+
+    default:
+        break;
+    }
+}
+
+/* Receive state machine, one byte at a time */
+static void rxByte(tSblEngine *pEng, uint8_t byte, uint64_t ui64NowUs)
+{
+    if(pEng->xstate == XS_IDLE)
+    {
+        pEng->stray++;
+        return;
+    }
+
+    pEng->rx[pEng->rxLen++] = byte;
+    if(pEng->rxLen < pEng->rxWant)
+        return;
+
+    switch(pEng->xstate)
+    {
+    case XS_TX:
+    case XS_ACK:
+        if(pEng->rx[0] == 0x00 && (pEng->rx[1] == 0xCC || pEng->rx[1] == 0x33))
+        {
+            pEng->bAck = (pEng->rx[1] == 0xCC);
+            if(!pEng->bAck)
+                printf("NACK received 0x%02X 0x%02X.\n", pEng->rx[0], pEng->rx[1]);
+            SBL_PROBE3(cmd__ack, pEng->cmd, pEng->bAck,
+                       (ui64NowUs > pEng->txDoneUs) ? ui64NowUs - pEng->txDoneUs : 0);
+            if(pEng->op != SBL_OP_AUTOBAUD)
+                metricsCommand(pEng->cmd, (pEng->bAck) ? "ack" : "nak");
+
+            /* A response can't beat the end of its command, unless
+             * the owner reports TX completion late. A chained
+             * GET_STATUS went out before the previous answer, its
+             * latency isn't one. */
+            if(pEng->xstate == XS_ACK && !pEng->bChained)
+            {
+                uint64_t latencyUs = (ui64NowUs > pEng->txDoneUs) ? ui64NowUs - pEng->txDoneUs : 0;
+                updateCmdLatency(pEng->cmd, pEng->cmdUnits, (uint32_t)latencyUs);
+                if(pEng->op != SBL_OP_AUTOBAUD)
+                    metricsCommandLatency(pEng->cmd, latencyUs);
+            }
+        }
+        else
+        {
+            printf("ACK/NAK not received. Expected 0x00 0xCC or 0x00 0x33, received 0x%02X 0x%02X.\n", pEng->rx[0], pEng->rx[1]);
+            pEng->event.failAddr = pEng->addr + pEng->offset;
+            finish(pEng, SBL_ERROR);
+            return;
+        }
+
+        pEng->rxLen = 0;
+        pEng->ackUs = ui64NowUs;
+        if(pEng->bAck && pEng->bExpectData)
+        {
+            pEng->xstate = XS_HDR;
+            pEng->rxWant = 2;
+            pEng->deadlineUs = ui64NowUs + (uint64_t)getDataTimeoutMs(2)*1000;
+            return;
+        }
+        cmdComplete(pEng);
+        break;
+
+    case XS_HDR:
+        if(pEng->rx[0] < 2 || (uint32_t)(pEng->rx[0] - 2) > pEng->dataMax)
+        {
+            printf("Error: Device sending more data than expected. \nMax expected was %d, sent was %d.\n", pEng->dataMax, pEng->rx[0]);
+            queueAck(pEng, false);
+            finish(pEng, SBL_ERROR);
+            return;
+        }
+        pEng->rxWant = pEng->rx[0];
+        pEng->deadlineUs = ui64NowUs + (uint64_t)getDataTimeoutMs(pEng->rxWant - 2)*1000;
+        pEng->xstate = XS_DATA;
+        if(pEng->rxLen < pEng->rxWant)
+            return;
+        /* Empty response */
+        /* fall through */
+
+    case XS_DATA:
+    {
+        uint8_t dataChecksum = generateCheckSum(0, (const char*)&pEng->rx[2], pEng->rxWant - 2);
+        if(dataChecksum != pEng->rx[1])
+        {
+            SBL_PROBE3(cmd__data, pEng->cmd, pEng->rxWant - 2, SBL_ERROR);
+            printf("Checksum verification error. Expected 0x%02X, got 0x%02X.\n", pEng->rx[1], dataChecksum);
+            queueAck(pEng, false);
+            finish(pEng, SBL_ERROR);
+            return;
+        }
+        pEng->rspLen = pEng->rxWant - 2;
+        memcpy(pEng->rsp, &pEng->rx[2], pEng->rspLen);
+        SBL_PROBE3(cmd__data, pEng->cmd, pEng->rspLen, SBL_SUCCESS);
+        pEng->rxLen = 0;
+        pEng->ackUs = ui64NowUs;
+        cmdComplete(pEng);
+        break;
+    }
+
+    default:
+        break;
+    }
+}
+
+/* SECTOR_ERASE + GET_STATUS per page */
+static void stepEraseRange(tSblEngine *pEng)
+{
+    uint8_t pcPayload[4];
+    uint32_t pageAddr = pEng->addr + pEng->idx*SBL_CC2650_PAGE_ERASE_SIZE;
+
+    switch(pEng->step)
+    {
+    case STEP_CMD:
+        /* Erase the page, then read status once it's answered */
+        pEng->step = STEP_STATUS;
+        ulToCharArray(pageAddr, pcPayload);
+        queueCmdStatus(pEng, CMD_SECTOR_ERASE, pcPayload, 4);
+        break;
+
+    case STEP_STATUS:
+        /* SECTOR_ERASE answered */
+        if(!pEng->bAck)
+        {
+            pEng->event.failAddr = pageAddr;
+            failCmd(pEng);
+            break;
+        }
+        pEng->step = STEP_DATA_STATUS;
+        requestStatus(pEng);
+        break;
+
+    case STEP_DATA_STATUS:
+        if(!takeStatus(pEng))
+            break;
+        if(pEng->devStatus != CMD_RET_SUCCESS)
+        {
+            printf("Flash erase failed. (Status 0x%02X = %s). Flash pages may be locked.\n", pEng->devStatus, getCmdStatusString(pEng->devStatus));
+            pEng->event.failAddr = pageAddr;
+            finish(pEng, SBL_ERROR);
+            break;
+        }
+
+        pEng->idx++;
+        pEng->offset = pEng->idx*SBL_CC2650_PAGE_ERASE_SIZE;
+        pEng->progress = 100*pEng->idx/pEng->numChunks;
+        if(pEng->idx == pEng->numChunks)
+        {
+            finish(pEng, SBL_SUCCESS);
+            break;
+        }
+        pEng->step = STEP_CMD;
+        stepEraseRange(pEng);
+        break;
+    }
+}
+
+/* DOWNLOAD, GET_STATUS, then SEND_DATA + GET_STATUS per chunk */
+static void stepWriteRange(tSblEngine *pEng)
+{
+    uint32_t chunkAddr = pEng->addr + pEng->offset;
+
+    switch(pEng->step)
+    {
+    case STEP_CMD:
+        /* DOWNLOAD answered */
+        if(!pEng->bAck)
+        {
+            failCmd(pEng);
+            break;
+        }
+        pEng->step = STEP_STATUS;
+        requestStatus(pEng);
+        break;
+
+    case STEP_STATUS:
+        if(!takeStatus(pEng))
+            break;
+        if(pEng->devStatus != CMD_RET_SUCCESS)
+        {
+            printf("Error during download initialization. Device returned status %d (%s).\n", pEng->devStatus, getCmdStatusString(pEng->devStatus));
+            finish(pEng, SBL_ERROR);
+            break;
+        }
+        pEng->step = STEP_DATA;
+        pEng->chunkLen = MIN(SBL_CC2650_MAX_BYTES_PER_TRANSFER, pEng->count - pEng->offset);
+        SBL_PROBE3(flash__chunk, pEng->addr + pEng->offset, pEng->chunkLen, pEng->idx);
+        queueCmdStatus(pEng, CMD_SEND_DATA, &pEng->pSrc[pEng->offset], pEng->chunkLen);
+        break;
+
+    case STEP_DATA:
+        /* SEND_DATA answered */
+        if(!pEng->bAck)
+        {
+            printf("Error during flash download. \n- Start address 0x%08X (page %d). \n- Tried to transfer %d bytes. \n- This was transfer %d.\n",
+                   chunkAddr, addressToPage(chunkAddr), pEng->chunkLen, pEng->idx + 1);
+            pEng->event.failAddr = chunkAddr;
+            failCmd(pEng);
+            break;
+        }
+        pEng->step = STEP_DATA_STATUS;
+        requestStatus(pEng);
+        break;
+
+    case STEP_DATA_STATUS:
+        if(!takeStatus(pEng))
+            break;
+        if(pEng->devStatus != CMD_RET_SUCCESS)
+        {
+            printf("Device returned status %s\n", getCmdStatusString(pEng->devStatus));
+            if(pEng->bIsRetry)
+            {
+                /* We have failed a second time. Aborting. */
+                printf("Error retrying flash download.\n- Start address 0x%08X (page %d). \n- Tried to transfer %d bytes. \n- This was transfer %d.\n",
+                       chunkAddr, addressToPage(chunkAddr), pEng->chunkLen, pEng->idx + 1);
+                pEng->event.failAddr = chunkAddr;
+                finish(pEng, SBL_ERROR);
+                break;
+            }
+            /* Retry to send data one more time. */
+            pEng->bIsRetry = true;
+            metricsRetry("send_data");
+        }
+        else
+        {
+            pEng->offset += pEng->chunkLen;
+            pEng->idx++;
+            pEng->bIsRetry = false;
+            pEng->progress = (uint32_t)((100ULL*pEng->offset)/pEng->count);
+            if(pEng->offset == pEng->count)
+            {
+                finish(pEng, SBL_SUCCESS);
+                break;
+            }
+        }
+        pEng->step = STEP_DATA;
+        pEng->chunkLen = MIN(SBL_CC2650_MAX_BYTES_PER_TRANSFER, pEng->count - pEng->offset);
+        SBL_PROBE3(flash__chunk, pEng->addr + pEng->offset, pEng->chunkLen, pEng->idx);
+        queueCmdStatus(pEng, CMD_SEND_DATA, &pEng->pSrc[pEng->offset], pEng->chunkLen);
+        break;
+    }
+}
+
+/* Queue the MEMORY_READ of chunk idx */
+static void nextReadChunk(tSblEngine *pEng)
+{
+    uint8_t pcPayload[6];
+    uint32_t maxUnits = (pEng->width == 4) ? SBL_CC2650_MAX_MEMREAD_WORDS : SBL_CC2650_MAX_MEMREAD_BYTES;
+    uint32_t chunkStart = pEng->addr + pEng->idx*maxUnits*pEng->width;
+
+    /* 4B address (MSB first), 1B access width, 1B number of accesses */
+    pEng->chunkLen = MIN(pEng->count - pEng->idx*maxUnits, maxUnits);
+    ulToCharArray(chunkStart, &pcPayload[0]);
+    pcPayload[4] = (pEng->width == 4) ? SBL_CC2650_ACCESS_WIDTH_32B : SBL_CC2650_ACCESS_WIDTH_8B;
+    pcPayload[5] = pEng->chunkLen;
+    queueCmd(pEng, CMD_MEMORY_READ, pcPayload, 6, pEng->chunkLen*pEng->width);
+}
+
+/* MEMORY_READ answered */
+static void stepReadMemory(tSblEngine *pEng)
+{
+    uint32_t maxUnits = (pEng->width == 4) ? SBL_CC2650_MAX_MEMREAD_WORDS : SBL_CC2650_MAX_MEMREAD_BYTES;
+    uint32_t expectedBytes = pEng->chunkLen*pEng->width;
+
+    if(!pEng->bAck)
+    {
+        finish(pEng, SBL_ERROR);
+        return;
+    }
+    if(pEng->rspLen != expectedBytes)
+    {
+        queueAck(pEng, false);
+        printf("readMemory(): Received %d bytes (%d B expected) in iteration %d.\n", pEng->rspLen, expectedBytes, pEng->idx);
+        finish(pEng, SBL_ERROR);
+        return;
+    }
+
+    memcpy(&pEng->pDst[pEng->idx*maxUnits*pEng->width], pEng->rsp, expectedBytes);
+    queueAck(pEng, true);
+
+    pEng->idx++;
+    pEng->offset += expectedBytes;
+    pEng->progress = 100*pEng->idx/pEng->numChunks;
+    if(pEng->idx == pEng->numChunks)
+        finish(pEng, SBL_SUCCESS);
+    else
+        nextReadChunk(pEng);
+}
+
+/* Is the range within the device flash */
+static bool rangeInFlash(const tSblEngine *pEng, uint32_t ui32StartAddress,
+                         uint32_t ui32ByteCount)
+{
+    uint64_t ui64EndAddr = (uint64_t)ui32StartAddress + ui32ByteCount;
+    return (ui64EndAddr <= (uint64_t)SBL_CC2650_FLASH_START_ADDRESS + pEng->flashSize);
+}
+
+/* Is the range within the device RAM */
+static bool rangeInRam(const tSblEngine *pEng, uint32_t ui32StartAddress,
+                       uint32_t ui32ByteCount)
+{
+    uint64_t ui64EndAddr = (uint64_t)ui32StartAddress + ui32ByteCount;
+
+    if(ui32StartAddress < SBL_CC2650_RAM_START_ADDRESS)
+        return false;
+    return (ui64EndAddr <= (uint64_t)SBL_CC2650_RAM_START_ADDRESS + pEng->ramSize);
+}
+
+/* Flash page an address is in */
+static uint32_t addressToPage(uint32_t ui32Address)
+{
+    return ((ui32Address - SBL_CC2650_FLASH_START_ADDRESS) / SBL_CC2650_PAGE_ERASE_SIZE);
+}
@@ -0,0 +1,141 @@
+/*
+ * sbl_engine.h
+ *
+ *  Created on: 18/10/2026
+ */
+
+#ifndef SBL_ENGINE_H_
+#define SBL_ENGINE_H_
+#include <stdint.h>
+#include <stdbool.h>
+#include "sbl_device.h"
+
+/* Largest packet we ever queue: <len> <cksum> <cmd> + 252B SEND_DATA,
+ * plus the ACK of a previous data response in front of it and, when
+ * pipelining, the GET_STATUS behind it */
+#define SBL_ENGINE_TX_MAX       (2 + 255 + 3)
+/* Largest data response: 253B memory read + <len> <cksum> */
+#define SBL_ENGINE_RX_MAX       (255)
+
+/* High level operations */
+typedef enum {
+    SBL_OP_NONE = 0,
+    SBL_OP_AUTOBAUD,
+    SBL_OP_PING,
+    SBL_OP_CHIP_ID,
+    SBL_OP_RESET,
+    SBL_OP_BANK_ERASE,
+    SBL_OP_ERASE_RANGE,
+    SBL_OP_WRITE_RANGE,
+    SBL_OP_CRC32,
+    SBL_OP_READ_MEMORY,
+    SBL_OP_SET_CCFG,
+} tSblOp;
+
+/* Completion of a high level operation */
+typedef struct {
+    tSblOp     op;
+    tSblStatus status;
+    uint32_t   value;           /* CRC32 / chip ID */
+    uint32_t   devStatus;       /* Last device status read */
+    uint32_t   failAddr;        /* Where it went wrong */
+} tSblEvent;
+
+/* One bootloader session. All state lives here, the engine never
+ * touches a file descriptor: the owner moves bytes in and out with
+ * sblEngineTxPending()/sblEngineTxDone()/sblEngineRx() and calls
+ * sblEngineTick() when sblEngineDeadline() passed. */
+typedef struct {
+    /* Operation */
+    tSblOp          op;
+    uint32_t        addr;
+    uint32_t        count;
+    uint32_t        width;          /* Memory access width, 1 or 4 */
+    const uint8_t  *pSrc;
+    uint8_t        *pDst;
+    uint32_t        idx;            /* Page/chunk being worked on */
+    uint32_t        offset;         /* Bytes done */
+    uint32_t        numChunks;
+    uint32_t        chunkLen;
+    uint32_t        step;           /* Where in the op's sequence we are */
+    bool            bIsRetry;
+    uint32_t        progress;       /* 0-100 */
+    bool            bPipeline;      /* Send GET_STATUS right behind the
+                                     * command it checks */
+    uint32_t        syncMs;         /* Autobaud ACK timeout, 0: default */
+
+    /* Command transaction in flight */
+    uint32_t        xstate;
+    cmd_t           cmd;
+    uint32_t        cmdUnits;
+    bool            bAck;
+    bool            bExpectData;
+    uint32_t        dataMax;
+    uint64_t        txDoneUs;
+    uint64_t        deadlineUs;
+    uint64_t        ackUs;          /* When the last answer completed */
+    bool            bStatusSent;    /* GET_STATUS already queued behind cmd */
+    bool            bChained;       /* Awaiting that GET_STATUS */
+    bool            bFailPending;   /* cmd NAKed, report once it's answered */
+
+    /* Transmit queue */
+    uint8_t         tx[SBL_ENGINE_TX_MAX];
+    uint32_t        txLen;
+    uint32_t        txOff;
+
+    /* Receive accumulator and last data response */
+    uint8_t         rx[SBL_ENGINE_RX_MAX];
+    uint32_t        rxLen;
+    uint32_t        rxWant;
+    uint8_t         rsp[SBL_ENGINE_RX_MAX];
+    uint32_t        rspLen;
+
+    /* Device */
+    uint32_t        flashSize;
+    uint32_t        ramSize;
+    uint32_t        devStatus;
+    uint32_t        stray;          /* Bytes received while idle */
+
+    /* Completion */
+    bool            bEventPending;
+    tSblEvent       event;
+} tSblEngine;
+
+extern void sblEngineInit(tSblEngine *pEng);
+extern void sblEngineSetSizes(tSblEngine *pEng, uint32_t ui32FlashSize,
+                              uint32_t ui32RamSize);
+extern void sblEngineSetPipeline(tSblEngine *pEng, bool bPipeline);
+extern void sblEngineSetSyncTimeout(tSblEngine *pEng, uint32_t ui32Ms);
+extern bool sblEngineBusy(const tSblEngine *pEng);
+
+/* Starting operations, SBL_SUCCESS if it was started */
+extern tSblStatus sblEngineAutobaud(tSblEngine *pEng);
+extern tSblStatus sblEnginePing(tSblEngine *pEng);
+extern tSblStatus sblEngineChipId(tSblEngine *pEng);
+extern tSblStatus sblEngineReset(tSblEngine *pEng);
+extern tSblStatus sblEngineBankErase(tSblEngine *pEng);
+extern tSblStatus sblEngineEraseRange(tSblEngine *pEng, uint32_t ui32StartAddress,
+                                      uint32_t ui32ByteCount);
+extern tSblStatus sblEngineWriteRange(tSblEngine *pEng, uint32_t ui32StartAddress,
+                                      uint32_t ui32ByteCount, const uint8_t *pcData);
+extern tSblStatus sblEngineCrc32(tSblEngine *pEng, uint32_t ui32StartAddress,
+                                 uint32_t ui32ByteCount);
+extern tSblStatus sblEngineReadMemory(tSblEngine *pEng, uint32_t ui32StartAddress,
+                                      uint32_t ui32UnitCount, uint32_t ui32Width,
+                                      uint8_t *pcData);
+extern tSblStatus sblEngineSetCcfg(tSblEngine *pEng, uint32_t ui32Field,
+                                   uint32_t ui32FieldValue);
+
+/* Moving bytes */
+extern uint32_t sblEngineTxPending(const tSblEngine *pEng, const uint8_t **ppData);
+extern void sblEngineTxDone(tSblEngine *pEng, uint32_t ui32Len, uint64_t ui64NowUs);
+extern uint32_t sblEngineRxWanted(const tSblEngine *pEng);
+extern void sblEngineRx(tSblEngine *pEng, const uint8_t *pcData, uint32_t ui32Len,
+                        uint64_t ui64NowUs);
+extern uint64_t sblEngineDeadline(const tSblEngine *pEng);
+extern void sblEngineTick(tSblEngine *pEng, uint64_t ui64NowUs);
+extern void sblEngineAbort(tSblEngine *pEng, tSblStatus status);
+extern bool sblEngineEvent(tSblEngine *pEng, tSblEvent *pEvent);
+extern const char *getOpString(tSblOp op);
+
+#endif /* SBL_ENGINE_H_ */
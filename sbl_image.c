@@ -0,0 +1,639 @@
+/*
+ * sbl_image.c
+ *
+ *  Created on: 18/10/2026
+ *  Description: Prepared images. Everything the host works out about
+ *               a .bin before flashing it (padded data, whole image
+ *               CRC, CRC of every page, which pages are blank and the
+ *               non-blank segments) is kept in a cache file named by
+ *               a hash of the file's contents:
+ *               <cache dir>/<hash>.img     header, tables, data
+ *               <cache dir>/by-stat/<key>  -> ../<hash>.img
+ *               The by-stat link is keyed by path, inode, size, mtime
+ *               and ctime, so an unchanged file is found without
+ *               reading it. Cache files are mapped read-only and
+ *               evicted least recently used first once they outgrow
+ *               the cap.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* Custom Includes */
+#include "sbl_image.h"
+#include "sbl_device_cc2640.h"
+#include "myFile.h"
+
+#define IMAGE_MAGIC             "SBLIMG1"
+#define IMAGE_VERSION           1
+#define IMAGE_ALIGN(x)          (((x) + 63u) & ~63u)
+
+/* FNV-1a, 64 bit */
+#define FNV_OFFSET              0xCBF29CE484222325ULL
+#define FNV_PRIME               0x100000001B3ULL
+
+/* Start of a cache file, host byte order (the cache is local) */
+typedef struct {
+    char     magic[8];
+    uint32_t version;
+    uint32_t hdrSize;
+    uint64_t hash;
+    uint32_t size;
+    uint32_t fileSize;
+    uint32_t crc;
+    uint32_t pageSize;
+    uint32_t numPages;
+    uint32_t numSegments;
+    uint32_t segOff;
+    uint32_t crcOff;
+    uint32_t blankOff;
+    uint32_t dataOff;
+    uint32_t fileLen;
+    uint32_t reserved;
+} tImageHdr;
+
+#ifdef SBL_SMALL
+/* Largest image laid out as buildImage() does, one arena slot */
+#define IMAGE_MAX_PAGES         (SBL_CC2650_MAX_FLASH_SIZE / SBL_IMAGE_PAGE_SIZE)
+#define IMAGE_SLOT_SIZE         (IMAGE_ALIGN(sizeof(tImageHdr)) +                               \
+                                 IMAGE_ALIGN(((IMAGE_MAX_PAGES + 1) / 2) * sizeof(tImageSegment)) + \
+                                 IMAGE_ALIGN(IMAGE_MAX_PAGES * sizeof(uint32_t)) +              \
+                                 IMAGE_ALIGN((IMAGE_MAX_PAGES + 7) / 8) +                        \
+                                 SBL_CC2650_MAX_FLASH_SIZE)
+#endif
+
+/* A cache file, for eviction */
+typedef struct {
+    char     name[32];
+    struct timespec mtime;
+} tCacheEntry;
+
+/* Static variables */
+static char m_cacheDir[PATH_MAX];
+#ifdef SBL_SMALL
+static uint8_t m_arena[SBL_SMALL_IMAGES][IMAGE_SLOT_SIZE] __attribute__((aligned(64)));
+static bool m_slotUsed[SBL_SMALL_IMAGES];
+#endif
+
+/* Static functions */
+static uint64_t fnv1a(uint64_t ui64Hash, const void *pData, size_t len);
+static void layoutImage(uint32_t ui32Size, uint32_t ui32FileSize, tImageHdr *pHdr);
+static void buildImage(uint8_t *pcBlob, tImageHdr *pHdr, uint64_t ui64Hash);
+static bool readData(const char *pcPath, uint8_t *pcData, uint32_t ui32FileSize, uint32_t ui32Size);
+static uint8_t *allocBlob(uint32_t ui32Len);
+static void freeBlob(uint8_t *pcBlob);
+static bool attachImage(tPreparedImage *pImage, const uint8_t *pcBlob, uint32_t ui32Len);
+static bool mapImage(const char *pcPath, uint32_t ui32FileSize, tPreparedImage *pImage);
+static bool storeImage(const char *pcPath, const uint8_t *pcBlob, uint32_t ui32Len);
+static void linkImage(const char *pcLink, const char *pcTarget);
+static void evictImages(const char *pcDir, const char *pcKeep);
+static int compareEntries(const void *pA, const void *pB);
+static uint64_t getCacheCap(void);
+
+/****************************************************************
+ * Function Name : getImageCacheDir
+ * Description   : Where prepared images live: $SBL_IMAGE_CACHE,
+ *                 else $XDG_CACHE_HOME/sbl_out/images, else
+ *                 ~/.cache/sbl_out/images
+ * Returns       : The directory, NULL if there is none
+ * Params        @None
+ ****************************************************************/
+const char *getImageCacheDir(void)
+{
+    const char *pcEnv;
+
+    if(m_cacheDir[0])
+        return (m_cacheDir);
+
+    if((pcEnv = getenv("SBL_IMAGE_CACHE")) && pcEnv[0])
+        snprintf(m_cacheDir, sizeof(m_cacheDir), "%s", pcEnv);
+    else if((pcEnv = getenv("XDG_CACHE_HOME")) && pcEnv[0])
+        snprintf(m_cacheDir, sizeof(m_cacheDir), "%s/sbl_out/images", pcEnv);
+    else if((pcEnv = getenv("HOME")) && pcEnv[0])
+        snprintf(m_cacheDir, sizeof(m_cacheDir), "%s/.cache/sbl_out/images", pcEnv);
+    else
+        return (NULL);
+    return (m_cacheDir);
+}
+
+/****************************************************************
+ * Function Name : prepareImage
+ * Description   : Gets an image ready to flash, from the cache if
+ *                 it was prepared before. Without a usable cache
+ *                 it is prepared on the heap, or in a slot of a
+ *                 static arena with SBL_SMALL.
+ * Returns       : SBL_SUCCESS, SBL_ARGUMENT_ERROR if the file can't
+ *                 be read
+ * Params        @pcPath: The .bin
+ *               @pImage: Populated, releaseImage() when done
+ ****************************************************************/
+tSblStatus prepareImage(const char *pcPath, tPreparedImage *pImage)
+{
+    char pcReal[PATH_MAX], pcLink[PATH_MAX], pcFile[PATH_MAX], pcTarget[64], pcName[32];
+    const char *pcDir = (getCacheCap()) ? getImageCacheDir() : NULL;
+    struct stat st;
+    tImageHdr hdr;
+    uint8_t *pcBlob;
+    uint64_t key, hash;
+    ssize_t n;
+
+    memset(pImage, 0, sizeof(*pImage));
+    if(!realpath(pcPath, pcReal) || stat(pcReal, &st) < 0 || st.st_size == 0 ||
+       st.st_size > UINT32_MAX - 4)
+    {
+        printf("ERROR: can't use image %s\n", pcPath);
+        return (SBL_ARGUMENT_ERROR);
+    }
+
+    /* Same file as last time? The ctime is in, the mtime alone can
+     * be put back (touch -d, cp -p, tar, rsync) after a rewrite */
+    key = fnv1a(FNV_OFFSET, pcReal, strlen(pcReal));
+    key = fnv1a(key, &st.st_dev, sizeof(st.st_dev));
+    key = fnv1a(key, &st.st_ino, sizeof(st.st_ino));
+    key = fnv1a(key, &st.st_size, sizeof(st.st_size));
+    key = fnv1a(key, &st.st_mtim, sizeof(st.st_mtim));
+    key = fnv1a(key, &st.st_ctim, sizeof(st.st_ctim));
+    if(pcDir)
+    {
+        snprintf(pcLink, sizeof(pcLink), "%s/by-stat/%016llx", pcDir, (unsigned long long)key);
+        if((n = readlink(pcLink, pcTarget, sizeof(pcTarget) - 1)) > 0)
+        {
+            pcTarget[n] = '\0';
+            snprintf(pcFile, sizeof(pcFile), "%s/by-stat/%s", pcDir, pcTarget);
+            if(mapImage(pcFile, st.st_size, pImage))
+            {
+                utimensat(AT_FDCWD, pcFile, NULL, 0);
+                return (SBL_SUCCESS);
+            }
+        }
+    }
+
+    /* The file goes straight to where the cache file has its data,
+     * the tables are worked out in front of it */
+    layoutImage((st.st_size + 3) & ~3u, st.st_size, &hdr);
+    if((pcBlob = allocBlob(hdr.fileLen)) == NULL)
+        return (SBL_MALLOC_ERROR);
+    if(!readData(pcReal, &pcBlob[hdr.dataOff], st.st_size, hdr.size))
+    {
+        freeBlob(pcBlob);
+        return (SBL_ARGUMENT_ERROR);
+    }
+    hash = fnv1a(FNV_OFFSET, &pcBlob[hdr.dataOff], st.st_size);
+
+    /* Same contents under another name or from before a touch. The
+     * hash only picks the file, the bytes decide; other contents
+     * under the same hash keep theirs and this one isn't cached. */
+    if(pcDir)
+    {
+        snprintf(pcName, sizeof(pcName), "%016llx.img", (unsigned long long)hash);
+        snprintf(pcFile, sizeof(pcFile), "%s/%s", pcDir, pcName);
+        if(mapImage(pcFile, st.st_size, pImage))
+        {
+            if(memcmp(pImage->pData, &pcBlob[hdr.dataOff], st.st_size) == 0)
+            {
+                freeBlob(pcBlob);
+                utimensat(AT_FDCWD, pcFile, NULL, 0);
+                linkImage(pcLink, pcName);
+                return (SBL_SUCCESS);
+            }
+            releaseImage(pImage);
+            pcDir = NULL;
+        }
+    }
+
+    buildImage(pcBlob, &hdr, hash);
+    if(pcDir && storeImage(pcFile, pcBlob, hdr.fileLen) && mapImage(pcFile, st.st_size, pImage))
+    {
+        freeBlob(pcBlob);
+        pImage->bCached = false;
+        linkImage(pcLink, pcName);
+        evictImages(pcDir, pcName);
+        return (SBL_SUCCESS);
+    }
+
+    /* No cache, keep it where it was built */
+    attachImage(pImage, pcBlob, hdr.fileLen);
+    pImage->pHeap = pcBlob;
+    return (SBL_SUCCESS);
+}
+
+/****************************************************************
+ * Function Name : releaseImage
+ * Description   : Unmaps or frees an image
+ * Returns       : None
+ * Params        @pImage: The image
+ ****************************************************************/
+void releaseImage(tPreparedImage *pImage)
+{
+    if(pImage->pMap)
+        munmap(pImage->pMap, pImage->mapLen);
+    freeBlob(pImage->pHeap);
+    memset(pImage, 0, sizeof(*pImage));
+}
+
+/****************************************************************
+ * Function Name : imagePageBlank
+ * Description   : Checks if a page of the image is all 0xFF, so
+ *                 there is nothing to program in it
+ * Returns       : true if it is
+ * Params        @pImage: The image
+ *               @ui32Page: Page, counted from the image start
+ ****************************************************************/
+bool imagePageBlank(const tPreparedImage *pImage, uint32_t ui32Page)
+{
+    if(ui32Page >= pImage->numPages)
+        return (true);
+    return ((pImage->pBlank[ui32Page / 8] >> (ui32Page % 8)) & 1);
+}
+
+/****************************************************************
+ * Function Name : imagePatchedCrc
+ * Description   : CRC32 the device will report for the image with
+ *                 patches applied, worked out from the image's CRC
+ *                 and the patched bytes alone: the cost grows with
+ *                 the patches, not with the image
+ * Returns       : SBL_SUCCESS, SBL_ARGUMENT_ERROR if a patch isn't
+ *                 inside the image or overlaps another
+ * Params        @pImage: The golden image
+ *               @pPatches: Its patches, any order
+ *               @ui32NumPatches: Number of patches
+ *               @pui32Crc: Populated with the CRC32
+ ****************************************************************/
+tSblStatus imagePatchedCrc(const tPreparedImage *pImage, const tImagePatch *pPatches,
+                           uint32_t ui32NumPatches, uint32_t *pui32Crc)
+{
+    uint32_t crc = pImage->crc;
+
+    for(uint32_t i = 0; i < ui32NumPatches; i++)
+    {
+        const tImagePatch *pPatch = &pPatches[i];
+        if(!pPatch->len || (uint64_t)pPatch->offset + pPatch->len > pImage->size)
+        {
+            printf("ERROR: patch at +0x%X (%u bytes) is outside the %u byte image\n",
+                   pPatch->offset, pPatch->len, pImage->size);
+            return (SBL_ARGUMENT_ERROR);
+        }
+        for(uint32_t j = 0; j < i; j++)
+        {
+            if(pPatch->offset < pPatches[j].offset + pPatches[j].len &&
+               pPatches[j].offset < pPatch->offset + pPatch->len)
+            {
+                printf("ERROR: patches at +0x%X and +0x%X overlap\n", pPatches[j].offset, pPatch->offset);
+                return (SBL_ARGUMENT_ERROR);
+            }
+        }
+
+        /* CRC is linear: the patched image's CRC differs by the
+         * register-only CRC of old ^ new, shifted past the tail */
+        crc ^= crcShift(calcCrcDelta(&pImage->pData[pPatch->offset], pPatch->pData, pPatch->len),
+                        pImage->size - pPatch->offset - pPatch->len);
+    }
+
+    *pui32Crc = crc;
+    return (SBL_SUCCESS);
+}
+
+/* Hashes more bytes into ui64Hash */
+static uint64_t fnv1a(uint64_t ui64Hash, const void *pData, size_t len)
+{
+    const uint8_t *p = (const uint8_t*)pData;
+
+    while(len--)
+    {
+        ui64Hash ^= *p++;
+        ui64Hash *= FNV_PRIME;
+    }
+    return (ui64Hash);
+}
+
+/* Offsets of a cache file: header, segments, page CRCs, blank
+ * bitmap, data */
+static void layoutImage(uint32_t ui32Size, uint32_t ui32FileSize, tImageHdr *pHdr)
+{
+    uint32_t numPages = (ui32Size + SBL_IMAGE_PAGE_SIZE - 1) / SBL_IMAGE_PAGE_SIZE;
+
+    memset(pHdr, 0, sizeof(*pHdr));
+    memcpy(pHdr->magic, IMAGE_MAGIC, sizeof(IMAGE_MAGIC));
+    pHdr->version = IMAGE_VERSION;
+    pHdr->hdrSize = sizeof(*pHdr);
+    pHdr->size = ui32Size;
+    pHdr->fileSize = ui32FileSize;
+    pHdr->pageSize = SBL_IMAGE_PAGE_SIZE;
+    pHdr->numPages = numPages;
+
+    /* At most every other page starts a segment */
+    pHdr->segOff = IMAGE_ALIGN(sizeof(*pHdr));
+    pHdr->crcOff = IMAGE_ALIGN(pHdr->segOff + ((numPages + 1) / 2) * sizeof(tImageSegment));
+    pHdr->blankOff = IMAGE_ALIGN(pHdr->crcOff + numPages * sizeof(uint32_t));
+    pHdr->dataOff = IMAGE_ALIGN(pHdr->blankOff + (numPages + 7) / 8);
+    pHdr->fileLen = pHdr->dataOff + ui32Size;
+}
+
+/* Fills in the tables of a cache file from its data, and the header */
+static void buildImage(uint8_t *pcBlob, tImageHdr *pHdr, uint64_t ui64Hash)
+{
+    const uint8_t *pcData = &pcBlob[pHdr->dataOff];
+    tImageSegment *pSeg = (tImageSegment*)&pcBlob[pHdr->segOff];
+    uint32_t *pCrc = (uint32_t*)&pcBlob[pHdr->crcOff];
+    uint8_t *pBlank = &pcBlob[pHdr->blankOff];
+    uint32_t numSegments = 0;
+    bool bInSeg = false;
+
+    memset(pcBlob, 0, pHdr->dataOff);
+    pHdr->hash = ui64Hash;
+    pHdr->crc = calcCrcLikeChip(pcData, pHdr->size);
+
+    for(uint32_t i = 0; i < pHdr->numPages; i++)
+    {
+        uint32_t off = i * SBL_IMAGE_PAGE_SIZE;
+        uint32_t len = (pHdr->size - off < SBL_IMAGE_PAGE_SIZE) ? pHdr->size - off : SBL_IMAGE_PAGE_SIZE;
+        bool bBlank = true;
+
+        pCrc[i] = calcCrcLikeChip(&pcData[off], len);
+        for(uint32_t j = 0; j < len && bBlank; j++)
+            bBlank = (pcData[off + j] == 0xFF);
+
+        if(bBlank)
+        {
+            pBlank[i / 8] |= 1 << (i % 8);
+            bInSeg = false;
+        }
+        else if(bInSeg)
+            pSeg[numSegments - 1].len += len;
+        else
+        {
+            pSeg[numSegments].offset = off;
+            pSeg[numSegments].len = len;
+            numSegments++;
+            bInSeg = true;
+        }
+    }
+    pHdr->numSegments = numSegments;
+    memcpy(pcBlob, pHdr, sizeof(*pHdr));
+}
+
+/* Reads a file of ui32FileSize bytes, padded with 0xFF (erased
+ * flash) to ui32Size */
+static bool readData(const char *pcPath, uint8_t *pcData, uint32_t ui32FileSize, uint32_t ui32Size)
+{
+    uint32_t done = 0;
+    ssize_t n = 0;
+    int fd;
+
+    if((fd = open(pcPath, O_RDONLY | O_CLOEXEC)) < 0)
+    {
+        printf("ERROR: opening file %s\n", pcPath);
+        return (false);
+    }
+    while(done < ui32FileSize && (n = read(fd, &pcData[done], ui32FileSize - done)) > 0)
+        done += n;
+    close(fd);
+    if(done != ui32FileSize)
+    {
+        printf("ERROR: File read failed\n");
+        return (false);
+    }
+    memset(&pcData[ui32FileSize], 0xFF, ui32Size - ui32FileSize);
+    return (true);
+}
+
+/* Room for a cache file being built: the heap, or a slot of the
+ * static arena in a small build */
+static uint8_t *allocBlob(uint32_t ui32Len)
+{
+#ifdef SBL_SMALL
+    if(ui32Len > IMAGE_SLOT_SIZE)
+    {
+        printf("ERROR: image larger than %u bytes of flash\n", SBL_CC2650_MAX_FLASH_SIZE);
+        return (NULL);
+    }
+    for(uint32_t i = 0; i < SBL_SMALL_IMAGES; i++)
+    {
+        if(!m_slotUsed[i])
+        {
+            m_slotUsed[i] = true;
+            return (m_arena[i]);
+        }
+    }
+    printf("ERROR: all %d image slots in use\n", SBL_SMALL_IMAGES);
+    return (NULL);
+#else
+    uint8_t *pcBlob = (uint8_t*)malloc(ui32Len);
+
+    if(!pcBlob)
+        printf("ERROR: malloc failed\n");
+    return (pcBlob);
+#endif
+}
+
+/* Gives back what allocBlob() returned, NULL is fine */
+static void freeBlob(uint8_t *pcBlob)
+{
+#ifdef SBL_SMALL
+    for(uint32_t i = 0; i < SBL_SMALL_IMAGES; i++)
+    {
+        if(pcBlob == m_arena[i])
+            m_slotUsed[i] = false;
+    }
+#else
+    free(pcBlob);
+#endif
+}
+
+/* Points an image into a cache file's bytes, false if they aren't
+ * one. The tables must be where layoutImage() puts them and the
+ * segments inside the image, nothing is read past ui32Len. */
+static bool attachImage(tPreparedImage *pImage, const uint8_t *pcBlob, uint32_t ui32Len)
+{
+    const tImageHdr *pHdr = (const tImageHdr*)pcBlob;
+    const tImageSegment *pSeg;
+    tImageHdr layout;
+
+    if(ui32Len < sizeof(*pHdr) || memcmp(pHdr->magic, IMAGE_MAGIC, sizeof(IMAGE_MAGIC)) ||
+       pHdr->version != IMAGE_VERSION || pHdr->hdrSize != sizeof(*pHdr) ||
+       pHdr->fileLen != ui32Len || pHdr->pageSize != SBL_IMAGE_PAGE_SIZE ||
+       pHdr->size == 0 || pHdr->size > ui32Len || pHdr->fileSize > pHdr->size)
+        return (false);
+
+    layoutImage(pHdr->size, pHdr->fileSize, &layout);
+    if(pHdr->numPages != layout.numPages || pHdr->segOff != layout.segOff ||
+       pHdr->crcOff != layout.crcOff || pHdr->blankOff != layout.blankOff ||
+       pHdr->dataOff != layout.dataOff || pHdr->dataOff > ui32Len ||
+       ui32Len - pHdr->dataOff != pHdr->size ||
+       pHdr->numSegments > (layout.numPages + 1) / 2)
+        return (false);
+
+    pSeg = (const tImageSegment*)&pcBlob[pHdr->segOff];
+    for(uint32_t i = 0; i < pHdr->numSegments; i++)
+    {
+        if(pSeg[i].offset > pHdr->size || pSeg[i].len > pHdr->size - pSeg[i].offset)
+            return (false);
+    }
+
+    pImage->hash = pHdr->hash;
+    pImage->pData = &pcBlob[pHdr->dataOff];
+    pImage->size = pHdr->size;
+    pImage->fileSize = pHdr->fileSize;
+    pImage->crc = pHdr->crc;
+    pImage->numPages = pHdr->numPages;
+    pImage->pPageCrc = (const uint32_t*)&pcBlob[pHdr->crcOff];
+    pImage->pBlank = &pcBlob[pHdr->blankOff];
+    pImage->numSegments = pHdr->numSegments;
+    pImage->pSegments = (const tImageSegment*)&pcBlob[pHdr->segOff];
+    return (true);
+}
+
+/* Maps a cache file of an image of ui32FileSize bytes */
+static bool mapImage(const char *pcPath, uint32_t ui32FileSize, tPreparedImage *pImage)
+{
+    struct stat st;
+    void *pMap;
+    int fd;
+
+    if((fd = open(pcPath, O_RDONLY | O_CLOEXEC)) < 0)
+        return (false);
+    if(fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(tImageHdr) || st.st_size > UINT32_MAX)
+    {
+        close(fd);
+        return (false);
+    }
+    pMap = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    if(pMap == MAP_FAILED)
+        return (false);
+
+    if(!attachImage(pImage, (const uint8_t*)pMap, st.st_size) || pImage->fileSize != ui32FileSize)
+    {
+        munmap(pMap, st.st_size);
+        memset(pImage, 0, sizeof(*pImage));
+        return (false);
+    }
+    pImage->pMap = pMap;
+    pImage->mapLen = st.st_size;
+    pImage->bCached = true;
+    return (true);
+}
+
+/* Writes a cache file, whole or not at all */
+static bool storeImage(const char *pcPath, const uint8_t *pcBlob, uint32_t ui32Len)
+{
+    char pcTmp[PATH_MAX + 16];
+    FILE *pFile;
+    bool bOk;
+
+    makeParentDirs(pcPath);
+    snprintf(pcTmp, sizeof(pcTmp), "%s.%d", pcPath, (int)getpid());
+    if((pFile = fopen(pcTmp, "wb")) == NULL)
+        return (false);
+    bOk = (fwrite(pcBlob, 1, ui32Len, pFile) == ui32Len);
+    bOk = (fclose(pFile) == 0) && bOk;
+    if(!bOk || rename(pcTmp, pcPath) < 0)
+    {
+        unlink(pcTmp);
+        return (false);
+    }
+    return (true);
+}
+
+/* Points a by-stat link at a cache file */
+static void linkImage(const char *pcLink, const char *pcTarget)
+{
+    char pcTmp[PATH_MAX + 16], pcRel[PATH_MAX];
+
+    makeParentDirs(pcLink);
+    snprintf(pcRel, sizeof(pcRel), "../%s", pcTarget);
+    snprintf(pcTmp, sizeof(pcTmp), "%s.%d", pcLink, (int)getpid());
+    unlink(pcTmp);
+    if(symlink(pcRel, pcTmp) < 0 || rename(pcTmp, pcLink) < 0)
+        unlink(pcTmp);
+}
+
+/* Drops least recently used cache files until they fit the cap, and
+ * links left pointing at nothing. Each pass over the directory drops
+ * the oldest file, so nothing is held but that one entry. */
+static void evictImages(const char *pcDir, const char *pcKeep)
+{
+    char pcPath[PATH_MAX];
+    uint64_t cap = getCacheCap();
+    struct dirent *pEnt;
+    struct stat st;
+    DIR *pDir;
+
+    for(;;)
+    {
+        tCacheEntry oldest = { .name = "" };
+        uint64_t total = 0;
+
+        if((pDir = opendir(pcDir)) == NULL)
+            return;
+        while((pEnt = readdir(pDir)) != NULL)
+        {
+            tCacheEntry entry;
+            size_t len = strlen(pEnt->d_name);
+
+            if(len < 5 || len >= sizeof(entry.name) || strcmp(&pEnt->d_name[len - 4], ".img"))
+                continue;
+            snprintf(pcPath, sizeof(pcPath), "%s/%s", pcDir, pEnt->d_name);
+            if(stat(pcPath, &st) < 0)
+                continue;
+            strcpy(entry.name, pEnt->d_name);
+            entry.mtime = st.st_mtim;
+            total += st.st_size;
+            if(strcmp(entry.name, pcKeep) != 0 &&
+               (!oldest.name[0] || compareEntries(&entry, &oldest) < 0))
+                oldest = entry;
+        }
+        closedir(pDir);
+
+        if(total <= cap || !oldest.name[0])
+            break;
+        snprintf(pcPath, sizeof(pcPath), "%s/%s", pcDir, oldest.name);
+        if(unlink(pcPath) < 0)
+            break;
+    }
+
+    snprintf(pcPath, sizeof(pcPath), "%s/by-stat", pcDir);
+    if((pDir = opendir(pcPath)) == NULL)
+        return;
+    while((pEnt = readdir(pDir)) != NULL)
+    {
+        if(pEnt->d_name[0] == '.')
+            continue;
+        snprintf(pcPath, sizeof(pcPath), "%s/by-stat/%s", pcDir, pEnt->d_name);
+        if(stat(pcPath, &st) < 0 && errno == ENOENT)
+            unlink(pcPath);
+    }
+    closedir(pDir);
+}
+
+/* Oldest first */
+static int compareEntries(const void *pA, const void *pB)
+{
+    const tCacheEntry *a = (const tCacheEntry*)pA;
+    const tCacheEntry *b = (const tCacheEntry*)pB;
+
+    if(a->mtime.tv_sec != b->mtime.tv_sec)
+        return (a->mtime.tv_sec < b->mtime.tv_sec) ? -1 : 1;
+    if(a->mtime.tv_nsec != b->mtime.tv_nsec)
+        return (a->mtime.tv_nsec < b->mtime.tv_nsec) ? -1 : 1;
+    return (0);
+}
+
+/* Bytes of cache allowed, 0 turns it off */
+static uint64_t getCacheCap(void)
+{
+    const char *pcEnv = getenv("SBL_IMAGE_CACHE_MAX");
+
+    if(pcEnv && pcEnv[0])
+        return (strtoull(pcEnv, NULL, 0));
+    return (SBL_IMAGE_CACHE_MAX);
+}
@@ -0,0 +1,61 @@
+/*
+ * sbl_image.h
+ *
+ *  Created on: 18/10/2026
+ */
+
+#ifndef SBL_IMAGE_H_
+#define SBL_IMAGE_H_
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "sbl_device.h"
+
+/* Pages of the image, counted from its first byte */
+#define SBL_IMAGE_PAGE_SIZE         4096
+/* Cache size cap, $SBL_IMAGE_CACHE_MAX overrides (bytes) */
+#define SBL_IMAGE_CACHE_MAX         (64u * 1024 * 1024)
+
+/* A run of pages that aren't all 0xFF, offsets into the image */
+typedef struct {
+    uint32_t offset;
+    uint32_t len;
+} tImageSegment;
+
+/* An image ready to flash. Everything points into one read-only
+ * mapping of its cache file, or into a heap copy (a static arena
+ * slot with SBL_SMALL) when there is no cache. */
+typedef struct {
+    uint64_t             hash;          /* Of the file contents */
+    const uint8_t       *pData;         /* Padded with 0xFF to 4 bytes */
+    uint32_t             size;          /* Padded size */
+    uint32_t             fileSize;
+    uint32_t             crc;           /* calcCrcLikeChip() of pData */
+    uint32_t             numPages;
+    const uint32_t      *pPageCrc;      /* calcCrcLikeChip() per page */
+    const uint8_t       *pBlank;        /* Bit per page, set if all 0xFF */
+    uint32_t             numSegments;
+    const tImageSegment *pSegments;
+    bool                 bCached;       /* Came from the cache */
+
+    /* Backing */
+    void                *pMap;
+    size_t               mapLen;
+    void                *pHeap;         /* Or arena slot */
+} tPreparedImage;
+
+/* Bytes that replace part of an image, offset from its start */
+typedef struct {
+    uint32_t       offset;
+    uint32_t       len;
+    const uint8_t *pData;
+} tImagePatch;
+
+extern const char *getImageCacheDir(void);
+extern tSblStatus prepareImage(const char *pcPath, tPreparedImage *pImage);
+extern void releaseImage(tPreparedImage *pImage);
+extern bool imagePageBlank(const tPreparedImage *pImage, uint32_t ui32Page);
+extern tSblStatus imagePatchedCrc(const tPreparedImage *pImage, const tImagePatch *pPatches,
+                                  uint32_t ui32NumPatches, uint32_t *pui32Crc);
+
+#endif /* SBL_IMAGE_H_ */
@@ -0,0 +1,219 @@
+/*
+ * sbl_layout.c
+ *
+ *  Created on: 18/10/2026
+ *  Description: Flash layouts: which ranges of a device are kept
+ *               (SNV pages, calibration), which are erased and which
+ *               are programmed from which file. A layout file has
+ *               one range per line, '#' starts a comment:
+ *
+ *                   keep    0x1E000 0x2000
+ *                   erase   0x10000 0x4000
+ *                   program 0x00000 app.bin
+ *                   program 0x18000 stack.bin
+ *
+ *               Files are found relative to the layout file. The
+ *               erase plan covers the pages of every erase and
+ *               program range and never a page of a keep range.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libgen.h>
+
+/* Custom Includes */
+#include "sbl_layout.h"
+#include "sbl_device_cc2640.h"
+#include "sbl_cli.h"
+
+/* Static functions */
+static const char *kindName(tLayoutKind kind);
+static bool layoutFilePath(const char *pcLayout, const char *pcFile, char *pcOut, size_t len);
+
+/****************************************************************
+ * Function Name : parseLayout
+ * Description   : Reads a layout file
+ * Returns       : SBL_SUCCESS, SBL_ARGUMENT_ERROR naming the line
+ *                 that's wrong
+ * Params        @pcPath: The layout file
+ *               @pLayout: Populated with its ranges, in file order
+ ****************************************************************/
+tSblStatus parseLayout(const char *pcPath, tFlashLayout *pLayout)
+{
+    tSblStatus retCode = SBL_SUCCESS;
+    char line[PATH_MAX + 64];
+    uint32_t lineNo = 0;
+    FILE *fp;
+
+    if(!(fp = fopen(pcPath, "r")))
+    {
+        printf("ERROR: opening layout %s\n", pcPath);
+        return (SBL_ARGUMENT_ERROR);
+    }
+
+    pLayout->numEntries = 0;
+    while(retCode == SBL_SUCCESS && fgets(line, sizeof(line), fp))
+    {
+        char *pcKind, *pcAddr, *pcArg, *hash = strchr(line, '#');
+        tLayoutEntry *pEntry;
+
+        lineNo++;
+        if(hash)
+            *hash = '\0';
+        if(!(pcKind = strtok(line, " \t\r\n")))
+            continue;
+        pcAddr = strtok(NULL, " \t\r\n");
+        pcArg = strtok(NULL, " \t\r\n");
+
+        if(pLayout->numEntries == SBL_LAYOUT_MAX_ENTRIES)
+        {
+            printf("ERROR: %s:%u: more than %d ranges\n", pcPath, lineNo, SBL_LAYOUT_MAX_ENTRIES);
+            retCode = SBL_ARGUMENT_ERROR;
+            break;
+        }
+        pEntry = &pLayout->entries[pLayout->numEntries];
+        memset(pEntry, 0, sizeof(*pEntry));
+        pEntry->line = lineNo;
+
+        if(!strcmp(pcKind, "keep"))
+            pEntry->kind = LAYOUT_KEEP;
+        else if(!strcmp(pcKind, "erase"))
+            pEntry->kind = LAYOUT_ERASE;
+        else if(!strcmp(pcKind, "program"))
+            pEntry->kind = LAYOUT_PROGRAM;
+        else
+        {
+            printf("ERROR: %s:%u: '%s' is not keep, erase or program\n", pcPath, lineNo, pcKind);
+            retCode = SBL_ARGUMENT_ERROR;
+            break;
+        }
+
+        if(!pcAddr || !pcArg || strtok(NULL, " \t\r\n") || !parseNum(pcAddr, &pEntry->addr) ||
+           (pEntry->kind != LAYOUT_PROGRAM && (!parseNum(pcArg, &pEntry->len) || !pEntry->len)))
+        {
+            printf("ERROR: %s:%u: expected '%s <addr> %s'\n", pcPath, lineNo, pcKind,
+                   (pEntry->kind == LAYOUT_PROGRAM) ? "<file>" : "<len>");
+            retCode = SBL_ARGUMENT_ERROR;
+            break;
+        }
+        if(pEntry->kind == LAYOUT_PROGRAM &&
+           !layoutFilePath(pcPath, pcArg, pEntry->path, sizeof(pEntry->path)))
+        {
+            printf("ERROR: %s:%u: path too long\n", pcPath, lineNo);
+            retCode = SBL_ARGUMENT_ERROR;
+            break;
+        }
+        pLayout->numEntries++;
+    }
+
+    fclose(fp);
+    return (retCode);
+}
+
+/****************************************************************
+ * Function Name : planLayoutErase
+ * Description   : Works out the pages to erase: those of erase and
+ *                 program ranges. Fails if one of them shares a
+ *                 page with a keep range, erasing it would lose
+ *                 what is kept, or if two program ranges overlap.
+ * Returns       : SBL_SUCCESS, SBL_ARGUMENT_ERROR on a conflict or
+ *                 a range outside flash
+ * Params        @pLayout: Ranges, PROGRAM lengths filled in
+ *               @ui32FlashSize: Device flash size
+ *               @pbErase: Populated per page, SBL_LAYOUT_MAX_PAGES
+ ****************************************************************/
+tSblStatus planLayoutErase(const tFlashLayout *pLayout, uint32_t ui32FlashSize,
+                           bool *pbErase)
+{
+    uint32_t numPages = ui32FlashSize / SBL_CC2650_PAGE_ERASE_SIZE;
+    int32_t pKeptBy[SBL_LAYOUT_MAX_PAGES];
+
+    if(numPages > SBL_LAYOUT_MAX_PAGES)
+    {
+        printf("ERROR: layouts cover up to %d pages of flash\n", SBL_LAYOUT_MAX_PAGES);
+        return (SBL_ARGUMENT_ERROR);
+    }
+    memset(pbErase, 0, SBL_LAYOUT_MAX_PAGES * sizeof(bool));
+    for(uint32_t p = 0; p < SBL_LAYOUT_MAX_PAGES; p++)
+        pKeptBy[p] = -1;
+
+    /* Kept pages first, whatever order the file has */
+    for(uint32_t pass = 0; pass < 2; pass++)
+    {
+        for(uint32_t i = 0; i < pLayout->numEntries; i++)
+        {
+            const tLayoutEntry *pEntry = &pLayout->entries[i];
+            uint32_t first, last;
+
+            if((pass == 0) != (pEntry->kind == LAYOUT_KEEP))
+                continue;
+            if(!pEntry->len ||
+               (uint64_t)pEntry->addr + pEntry->len > SBL_CC2650_FLASH_START_ADDRESS + (uint64_t)ui32FlashSize)
+            {
+                printf("ERROR: layout line %u: %s 0x%08X + %u bytes is not in flash\n",
+                       pEntry->line, kindName(pEntry->kind), pEntry->addr, pEntry->len);
+                return (SBL_ARGUMENT_ERROR);
+            }
+
+            /* Two images for the same bytes, the second would fail
+             * its CRC with the first already written */
+            for(uint32_t j = 0; j < i && pEntry->kind == LAYOUT_PROGRAM; j++)
+            {
+                const tLayoutEntry *pOther = &pLayout->entries[j];
+
+                if(pOther->kind == LAYOUT_PROGRAM && pEntry->addr < pOther->addr + pOther->len &&
+                   pOther->addr < pEntry->addr + pEntry->len)
+                {
+                    printf("ERROR: layout line %u: program 0x%08X + %u bytes overlaps line %u\n",
+                           pEntry->line, pEntry->addr, pEntry->len, pOther->line);
+                    return (SBL_ARGUMENT_ERROR);
+                }
+            }
+
+            first = (pEntry->addr - SBL_CC2650_FLASH_START_ADDRESS) / SBL_CC2650_PAGE_ERASE_SIZE;
+            last = (pEntry->addr + pEntry->len - 1 - SBL_CC2650_FLASH_START_ADDRESS) / SBL_CC2650_PAGE_ERASE_SIZE;
+            for(uint32_t p = first; p <= last; p++)
+            {
+                if(pass == 0)
+                    pKeptBy[p] = (int32_t)i;
+                else if(pKeptBy[p] >= 0)
+                {
+                    printf("ERROR: layout line %u: %s 0x%08X + %u bytes needs page %u erased, "
+                           "line %u keeps it\n", pEntry->line, kindName(pEntry->kind), pEntry->addr,
+                           pEntry->len, p, pLayout->entries[pKeptBy[p]].line);
+                    return (SBL_ARGUMENT_ERROR);
+                }
+                else
+                    pbErase[p] = true;
+            }
+        }
+    }
+    return (SBL_SUCCESS);
+}
+
+/* Same as the CLI's, 0x.. hex or decimal */
+/* A program file named relative to the layout file is found next
+ * to it, wherever the tool runs from */
+static bool layoutFilePath(const char *pcLayout, const char *pcFile, char *pcOut, size_t len)
+{
+    char pcDir[PATH_MAX];
+    const char *pcBase;
+
+    snprintf(pcDir, sizeof(pcDir), "%s", pcLayout);
+    pcBase = dirname(pcDir);
+    if(pcFile[0] == '/' || !strcmp(pcBase, "."))
+        return (snprintf(pcOut, len, "%s", pcFile) < (int)len);
+    return (snprintf(pcOut, len, "%s/%s", pcBase, pcFile) < (int)len);
+}
+
+static const char *kindName(tLayoutKind kind)
+{
+    switch(kind)
+    {
+    case LAYOUT_KEEP:       return "keep"; break;
+    case LAYOUT_ERASE:      return "erase"; break;
+    case LAYOUT_PROGRAM:    return "program"; break;
+    default:                return "?"; break;
+    }
+}
@@ -0,0 +1,42 @@
+/*
+ * sbl_layout.h
+ *
+ *  Created on: 18/10/2026
+ */
+
+#ifndef SBL_LAYOUT_H_
+#define SBL_LAYOUT_H_
+#include <stdint.h>
+#include <stdbool.h>
+#include <limits.h>
+#include "sbl_device.h"
+
+/* Lines one layout file takes */
+#define SBL_LAYOUT_MAX_ENTRIES  32
+/* Pages the erase plan covers, 1 MB of flash */
+#define SBL_LAYOUT_MAX_PAGES    256
+
+typedef enum {
+    LAYOUT_KEEP,        /* Never erased */
+    LAYOUT_ERASE,       /* Erased, left blank */
+    LAYOUT_PROGRAM,     /* Erased, programmed from a file, verified */
+} tLayoutKind;
+
+typedef struct {
+    tLayoutKind kind;
+    uint32_t    addr;
+    uint32_t    len;            /* 0 for PROGRAM until the image is known */
+    char        path[PATH_MAX]; /* PROGRAM only */
+    uint32_t    line;
+} tLayoutEntry;
+
+typedef struct {
+    tLayoutEntry entries[SBL_LAYOUT_MAX_ENTRIES];
+    uint32_t     numEntries;
+} tFlashLayout;
+
+extern tSblStatus parseLayout(const char *pcPath, tFlashLayout *pLayout);
+extern tSblStatus planLayoutErase(const tFlashLayout *pLayout, uint32_t ui32FlashSize,
+                                  bool *pbErase);
+
+#endif /* SBL_LAYOUT_H_ */
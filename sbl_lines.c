@@ -0,0 +1,203 @@
+/*
+ * sbl_lines.c
+ *
+ *  Created on: 18/10/2026
+ *  Description: Bootloader entry and release over the modem control
+ *               lines. Fixtures wire DTR and RTS (through a
+ *               transistor or the adapter's own inversion) to the
+ *               backdoor pin and reset of the CC26x0, so no one has
+ *               to hold a button. A sequence is a comma separated
+ *               list of steps, each either lines to change at once
+ *               ('+' between them, '!' to deassert) or a pause in ms:
+ *
+ *                   dtr+!rts,rts,10,!rts,50,!dtr
+ *
+ *               asserts DTR with RTS deasserted, asserts RTS, waits
+ *               10 ms, deasserts RTS, waits 50 ms, deasserts DTR.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+/* Custom Includes */
+#include "sbl_lines.h"
+#include "Linux_Serial.h"
+#include "sbl_timeline.h"
+
+/* Static variables */
+static tLineSequence m_enter;
+static tLineSequence m_release;
+
+/* Static functions */
+static tSblStatus setSequence(const char *pcSpec, const char *pcDefault, tLineSequence *pSeq);
+
+/****************************************************************
+ * Function Name : parseLineSequence
+ * Description   : Reads a sequence, see the top of this file
+ * Returns       : SBL_SUCCESS, SBL_ARGUMENT_ERROR naming the step
+ *                 that's wrong
+ * Params        @pcSpec: The sequence
+ *               @pSeq: Populated with its steps
+ ****************************************************************/
+tSblStatus parseLineSequence(const char *pcSpec, tLineSequence *pSeq)
+{
+    const char *p = pcSpec;
+
+    memset(pSeq, 0, sizeof(*pSeq));
+    while(*p)
+    {
+        tLineStep *pStep = &pSeq->steps[pSeq->numSteps];
+        char *end;
+
+        if(pSeq->numSteps == SBL_LINES_MAX_STEPS)
+        {
+            printf("ERROR: '%s' has more than %d steps\n", pcSpec, SBL_LINES_MAX_STEPS);
+            return (SBL_ARGUMENT_ERROR);
+        }
+
+        /* A pause, or lines changing together */
+        if(*p >= '0' && *p <= '9')
+        {
+            pStep->waitMs = (uint32_t)strtoul(p, &end, 10);
+            p = end;
+        }
+        else
+        {
+            do
+            {
+                bool bClear = (*p == '!');
+                uint32_t line = 0;
+
+                p += bClear;
+                if(!strncmp(p, "dtr", 3))
+                    line = TIOCM_DTR;
+                else if(!strncmp(p, "rts", 3))
+                    line = TIOCM_RTS;
+                else
+                {
+                    printf("ERROR: '%s': expected dtr, rts, !dtr, !rts or ms at '%s'\n", pcSpec, p);
+                    return (SBL_ARGUMENT_ERROR);
+                }
+                p += 3;
+                if(bClear)
+                    pStep->clear |= line;
+                else
+                    pStep->set |= line;
+            } while(*p == '+' && *++p);
+        }
+
+        if(*p && *p++ != ',')
+        {
+            printf("ERROR: '%s': expected ',' between steps\n", pcSpec);
+            return (SBL_ARGUMENT_ERROR);
+        }
+        pSeq->numSteps++;
+    }
+    return (SBL_SUCCESS);
+}
+
+/****************************************************************
+ * Function Name : runLineSequence
+ * Description   : Drives the lines of the open port through a
+ *                 sequence, sleeping out its pauses
+ * Returns       : SBL_SUCCESS, SBL_PORT_ERROR if the port has no
+ *                 modem lines or setting them failed
+ * Params        @pSeq: The sequence
+ ****************************************************************/
+tSblStatus runLineSequence(const tLineSequence *pSeq)
+{
+    for(uint32_t i = 0; i < pSeq->numSteps; i++)
+    {
+        const tLineStep *pStep = &pSeq->steps[i];
+
+        if((pStep->set || pStep->clear) && serialSetLines(pStep->set, pStep->clear) < 0)
+            return (SBL_PORT_ERROR);
+        if(pStep->waitMs)
+            usleep(pStep->waitMs * 1000);
+    }
+    return (SBL_SUCCESS);
+}
+
+/****************************************************************
+ * Function Name : linesSetEnter
+ * Description   : Sets the sequence that puts the device into the
+ *                 ROM bootloader before autobaud
+ * Returns       : SBL_SUCCESS, SBL_ARGUMENT_ERROR
+ * Params        @pcSpec: A sequence, or "default" for
+ *                        SBL_LINES_ENTER_DEFAULT
+ ****************************************************************/
+tSblStatus linesSetEnter(const char *pcSpec)
+{
+    return setSequence(pcSpec, SBL_LINES_ENTER_DEFAULT, &m_enter);
+}
+
+/****************************************************************
+ * Function Name : linesSetRelease
+ * Description   : Sets the sequence that lets the device boot its
+ *                 application after the reset op
+ * Returns       : SBL_SUCCESS, SBL_ARGUMENT_ERROR
+ * Params        @pcSpec: A sequence, or "default" for
+ *                        SBL_LINES_RELEASE_DEFAULT
+ ****************************************************************/
+tSblStatus linesSetRelease(const char *pcSpec)
+{
+    return setSequence(pcSpec, SBL_LINES_RELEASE_DEFAULT, &m_release);
+}
+
+/****************************************************************
+ * Function Name : linesHaveEnter
+ * Description   : Tells if an entry sequence was set
+ * Returns       : true if there is one
+ * Params        @None
+ ****************************************************************/
+bool linesHaveEnter(void)
+{
+    return (m_enter.numSteps != 0);
+}
+
+/****************************************************************
+ * Function Name : linesEnter
+ * Description   : Runs the entry sequence, if any
+ * Returns       : SBL_SUCCESS, SBL_PORT_ERROR
+ * Params        @None
+ ****************************************************************/
+tSblStatus linesEnter(void)
+{
+    uint64_t t0 = timelineNow();
+    tSblStatus retCode;
+
+    if(!m_enter.numSteps)
+        return (SBL_SUCCESS);
+    retCode = runLineSequence(&m_enter);
+    timelineSpan(TL_SESSION, "bootloader entry lines", t0, "steps", m_enter.numSteps);
+    return (retCode);
+}
+
+/****************************************************************
+ * Function Name : linesRelease
+ * Description   : Runs the release sequence, if any
+ * Returns       : SBL_SUCCESS, SBL_PORT_ERROR
+ * Params        @None
+ ****************************************************************/
+tSblStatus linesRelease(void)
+{
+    uint64_t t0 = timelineNow();
+    tSblStatus retCode;
+
+    if(!m_release.numSteps)
+        return (SBL_SUCCESS);
+    retCode = runLineSequence(&m_release);
+    timelineSpan(TL_SESSION, "release lines", t0, "steps", m_release.numSteps);
+    return (retCode);
+}
+
+/* Parses pcSpec into pSeq, "default" being pcDefault */
+static tSblStatus setSequence(const char *pcSpec, const char *pcDefault, tLineSequence *pSeq)
+{
+    if(!pcSpec || !strcmp(pcSpec, "default"))
+        pcSpec = pcDefault;
+    return parseLineSequence(pcSpec, pSeq);
+}
@@ -0,0 +1,42 @@
+/*
+ * sbl_lines.h
+ *
+ *  Created on: 18/10/2026
+ */
+
+#ifndef SBL_LINES_H_
+#define SBL_LINES_H_
+#include <stdint.h>
+#include <stdbool.h>
+#include "sbl_device.h"
+
+/* Steps of one sequence */
+#define SBL_LINES_MAX_STEPS     16
+
+/* RTS on reset, DTR on the backdoor pin: hold the pin, pulse reset,
+ * let the ROM see the pin, let go of it */
+#define SBL_LINES_ENTER_DEFAULT     "dtr+!rts,rts,10,!rts,50,!dtr"
+/* Backdoor pin released, reset pulsed: the application boots */
+#define SBL_LINES_RELEASE_DEFAULT   "!dtr+rts,10,!rts"
+
+/* Lines to change at once, then a pause */
+typedef struct {
+    uint32_t set;           /* TIOCM_* */
+    uint32_t clear;
+    uint32_t waitMs;
+} tLineStep;
+
+typedef struct {
+    tLineStep steps[SBL_LINES_MAX_STEPS];
+    uint32_t  numSteps;
+} tLineSequence;
+
+extern tSblStatus parseLineSequence(const char *pcSpec, tLineSequence *pSeq);
+extern tSblStatus runLineSequence(const tLineSequence *pSeq);
+extern tSblStatus linesSetEnter(const char *pcSpec);
+extern tSblStatus linesSetRelease(const char *pcSpec);
+extern bool linesHaveEnter(void);
+extern tSblStatus linesEnter(void);
+extern tSblStatus linesRelease(void);
+
+#endif /* SBL_LINES_H_ */
@@ -0,0 +1,485 @@
+/*
+ * sbl_metrics.c
+ *
+ *  Created on: 18/10/2026
+ *  Description: Counters and histograms of flashing sessions in the
+ *               Prometheus text format, for node_exporter's textfile
+ *               collector. Every process adds what it counted to the
+ *               file (locked, replaced atomically), so one-shot runs
+ *               and a long running station can share one file and
+ *               the counters only ever grow.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/file.h>
+
+/* Custom Includes */
+#include "sbl_metrics.h"
+#include "myFile.h"
+
+#define METRICS_KEY_MAX     192
+#define METRICS_LINE_MAX    (METRICS_KEY_MAX + 64)
+
+typedef enum {
+    MT_COUNTER,
+    MT_HISTOGRAM,
+} tMetricType;
+
+typedef struct {
+    const char   *name;
+    tMetricType   type;
+    const double *pBuckets;     /* Upper bounds, histograms only */
+    uint32_t      numBuckets;
+    const char   *help;
+} tMetricFamily;
+
+/* One series, "name{labels}" and its value */
+typedef struct {
+    char   key[METRICS_KEY_MAX];
+    double value;
+} tMetricSeries;
+
+enum {
+    MF_SESSIONS,
+    MF_SESSION_SECONDS,
+    MF_OP_SECONDS,
+    MF_OP_FAILURES,
+    MF_COMMANDS,
+    MF_COMMAND_SECONDS,
+    MF_RETRIES,
+    MF_PORT_BYTES,
+    MF_UNITS,
+    MF_FLASH_BYTES,
+    MF_FLASH_SECONDS,
+    NUM_FAMILIES
+};
+
+static const double m_sessionBuckets[] = { 0.1, 0.5, 1, 2, 5, 10, 20, 30, 60, 120, 300 };
+static const double m_cmdBuckets[] = { 0.0001, 0.0005, 0.001, 0.002, 0.005, 0.01,
+                                       0.02, 0.05, 0.1, 0.5, 1 };
+#define NUM_BUCKETS(b) (sizeof(b) / sizeof(b[0]))
+
+static const tMetricFamily m_families[NUM_FAMILIES] = {
+    [MF_SESSIONS]        = { "sbl_sessions_total", MT_COUNTER, NULL, 0,
+                             "Bootloader sessions (station jobs) by result" },
+    [MF_SESSION_SECONDS] = { "sbl_session_duration_seconds", MT_HISTOGRAM,
+                             m_sessionBuckets, NUM_BUCKETS(m_sessionBuckets),
+                             "Wall time of a session" },
+    [MF_OP_SECONDS]      = { "sbl_op_duration_seconds", MT_HISTOGRAM,
+                             m_sessionBuckets, NUM_BUCKETS(m_sessionBuckets),
+                             "Wall time of a protocol operation (autobaud, erase_range, ...)" },
+    [MF_OP_FAILURES]     = { "sbl_op_failures_total", MT_COUNTER, NULL, 0,
+                             "Protocol operations that failed" },
+    [MF_COMMANDS]        = { "sbl_commands_total", MT_COUNTER, NULL, 0,
+                             "Bootloader commands by answer (ack, nak, timeout)" },
+    [MF_COMMAND_SECONDS] = { "sbl_command_latency_seconds", MT_HISTOGRAM,
+                             m_cmdBuckets, NUM_BUCKETS(m_cmdBuckets),
+                             "Command sent to ACK/NAK received" },
+    [MF_RETRIES]         = { "sbl_retries_total", MT_COUNTER, NULL, 0,
+                             "Autobaud tries beyond the first, SEND_DATA resent" },
+    [MF_PORT_BYTES]      = { "sbl_port_bytes_total", MT_COUNTER, NULL, 0,
+                             "Bytes moved over the port" },
+    [MF_UNITS]           = { "sbl_units_flashed_total", MT_COUNTER, NULL, 0,
+                             "Images flashed (erase, write, verify) by result" },
+    [MF_FLASH_BYTES]     = { "sbl_flash_bytes_total", MT_COUNTER, NULL, 0,
+                             "Image bytes flashed and verified" },
+    [MF_FLASH_SECONDS]   = { "sbl_flash_seconds_total", MT_COUNTER, NULL, 0,
+                             "Time spent flashing, erase to verify" },
+};
+
+/* Static variables */
+static char m_path[PATH_MAX];
+static tMetricSeries m_delta[SBL_METRICS_MAX_SERIES];     /* Since the last flush */
+static uint32_t m_numDelta;
+static tMetricSeries m_merged[SBL_METRICS_MAX_SERIES];    /* Flush scratch */
+static uint32_t m_dropped;
+
+/* Static functions */
+static void count(uint32_t ui32Family, const char *pcLabels, double dValue);
+static void observe(uint32_t ui32Family, const char *pcLabels, double dValue);
+static double *series(tMetricSeries *pSeries, uint32_t *pNum, const char *pcKey);
+static int familyOf(const char *pcKey);
+static void label(char *pcOut, uint32_t ui32Len, const char *pcName, const char *pcValue);
+
+/****************************************************************
+ * Function Name : metricsOpen
+ * Description   : Starts counting, added to the file by
+ *                 metricsFlush()
+ * Returns       : 0 on success, -1 if the file can't be written
+ * Params        @pcPath: The .prom file, e.g. in node_exporter's
+ *                 --collector.textfile.directory
+ ****************************************************************/
+int metricsOpen(const char *pcPath)
+{
+    char pcLock[PATH_MAX + 8];
+    int fd;
+
+    makeParentDirs(pcPath);
+    snprintf(pcLock, sizeof(pcLock), "%s.lock", pcPath);
+    if((fd = open(pcLock, O_RDWR | O_CREAT | O_CLOEXEC, 0644)) < 0)
+    {
+        perror("Metrics: ERROR OPENING FILE |");
+        return (-1);
+    }
+    close(fd);
+    snprintf(m_path, sizeof(m_path), "%s", pcPath);
+    m_numDelta = 0;
+    return (0);
+}
+
+/****************************************************************
+ * Function Name : metricsFlush
+ * Description   : Adds what was counted since the last flush to
+ *                 the file. Other processes may flush to it at the
+ *                 same time, it's locked meanwhile.
+ * Returns       : None
+ * Params        @None
+ ****************************************************************/
+void metricsFlush(void)
+{
+    char pcLock[PATH_MAX + 8], pcTmp[PATH_MAX + 32], pcLine[METRICS_LINE_MAX];
+    uint32_t numMerged = 0;
+    FILE *pIn, *pOut;
+    int lockFd;
+
+    if(!m_path[0] || !m_numDelta)
+        return;
+
+    snprintf(pcLock, sizeof(pcLock), "%s.lock", m_path);
+    if((lockFd = open(pcLock, O_RDWR | O_CREAT | O_CLOEXEC, 0644)) < 0 ||
+       flock(lockFd, LOCK_EX) < 0)
+    {
+        perror("Metrics: ERROR LOCKING FILE |");
+        if(lockFd >= 0)
+            close(lockFd);
+        return;
+    }
+
+    /* What earlier runs counted, in their order */
+    if((pIn = fopen(m_path, "r")))
+    {
+        while(fgets(pcLine, sizeof(pcLine), pIn))
+        {
+            char *pcValue = strrchr(pcLine, ' ');
+            double *pValue;
+
+            if(pcLine[0] == '#' || !pcValue)
+                continue;
+            *pcValue++ = '\0';
+            if(familyOf(pcLine) >= 0 && (pValue = series(m_merged, &numMerged, pcLine)))
+                *pValue = strtod(pcValue, NULL);
+        }
+        fclose(pIn);
+    }
+
+    /* Plus ours, new series after the old ones */
+    for(uint32_t i = 0; i < m_numDelta; i++)
+    {
+        double *pValue = series(m_merged, &numMerged, m_delta[i].key);
+        if(pValue)
+            *pValue += m_delta[i].value;
+    }
+
+    snprintf(pcTmp, sizeof(pcTmp), "%s.%d.tmp", m_path, (int)getpid());
+    if(!(pOut = fopen(pcTmp, "w")))
+    {
+        perror("Metrics: ERROR WRITING FILE |");
+        close(lockFd);
+        return;
+    }
+    for(uint32_t f = 0; f < NUM_FAMILIES; f++)
+    {
+        fprintf(pOut, "# HELP %s %s\n# TYPE %s %s\n", m_families[f].name, m_families[f].help,
+                m_families[f].name, (m_families[f].type == MT_COUNTER) ? "counter" : "histogram");
+        for(uint32_t i = 0; i < numMerged; i++)
+        {
+            if(familyOf(m_merged[i].key) == (int)f)
+                fprintf(pOut, "%s %.15g\n", m_merged[i].key, m_merged[i].value);
+        }
+    }
+    if(fclose(pOut) != 0 || rename(pcTmp, m_path) < 0)
+    {
+        perror("Metrics: ERROR WRITING FILE |");
+        unlink(pcTmp);
+        close(lockFd);
+        return;
+    }
+    close(lockFd);
+
+    m_numDelta = 0;
+    if(m_dropped)
+    {
+        printf("Metrics: %u samples dropped, more than %u series\n", m_dropped,
+               SBL_METRICS_MAX_SERIES);
+        m_dropped = 0;
+    }
+}
+
+/****************************************************************
+ * Function Name : metricsClose
+ * Description   : Flushes and stops counting
+ * Returns       : None
+ * Params        @None
+ ****************************************************************/
+void metricsClose(void)
+{
+    metricsFlush();
+    m_path[0] = '\0';
+}
+
+/****************************************************************
+ * Function Name : metricsSession
+ * Description   : Counts a session (a station job) that ended
+ * Returns       : None
+ * Params        @bOk: It succeeded
+ *               @dSeconds: Its wall time
+ ****************************************************************/
+void metricsSession(bool bOk, double dSeconds)
+{
+    if(!m_path[0])
+        return;
+    count(MF_SESSIONS, (bOk) ? "result=\"ok\"" : "result=\"fail\"", 1);
+    observe(MF_SESSION_SECONDS, "", dSeconds);
+}
+
+/****************************************************************
+ * Function Name : metricsOp
+ * Description   : Counts a protocol operation that completed
+ * Returns       : None
+ * Params        @pcOp: getOpString()
+ *               @bOk: It succeeded
+ *               @dSeconds: Its wall time
+ ****************************************************************/
+void metricsOp(const char *pcOp, bool bOk, double dSeconds)
+{
+    char pcLabels[METRICS_KEY_MAX];
+
+    if(!m_path[0])
+        return;
+    label(pcLabels, sizeof(pcLabels), "op", pcOp);
+    observe(MF_OP_SECONDS, pcLabels, dSeconds);
+    if(!bOk)
+        count(MF_OP_FAILURES, pcLabels, 1);
+}
+
+/****************************************************************
+ * Function Name : metricsCommand
+ * Description   : Counts a command and how it was answered
+ * Returns       : None
+ * Params        @cmd: The command
+ *               @pcResult: "ack", "nak" or "timeout"
+ ****************************************************************/
+void metricsCommand(cmd_t cmd, const char *pcResult)
+{
+    char pcLabels[METRICS_KEY_MAX];
+    int n;
+
+    if(!m_path[0])
+        return;
+    label(pcLabels, sizeof(pcLabels), "cmd", getCmdString(cmd));
+    n = strlen(pcLabels);
+    pcLabels[n++] = ',';
+    label(&pcLabels[n], sizeof(pcLabels) - n, "result", pcResult);
+    count(MF_COMMANDS, pcLabels, 1);
+}
+
+/****************************************************************
+ * Function Name : metricsCommandLatency
+ * Description   : Adds a command's ACK turnaround
+ * Returns       : None
+ * Params        @cmd: The command
+ *               @ui64LatencyUs: Sent to answered
+ ****************************************************************/
+void metricsCommandLatency(cmd_t cmd, uint64_t ui64LatencyUs)
+{
+    char pcLabels[METRICS_KEY_MAX];
+
+    if(!m_path[0])
+        return;
+    label(pcLabels, sizeof(pcLabels), "cmd", getCmdString(cmd));
+    observe(MF_COMMAND_SECONDS, pcLabels, ui64LatencyUs / 1e6);
+}
+
+/****************************************************************
+ * Function Name : metricsRetry
+ * Description   : Counts something done again
+ * Returns       : None
+ * Params        @pcWhat: "sync", "send_data"
+ ****************************************************************/
+void metricsRetry(const char *pcWhat)
+{
+    char pcLabels[METRICS_KEY_MAX];
+
+    if(!m_path[0])
+        return;
+    label(pcLabels, sizeof(pcLabels), "what", pcWhat);
+    count(MF_RETRIES, pcLabels, 1);
+}
+
+/****************************************************************
+ * Function Name : metricsPortBytes
+ * Description   : Adds the bytes a session moved over its port
+ * Returns       : None
+ * Params        @pcPort: Port ID
+ *               @ui64Tx: Bytes sent
+ *               @ui64Rx: Bytes received
+ ****************************************************************/
+void metricsPortBytes(const char *pcPort, uint64_t ui64Tx, uint64_t ui64Rx)
+{
+    char pcLabels[METRICS_KEY_MAX];
+    int n;
+
+    if(!m_path[0])
+        return;
+    label(pcLabels, sizeof(pcLabels), "port", pcPort);
+    n = strlen(pcLabels);
+    snprintf(&pcLabels[n], sizeof(pcLabels) - n, ",dir=\"tx\"");
+    count(MF_PORT_BYTES, pcLabels, ui64Tx);
+    snprintf(&pcLabels[n], sizeof(pcLabels) - n, ",dir=\"rx\"");
+    count(MF_PORT_BYTES, pcLabels, ui64Rx);
+}
+
+/****************************************************************
+ * Function Name : metricsFlashed
+ * Description   : Counts an image flashed to a device, bytes/s
+ *                 per port is flash_bytes over flash_seconds
+ * Returns       : None
+ * Params        @pcPort: Port ID
+ *               @bOk: Erased, written and verified
+ *               @ui32Bytes: Image size
+ *               @dSeconds: Erase to verify
+ ****************************************************************/
+void metricsFlashed(const char *pcPort, bool bOk, uint32_t ui32Bytes, double dSeconds)
+{
+    char pcLabels[METRICS_KEY_MAX];
+    int n;
+
+    if(!m_path[0])
+        return;
+    label(pcLabels, sizeof(pcLabels), "port", pcPort);
+    if(bOk)
+    {
+        count(MF_FLASH_BYTES, pcLabels, ui32Bytes);
+        count(MF_FLASH_SECONDS, pcLabels, dSeconds);
+    }
+    n = strlen(pcLabels);
+    snprintf(&pcLabels[n], sizeof(pcLabels) - n, ",result=\"%s\"", (bOk) ? "ok" : "fail");
+    count(MF_UNITS, pcLabels, 1);
+}
+
+/* Adds to a counter */
+static void count(uint32_t ui32Family, const char *pcLabels, double dValue)
+{
+    char pcKey[METRICS_KEY_MAX];
+    double *pValue;
+
+    snprintf(pcKey, sizeof(pcKey), (pcLabels[0]) ? "%s{%s}" : "%s%s",
+             m_families[ui32Family].name, pcLabels);
+    if((pValue = series(m_delta, &m_numDelta, pcKey)))
+        *pValue += dValue;
+}
+
+/* Adds a sample to a histogram: its bucket and every one above,
+ * _sum and _count. Its series are created together, in order. */
+static void observe(uint32_t ui32Family, const char *pcLabels, double dValue)
+{
+    const tMetricFamily *pFamily = &m_families[ui32Family];
+    char pcKey[METRICS_KEY_MAX];
+    const char *pcSep = (pcLabels[0]) ? "," : "";
+    double *pValue;
+
+    for(uint32_t b = 0; b <= pFamily->numBuckets; b++)
+    {
+        if(b < pFamily->numBuckets)
+            snprintf(pcKey, sizeof(pcKey), "%s_bucket{%s%sle=\"%g\"}", pFamily->name,
+                     pcLabels, pcSep, pFamily->pBuckets[b]);
+        else
+            snprintf(pcKey, sizeof(pcKey), "%s_bucket{%s%sle=\"+Inf\"}", pFamily->name,
+                     pcLabels, pcSep);
+        if(!(pValue = series(m_delta, &m_numDelta, pcKey)))
+            return;
+        if(b == pFamily->numBuckets || dValue <= pFamily->pBuckets[b])
+            *pValue += 1;
+    }
+
+    snprintf(pcKey, sizeof(pcKey), (pcLabels[0]) ? "%s_sum{%s}" : "%s_sum%s",
+             pFamily->name, pcLabels);
+    if((pValue = series(m_delta, &m_numDelta, pcKey)))
+        *pValue += dValue;
+    snprintf(pcKey, sizeof(pcKey), (pcLabels[0]) ? "%s_count{%s}" : "%s_count%s",
+             pFamily->name, pcLabels);
+    if((pValue = series(m_delta, &m_numDelta, pcKey)))
+        *pValue += 1;
+}
+
+/* Value of a series, added at 0 if it's new. NULL if full. */
+static double *series(tMetricSeries *pSeries, uint32_t *pNum, const char *pcKey)
+{
+    for(uint32_t i = *pNum; i > 0; i--)
+    {
+        if(!strcmp(pSeries[i - 1].key, pcKey))
+            return (&pSeries[i - 1].value);
+    }
+    if(*pNum == SBL_METRICS_MAX_SERIES)
+    {
+        m_dropped++;
+        return (NULL);
+    }
+    snprintf(pSeries[*pNum].key, sizeof(pSeries[*pNum].key), "%s", pcKey);
+    pSeries[*pNum].value = 0;
+    return (&pSeries[(*pNum)++].value);
+}
+
+/* Family a series belongs to, -1 if none */
+static int familyOf(const char *pcKey)
+{
+    static const char *const pcSuffixes[] = { "_bucket", "_sum", "_count" };
+
+    for(uint32_t f = 0; f < NUM_FAMILIES; f++)
+    {
+        uint32_t len = strlen(m_families[f].name);
+        const char *pcRest = &pcKey[len];
+
+        if(strncmp(pcKey, m_families[f].name, len))
+            continue;
+        if(m_families[f].type == MT_HISTOGRAM)
+        {
+            for(uint32_t s = 0; s < 3; s++)
+            {
+                uint32_t sLen = strlen(pcSuffixes[s]);
+                if(!strncmp(pcRest, pcSuffixes[s], sLen) &&
+                   (pcRest[sLen] == '{' || pcRest[sLen] == '\0'))
+                    return ((int)f);
+            }
+        }
+        else if(pcRest[0] == '{' || pcRest[0] == '\0')
+            return ((int)f);
+    }
+    return (-1);
+}
+
+/* name="value", value escaped */
+static void label(char *pcOut, uint32_t ui32Len, const char *pcName, const char *pcValue)
+{
+    uint32_t n = snprintf(pcOut, ui32Len, "%s=\"", pcName);
+
+    for(; *pcValue && n + 4 < ui32Len; pcValue++)
+    {
+        if(*pcValue == '"' || *pcValue == '\\')
+            pcOut[n++] = '\\';
+        if(*pcValue == '\n')
+        {
+            pcOut[n++] = '\\';
+            pcOut[n++] = 'n';
+            continue;
+        }
+        pcOut[n++] = *pcValue;
+    }
+    pcOut[n++] = '"';
+    pcOut[n] = '\0';
+}
@@ -0,0 +1,27 @@
+/*
+ * sbl_metrics.h
+ *
+ *  Created on: 18/10/2026
+ */
+
+#ifndef SBL_METRICS_H_
+#define SBL_METRICS_H_
+#include <stdint.h>
+#include <stdbool.h>
+#include "sbl_device.h"
+
+/* Distinct series kept, labels included */
+#define SBL_METRICS_MAX_SERIES      1024
+
+extern int metricsOpen(const char *pcPath);
+extern void metricsFlush(void);
+extern void metricsClose(void);
+extern void metricsSession(bool bOk, double dSeconds);
+extern void metricsOp(const char *pcOp, bool bOk, double dSeconds);
+extern void metricsCommand(cmd_t cmd, const char *pcResult);
+extern void metricsCommandLatency(cmd_t cmd, uint64_t ui64LatencyUs);
+extern void metricsRetry(const char *pcWhat);
+extern void metricsPortBytes(const char *pcPort, uint64_t ui64Tx, uint64_t ui64Rx);
+extern void metricsFlashed(const char *pcPort, bool bOk, uint32_t ui32Bytes, double dSeconds);
+
+#endif /* SBL_METRICS_H_ */
@@ -0,0 +1,43 @@
+/*
+ * sbl_probes.h
+ *
+ *  Created on: 18/10/2026
+ */
+
+#ifndef SBL_PROBES_H_
+#define SBL_PROBES_H_
+
+/* USDT probes, provider "sbl", for attaching bpftrace or perf to a
+ * running flasher, see tools/bpftrace. With <sys/sdt.h> around
+ * (systemtap-sdt-dev) each probe is a nop plus an ELF note; without
+ * it, or with -DSBL_NO_USDT, they compile to nothing.
+ *
+ *  cmd__send       cmd, addr, len      command packet built
+ *  cmd__sent       cmd, len, status    it left the host, len bytes
+ *                                      with a GET_STATUS sent behind it
+ *  cmd__ack        cmd, ack, us        ACK (1)/NAK (0), us since sent
+ *  cmd__data       cmd, len, status    data response taken
+ *  serial__write__start  len
+ *  serial__write__done   len, rc       after tcdrain()
+ *  serial__read__start   len, timeout_ms
+ *  serial__read__done    len, rc
+ *  flash__chunk    addr, len, idx      SEND_DATA of writeFlashRange()
+ */
+#if !defined(SBL_NO_USDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define SBL_USDT
+#endif
+#endif
+
+#ifdef SBL_USDT
+#define SBL_PROBE1(name, a)         DTRACE_PROBE1(sbl, name, a)
+#define SBL_PROBE2(name, a, b)      DTRACE_PROBE2(sbl, name, a, b)
+#define SBL_PROBE3(name, a, b, c)   DTRACE_PROBE3(sbl, name, a, b, c)
+#else
+#define SBL_PROBE1(name, a)         ((void)(a))
+#define SBL_PROBE2(name, a, b)      ((void)(a), (void)(b))
+#define SBL_PROBE3(name, a, b, c)   ((void)(a), (void)(b), (void)(c))
+#endif
+
+#endif /* SBL_PROBES_H_ */
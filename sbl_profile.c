@@ -0,0 +1,208 @@
+/*
+ * sbl_profile.c
+ *
+ *  Created on: 18/10/2026
+ *  Description: Per-port link profiles. A fixture port behaves the
+ *               same from one run to the next, so what a session
+ *               learned about it is kept in a small text database,
+ *               one line per port:
+ *               <port id> sessions=12 failures=0 timeouts=0 ...
+ *               The next session on that port starts from it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include "sbl_profile.h"
+#include "myFile.h"
+
+/* Longest line we write, key plus fields */
+#define PROFILE_LINE_MAX    (SBL_PROFILE_KEY_MAX + 256)
+
+/* Static variables */
+static char m_dbPath[PATH_MAX];
+
+/* Static functions */
+static bool parseProfile(const char *pcLine, tPortProfile *pProfile);
+static void formatProfile(const tPortProfile *pProfile, char *pcLine, uint32_t ui32Len);
+
+/****************************************************************
+ * Function Name : getProfileDbPath
+ * Description   : Where profiles live: $SBL_PROFILE_DB, else
+ *                 $XDG_CACHE_HOME/sbl_out/ports, else
+ *                 ~/.cache/sbl_out/ports
+ * Returns       : The path, NULL if there is no home
+ * Params        @None
+ ****************************************************************/
+const char *getProfileDbPath(void)
+{
+    const char *pcEnv;
+
+    if(m_dbPath[0])
+        return (m_dbPath);
+
+    if((pcEnv = getenv("SBL_PROFILE_DB")) && pcEnv[0])
+        snprintf(m_dbPath, sizeof(m_dbPath), "%s", pcEnv);
+    else if((pcEnv = getenv("XDG_CACHE_HOME")) && pcEnv[0])
+        snprintf(m_dbPath, sizeof(m_dbPath), "%s/sbl_out/ports", pcEnv);
+    else if((pcEnv = getenv("HOME")) && pcEnv[0])
+        snprintf(m_dbPath, sizeof(m_dbPath), "%s/.cache/sbl_out/ports", pcEnv);
+    else
+        return (NULL);
+    return (m_dbPath);
+}
+
+/****************************************************************
+ * Function Name : loadPortProfile
+ * Description   : Looks up the profile of a port
+ * Returns       : SBL_SUCCESS if there is one, SBL_ERROR if not
+ * Params        @pcKey: Port id
+ *               @pProfile: Populated with the profile
+ ****************************************************************/
+tSblStatus loadPortProfile(const char *pcKey, tPortProfile *pProfile)
+{
+    char pcLine[PROFILE_LINE_MAX];
+    const char *pcPath = getProfileDbPath();
+    tSblStatus retCode = SBL_ERROR;
+    FILE *pFile;
+
+    if(!pcPath || !(pFile = fopen(pcPath, "r")))
+        return (SBL_ERROR);
+
+    while(fgets(pcLine, sizeof(pcLine), pFile))
+    {
+        if(parseProfile(pcLine, pProfile) && !strcmp(pProfile->key, pcKey))
+        {
+            retCode = SBL_SUCCESS;
+            break;
+        }
+    }
+    fclose(pFile);
+    return (retCode);
+}
+
+/****************************************************************
+ * Function Name : savePortProfile
+ * Description   : Stores the profile of a port, replacing the one
+ *                 it had. Sessions on other ports may save at the
+ *                 same time, the database is locked meanwhile.
+ * Returns       : SBL_SUCCESS, ...
+ * Params        @pProfile: The profile
+ ****************************************************************/
+tSblStatus savePortProfile(const tPortProfile *pProfile)
+{
+    char pcLock[PATH_MAX + 8], pcTmp[PATH_MAX + 32], pcLine[PROFILE_LINE_MAX];
+    const char *pcPath = getProfileDbPath();
+    tPortProfile other;
+    FILE *pIn, *pOut;
+    int lockFd;
+
+    if(!pcPath)
+        return (SBL_ERROR);
+    makeParentDirs(pcPath);
+
+    /* The database itself gets replaced, lock a file next to it */
+    snprintf(pcLock, sizeof(pcLock), "%s.lock", pcPath);
+    if((lockFd = open(pcLock, O_RDWR | O_CREAT | O_CLOEXEC, 0644)) < 0 ||
+       flock(lockFd, LOCK_EX) < 0)
+    {
+        perror("Profile: ERROR LOCKING DATABASE |");
+        if(lockFd >= 0)
+            close(lockFd);
+        return (SBL_ERROR);
+    }
+
+    snprintf(pcTmp, sizeof(pcTmp), "%s.%d.tmp", pcPath, (int)getpid());
+    if(!(pOut = fopen(pcTmp, "w")))
+    {
+        perror("Profile: ERROR WRITING DATABASE |");
+        close(lockFd);
+        return (SBL_ERROR);
+    }
+
+    /* Every other port as it was, this one last */
+    if((pIn = fopen(pcPath, "r")))
+    {
+        while(fgets(pcLine, sizeof(pcLine), pIn))
+        {
+            if(parseProfile(pcLine, &other) && strcmp(other.key, pProfile->key))
+                fputs(pcLine, pOut);
+        }
+        fclose(pIn);
+    }
+    formatProfile(pProfile, pcLine, sizeof(pcLine));
+    fputs(pcLine, pOut);
+
+    if(fclose(pOut) != 0 || rename(pcTmp, pcPath) < 0)
+    {
+        perror("Profile: ERROR WRITING DATABASE |");
+        unlink(pcTmp);
+        close(lockFd);
+        return (SBL_ERROR);
+    }
+    close(lockFd);
+    return (SBL_SUCCESS);
+}
+
+/****************************************************************
+ * Function Name : printPortProfile
+ * Description   : Prints a profile
+ * Returns       : None
+ * Params        @pProfile: The profile
+ ****************************************************************/
+void printPortProfile(const tPortProfile *pProfile)
+{
+    printf("Port profile %s: %u sessions, %u failed, %u timeouts\n",
+           pProfile->key, pProfile->sessions, pProfile->failures, pProfile->timeouts);
+    printf("  link %u us (+/- %u us)\n", pProfile->linkSrttUs, pProfile->linkVarUs);
+    if(pProfile->rttP50Us)
+        printf("  ping RTT p50 %u us, p90 %u us, p99 %u us\n",
+               pProfile->rttP50Us, pProfile->rttP90Us, pProfile->rttP99Us);
+}
+
+/* One database line, false if it isn't a profile */
+static bool parseProfile(const char *pcLine, tPortProfile *pProfile)
+{
+    char pcName[32];
+    unsigned int value;
+    int n;
+
+    memset(pProfile, 0, sizeof(*pProfile));
+    if(sscanf(pcLine, "%255s%n", pProfile->key, &n) != 1 || pProfile->key[0] == '#')
+        return false;
+    pcLine += n;
+
+    /* name=value pairs, unknown names are skipped */
+    while(sscanf(pcLine, " %31[^=]=%u%n", pcName, &value, &n) == 2)
+    {
+        pcLine += n;
+        if(!strcmp(pcName, "sessions"))    pProfile->sessions = value;
+        else if(!strcmp(pcName, "failures"))    pProfile->failures = value;
+        else if(!strcmp(pcName, "timeouts"))    pProfile->timeouts = value;
+        else if(!strcmp(pcName, "rtt_p50"))     pProfile->rttP50Us = value;
+        else if(!strcmp(pcName, "rtt_p90"))     pProfile->rttP90Us = value;
+        else if(!strcmp(pcName, "rtt_p99"))     pProfile->rttP99Us = value;
+        else if(!strcmp(pcName, "srtt"))        pProfile->linkSrttUs = value;
+        else if(!strcmp(pcName, "rttvar"))      pProfile->linkVarUs = value;
+    }
+    return true;
+}
+
+/* The database line of a profile */
+static void formatProfile(const tPortProfile *pProfile, char *pcLine, uint32_t ui32Len)
+{
+    snprintf(pcLine, ui32Len,
+             "%s sessions=%u failures=%u timeouts=%u rtt_p50=%u rtt_p90=%u "
+             "rtt_p99=%u srtt=%u rttvar=%u\n",
+             pProfile->key, pProfile->sessions, pProfile->failures,
+             pProfile->timeouts, pProfile->rttP50Us, pProfile->rttP90Us,
+             pProfile->rttP99Us, pProfile->linkSrttUs, pProfile->linkVarUs);
+}
+
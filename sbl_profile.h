@@ -0,0 +1,33 @@
+/*
+ * sbl_profile.h
+ *
+ *  Created on: 18/10/2026
+ */
+
+#ifndef SBL_PROFILE_H_
+#define SBL_PROFILE_H_
+#include <stdint.h>
+#include <stdbool.h>
+#include "sbl_device.h"
+
+#define SBL_PROFILE_KEY_MAX     256
+
+/* What we know about one physical port, see serialGetPortId() */
+typedef struct {
+    char     key[SBL_PROFILE_KEY_MAX];
+    uint32_t sessions;
+    uint32_t failures;      /* Sessions that ended in an error */
+    uint32_t timeouts;      /* Responses that never came, all sessions */
+    uint32_t rttP50Us;      /* Ping RTT of the tuned link, 0 if never */
+    uint32_t rttP90Us;      /* calibrated */
+    uint32_t rttP99Us;
+    uint32_t linkSrttUs;    /* Learned link turnaround */
+    uint32_t linkVarUs;
+} tPortProfile;
+
+extern const char *getProfileDbPath(void);
+extern tSblStatus loadPortProfile(const char *pcKey, tPortProfile *pProfile);
+extern tSblStatus savePortProfile(const tPortProfile *pProfile);
+extern void printPortProfile(const tPortProfile *pProfile);
+
+#endif /* SBL_PROFILE_H_ */
@@ -0,0 +1,361 @@
+/*
+ * sbl_scan.c
+ *
+ *  Created on: 18/10/2026
+ *  Description: Finds the devices sitting in the ROM bootloader on
+ *               a bench full of adapters. Every candidate port is
+ *               opened at once (one thread each, USB ttys take a
+ *               while to open), then all of them run on one io_uring
+ *               reactor: autobaud, ping, chip ID, flash and RAM size
+ *               registers and the IEEE address. Whatever hasn't
+ *               answered when the budget runs out is reported as
+ *               such, the scan never waits on a silent port.
+ */
+
+#define _GNU_SOURCE     /* versionsort() */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <termios.h>
+#include <sys/timerfd.h>
+
+/* Custom Includes */
+#include "sbl_scan.h"
+#include "sbl_engine.h"
+#include "sbl_device_cc2640.h"
+#include "Linux_Serial.h"
+#include "Linux_Uring.h"
+
+/* How far a port got */
+typedef enum {
+    SC_OPEN = 0,
+    SC_SYNC,
+    SC_PING,
+    SC_CHIP_ID,
+    SC_FLASH_SIZE,
+    SC_RAM_SIZE,
+    SC_IEEE,
+    SC_DONE,
+    SC_FAILED,
+} tScanState;
+
+/* A candidate port */
+typedef struct {
+    char        path[PATH_MAX];
+    int         fd;
+    int         openErrno;      /* Set by the opening thread */
+    pthread_t   thread;
+    bool        bThread;        /* Thread to join */
+    tUringPort *pUring;
+    tScanState  state;
+    const char *pcWhy;          /* SC_FAILED */
+    uint64_t    doneUs;
+    uint32_t    chipId;
+    uint32_t    flashCfg;
+    uint32_t    ramCfg;
+    uint32_t    mac[2];         /* MAC_15_4_0 is the low word */
+} tScanPort;
+
+/* Static variables */
+static tUringReactor m_reactor;
+static tScanPort m_ports[SCAN_MAX_PORTS];
+static uint32_t m_numPorts;
+static uint32_t m_numBusy;
+static int m_timerFd = -1;
+static uint64_t m_startUs;
+
+static const char *m_stateNames[] = {
+    "open", "autobaud", "ping", "chip id", "flash size", "ram size", "ieee address",
+};
+
+/* Static functions */
+static void addPort(const char *pcPath);
+static void findPorts(void);
+static int isUsbTty(const struct dirent *pEnt);
+static void *openThread(void *pArg);
+static void finishPort(tScanPort *pPort, tScanState state, const char *pcWhy);
+static void onEvent(tUringPort *pUring, const tSblEvent *pEvent);
+static void onDeadline(int fd, void *pUser);
+static void printPort(const tScanPort *pPort);
+
+/****************************************************************
+ * Function Name : runScan
+ * Description   : Probes ports for devices in the bootloader, all
+ *                 at once, and prints what answered: chip ID,
+ *                 flash and RAM size, IEEE address
+ * Returns       : SBL_SUCCESS if a device was found, SBL_ERROR if
+ *                 none, SBL_PORT_ERROR if the scan couldn't run
+ * Params        @ui32BudgetMs: Time the whole scan may take
+ *               @argc, argv: Ports to probe, none for every
+ *                 ttyUSB* and ttyACM* there is
+ ****************************************************************/
+tSblStatus runScan(uint32_t ui32BudgetMs, int argc, char **argv)
+{
+    struct itimerspec its;
+    uint64_t budgetUs = (uint64_t)ui32BudgetMs * 1000, elapsedUs;
+    uint32_t found = 0;
+
+    m_startUs = serialGetTimeUs();
+    for(int i = 0; i < argc; i++)
+        addPort(argv[i]);
+    if(!argc)
+        findPorts();
+    if(!m_numPorts)
+    {
+        printf("Scan: no ports\n");
+        return (SBL_ERROR);
+    }
+
+    /* Opening a USB tty sets up the adapter, they take their time
+     * side by side rather than one after the other */
+    for(uint32_t i = 0; i < m_numPorts; i++)
+    {
+        if(pthread_create(&m_ports[i].thread, NULL, openThread, &m_ports[i]) != 0)
+            openThread(&m_ports[i]);
+        else
+            m_ports[i].bThread = true;
+    }
+    for(uint32_t i = 0; i < m_numPorts; i++)
+    {
+        if(m_ports[i].bThread)
+            pthread_join(m_ports[i].thread, NULL);
+    }
+
+    if(uringInit(&m_reactor, m_numPorts, onEvent) != 0)
+        return (SBL_PORT_ERROR);
+
+    for(uint32_t i = 0; i < m_numPorts; i++)
+    {
+        tScanPort *pPort = &m_ports[i];
+
+        if(pPort->fd < 0)
+        {
+            finishPort(pPort, SC_FAILED, strerror(pPort->openErrno));
+            continue;
+        }
+        if(!(pPort->pUring = uringAddPort(&m_reactor, pPort->fd, pPort)))
+        {
+            finishPort(pPort, SC_FAILED, "no room on the reactor");
+            continue;
+        }
+        sblEngineSetSyncTimeout(&pPort->pUring->eng, (ui32BudgetMs < SCAN_SYNC_MS) ? ui32BudgetMs : SCAN_SYNC_MS);
+        if(sblEngineAutobaud(&pPort->pUring->eng) != SBL_SUCCESS)
+        {
+            finishPort(pPort, SC_FAILED, "autobaud not started");
+            continue;
+        }
+        pPort->state = SC_SYNC;
+        m_numBusy++;
+        uringKick(&m_reactor, pPort->pUring);
+    }
+
+    /* What's left of the budget once the ports are open */
+    elapsedUs = serialGetTimeUs() - m_startUs;
+    elapsedUs = (elapsedUs < budgetUs) ? budgetUs - elapsedUs : 1000;
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = elapsedUs / 1000000;
+    its.it_value.tv_nsec = (elapsedUs % 1000000) * 1000;
+    if(m_numBusy &&
+       ((m_timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) < 0 ||
+        timerfd_settime(m_timerFd, 0, &its, NULL) < 0 ||
+        uringWatchFd(&m_reactor, m_timerFd, onDeadline, NULL) != 0))
+    {
+        perror("Scan: ERROR CREATING TIMER |");
+        onDeadline(-1, NULL);
+    }
+    uringRun(&m_reactor);
+
+    for(uint32_t i = 0; i < m_numPorts; i++)
+    {
+        printPort(&m_ports[i]);
+        found += (m_ports[i].state == SC_DONE);
+        if(m_ports[i].fd >= 0)
+            close(m_ports[i].fd);
+    }
+    if(m_timerFd >= 0)
+        close(m_timerFd);
+    uringClose(&m_reactor);
+    printf("Scan: %u of %u ports in the bootloader, %.1f ms\n", found, m_numPorts,
+           (serialGetTimeUs() - m_startUs) / 1000.0);
+    return (found) ? SBL_SUCCESS : SBL_ERROR;
+}
+
+/* Adds a port to probe */
+static void addPort(const char *pcPath)
+{
+    tScanPort *pPort;
+
+    if(m_numPorts == SCAN_MAX_PORTS)
+    {
+        printf("Scan: more than %d ports, %s skipped\n", SCAN_MAX_PORTS, pcPath);
+        return;
+    }
+    pPort = &m_ports[m_numPorts++];
+    memset(pPort, 0, sizeof(*pPort));
+    snprintf(pPort->path, sizeof(pPort->path), "%s", pcPath);
+    pPort->fd = -1;
+}
+
+/* ttyUSB* (FTDI, CP210x, ...) and ttyACM* (XDS110, CDC) there are,
+ * in number order */
+static void findPorts(void)
+{
+    char pcPath[PATH_MAX];
+    struct dirent **ppEnts;
+    int n;
+
+    if((n = scandir("/dev", &ppEnts, isUsbTty, versionsort)) < 0)
+    {
+        perror("Scan: ERROR LISTING /dev |");
+        return;
+    }
+    for(int i = 0; i < n; i++)
+    {
+        snprintf(pcPath, sizeof(pcPath), "/dev/%s", ppEnts[i]->d_name);
+        addPort(pcPath);
+        free(ppEnts[i]);
+    }
+    free(ppEnts);
+}
+
+/* scandir() filter, the names findPorts() is after */
+static int isUsbTty(const struct dirent *pEnt)
+{
+    return (strncmp(pEnt->d_name, "ttyUSB", 6) == 0 || strncmp(pEnt->d_name, "ttyACM", 6) == 0);
+}
+
+/* Opens and configures one port, old bytes thrown away */
+static void *openThread(void *pArg)
+{
+    tScanPort *pPort = (tScanPort*)pArg;
+    int fd;
+
+    if((fd = open(pPort->path, O_RDWR | O_NOCTTY | O_CLOEXEC)) < 0)
+    {
+        pPort->openErrno = errno;
+        return (NULL);
+    }
+    if(serialConfigLine(fd) < 0)
+    {
+        pPort->openErrno = errno;
+        close(fd);
+        return (NULL);
+    }
+    tcflush(fd, TCIOFLUSH);
+    pPort->fd = fd;
+    return (NULL);
+}
+
+/* A port is done, the reactor stops with the last one */
+static void finishPort(tScanPort *pPort, tScanState state, const char *pcWhy)
+{
+    bool bWasBusy = (pPort->state != SC_OPEN);
+
+    pPort->state = state;
+    pPort->pcWhy = pcWhy;
+    pPort->doneUs = serialGetTimeUs();
+    if(bWasBusy && --m_numBusy == 0 && m_timerFd >= 0)
+    {
+        uringUnwatchFd(&m_reactor, m_timerFd);
+        uringStop(&m_reactor);
+    }
+}
+
+/* Next step of a port */
+static void onEvent(tUringPort *pUring, const tSblEvent *pEvent)
+{
+    tScanPort *pPort = (tScanPort*)pUring->pUser;
+    tSblEngine *pEng = &pUring->eng;
+
+    if(pPort->state == SC_DONE || pPort->state == SC_FAILED)
+        return;
+
+    if(pEvent->status != SBL_SUCCESS)
+    {
+        finishPort(pPort, SC_FAILED, (pPort->state == SC_SYNC) ? "no bootloader" : getOpString(pEvent->op));
+        return;
+    }
+
+    switch(pPort->state)
+    {
+    case SC_SYNC:
+        pPort->state = SC_PING;
+        sblEnginePing(pEng);
+        break;
+
+    case SC_PING:
+        pPort->state = SC_CHIP_ID;
+        sblEngineChipId(pEng);
+        break;
+
+    case SC_CHIP_ID:
+        pPort->chipId = pEvent->value;
+        pPort->state = SC_FLASH_SIZE;
+        sblEngineReadMemory(pEng, SBL_CC2650_FLASH_SIZE_CFG, 1, 4, (uint8_t*)&pPort->flashCfg);
+        break;
+
+    case SC_FLASH_SIZE:
+        pPort->state = SC_RAM_SIZE;
+        sblEngineReadMemory(pEng, SBL_CC2650_RAM_SIZE_CFG, 1, 4, (uint8_t*)&pPort->ramCfg);
+        break;
+
+    case SC_RAM_SIZE:
+        pPort->state = SC_IEEE;
+        sblEngineReadMemory(pEng, SBL_CC2650_FCFG1_MAC_15_4, 2, 4, (uint8_t*)pPort->mac);
+        break;
+
+    case SC_IEEE:
+        finishPort(pPort, SC_DONE, NULL);
+        break;
+
+    default:
+        break;
+    }
+}
+
+/* Budget spent, whoever is still at it is given up on */
+static void onDeadline(int fd, void *pUser)
+{
+    (void)pUser;
+    if(fd >= 0)
+        uringUnwatchFd(&m_reactor, fd);
+
+    for(uint32_t i = 0; i < m_numPorts; i++)
+    {
+        tScanPort *pPort = &m_ports[i];
+        static char pcWhy[SCAN_MAX_PORTS][48];
+
+        if(pPort->state == SC_OPEN || pPort->state == SC_DONE || pPort->state == SC_FAILED)
+            continue;
+        snprintf(pcWhy[i], sizeof(pcWhy[i]), "no answer to %s in time", m_stateNames[pPort->state]);
+        finishPort(pPort, SC_FAILED, pcWhy[i]);
+        uringRemovePort(&m_reactor, pPort->pUring);
+    }
+    uringStop(&m_reactor);
+}
+
+/* One line about a port */
+static void printPort(const tScanPort *pPort)
+{
+    double ms = (pPort->doneUs - m_startUs) / 1000.0;
+
+    if(pPort->state != SC_DONE)
+    {
+        printf("%s: %s (%.1f ms)\n", pPort->path, pPort->pcWhy, ms);
+        return;
+    }
+    printf("%s: chip=0x%08X rev=%u flash=%u ram=%u ieee=%016" PRIx64 " (%.1f ms)\n",
+           pPort->path, pPort->chipId, getDeviceRev(pPort->chipId),
+           (pPort->flashCfg & 0xFF) * SBL_CC2650_PAGE_ERASE_SIZE,
+           decodeRamSize(pPort->chipId, pPort->ramCfg),
+           ((uint64_t)pPort->mac[1] << 32) | pPort->mac[0], ms);
+}
@@ -0,0 +1,20 @@
+/*
+ * sbl_scan.h
+ *
+ *  Created on: 18/10/2026
+ */
+
+#ifndef SBL_SCAN_H_
+#define SBL_SCAN_H_
+#include <stdint.h>
+#include "sbl_device.h"
+
+#define SCAN_MAX_PORTS          64
+/* Whole scan, ms, --scan without a value */
+#define SCAN_DEFAULT_BUDGET_MS  100
+/* Autobaud ACK wait, shortened to the budget if that's less */
+#define SCAN_SYNC_MS            50
+
+extern tSblStatus runScan(uint32_t ui32BudgetMs, int argc, char **argv);
+
+#endif /* SBL_SCAN_H_ */
@@ -0,0 +1,331 @@
+/*
+ * sbl_sim.c
+ *
+ *  Created on: 18/10/2026
+ *  Description: Simulated CC26x0 ROM bootloader, the device side of
+ *               the protocol for benchmarks and in-process testing
+ */
+
+#include <string.h>
+#include "sbl_sim.h"
+#include "sbl_device_cc2640.h"
+
+/* Static functions */
+static void respond(tSblSim *pSim, bool bAck, const uint8_t *pcData,
+                    uint32_t ui32Len, uint64_t ui64ReadyUs);
+static void handlePacket(tSblSim *pSim, uint64_t ui64NowUs);
+static uint32_t readWord(const tSblSim *pSim, uint32_t ui32Address);
+
+/****************************************************************
+ * Function Name : sblSimInit
+ * Description   : Powers up a simulated device: erased flash, in
+ *                 the bootloader, waiting for autobaud
+ * Returns       : None
+ * Params        @pSim: The device
+ ****************************************************************/
+void sblSimInit(tSblSim *pSim)
+{
+    memset(pSim, 0, sizeof(*pSim));
+    memset(pSim->flash, 0xFF, sizeof(pSim->flash));
+    pSim->status = CMD_RET_SUCCESS;
+    pSim->ieee = SBL_SIM_IEEE;
+}
+
+/****************************************************************
+ * Function Name : sblSimRx
+ * Description   : Feeds bytes sent by the host
+ * Returns       : None
+ * Params        @pSim: The device
+ *               @pcData: Bytes from the host
+ *               @ui32Len: Number of bytes
+ *               @ui64NowUs: Current time
+ ****************************************************************/
+void sblSimRx(tSblSim *pSim, const uint8_t *pcData, uint32_t ui32Len,
+              uint64_t ui64NowUs)
+{
+    for(uint32_t i = 0; i < ui32Len; i++)
+    {
+        uint8_t byte = pcData[i];
+
+        /* Only the ROM bootloader listens */
+        if(pSim->bInReset || pSim->bInApp)
+            continue;
+
+        /* ACK/NAK of a data response we sent */
+        if(pSim->hostAckWanted)
+        {
+            pSim->hostAckWanted--;
+            continue;
+        }
+
+        if(!pSim->bSynced)
+        {
+            /* Wait for 0x55 0x55 */
+            if(byte == 0x55 && pSim->inLen == 1)
+            {
+                pSim->bSynced = true;
+                pSim->inLen = 0;
+                respond(pSim, true, NULL, 0, ui64NowUs + pSim->turnaroundUs);
+            }
+            else
+                pSim->inLen = (byte == 0x55) ? 1 : 0;
+            continue;
+        }
+
+        /* Zero bytes between packets are ignored */
+        if(pSim->inLen == 0 && byte == 0x00)
+            continue;
+
+        pSim->in[pSim->inLen++] = byte;
+        if(pSim->inLen >= 3 && pSim->inLen == pSim->in[0])
+        {
+            handlePacket(pSim, ui64NowUs);
+            pSim->inLen = 0;
+        }
+        else if(pSim->in[0] < 3)
+        {
+            pSim->badPackets++;
+            pSim->inLen = 0;
+        }
+    }
+}
+
+/****************************************************************
+ * Function Name : sblSimSetPins
+ * Description   : Drives the reset and backdoor pins. Releasing
+ *                 reset boots the ROM bootloader if the backdoor
+ *                 pin is at its level then, else the application,
+ *                 which ignores the UART.
+ * Returns       : None
+ * Params        @pSim: The device
+ *               @bReset: Reset held
+ *               @bBackdoor: Backdoor pin at its bootloader level
+ ****************************************************************/
+void sblSimSetPins(tSblSim *pSim, bool bReset, bool bBackdoor)
+{
+    if(bReset && !pSim->bInReset)
+    {
+        pSim->bSynced = false;
+        pSim->inLen = pSim->outLen = pSim->outOff = 0;
+        pSim->hostAckWanted = pSim->dlLeft = 0;
+    }
+    else if(!bReset && pSim->bInReset)
+        pSim->bInApp = !bBackdoor;
+    pSim->bInReset = bReset;
+    pSim->bBackdoor = bBackdoor;
+}
+
+/****************************************************************
+ * Function Name : sblSimTxPending
+ * Description   : Bytes the device is sending
+ * Returns       : Number of bytes, 0 while the device is busy
+ * Params        @pSim: The device
+ *               @ui64NowUs: Current time
+ *               @ppData: Populated with where they are
+ ****************************************************************/
+uint32_t sblSimTxPending(const tSblSim *pSim, uint64_t ui64NowUs,
+                         const uint8_t **ppData)
+{
+    *ppData = &pSim->out[pSim->outOff];
+    if(ui64NowUs < pSim->readyUs)
+        return (0);
+    return (pSim->outLen - pSim->outOff);
+}
+
+/****************************************************************
+ * Function Name : sblSimTxDone
+ * Description   : Reports device bytes as delivered to the host
+ * Returns       : None
+ * Params        @pSim: The device
+ *               @ui32Len: Number of bytes
+ ****************************************************************/
+void sblSimTxDone(tSblSim *pSim, uint32_t ui32Len)
+{
+    pSim->outOff += ui32Len;
+    if(pSim->outOff >= pSim->outLen)
+        pSim->outOff = pSim->outLen = 0;
+}
+
+/* Queue ACK/NAK and optionally a data response */
+static void respond(tSblSim *pSim, bool bAck, const uint8_t *pcData,
+                    uint32_t ui32Len, uint64_t ui64ReadyUs)
+{
+    uint8_t *pOut = &pSim->out[pSim->outLen];
+    uint32_t outLen = pSim->outLen;
+
+    pOut[0] = 0x00;
+    pOut[1] = (bAck) ? 0xCC : 0x33;
+    pSim->outLen += 2;
+
+    if(bAck && pcData)
+    {
+        pOut[2] = ui32Len + 2;
+        pOut[3] = generateCheckSum(0, (const char*)pcData, ui32Len);
+        memcpy(&pOut[4], pcData, ui32Len);
+        pSim->outLen += ui32Len + 2;
+        pSim->hostAckWanted = 2;
+    }
+
+    /* Packets are handled in order, an answer still queued holds
+     * back the ones behind it */
+    if(outLen > pSim->outOff && pSim->readyUs > ui64ReadyUs)
+        ui64ReadyUs = pSim->readyUs;
+    pSim->readyUs = ui64ReadyUs + (uint64_t)(pSim->outLen - outLen) * pSim->wireNsPerByte / 1000;
+}
+
+/* A complete packet arrived */
+static void handlePacket(tSblSim *pSim, uint64_t ui64NowUs)
+{
+    uint8_t *pkt = pSim->in;
+    uint32_t len = pkt[0] - 3;
+    const uint8_t *pcPayload = &pkt[3];
+    uint64_t readyUs = ui64NowUs + pSim->turnaroundUs +
+                       (uint64_t)pkt[0] * pSim->wireNsPerByte / 1000;
+    uint8_t pcData[SBL_CC2650_MAX_MEMREAD_BYTES];
+
+    pSim->cmds++;
+    if(generateCheckSum(pkt[2], (const char*)pcPayload, len) != pkt[1])
+    {
+        pSim->badPackets++;
+        respond(pSim, false, NULL, 0, readyUs);
+        return;
+    }
+
+    switch(pkt[2])
+    {
+    case CMD_PING:
+    case CMD_RESET:
+    case CMD_SET_CCFG:
+        respond(pSim, true, NULL, 0, readyUs);
+        break;
+
+    case CMD_GET_STATUS:
+        pcData[0] = pSim->status;
+        respond(pSim, true, pcData, 1, readyUs);
+        break;
+
+    case CMD_GET_CHIP_ID:
+        ulToCharArray(SBL_SIM_CHIP_ID, pcData);
+        respond(pSim, true, pcData, 4, readyUs);
+        break;
+
+    case CMD_SECTOR_ERASE:
+    {
+        uint32_t addr = charArrayToUL((const char*)pcPayload) & ~(SBL_CC2650_PAGE_ERASE_SIZE - 1);
+        if(len != 4 || addr >= SBL_SIM_FLASH_SIZE)
+        {
+            pSim->status = CMD_RET_INVALID_ADR;
+            respond(pSim, true, NULL, 0, readyUs);
+            break;
+        }
+        memset(&pSim->flash[addr], 0xFF, SBL_CC2650_PAGE_ERASE_SIZE);
+        pSim->status = CMD_RET_SUCCESS;
+        respond(pSim, true, NULL, 0, readyUs + pSim->eraseUsPerPage);
+        break;
+    }
+
+    case CMD_BANK_ERASE:
+        memset(pSim->flash, 0xFF, SBL_SIM_FLASH_SIZE);
+        pSim->status = CMD_RET_SUCCESS;
+        respond(pSim, true, NULL, 0,
+                readyUs + (uint64_t)pSim->eraseUsPerPage * (SBL_SIM_FLASH_SIZE / SBL_CC2650_PAGE_ERASE_SIZE));
+        break;
+
+    case CMD_DOWNLOAD:
+        pSim->dlAddr = charArrayToUL((const char*)&pcPayload[0]);
+        pSim->dlLeft = charArrayToUL((const char*)&pcPayload[4]);
+        if(len != 8 || pSim->dlAddr + pSim->dlLeft > SBL_SIM_FLASH_SIZE)
+        {
+            pSim->status = CMD_RET_INVALID_ADR;
+            pSim->dlLeft = 0;
+        }
+        else
+            pSim->status = CMD_RET_SUCCESS;
+        respond(pSim, true, NULL, 0, readyUs);
+        break;
+
+    case CMD_SEND_DATA:
+        if(len > pSim->dlLeft)
+        {
+            pSim->status = CMD_RET_INVALID_CMD;
+            respond(pSim, false, NULL, 0, readyUs);
+            break;
+        }
+        /* Programming can only clear bits */
+        for(uint32_t i = 0; i < len; i++)
+            pSim->flash[pSim->dlAddr + i] &= pcPayload[i];
+        pSim->dlAddr += len;
+        pSim->dlLeft -= len;
+        pSim->status = CMD_RET_SUCCESS;
+        respond(pSim, true, NULL, 0, readyUs);
+        break;
+
+    case CMD_CRC32:
+    {
+        uint32_t addr = charArrayToUL((const char*)&pcPayload[0]);
+        uint32_t count = charArrayToUL((const char*)&pcPayload[4]);
+        if(addr + count > SBL_SIM_FLASH_SIZE)
+        {
+            respond(pSim, false, NULL, 0, readyUs);
+            break;
+        }
+        ulToCharArray(calcCrcLikeChip(&pSim->flash[addr], count), pcData);
+        respond(pSim, true, pcData, 4, readyUs + ((uint64_t)count * pSim->crcNsPerByte) / 1000);
+        break;
+    }
+
+    case CMD_MEMORY_READ:
+    {
+        uint32_t addr = charArrayToUL((const char*)&pcPayload[0]);
+        uint32_t width = (pcPayload[4] == SBL_CC2650_ACCESS_WIDTH_32B) ? 4 : 1;
+        uint32_t count = pcPayload[5] * width;
+        if(count > sizeof(pcData))
+        {
+            respond(pSim, false, NULL, 0, readyUs);
+            break;
+        }
+        for(uint32_t i = 0; i < count; i++)
+        {
+            /* Little endian words, as the device stores them */
+            uint32_t word = readWord(pSim, (addr + i) & ~3u);
+            pcData[i] = (uint8_t)(word >> (8 * ((addr + i) & 3)));
+        }
+        respond(pSim, true, pcData, count, readyUs);
+        break;
+    }
+
+    case CMD_MEMORY_WRITE:
+        respond(pSim, true, NULL, 0, readyUs);
+        break;
+
+    default:
+        pSim->status = CMD_RET_UNKNOWN_CMD;
+        respond(pSim, false, NULL, 0, readyUs);
+        break;
+    }
+}
+
+/* A 32 bit word of the device memory map */
+static uint32_t readWord(const tSblSim *pSim, uint32_t ui32Address)
+{
+    switch(ui32Address)
+    {
+    case SBL_CC2650_FLASH_SIZE_CFG:
+        return (SBL_SIM_FLASH_SIZE / SBL_CC2650_PAGE_ERASE_SIZE);
+    case SBL_CC2650_RAM_SIZE_CFG:
+        return (3);
+    case SBL_CC2650_FCFG1_MAC_15_4:
+        return ((uint32_t)pSim->ieee);
+    case SBL_CC2650_FCFG1_MAC_15_4 + 4:
+        return ((uint32_t)(pSim->ieee >> 32));
+    default:
+        break;
+    }
+
+    if(ui32Address + 4 <= SBL_SIM_FLASH_SIZE)
+    {
+        const uint8_t *p = &pSim->flash[ui32Address];
+        return (p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24));
+    }
+    return (0);
+}
@@ -0,0 +1,56 @@
+/*
+ * sbl_sim.h
+ *
+ *  Created on: 18/10/2026
+ */
+
+#ifndef SBL_SIM_H_
+#define SBL_SIM_H_
+#include <stdint.h>
+#include <stdbool.h>
+
+#define SBL_SIM_FLASH_SIZE      (128 * 1024)
+#define SBL_SIM_CHIP_ID         0x2B9BE02F
+#define SBL_SIM_IEEE            0x00124B0000C0FFEEULL
+
+/* Simulated CC26x0 ROM bootloader. Sans-IO like the engine: host
+ * bytes go in with sblSimRx(), device bytes come out of
+ * sblSimTxPending() once the simulated device time has passed. */
+typedef struct {
+    uint8_t  flash[SBL_SIM_FLASH_SIZE];
+    uint8_t  in[256];           /* Packet being received */
+    uint32_t inLen;
+    uint8_t  out[512];          /* Response being sent */
+    uint32_t outLen;
+    uint32_t outOff;
+    uint64_t readyUs;           /* Response not visible before this */
+    bool     bSynced;           /* Autobaud seen */
+    uint32_t hostAckWanted;     /* Bytes of host ACK/NAK still due */
+    uint32_t status;            /* Answer to GET_STATUS */
+    uint32_t dlAddr;            /* DOWNLOAD in progress */
+    uint32_t dlLeft;
+    uint64_t ieee;              /* FCFG1 MAC_15_4, SBL_SIM_IEEE */
+    bool     bInReset;          /* Reset pin held, see sblSimSetPins() */
+    bool     bBackdoor;         /* Backdoor pin at its bootloader level */
+    bool     bInApp;            /* Booted the application, deaf to us */
+
+    /* Timing, all 0 answers instantly */
+    uint32_t eraseUsPerPage;
+    uint32_t crcNsPerByte;
+    uint32_t turnaroundUs;
+    uint32_t wireNsPerByte;     /* UART time, request and response */
+
+    /* Counters */
+    uint32_t cmds;
+    uint32_t badPackets;
+} tSblSim;
+
+extern void sblSimInit(tSblSim *pSim);
+extern void sblSimRx(tSblSim *pSim, const uint8_t *pcData, uint32_t ui32Len,
+                     uint64_t ui64NowUs);
+extern uint32_t sblSimTxPending(const tSblSim *pSim, uint64_t ui64NowUs,
+                                const uint8_t **ppData);
+extern void sblSimTxDone(tSblSim *pSim, uint32_t ui32Len);
+extern void sblSimSetPins(tSblSim *pSim, bool bReset, bool bBackdoor);
+
+#endif /* SBL_SIM_H_ */
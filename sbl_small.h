@@ -0,0 +1,36 @@
+/*
+ * sbl_small.h
+ *
+ *  Created on: 18/10/2026
+ */
+
+#ifndef SBL_SMALL_H_
+#define SBL_SMALL_H_
+
+/* Small footprint build for gateways with a few MB to spare,
+ * -DSBL_SMALL, see README. Images come from a static arena of
+ * SBL_SMALL_IMAGES slots sized for the largest CC26x0 flash (or are
+ * mapped from the image cache), the daemon and scan modes and trace
+ * replay are left out and printf() compiles to nothing: the run is
+ * reported by its exit status, system errors still by perror() on
+ * stderr. */
+#ifdef SBL_SMALL
+#include <stdio.h>
+
+/* Images held at once: watch keeps the last one next to the new */
+#define SBL_SMALL_IMAGES        2
+
+#ifndef SBL_NO_USDT
+#define SBL_NO_USDT
+#endif
+
+/* Arguments are still evaluated, nothing is formatted */
+static inline int sblNoPrintf(const char *pcFmt, ...)
+{
+    (void)pcFmt;
+    return (0);
+}
+#define printf(...)             sblNoPrintf(__VA_ARGS__)
+#endif
+
+#endif /* SBL_SMALL_H_ */
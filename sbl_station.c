@@ -0,0 +1,946 @@
+/*
+ * sbl_station.c
+ *
+ *  Created on: 18/10/2026
+ *  Description: Programming station daemon. One process keeps every
+ *               USB serial port configured, notices adapters coming
+ *               and going (inotify on /dev), keeps the images it
+ *               was asked for loaded and takes flash jobs over a
+ *               Unix socket. A job waits for its device: the port
+ *               is autobauded every few tens of ms, so a unit that
+ *               enters the bootloader is programmed right away.
+ *               All ports run on one io_uring reactor.
+ *
+ *               Protocol, one line per request:
+ *               flash <port> <image> [addr]  -> job <id> queued
+ *                   ... later                -> job <id> ok|fail ...
+ *               ports                        -> port ... lines, end
+ *               jobs                         -> job ... lines, end
+ */
+
+#define _GNU_SOURCE     /* accept4() */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <dirent.h>
+#include <signal.h>
+#include <unistd.h>
+#include <termios.h>
+#include <sys/inotify.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
+
+/* Custom Includes */
+#include "sbl_station.h"
+#include "sbl_engine.h"
+#include "sbl_timeout.h"
+#include "sbl_device_cc2640.h"
+#include "Linux_Serial.h"
+#include "Linux_Uring.h"
+#include "sbl_image.h"
+#include "sbl_metrics.h"
+
+#define STATION_DEV_DIR         "/dev"
+/* Requests and replies, a line can hold two paths */
+#define STATION_LINE_MAX        (2 * PATH_MAX + 256)
+
+/* Where a port is */
+typedef enum {
+    PS_FREE = 0,
+    PS_SETTLING,        /* Just opened, old bytes may still come in */
+    PS_IDLE,
+    PS_SYNC,            /* Autobaud sent */
+    PS_SYNC_WAIT,       /* No answer, quiet before the next try */
+    PS_SIZE,            /* Reading the flash size */
+    PS_ERASE,
+    PS_WRITE,
+    PS_VERIFY,
+    PS_RESET,
+} tPortState;
+
+/* A prepared image, see sbl_image.c */
+typedef struct {
+    char     path[PATH_MAX];
+    struct timespec mtime;  /* Of the file it was prepared from */
+    struct timespec ctime;
+    ino_t    ino;
+    off_t    fileSize;
+    bool     bLoaded;       /* false if the slot is free */
+    tPreparedImage img;
+    uint32_t refs;          /* Jobs not done with it */
+    uint64_t lastUseUs;
+} tStationImage;
+
+/* A flash job, timestamps in us, 0 until reached */
+typedef struct {
+    uint32_t id;            /* 0 if the slot is free */
+    int      clientFd;      /* -1 once the client is gone */
+    char     port[PATH_MAX];
+    tStationImage *pImage;
+    uint32_t addr;
+    bool     bActive;
+    uint32_t syncTries;
+    uint32_t seg;           /* Next segment to write */
+    uint64_t queuedUs;
+    uint64_t syncUs;        /* Device answered */
+    uint64_t eraseUs;       /* Erase done */
+    uint64_t writeUs;
+    uint64_t verifyUs;
+} tStationJob;
+
+/* A port */
+typedef struct {
+    char        path[PATH_MAX];
+    int         fd;
+    tUringPort *pUring;
+    tPortState  state;
+    uint64_t    untilUs;        /* End of PS_SETTLING / PS_SYNC_WAIT */
+    uint32_t    strayMark;      /* Engine stray count at the last try */
+    uint32_t    flashCfg;       /* Flash size register */
+    tStationJob *pJob;
+    uint32_t    jobsOk;
+    uint32_t    jobsFailed;
+    uint64_t    opUs;           /* Engine operation started */
+} tStationPort;
+
+/* A connected client */
+typedef struct {
+    int      fd;            /* -1 if the slot is free */
+    char     line[STATION_LINE_MAX];
+    uint32_t lineLen;
+} tStationClient;
+
+/* Static variables */
+static tUringReactor m_reactor;
+static tStationPort m_ports[STATION_MAX_PORTS];
+static tStationJob m_jobs[STATION_MAX_JOBS];
+static tStationImage m_images[STATION_MAX_IMAGES];
+static tStationClient m_clients[STATION_MAX_CLIENTS];
+static uint32_t m_nextJobId = 1;
+static int m_listenFd = -1;
+static int m_inotifyFd = -1;
+static int m_timerFd = -1;
+static int m_signalFd = -1;
+
+static const char *m_stateNames[] = {
+    "free", "settling", "idle", "sync", "sync", "size",
+    "erase", "write", "verify", "reset",
+};
+
+/* Static functions */
+static tSblStatus setupFds(const char *pcSocketPath);
+static void closeFds(const char *pcSocketPath);
+static void scanDev(void);
+static bool isUsbTty(const char *pcName);
+static tStationPort *findPort(const char *pcPath);
+static tStationPort *openStationPort(const char *pcPath);
+static void closeStationPort(tStationPort *pPort, const char *pcWhy);
+static tStationImage *getImage(const char *pcPath);
+static void putImage(tStationImage *pImage);
+static void schedule(tStationPort *pPort);
+static void startSync(tStationPort *pPort);
+static void reportJob(tStationJob *pJob, bool bOk, const char *pcWhy);
+static void finishJob(tStationPort *pPort, bool bOk, const char *pcWhy);
+static void onEvent(tUringPort *pUring, const tSblEvent *pEvent);
+static void onListen(int fd, void *pUser);
+static void onClient(int fd, void *pUser);
+static void onInotify(int fd, void *pUser);
+static void onTick(int fd, void *pUser);
+static void onSignal(int fd, void *pUser);
+static void handleLine(tStationClient *pClient, char *pcLine);
+static void cmdFlash(tStationClient *pClient, char *pcArgs);
+static void reply(int fd, const char *pcFmt, ...) __attribute__((format(printf, 2, 3)));
+static void canonPortPath(const char *pcIn, char *pcOut, uint32_t ui32Len);
+static double msBetween(uint64_t ui64FromUs, uint64_t ui64ToUs);
+
+/****************************************************************
+ * Function Name : runStation
+ * Description   : Runs the programming station until SIGINT or
+ *                 SIGTERM. Jobs in progress are finished first.
+ * Returns       : SBL_SUCCESS, SBL_PORT_ERROR if it couldn't start
+ * Params        @pcSocketPath: Unix socket to take jobs on
+ ****************************************************************/
+tSblStatus runStation(const char *pcSocketPath)
+{
+    tSblStatus retCode = SBL_SUCCESS;
+
+    for(uint32_t i = 0; i < STATION_MAX_CLIENTS; i++)
+        m_clients[i].fd = -1;
+
+    if(uringInit(&m_reactor, STATION_MAX_PORTS, onEvent) != 0)
+        return (SBL_PORT_ERROR);
+
+    if(setupFds(pcSocketPath) != SBL_SUCCESS)
+    {
+        closeFds(pcSocketPath);
+        uringClose(&m_reactor);
+        return (SBL_PORT_ERROR);
+    }
+
+    /* Adapters plugged in before we started */
+    scanDev();
+
+    printf("Station: listening on %s\n", pcSocketPath);
+    if(uringRun(&m_reactor) != 0)
+        retCode = SBL_ERROR;
+
+    for(uint32_t i = 0; i < STATION_MAX_PORTS; i++)
+    {
+        if(m_ports[i].state != PS_FREE)
+            closeStationPort(&m_ports[i], "station stopped");
+    }
+    for(uint32_t i = 0; i < STATION_MAX_CLIENTS; i++)
+    {
+        if(m_clients[i].fd >= 0)
+            close(m_clients[i].fd);
+    }
+    closeFds(pcSocketPath);
+    uringClose(&m_reactor);
+    for(uint32_t i = 0; i < STATION_MAX_IMAGES; i++)
+        releaseImage(&m_images[i].img);
+    printf("Station: stopped\n");
+    return (retCode);
+}
+
+/* Socket, inotify, tick timer and signals, all watched */
+static tSblStatus setupFds(const char *pcSocketPath)
+{
+    struct sockaddr_un sa;
+    struct itimerspec its;
+    sigset_t sigs;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sun_family = AF_UNIX;
+    if(strlen(pcSocketPath) >= sizeof(sa.sun_path))
+    {
+        printf("Station: socket path too long\n");
+        return (SBL_ARGUMENT_ERROR);
+    }
+    strcpy(sa.sun_path, pcSocketPath);
+    unlink(pcSocketPath);
+
+    if((m_listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0)) < 0 ||
+       bind(m_listenFd, (struct sockaddr*)&sa, sizeof(sa)) < 0 ||
+       listen(m_listenFd, 16) < 0)
+    {
+        perror("Station: ERROR LISTENING |");
+        return (SBL_PORT_ERROR);
+    }
+
+    /* udev creates the node and then fixes its permissions, try on
+     * both */
+    if((m_inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0 ||
+       inotify_add_watch(m_inotifyFd, STATION_DEV_DIR, IN_CREATE | IN_ATTRIB | IN_DELETE) < 0)
+    {
+        perror("Station: ERROR WATCHING " STATION_DEV_DIR " |");
+        return (SBL_PORT_ERROR);
+    }
+
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_nsec = STATION_TICK_MS * 1000000L;
+    its.it_interval = its.it_value;
+    if((m_timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) < 0 ||
+       timerfd_settime(m_timerFd, 0, &its, NULL) < 0)
+    {
+        perror("Station: ERROR CREATING TIMER |");
+        return (SBL_PORT_ERROR);
+    }
+
+    sigemptyset(&sigs);
+    sigaddset(&sigs, SIGINT);
+    sigaddset(&sigs, SIGTERM);
+    sigprocmask(SIG_BLOCK, &sigs, NULL);
+    if((m_signalFd = signalfd(-1, &sigs, SFD_NONBLOCK | SFD_CLOEXEC)) < 0)
+    {
+        perror("Station: ERROR CREATING SIGNALFD |");
+        return (SBL_PORT_ERROR);
+    }
+    /* Clients hanging up must not kill us */
+    signal(SIGPIPE, SIG_IGN);
+
+    if(uringWatchFd(&m_reactor, m_listenFd, onListen, NULL) != 0 ||
+       uringWatchFd(&m_reactor, m_inotifyFd, onInotify, NULL) != 0 ||
+       uringWatchFd(&m_reactor, m_timerFd, onTick, NULL) != 0 ||
+       uringWatchFd(&m_reactor, m_signalFd, onSignal, NULL) != 0)
+        return (SBL_ERROR);
+    return (SBL_SUCCESS);
+}
+
+/* Closes what setupFds() opened */
+static void closeFds(const char *pcSocketPath)
+{
+    if(m_listenFd >= 0)
+    {
+        close(m_listenFd);
+        unlink(pcSocketPath);
+    }
+    if(m_inotifyFd >= 0)
+        close(m_inotifyFd);
+    if(m_timerFd >= 0)
+        close(m_timerFd);
+    if(m_signalFd >= 0)
+        close(m_signalFd);
+    m_listenFd = m_inotifyFd = m_timerFd = m_signalFd = -1;
+}
+
+/* Opens the USB serial ports already there */
+static void scanDev(void)
+{
+    char pcPath[PATH_MAX];
+    struct dirent *pEnt;
+    DIR *pDir;
+
+    if((pDir = opendir(STATION_DEV_DIR)) == NULL)
+    {
+        perror("Station: ERROR LISTING " STATION_DEV_DIR " |");
+        return;
+    }
+    while((pEnt = readdir(pDir)) != NULL)
+    {
+        if(!isUsbTty(pEnt->d_name))
+            continue;
+        snprintf(pcPath, sizeof(pcPath), STATION_DEV_DIR "/%s", pEnt->d_name);
+        if(!findPort(pcPath))
+            openStationPort(pcPath);
+    }
+    closedir(pDir);
+}
+
+/* ttyUSB* (FTDI, CP210x, ...) and ttyACM* (XDS110, CDC) */
+static bool isUsbTty(const char *pcName)
+{
+    return (strncmp(pcName, "ttyUSB", 6) == 0 || strncmp(pcName, "ttyACM", 6) == 0);
+}
+
+/* Port by path, NULL if not open */
+static tStationPort *findPort(const char *pcPath)
+{
+    for(uint32_t i = 0; i < STATION_MAX_PORTS; i++)
+    {
+        if(m_ports[i].state != PS_FREE && strcmp(m_ports[i].path, pcPath) == 0)
+            return (&m_ports[i]);
+    }
+    return (NULL);
+}
+
+/* Opens and configures a tty and hands it to the reactor. Bytes
+ * left over in it are discarded when it has settled. */
+static tStationPort *openStationPort(const char *pcPath)
+{
+    tStationPort *pPort = NULL;
+    int fd;
+
+    for(uint32_t i = 0; i < STATION_MAX_PORTS && !pPort; i++)
+    {
+        if(m_ports[i].state == PS_FREE)
+            pPort = &m_ports[i];
+    }
+    if(!pPort)
+    {
+        printf("Station: no room for %s\n", pcPath);
+        return (NULL);
+    }
+
+    if((fd = open(pcPath, O_RDWR | O_NOCTTY | O_CLOEXEC)) < 0)
+    {
+        /* Permissions may not be set yet, IN_ATTRIB brings us back */
+        if(errno != EACCES)
+            printf("Station: can't open %s (%s)\n", pcPath, strerror(errno));
+        return (NULL);
+    }
+    if(serialConfigLine(fd) < 0)
+    {
+        close(fd);
+        return (NULL);
+    }
+    tcflush(fd, TCIOFLUSH);
+
+    memset(pPort, 0, sizeof(*pPort));
+    snprintf(pPort->path, sizeof(pPort->path), "%s", pcPath);
+    pPort->fd = fd;
+    if(!(pPort->pUring = uringAddPort(&m_reactor, fd, pPort)))
+    {
+        close(fd);
+        return (NULL);
+    }
+    sblEngineSetSyncTimeout(&pPort->pUring->eng, STATION_SYNC_MS);
+    pPort->state = PS_SETTLING;
+    pPort->untilUs = serialGetTimeUs() + STATION_SETTLE_MS * 1000;
+    printf("Station: %s added\n", pPort->path);
+    return (pPort);
+}
+
+/* Fails its job and lets go of a port */
+static void closeStationPort(tStationPort *pPort, const char *pcWhy)
+{
+    tUringPort *pUring = pPort->pUring;
+
+    if(pPort->pJob)
+        finishJob(pPort, false, pcWhy);
+
+    /* No new job may start from the abort event below */
+    pPort->state = PS_FREE;
+    uringRemovePort(&m_reactor, pUring);
+    close(pPort->fd);
+    printf("Station: %s removed (%s)\n", pPort->path, pcWhy);
+    pPort->fd = -1;
+    pPort->pUring = NULL;
+}
+
+/* The loaded image of a file, (re)loaded if the file changed */
+static tStationImage *getImage(const char *pcPath)
+{
+    char pcReal[PATH_MAX];
+    struct stat st;
+    tStationImage *pImage = NULL, *pLru = NULL;
+
+    if(!realpath(pcPath, pcReal) || stat(pcReal, &st) < 0)
+        return (NULL);
+
+    for(uint32_t i = 0; i < STATION_MAX_IMAGES; i++)
+    {
+        tStationImage *p = &m_images[i];
+
+        if(p->bLoaded && strcmp(p->path, pcReal) == 0)
+        {
+            /* A same size rebuild within a second, or one with its
+             * mtime put back, still changes the ctime */
+            if(p->ino == st.st_ino && p->fileSize == st.st_size &&
+               p->mtime.tv_sec == st.st_mtim.tv_sec && p->mtime.tv_nsec == st.st_mtim.tv_nsec &&
+               p->ctime.tv_sec == st.st_ctim.tv_sec && p->ctime.tv_nsec == st.st_ctim.tv_nsec)
+            {
+                p->refs++;
+                p->lastUseUs = serialGetTimeUs();
+                return (p);
+            }
+            /* Rebuilt since, reload unless a job still flashes it */
+            if(!p->refs)
+                pImage = p;
+        }
+        else if(!p->bLoaded && !pImage)
+            pImage = p;
+        else if(p->bLoaded && !p->refs && (!pLru || p->lastUseUs < pLru->lastUseUs))
+            pLru = p;
+    }
+    if(!pImage && !(pImage = pLru))
+    {
+        printf("Station: all %d images in use\n", STATION_MAX_IMAGES);
+        return (NULL);
+    }
+
+    releaseImage(&pImage->img);
+    memset(pImage, 0, sizeof(*pImage));
+    if(prepareImage(pcReal, &pImage->img) != SBL_SUCCESS)
+        return (NULL);
+    snprintf(pImage->path, sizeof(pImage->path), "%s", pcReal);
+    pImage->bLoaded = true;
+    pImage->mtime = st.st_mtim;
+    pImage->ctime = st.st_ctim;
+    pImage->ino = st.st_ino;
+    pImage->fileSize = st.st_size;
+    pImage->refs = 1;
+    pImage->lastUseUs = serialGetTimeUs();
+    printf("Station: %s %s, %u bytes, crc %08X\n", (pImage->img.bCached) ? "mapped" : "prepared",
+           pImage->path, pImage->img.size, pImage->img.crc);
+    return (pImage);
+}
+
+/* A job is done with its image, it stays loaded */
+static void putImage(tStationImage *pImage)
+{
+    if(pImage && pImage->refs)
+        pImage->refs--;
+}
+
+/* Starts the oldest job waiting for an idle port */
+static void schedule(tStationPort *pPort)
+{
+    tStationJob *pJob = NULL;
+
+    if(pPort->state != PS_IDLE || pPort->pJob)
+        return;
+
+    for(uint32_t i = 0; i < STATION_MAX_JOBS; i++)
+    {
+        tStationJob *p = &m_jobs[i];
+        if(p->id && !p->bActive && strcmp(p->port, pPort->path) == 0 &&
+           (!pJob || p->id < pJob->id))
+            pJob = p;
+    }
+    if(!pJob)
+        return;
+
+    pJob->bActive = true;
+    pPort->pJob = pJob;
+    startSync(pPort);
+}
+
+/* Knocks on the port, the device may not be in the bootloader yet */
+static void startSync(tStationPort *pPort)
+{
+    tSblEngine *pEng = &pPort->pUring->eng;
+
+    pPort->pJob->syncTries++;
+    pPort->strayMark = pEng->stray;
+    pPort->opUs = serialGetTimeUs();
+    if(sblEngineAutobaud(pEng) != SBL_SUCCESS)
+    {
+        finishJob(pPort, false, "autobaud not started");
+        return;
+    }
+    pPort->state = PS_SYNC;
+    uringKick(&m_reactor, pPort->pUring);
+}
+
+/* Reports a job to its client and frees its slot */
+static void reportJob(tStationJob *pJob, bool bOk, const char *pcWhy)
+{
+    uint64_t now = serialGetTimeUs();
+    char pcLine[STATION_LINE_MAX];
+
+    snprintf(pcLine, sizeof(pcLine),
+             "job %u %s port=%s bytes=%u tries=%u wait=%.1f erase=%.1f write=%.1f "
+             "verify=%.1f reset=%.1f total=%.1f ms%s%s\n",
+             pJob->id, (bOk) ? "ok" : "fail", pJob->port,
+             pJob->pImage->img.size, pJob->syncTries,
+             msBetween(pJob->queuedUs, pJob->syncUs),
+             msBetween(pJob->syncUs, pJob->eraseUs),
+             msBetween(pJob->eraseUs, pJob->writeUs),
+             msBetween(pJob->writeUs, pJob->verifyUs),
+             msBetween(pJob->verifyUs, (bOk) ? now : 0),
+             msBetween(pJob->queuedUs, now),
+             (pcWhy) ? " " : "", (pcWhy) ? pcWhy : "");
+    printf("Station: %s", pcLine);
+    if(pJob->clientFd >= 0)
+        reply(pJob->clientFd, "%s", pcLine);
+
+    metricsSession(bOk, msBetween(pJob->queuedUs, now) / 1000);
+    metricsFlashed(pJob->port, bOk, pJob->pImage->img.size, msBetween(pJob->syncUs, pJob->verifyUs) / 1000);
+    metricsFlush();
+
+    putImage(pJob->pImage);
+    memset(pJob, 0, sizeof(*pJob));
+}
+
+/* Ends the job of a port, which goes back to idle */
+static void finishJob(tStationPort *pPort, bool bOk, const char *pcWhy)
+{
+    reportJob(pPort->pJob, bOk, pcWhy);
+    if(bOk)
+        pPort->jobsOk++;
+    else
+        pPort->jobsFailed++;
+    pPort->pJob = NULL;
+    if(pPort->state != PS_FREE)
+        pPort->state = PS_IDLE;
+}
+
+/* Steps a job through its phases */
+static void onEvent(tUringPort *pUring, const tSblEvent *pEvent)
+{
+    tStationPort *pPort = (tStationPort*)pUring->pUser;
+    tStationJob *pJob = pPort->pJob;
+    tSblEngine *pEng = &pUring->eng;
+    uint64_t now = serialGetTimeUs();
+    uint32_t flashSize;
+
+    if(!pJob)
+        return;
+
+    if(pEvent->op == SBL_OP_AUTOBAUD && pEvent->status == SBL_TIMEOUT_ERROR)
+    {
+        /* Not in the bootloader (yet), try again after a quiet spell
+         * in which a late ACK can still turn up */
+        metricsRetry("sync");
+        if(now - pJob->queuedUs >= (uint64_t)STATION_WAIT_MS * 1000)
+            finishJob(pPort, false, "no device");
+        else
+        {
+            pPort->state = PS_SYNC_WAIT;
+            pPort->untilUs = now + STATION_RESYNC_MS * 1000;
+        }
+        return;
+    }
+
+    /* The next operation, if any, starts now */
+    metricsOp(getOpString(pEvent->op), pEvent->status == SBL_SUCCESS, (now - pPort->opUs) / 1e6);
+    pPort->opUs = now;
+    if(pEvent->status != SBL_SUCCESS)
+    {
+        char pcWhy[64];
+        snprintf(pcWhy, sizeof(pcWhy), "%s failed", getOpString(pEvent->op));
+        finishJob(pPort, false, pcWhy);
+        schedule(pPort);
+        return;
+    }
+
+    switch(pPort->state)
+    {
+    case PS_SYNC:
+        pJob->syncUs = now;
+        pPort->state = PS_SIZE;
+        sblEngineReadMemory(pEng, SBL_CC2650_FLASH_SIZE_CFG, 1, 4, (uint8_t*)&pPort->flashCfg);
+        break;
+
+    case PS_SIZE:
+        flashSize = (pPort->flashCfg & 0xFF) * SBL_CC2650_PAGE_ERASE_SIZE;
+        setTimeoutFlashSize(flashSize);
+        sblEngineSetSizes(pEng, flashSize, STATION_RAM_SIZE);
+        pPort->state = PS_ERASE;
+        if(sblEngineEraseRange(pEng, pJob->addr, pJob->pImage->img.size) != SBL_SUCCESS)
+        {
+            finishJob(pPort, false, "image doesn't fit");
+            schedule(pPort);
+        }
+        break;
+
+    case PS_ERASE:
+        pJob->eraseUs = now;
+        pPort->state = PS_WRITE;
+        /* fall through */
+
+    case PS_WRITE:
+        /* Segment by segment, blank pages are skipped */
+        if(pJob->seg < pJob->pImage->img.numSegments)
+        {
+            const tImageSegment *pSeg = &pJob->pImage->img.pSegments[pJob->seg++];
+            sblEngineWriteRange(pEng, pJob->addr + pSeg->offset, pSeg->len,
+                                &pJob->pImage->img.pData[pSeg->offset]);
+            break;
+        }
+        pJob->writeUs = now;
+        pPort->state = PS_VERIFY;
+        sblEngineCrc32(pEng, pJob->addr, pJob->pImage->img.size);
+        break;
+
+    case PS_VERIFY:
+        if(pEvent->value != pJob->pImage->img.crc)
+        {
+            finishJob(pPort, false, "crc mismatch");
+            schedule(pPort);
+            break;
+        }
+        pJob->verifyUs = now;
+        pPort->state = PS_RESET;
+        sblEngineReset(pEng);
+        break;
+
+    case PS_RESET:
+        finishJob(pPort, true, NULL);
+        schedule(pPort);
+        break;
+
+    default:
+        break;
+    }
+}
+
+/* New client */
+static void onListen(int fd, void *pUser)
+{
+    int clientFd;
+
+    (void)pUser;
+    while((clientFd = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+    {
+        tStationClient *pClient = NULL;
+
+        for(uint32_t i = 0; i < STATION_MAX_CLIENTS && !pClient; i++)
+        {
+            if(m_clients[i].fd < 0)
+                pClient = &m_clients[i];
+        }
+        if(!pClient || uringWatchFd(&m_reactor, clientFd, onClient, pClient) != 0)
+        {
+            reply(clientFd, "error too many clients\n");
+            close(clientFd);
+            continue;
+        }
+        pClient->fd = clientFd;
+        pClient->lineLen = 0;
+    }
+}
+
+/* Requests from a client, one per line */
+static void onClient(int fd, void *pUser)
+{
+    tStationClient *pClient = (tStationClient*)pUser;
+    char buf[STATION_LINE_MAX];
+    ssize_t n;
+
+    while((n = read(fd, buf, sizeof(buf))) > 0)
+    {
+        for(ssize_t i = 0; i < n; i++)
+        {
+            if(buf[i] == '\n')
+            {
+                pClient->line[pClient->lineLen] = '\0';
+                handleLine(pClient, pClient->line);
+                pClient->lineLen = 0;
+            }
+            else if(pClient->lineLen < sizeof(pClient->line) - 1)
+                pClient->line[pClient->lineLen++] = buf[i];
+        }
+    }
+    if(n < 0 && (errno == EAGAIN || errno == EINTR))
+        return;
+
+    /* Gone, its jobs still run */
+    for(uint32_t i = 0; i < STATION_MAX_JOBS; i++)
+    {
+        if(m_jobs[i].id && m_jobs[i].clientFd == fd)
+            m_jobs[i].clientFd = -1;
+    }
+    uringUnwatchFd(&m_reactor, fd);
+    close(fd);
+    pClient->fd = -1;
+}
+
+/* Ports appearing and disappearing */
+static void onInotify(int fd, void *pUser)
+{
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    char pcPath[PATH_MAX];
+    ssize_t n;
+
+    (void)pUser;
+    while((n = read(fd, buf, sizeof(buf))) > 0)
+    {
+        for(char *p = buf; p < buf + n; p += sizeof(struct inotify_event) + ((struct inotify_event*)p)->len)
+        {
+            const struct inotify_event *pEv = (const struct inotify_event*)p;
+            tStationPort *pPort;
+
+            if(!pEv->len || !isUsbTty(pEv->name))
+                continue;
+            snprintf(pcPath, sizeof(pcPath), STATION_DEV_DIR "/%s", pEv->name);
+            pPort = findPort(pcPath);
+            if(pEv->mask & IN_DELETE)
+            {
+                if(pPort)
+                    closeStationPort(pPort, "unplugged");
+            }
+            else if(!pPort)
+                openStationPort(pcPath);
+        }
+    }
+}
+
+/* Settling, sync retries, dead ports, jobs that waited too long */
+static void onTick(int fd, void *pUser)
+{
+    uint64_t exp, now = serialGetTimeUs();
+
+    (void)pUser;
+    if(read(fd, &exp, sizeof(exp)) < 0 && errno != EAGAIN)
+        perror("Station: ERROR READING TIMER |");
+
+    for(uint32_t i = 0; i < STATION_MAX_PORTS; i++)
+    {
+        tStationPort *pPort = &m_ports[i];
+
+        if(pPort->state == PS_FREE)
+            continue;
+        if(pPort->pUring->bDead)
+        {
+            closeStationPort(pPort, "port failed");
+            continue;
+        }
+        if(now < pPort->untilUs)
+            continue;
+
+        if(pPort->state == PS_SETTLING)
+        {
+            tcflush(pPort->fd, TCIOFLUSH);
+            pPort->state = PS_IDLE;
+            schedule(pPort);
+        }
+        else if(pPort->state == PS_SYNC_WAIT)
+        {
+            if(pPort->pUring->eng.stray != pPort->strayMark)
+            {
+                /* The ACK came late, the device is synced now and a
+                 * second 0x55 0x55 would start a bogus packet */
+                pPort->pJob->syncUs = now;
+                pPort->state = PS_SIZE;
+                sblEngineReadMemory(&pPort->pUring->eng, SBL_CC2650_FLASH_SIZE_CFG, 1, 4,
+                                    (uint8_t*)&pPort->flashCfg);
+                uringKick(&m_reactor, pPort->pUring);
+            }
+            else
+                startSync(pPort);
+        }
+    }
+
+    /* Jobs whose port never showed up or stayed busy */
+    for(uint32_t i = 0; i < STATION_MAX_JOBS; i++)
+    {
+        tStationJob *pJob = &m_jobs[i];
+
+        if(pJob->id && !pJob->bActive && now - pJob->queuedUs >= (uint64_t)STATION_WAIT_MS * 1000)
+            reportJob(pJob, false, "never started");
+    }
+}
+
+/* SIGINT/SIGTERM: stop once the jobs in progress are done */
+static void onSignal(int fd, void *pUser)
+{
+    struct signalfd_siginfo si;
+
+    (void)pUser;
+    if(read(fd, &si, sizeof(si)) != sizeof(si))
+        return;
+    printf("Station: signal %u, stopping\n", si.ssi_signo);
+
+    /* Waiting jobs would never start */
+    for(uint32_t i = 0; i < STATION_MAX_JOBS; i++)
+    {
+        tStationJob *pJob = &m_jobs[i];
+
+        if(pJob->id && !pJob->bActive)
+            reportJob(pJob, false, "station stopped");
+    }
+    uringStop(&m_reactor);
+}
+
+/* One request */
+static void handleLine(tStationClient *pClient, char *pcLine)
+{
+    char *pcSave = NULL;
+    char *pcCmd = strtok_r(pcLine, " \t\r", &pcSave);
+
+    if(!pcCmd)
+        return;
+
+    if(strcmp(pcCmd, "flash") == 0)
+        cmdFlash(pClient, pcSave);
+    else if(strcmp(pcCmd, "ports") == 0)
+    {
+        for(uint32_t i = 0; i < STATION_MAX_PORTS; i++)
+        {
+            tStationPort *pPort = &m_ports[i];
+            if(pPort->state != PS_FREE)
+                reply(pClient->fd, "port %s %s ok=%u fail=%u job=%u\n", pPort->path,
+                      m_stateNames[pPort->state], pPort->jobsOk, pPort->jobsFailed,
+                      (pPort->pJob) ? pPort->pJob->id : 0);
+        }
+        reply(pClient->fd, "end\n");
+    }
+    else if(strcmp(pcCmd, "jobs") == 0)
+    {
+        uint64_t now = serialGetTimeUs();
+        for(uint32_t i = 0; i < STATION_MAX_JOBS; i++)
+        {
+            tStationJob *pJob = &m_jobs[i];
+            if(pJob->id)
+                reply(pClient->fd, "job %u %s %s %s age=%.1f ms\n", pJob->id, pJob->port,
+                      pJob->pImage->path, (pJob->bActive) ? "active" : "waiting",
+                      msBetween(pJob->queuedUs, now));
+        }
+        reply(pClient->fd, "end\n");
+    }
+    else
+        reply(pClient->fd, "error unknown command %s\n", pcCmd);
+}
+
+/* flash <port> <image> [addr] */
+static void cmdFlash(tStationClient *pClient, char *pcArgs)
+{
+    char *pcSave = NULL;
+    char *pcPort = strtok_r(pcArgs, " \t\r", &pcSave);
+    char *pcImage = strtok_r(NULL, " \t\r", &pcSave);
+    char *pcAddr = strtok_r(NULL, " \t\r", &pcSave);
+    char *pcEnd = NULL;
+    tStationJob *pJob = NULL;
+    tStationPort *pPort;
+
+    if(!pcPort || !pcImage)
+    {
+        reply(pClient->fd, "error usage: flash <port> <image> [addr]\n");
+        return;
+    }
+    for(uint32_t i = 0; i < STATION_MAX_JOBS && !pJob; i++)
+    {
+        if(!m_jobs[i].id)
+            pJob = &m_jobs[i];
+    }
+    if(!pJob)
+    {
+        reply(pClient->fd, "error all %d jobs in use\n", STATION_MAX_JOBS);
+        return;
+    }
+
+    memset(pJob, 0, sizeof(*pJob));
+    if(pcAddr)
+    {
+        pJob->addr = strtoul(pcAddr, &pcEnd, 0);
+        if(*pcEnd)
+        {
+            reply(pClient->fd, "error bad address %s\n", pcAddr);
+            return;
+        }
+    }
+    if(!(pJob->pImage = getImage(pcImage)))
+    {
+        reply(pClient->fd, "error can't load %s\n", pcImage);
+        return;
+    }
+    canonPortPath(pcPort, pJob->port, sizeof(pJob->port));
+    pJob->id = m_nextJobId++;
+    pJob->clientFd = pClient->fd;
+    pJob->queuedUs = serialGetTimeUs();
+    reply(pClient->fd, "job %u queued\n", pJob->id);
+
+    /* USB ports come by themselves, anything else named is opened
+     * on demand (ptys, on-board UARTs) */
+    if(!(pPort = findPort(pJob->port)) && access(pJob->port, F_OK) == 0)
+        pPort = openStationPort(pJob->port);
+    if(pPort)
+        schedule(pPort);
+}
+
+/* Writes a reply, a client that doesn't read loses it */
+static void reply(int fd, const char *pcFmt, ...)
+{
+    char pcLine[STATION_LINE_MAX];
+    va_list ap;
+    int n;
+
+    va_start(ap, pcFmt);
+    n = vsnprintf(pcLine, sizeof(pcLine), pcFmt, ap);
+    va_end(ap);
+    if(n > (int)sizeof(pcLine) - 1)
+        n = sizeof(pcLine) - 1;
+    if(send(fd, pcLine, n, MSG_NOSIGNAL | MSG_DONTWAIT) != n)
+        printf("Station: reply to client %d lost\n", fd);
+}
+
+/* ttyUSB0 -> /dev/ttyUSB0, symlinks resolved where they exist */
+static void canonPortPath(const char *pcIn, char *pcOut, uint32_t ui32Len)
+{
+    char pcPath[PATH_MAX];
+
+    if(!strchr(pcIn, '/'))
+        snprintf(pcPath, sizeof(pcPath), STATION_DEV_DIR "/%s", pcIn);
+    else
+        snprintf(pcPath, sizeof(pcPath), "%s", pcIn);
+    if(!realpath(pcPath, pcOut))
+        snprintf(pcOut, ui32Len, "%s", pcPath);
+}
+
+/* Phase length, 0 if either end wasn't reached */
+static double msBetween(uint64_t ui64FromUs, uint64_t ui64ToUs)
+{
+    if(!ui64FromUs || !ui64ToUs || ui64ToUs < ui64FromUs)
+        return (0);
+    return ((ui64ToUs - ui64FromUs) / 1000.0);
+}
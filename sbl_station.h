@@ -0,0 +1,31 @@
+/*
+ * sbl_station.h
+ *
+ *  Created on: 18/10/2026
+ */
+
+#ifndef SBL_STATION_H_
+#define SBL_STATION_H_
+#include <stdint.h>
+#include "sbl_device.h"
+
+/* Sizing */
+#define STATION_MAX_PORTS       64
+#define STATION_MAX_JOBS        256
+#define STATION_MAX_IMAGES      16
+#define STATION_MAX_CLIENTS     32
+
+/* Timing, ms */
+#define STATION_TICK_MS         10      /* Housekeeping period */
+#define STATION_SETTLE_MS       100     /* New tty until it's flushed */
+#define STATION_SYNC_MS         50      /* Autobaud ACK wait per try */
+#define STATION_RESYNC_MS       20      /* Quiet time between tries */
+#define STATION_WAIT_MS         60000   /* Job waits this long for its
+                                         * device to show up */
+
+/* RAM size assumed for range checks, the daemon only writes flash */
+#define STATION_RAM_SIZE        0x5000
+
+extern tSblStatus runStation(const char *pcSocketPath);
+
+#endif /* SBL_STATION_H_ */
@@ -0,0 +1,210 @@
+/*
+ * sbl_timeline.c
+ *
+ *  Created on: 18/10/2026
+ *  Description: Session timeline in the Chrome trace event format,
+ *               for Perfetto or chrome://tracing. Spans are kept in
+ *               memory while flashing and written out as JSON when
+ *               the tool exits. Names and argument keys must be
+ *               string constants, only their pointers are kept.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Custom Includes */
+#include "sbl_timeline.h"
+#include "sbl_small.h"
+
+/* Spans kept before the first realloc(), all a small build keeps */
+#define TIMELINE_INITIAL_SPANS      4096
+
+typedef struct {
+    const char *pcName;
+    const char *pcArg;      /* NULL if none */
+    uint64_t    startUs;
+    uint64_t    endUs;
+    uint32_t    arg;
+    uint8_t     lane;
+} tTimelineSpan;
+
+/* Static variables */
+static FILE *m_fp;
+static char m_port[256];
+static tTimelineSpan *m_pSpans;
+static uint32_t m_numSpans;
+static uint32_t m_maxSpans;
+static uint32_t m_dropped;
+#ifdef SBL_SMALL
+static tTimelineSpan m_spanArena[TIMELINE_INITIAL_SPANS];
+#endif
+
+static const char *const m_laneNames[] = {
+    [TL_SESSION]  = "session",
+    [TL_CALLS]    = "calls",
+    [TL_COMMANDS] = "commands",
+    [TL_PORT]     = "port",
+};
+
+/****************************************************************
+ * Function Name : timelineOpen
+ * Description   : Starts recording spans, written to the file by
+ *                 timelineClose()
+ * Returns       : 0 on success, -1 on failure
+ * Params        @pcPath: JSON file, replaced
+ *               @pcPort: Port name, shown as the process
+ ****************************************************************/
+int timelineOpen(const char *pcPath, const char *pcPort)
+{
+    /* Opened now so a bad path fails before flashing, not after */
+    if(!(m_fp = fopen(pcPath, "w")))
+    {
+        perror("TIMELINE: ERROR OPENING FILE |");
+        return (-1);
+    }
+#ifdef SBL_SMALL
+    m_pSpans = m_spanArena;
+#else
+    if(!(m_pSpans = malloc(TIMELINE_INITIAL_SPANS * sizeof(tTimelineSpan))))
+    {
+        printf("TIMELINE: OUT OF MEMORY\r\n");
+        fclose(m_fp);
+        m_fp = NULL;
+        return (-1);
+    }
+#endif
+    m_maxSpans = TIMELINE_INITIAL_SPANS;
+    m_numSpans = m_dropped = 0;
+    snprintf(m_port, sizeof(m_port), "%s", (pcPort) ? pcPort : "");
+    return (0);
+}
+
+/****************************************************************
+ * Function Name : timelineClose
+ * Description   : Writes the spans recorded and stops
+ * Returns       : None
+ * Params        @None
+ ****************************************************************/
+void timelineClose(void)
+{
+    if(!m_fp)
+        return;
+
+    fprintf(m_fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(m_fp, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"sbl_out ");
+    for(const char *p = m_port; *p; p++)
+        fprintf(m_fp, (*p == '"' || *p == '\\') ? "\\%c" : "%c", *p);
+    fprintf(m_fp, "\"}}");
+    for(uint32_t lane = TL_SESSION; lane <= TL_PORT; lane++)
+    {
+        fprintf(m_fp, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+                "\"args\":{\"name\":\"%s\"}}", lane, m_laneNames[lane]);
+        fprintf(m_fp, ",\n{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+                "\"args\":{\"sort_index\":%u}}", lane, lane);
+    }
+
+    for(uint32_t i = 0; i < m_numSpans; i++)
+    {
+        const tTimelineSpan *pSpan = &m_pSpans[i];
+
+        fprintf(m_fp, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+                "\"ts\":%llu,\"dur\":%llu", pSpan->pcName, pSpan->lane,
+                (unsigned long long)pSpan->startUs,
+                (unsigned long long)(pSpan->endUs - pSpan->startUs));
+        if(pSpan->pcArg)
+            fprintf(m_fp, ",\"args\":{\"%s\":%u}", pSpan->pcArg, pSpan->arg);
+        fprintf(m_fp, "}");
+    }
+    fprintf(m_fp, "\n]}\n");
+
+    if(fclose(m_fp) != 0)
+        perror("TIMELINE: ERROR WRITING FILE |");
+    if(m_dropped)
+        printf("TIMELINE: %u SPANS DROPPED, OUT OF MEMORY\r\n", m_dropped);
+    m_fp = NULL;
+#ifndef SBL_SMALL
+    free(m_pSpans);
+#endif
+    m_pSpans = NULL;
+}
+
+/****************************************************************
+ * Function Name : timelineNow
+ * Description   : Start of a span, same clock as serialGetTimeUs()
+ * Returns       : Time in microseconds, 0 if not recording
+ * Params        @None
+ ****************************************************************/
+uint64_t timelineNow(void)
+{
+    struct timespec ts;
+
+    if(!m_fp)
+        return (0);
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec*1000000 + ts.tv_nsec/1000);
+}
+
+/****************************************************************
+ * Function Name : timelineSpan
+ * Description   : Records a span that ends now
+ * Returns       : None
+ * Params        @lane: Row it goes on
+ *               @pcName: Constant string
+ *               @ui64StartUs: From timelineNow(), 0 records nothing
+ *               @pcArg: Constant name of a value to attach, or NULL
+ *               @ui32Arg: The value
+ ****************************************************************/
+void timelineSpan(tTimelineLane lane, const char *pcName, uint64_t ui64StartUs,
+                  const char *pcArg, uint32_t ui32Arg)
+{
+    if(!m_fp || !ui64StartUs)
+        return;
+    timelineSpanAt(lane, pcName, ui64StartUs, timelineNow(), pcArg, ui32Arg);
+}
+
+/****************************************************************
+ * Function Name : timelineSpanAt
+ * Description   : Records a span measured elsewhere, e.g. by the
+ *                 protocol engine
+ * Returns       : None
+ * Params        @lane: Row it goes on
+ *               @pcName: Constant string
+ *               @ui64StartUs: Start, serialGetTimeUs() clock
+ *               @ui64EndUs: End, same clock
+ *               @pcArg: Constant name of a value to attach, or NULL
+ *               @ui32Arg: The value
+ ****************************************************************/
+void timelineSpanAt(tTimelineLane lane, const char *pcName, uint64_t ui64StartUs,
+                    uint64_t ui64EndUs, const char *pcArg, uint32_t ui32Arg)
+{
+    tTimelineSpan *pSpan;
+
+    if(!m_fp || !ui64StartUs)
+        return;
+
+    if(m_numSpans == m_maxSpans)
+    {
+#ifdef SBL_SMALL
+        tTimelineSpan *pMore = NULL;
+#else
+        tTimelineSpan *pMore = realloc(m_pSpans, 2 * (size_t)m_maxSpans * sizeof(tTimelineSpan));
+#endif
+        if(!pMore)
+        {
+            m_dropped++;
+            return;
+        }
+        m_pSpans = pMore;
+        m_maxSpans *= 2;
+    }
+
+    pSpan = &m_pSpans[m_numSpans++];
+    pSpan->pcName = pcName;
+    pSpan->pcArg = pcArg;
+    pSpan->startUs = ui64StartUs;
+    pSpan->endUs = (ui64EndUs > ui64StartUs) ? ui64EndUs : ui64StartUs;
+    pSpan->arg = ui32Arg;
+    pSpan->lane = lane;
+}
@@ -0,0 +1,28 @@
+/*
+ * sbl_timeline.h
+ *
+ *  Created on: 18/10/2026
+ */
+
+#ifndef SBL_TIMELINE_H_
+#define SBL_TIMELINE_H_
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Rows of the timeline, spans on one row nest */
+typedef enum {
+    TL_SESSION = 1,     /* Phases of main.c and the operations */
+    TL_CALLS,           /* eraseFlashRange(), writeFlashRange(), ... */
+    TL_COMMANDS,        /* Command sent until its answer came */
+    TL_PORT,            /* serialWrite(), tcdrain(), serialRead() */
+} tTimelineLane;
+
+extern int timelineOpen(const char *pcPath, const char *pcPort);
+extern void timelineClose(void);
+extern uint64_t timelineNow(void);
+extern void timelineSpan(tTimelineLane lane, const char *pcName, uint64_t ui64StartUs,
+                         const char *pcArg, uint32_t ui32Arg);
+extern void timelineSpanAt(tTimelineLane lane, const char *pcName, uint64_t ui64StartUs,
+                           uint64_t ui64EndUs, const char *pcArg, uint32_t ui32Arg);
+
+#endif /* SBL_TIMELINE_H_ */
@@ -0,0 +1,347 @@
+/*
+ * sbl_timeout.c
+ *
+ *  Created on: 18/10/2026
+ *  Description: Per-command response timeouts. Each command gets a
+ *               timeout from a timing model of the device (erase
+ *               time per page, CRC cost per byte, ...) on top of the
+ *               link turnaround. Both are corrected by what we
+ *               observe during the session, in the same way TCP
+ *               derives its RTO from srtt/rttvar.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include "sbl_timeout.h"
+#include "sbl_device_cc2640.h"
+
+/* Macros */
+#define MIN(x, y) (((x) < (y)) ? (x) : (y))
+#define MAX(x, y) (((x) > (y)) ? (x) : (y))
+#define ABS(x)    (((x) < 0) ? -(x) : (x))
+
+/* Scale of 1000 permille means the device is exactly as fast as modelled */
+#define SCALE_PRIOR         1000
+#define SCALE_VAR_PRIOR     750
+#define SCALE_VAR_MAX       100000
+#define LINK_VAR_PRIOR_US   16000
+#define LINK_VAR_MAX_US     (SBL_TIMEOUT_CEILING_MS * 1000)
+
+/* Timing model and learned state of one command */
+typedef struct {
+    cmd_t    cmd;
+    uint32_t unitNs;        /* Device cost per payload unit, 0 if constant */
+    uint32_t samples;       /* Responses seen */
+    uint32_t maxUs;         /* Slowest response seen */
+    int32_t  scale;         /* Observed/modelled device time, permille */
+    int32_t  scaleVar;      /* Mean deviation of scale, permille */
+} tCmdTimeModel;
+
+/* Units are pages for erase and bytes for CRC32/SEND_DATA */
+static tCmdTimeModel m_models[] = {
+    { CMD_PING,          0,                                       0, 0, SCALE_PRIOR, SCALE_VAR_PRIOR },
+    { CMD_DOWNLOAD,      0,                                       0, 0, SCALE_PRIOR, SCALE_VAR_PRIOR },
+    { CMD_GET_STATUS,    0,                                       0, 0, SCALE_PRIOR, SCALE_VAR_PRIOR },
+    { CMD_SEND_DATA,     SBL_TIMEOUT_PROG_NS_PER_BYTE,            0, 0, SCALE_PRIOR, SCALE_VAR_PRIOR },
+    { CMD_RESET,         0,                                       0, 0, SCALE_PRIOR, SCALE_VAR_PRIOR },
+    { CMD_SECTOR_ERASE,  SBL_CC2650_PAGE_ERASE_TIME_MS * 1000000, 0, 0, SCALE_PRIOR, SCALE_VAR_PRIOR },
+    { CMD_CRC32,         SBL_TIMEOUT_CRC_NS_PER_BYTE,             0, 0, SCALE_PRIOR, SCALE_VAR_PRIOR },
+    { CMD_GET_CHIP_ID,   0,                                       0, 0, SCALE_PRIOR, SCALE_VAR_PRIOR },
+    { CMD_MEMORY_READ,   0,                                       0, 0, SCALE_PRIOR, SCALE_VAR_PRIOR },
+    { CMD_MEMORY_WRITE,  0,                                       0, 0, SCALE_PRIOR, SCALE_VAR_PRIOR },
+    { CMD_BANK_ERASE,    SBL_CC2650_PAGE_ERASE_TIME_MS * 1000000, 0, 0, SCALE_PRIOR, SCALE_VAR_PRIOR },
+    { CMD_SET_CCFG,      0,                                       0, 0, SCALE_PRIOR, SCALE_VAR_PRIOR },
+};
+#define NUM_MODELS (sizeof(m_models) / sizeof(m_models[0]))
+
+/* Link turnaround, learned from commands with constant device cost */
+static int32_t  m_linkSrttUs = SBL_TIMEOUT_LINK_PRIOR_US;
+static int32_t  m_linkVarUs  = LINK_VAR_PRIOR_US;
+static uint32_t m_linkSamples;
+static uint32_t m_timeouts;
+
+/* Wire time of one byte, 8N1 at 115200 by default */
+static uint32_t m_byteNs = (uint32_t)(10 * 1000000000ULL / 115200);
+/* Pages wiped by a bank erase, 128 KB part unless told otherwise */
+static uint32_t m_flashPages = (128 * 1024) / SBL_CC2650_PAGE_ERASE_SIZE;
+static uint32_t m_floorMs = SBL_TIMEOUT_FLOOR_MS;
+
+/* Static functions */
+static tCmdTimeModel *findModel(cmd_t cmdType);
+static uint64_t deviceNominalUs(const tCmdTimeModel *pModel, uint32_t ui32Units);
+
+/****************************************************************
+ * Function Name : getCmdUnits
+ * Description   : Derives the payload size the device has to work
+ *                 through for a command from its packet payload
+ * Returns       : Pages for erases, bytes for CRC32/SEND_DATA,
+ *                 0 for everything else
+ * Params        @cmdType: The command
+ *               @pcSendData: Command payload as sent
+ *               @ui32SendLen: Payload length
+ ****************************************************************/
+uint32_t getCmdUnits(cmd_t cmdType, const uint8_t *pcSendData,
+                     uint32_t ui32SendLen)
+{
+    switch(cmdType)
+    {
+    case CMD_SECTOR_ERASE:
+        return 1;
+    case CMD_BANK_ERASE:
+        return m_flashPages;
+    case CMD_CRC32:
+        /* 4B address, 4B byte count (MSB first), 4B repeat count */
+        if(ui32SendLen < 8)
+            return 0;
+        return charArrayToUL((const char*)&pcSendData[4]);
+    case CMD_SEND_DATA:
+        return ui32SendLen;
+    default:
+        return 0;
+    }
+}
+
+/****************************************************************
+ * Function Name : getCmdTimeoutMs
+ * Description   : Timeout for the ACK/NAK of a command
+ * Returns       : Timeout in milliseconds
+ * Params        @cmdType: The command sent
+ *               @ui32Units: Payload units, see getCmdUnits()
+ ****************************************************************/
+uint32_t getCmdTimeoutMs(cmd_t cmdType, uint32_t ui32Units)
+{
+    tCmdTimeModel *pModel = findModel(cmdType);
+    uint64_t timeoutUs = (uint64_t)m_linkSrttUs + 4*(uint64_t)m_linkVarUs;
+
+    /* ACK/NAK on the wire */
+    timeoutUs += (2 * (uint64_t)m_byteNs) / 1000;
+
+    if(pModel && pModel->unitNs && ui32Units)
+    {
+        uint64_t devUs = deviceNominalUs(pModel, ui32Units);
+        timeoutUs += devUs * (uint64_t)(pModel->scale + 4*pModel->scaleVar) / 1000;
+    }
+
+    uint64_t timeoutMs = (timeoutUs + 999) / 1000;
+    return (uint32_t)MIN(MAX(timeoutMs, m_floorMs), SBL_TIMEOUT_CEILING_MS);
+}
+
+/****************************************************************
+ * Function Name : getDataTimeoutMs
+ * Description   : Timeout for response data following an ACK
+ * Returns       : Timeout in milliseconds
+ * Params        @ui32ByteCount: Bytes expected on the wire
+ ****************************************************************/
+uint32_t getDataTimeoutMs(uint32_t ui32ByteCount)
+{
+    uint64_t timeoutUs = (uint64_t)m_linkSrttUs + 4*(uint64_t)m_linkVarUs;
+    timeoutUs += ((uint64_t)ui32ByteCount * m_byteNs) / 1000;
+
+    uint64_t timeoutMs = (timeoutUs + 999) / 1000;
+    return (uint32_t)MIN(MAX(timeoutMs, m_floorMs), SBL_TIMEOUT_CEILING_MS);
+}
+
+/****************************************************************
+ * Function Name : updateCmdLatency
+ * Description   : Feeds an observed command latency (end of the
+ *                 transmission to ACK/NAK received) into the model
+ * Returns       : None
+ * Params        @cmdType: The command sent
+ *               @ui32Units: Payload units, see getCmdUnits()
+ *               @ui32ElapsedUs: Observed latency
+ ****************************************************************/
+void updateCmdLatency(cmd_t cmdType, uint32_t ui32Units,
+                      uint32_t ui32ElapsedUs)
+{
+    tCmdTimeModel *pModel = findModel(cmdType);
+    if(!pModel)
+        return;
+
+    pModel->samples++;
+    pModel->maxUs = MAX(pModel->maxUs, ui32ElapsedUs);
+
+    if(!pModel->unitNs || !ui32Units)
+    {
+        /* Constant cost command, all of it is link turnaround */
+        int32_t sample = (int32_t)MIN(ui32ElapsedUs, LINK_VAR_MAX_US);
+        if(!m_linkSamples++)
+        {
+            m_linkSrttUs = sample;
+            m_linkVarUs  = sample / 2;
+        }
+        else
+        {
+            m_linkVarUs  += (ABS(sample - m_linkSrttUs) - m_linkVarUs) / 4;
+            m_linkSrttUs += (sample - m_linkSrttUs) / 8;
+        }
+        return;
+    }
+
+    /* Whatever exceeds the link turnaround is device time */
+    uint64_t devUs = deviceNominalUs(pModel, ui32Units);
+    uint32_t linkUs = (uint32_t)MIN((uint32_t)m_linkSrttUs, ui32ElapsedUs);
+    int32_t sample = (int32_t)MIN(((uint64_t)(ui32ElapsedUs - linkUs) * 1000) / devUs,
+                                  SCALE_VAR_MAX);
+    if(pModel->samples == 1)
+    {
+        pModel->scale    = sample;
+        pModel->scaleVar = MAX(sample / 2, 1);
+    }
+    else
+    {
+        pModel->scaleVar += (ABS(sample - pModel->scale) - pModel->scaleVar) / 4;
+        pModel->scale    += (sample - pModel->scale) / 8;
+    }
+}
+
+/****************************************************************
+ * Function Name : backoffCmdTimeout
+ * Description   : Widens the timeout of a command after it timed
+ *                 out, so a retry does not fail the same way
+ * Returns       : None
+ * Params        @cmdType: The command that timed out
+ ****************************************************************/
+void backoffCmdTimeout(cmd_t cmdType)
+{
+    tCmdTimeModel *pModel = findModel(cmdType);
+
+    m_timeouts++;
+    m_linkVarUs = MIN(MAX(m_linkVarUs, 1000) * 2, LINK_VAR_MAX_US);
+    if(pModel && pModel->unitNs)
+        pModel->scaleVar = MIN(MAX(pModel->scaleVar, 1) * 2, SCALE_VAR_MAX);
+}
+
+/****************************************************************
+ * Function Name : resetLinkLatency
+ * Description   : The link got faster or slower (adapter tuned),
+ *                 learn its turnaround anew. The old estimate holds
+ *                 until the first response replaces it.
+ * Returns       : None
+ * Params        @None
+ ****************************************************************/
+void resetLinkLatency(void)
+{
+    m_linkSamples = 0;
+}
+
+/****************************************************************
+ * Function Name : getLinkTiming
+ * Description   : Returns what was learned about the link
+ * Returns       : None
+ * Params        @pTiming: Populated with it
+ ****************************************************************/
+void getLinkTiming(tLinkTiming *pTiming)
+{
+    pTiming->srttUs = (uint32_t)m_linkSrttUs;
+    pTiming->varUs = (uint32_t)m_linkVarUs;
+    pTiming->samples = m_linkSamples;
+    pTiming->timeouts = m_timeouts;
+}
+
+/****************************************************************
+ * Function Name : seedLinkTiming
+ * Description   : Starts from a link turnaround learned earlier,
+ *                 e.g. in a previous session on the same port,
+ *                 instead of the prior. Responses refine it as if
+ *                 it had been measured in this session.
+ * Returns       : None
+ * Params        @ui32SrttUs: Smoothed turnaround
+ *               @ui32VarUs: Its mean deviation
+ ****************************************************************/
+void seedLinkTiming(uint32_t ui32SrttUs, uint32_t ui32VarUs)
+{
+    m_linkSrttUs = (int32_t)MIN(ui32SrttUs, LINK_VAR_MAX_US);
+    m_linkVarUs = (int32_t)MIN(ui32VarUs, LINK_VAR_MAX_US);
+    m_linkSamples = 1;
+}
+
+/****************************************************************
+ * Function Name : setTimeoutBaudRate
+ * Description   : Tells the model the line rate (8N1)
+ * Returns       : None
+ * Params        @ui32Baud: Baud rate
+ ****************************************************************/
+void setTimeoutBaudRate(uint32_t ui32Baud)
+{
+    if(ui32Baud)
+        m_byteNs = (uint32_t)(10 * 1000000000ULL / ui32Baud);
+}
+
+/****************************************************************
+ * Function Name : getWireTimeUs
+ * Description   : Time the UART needs to shift bytes out, for
+ *                 writers that can't wait for the drain
+ * Returns       : Time in microseconds
+ * Params        @ui32ByteCount: Number of bytes
+ ****************************************************************/
+uint32_t getWireTimeUs(uint32_t ui32ByteCount)
+{
+    return (uint32_t)(((uint64_t)ui32ByteCount * m_byteNs) / 1000);
+}
+
+/****************************************************************
+ * Function Name : setTimeoutFloor
+ * Description   : Sets the shortest timeout, for hosts whose
+ *                 scheduling jitter exceeds SBL_TIMEOUT_FLOOR_MS
+ * Returns       : None
+ * Params        @ui32FloorMs: Floor in milliseconds
+ ****************************************************************/
+void setTimeoutFloor(uint32_t ui32FloorMs)
+{
+    m_floorMs = MIN(MAX(ui32FloorMs, 1), SBL_TIMEOUT_CEILING_MS);
+}
+
+/****************************************************************
+ * Function Name : setTimeoutFlashSize
+ * Description   : Tells the model how many pages a bank erase wipes
+ * Returns       : None
+ * Params        @ui32FlashSize: Flash size in bytes
+ ****************************************************************/
+void setTimeoutFlashSize(uint32_t ui32FlashSize)
+{
+    if(ui32FlashSize)
+        m_flashPages = ui32FlashSize / SBL_CC2650_PAGE_ERASE_SIZE;
+}
+
+/****************************************************************
+ * Function Name : printCmdTimeouts
+ * Description   : Prints what was learned during the session
+ * Returns       : None
+ * Params        @None
+ ****************************************************************/
+void printCmdTimeouts(void)
+{
+    printf("Link turnaround: %d us (+/- %d us, %u samples)\n",
+           m_linkSrttUs, m_linkVarUs, m_linkSamples);
+    for(uint32_t i = 0; i < NUM_MODELS; i++)
+    {
+        tCmdTimeModel *pModel = &m_models[i];
+        if(!pModel->samples)
+            continue;
+        printf("  %-18s %6u rsp, max %8u us, timeout %5u ms",
+               getCmdString(pModel->cmd), pModel->samples, pModel->maxUs,
+               getCmdTimeoutMs(pModel->cmd, pModel->unitNs ? 1 : 0));
+        if(pModel->unitNs)
+            printf(" for 1 unit, device at %d.%03dx model", pModel->scale / 1000,
+                   pModel->scale % 1000);
+        printf("\n");
+    }
+}
+
+/* Look up the model of a command */
+static tCmdTimeModel *findModel(cmd_t cmdType)
+{
+    for(uint32_t i = 0; i < NUM_MODELS; i++)
+    {
+        if(m_models[i].cmd == cmdType)
+            return &m_models[i];
+    }
+    return NULL;
+}
+
+/* Device time the model predicts for a command */
+static uint64_t deviceNominalUs(const tCmdTimeModel *pModel, uint32_t ui32Units)
+{
+    return SBL_TIMEOUT_CMD_BASE_US + ((uint64_t)ui32Units * pModel->unitNs) / 1000;
+}
@@ -0,0 +1,50 @@
+/*
+ * sbl_timeout.h
+ *
+ *  Created on: 18/10/2026
+ */
+
+#ifndef SBL_TIMEOUT_H_
+#define SBL_TIMEOUT_H_
+#include <stdint.h>
+#include "sbl_device.h"
+
+/* Timeouts are never shorter than this, covers host scheduling jitter.
+ * Hosts running many sessions on one thread may want more, see
+ * setTimeoutFloor() */
+#define SBL_TIMEOUT_FLOOR_MS            10
+/* Nor longer than this, whatever the model says */
+#define SBL_TIMEOUT_CEILING_MS          30000
+/* Link turnaround assumed before anything was measured (FTDI default latency timer) */
+#define SBL_TIMEOUT_LINK_PRIOR_US       16000
+/* Device side fixed cost of any command */
+#define SBL_TIMEOUT_CMD_BASE_US         1000
+/* Device side CRC32 and flash program cost, per byte */
+#define SBL_TIMEOUT_CRC_NS_PER_BYTE     1000
+#define SBL_TIMEOUT_PROG_NS_PER_BYTE    2000
+
+/* What was learned about the link, see getLinkTiming() */
+typedef struct {
+    uint32_t srttUs;        /* Smoothed turnaround */
+    uint32_t varUs;         /* Its mean deviation */
+    uint32_t samples;
+    uint32_t timeouts;      /* Responses that never came */
+} tLinkTiming;
+
+extern uint32_t getCmdUnits(cmd_t cmdType, const uint8_t *pcSendData,
+                            uint32_t ui32SendLen);
+extern uint32_t getCmdTimeoutMs(cmd_t cmdType, uint32_t ui32Units);
+extern uint32_t getDataTimeoutMs(uint32_t ui32ByteCount);
+extern void updateCmdLatency(cmd_t cmdType, uint32_t ui32Units,
+                             uint32_t ui32ElapsedUs);
+extern void backoffCmdTimeout(cmd_t cmdType);
+extern void resetLinkLatency(void);
+extern void getLinkTiming(tLinkTiming *pTiming);
+extern void seedLinkTiming(uint32_t ui32SrttUs, uint32_t ui32VarUs);
+extern void setTimeoutBaudRate(uint32_t ui32Baud);
+extern uint32_t getWireTimeUs(uint32_t ui32ByteCount);
+extern void setTimeoutFloor(uint32_t ui32FloorMs);
+extern void setTimeoutFlashSize(uint32_t ui32FlashSize);
+extern void printCmdTimeouts(void);
+
+#endif /* SBL_TIMEOUT_H_ */
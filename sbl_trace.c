@@ -0,0 +1,191 @@
+/*
+ * sbl_trace.c
+ *
+ *  Created on: 18/10/2026
+ *  Description: Wire trace. Every byte serialWrite() sends and
+ *               serialRead() receives goes into a ring of fixed size
+ *               records in a memory mapped file, with its monotonic
+ *               time and direction. Nothing is formatted while
+ *               flashing; the file survives a crash of the tool and
+ *               tools/tracedump.c decodes it afterwards.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* Custom Includes */
+#include "sbl_trace.h"
+#include "sbl_small.h"
+
+/* Static variables */
+static tTraceHdr *m_pHdr;
+static tTraceRec *m_pRecs;
+static size_t m_mapLen;
+
+/* Static functions */
+static uint64_t clockNs(clockid_t clk);
+
+/****************************************************************
+ * Function Name : traceOpen
+ * Description   : Starts tracing into a new file of a fixed size,
+ *                 the oldest records are overwritten once it's full
+ * Returns       : 0 on success, -1 on failure
+ * Params        @pcPath: Trace file, replaced
+ *               @ui32NumRecs: Ring size in records
+ *               @pcPort: Port name, kept in the header
+ ****************************************************************/
+int traceOpen(const char *pcPath, uint32_t ui32NumRecs, const char *pcPort)
+{
+    void *pMap;
+    int fd;
+
+    m_mapLen = SBL_TRACE_HDR_SIZE + (size_t)ui32NumRecs * sizeof(tTraceRec);
+    if((fd = open(pcPath, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) < 0)
+    {
+        perror("TRACE: ERROR OPENING FILE |");
+        return (-1);
+    }
+    if(ftruncate(fd, m_mapLen) < 0 ||
+       (pMap = mmap(NULL, m_mapLen, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED)
+    {
+        perror("TRACE: ERROR MAPPING FILE |");
+        close(fd);
+        return (-1);
+    }
+    close(fd);
+
+    m_pHdr = (tTraceHdr*)pMap;
+    m_pRecs = (tTraceRec*)((uint8_t*)pMap + SBL_TRACE_HDR_SIZE);
+    memcpy(m_pHdr->magic, SBL_TRACE_MAGIC, sizeof(SBL_TRACE_MAGIC));
+    m_pHdr->version = SBL_TRACE_VERSION;
+    m_pHdr->recSize = sizeof(tTraceRec);
+    m_pHdr->numRecs = ui32NumRecs;
+    m_pHdr->startMonoNs = clockNs(CLOCK_MONOTONIC);
+    m_pHdr->startRealNs = clockNs(CLOCK_REALTIME);
+    snprintf(m_pHdr->port, sizeof(m_pHdr->port), "%s", (pcPort) ? pcPort : "");
+    return (0);
+}
+
+/****************************************************************
+ * Function Name : traceClose
+ * Description   : Stops tracing, the file stays
+ * Returns       : None
+ * Params        @None
+ ****************************************************************/
+void traceClose(void)
+{
+    if(!m_pHdr)
+        return;
+    munmap(m_pHdr, m_mapLen);
+    m_pHdr = NULL;
+    m_pRecs = NULL;
+}
+
+/****************************************************************
+ * Function Name : traceBytes
+ * Description   : Records bytes that went out or came in. Does
+ *                 nothing unless traceOpen() was called.
+ * Returns       : None
+ * Params        @dir: TRACE_TX, TRACE_RX or TRACE_FLUSH
+ *               @pcData: The bytes
+ *               @ui32Len: How many, 0 for TRACE_FLUSH
+ ****************************************************************/
+void traceBytes(tTraceDir dir, const uint8_t *pcData, uint32_t ui32Len)
+{
+    uint64_t seq, tNs;
+
+    if(!m_pHdr)
+        return;
+
+    tNs = clockNs(CLOCK_MONOTONIC);
+    seq = m_pHdr->seq;
+    do
+    {
+        tTraceRec *pRec = &m_pRecs[seq % m_pHdr->numRecs];
+        uint32_t n = (ui32Len < SBL_TRACE_REC_DATA) ? ui32Len : SBL_TRACE_REC_DATA;
+
+        pRec->tNs = tNs;
+        pRec->dir = dir;
+        pRec->len = n;
+        memcpy(pRec->data, pcData, n);
+        pcData += n;
+        ui32Len -= n;
+        seq++;
+    } while(ui32Len);
+
+    /* A reader of a live file sees whole records only */
+    atomic_store_explicit((_Atomic uint64_t*)&m_pHdr->seq, seq, memory_order_release);
+}
+
+/****************************************************************
+ * Function Name : traceMapFile
+ * Description   : Maps a trace file read-only for decoding or
+ *                 replay, munmap() it with the length returned
+ * Returns       : The header, NULL if the file isn't a trace
+ * Params        @pcPath: Trace file
+ *               @pMapLen: Set to the length mapped
+ ****************************************************************/
+const tTraceHdr *traceMapFile(const char *pcPath, size_t *pMapLen)
+{
+    const tTraceHdr *pHdr;
+    struct stat st;
+    void *pMap;
+    int fd;
+
+    if((fd = open(pcPath, O_RDONLY | O_CLOEXEC)) < 0 || fstat(fd, &st) < 0)
+    {
+        perror("TRACE: ERROR OPENING FILE |");
+        if(fd >= 0)
+            close(fd);
+        return (NULL);
+    }
+    if(st.st_size < SBL_TRACE_HDR_SIZE ||
+       (pMap = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED)
+    {
+        printf("TRACE: %s IS NOT A TRACE\r\n", pcPath);
+        close(fd);
+        return (NULL);
+    }
+    close(fd);
+
+    pHdr = (const tTraceHdr*)pMap;
+    if(memcmp(pHdr->magic, SBL_TRACE_MAGIC, sizeof(SBL_TRACE_MAGIC)) ||
+       pHdr->version != SBL_TRACE_VERSION || pHdr->recSize != sizeof(tTraceRec) ||
+       pHdr->numRecs == 0 ||
+       SBL_TRACE_HDR_SIZE + (uint64_t)pHdr->numRecs * sizeof(tTraceRec) > (uint64_t)st.st_size)
+    {
+        printf("TRACE: %s IS NOT A TRACE\r\n", pcPath);
+        munmap(pMap, st.st_size);
+        return (NULL);
+    }
+    *pMapLen = st.st_size;
+    return (pHdr);
+}
+
+/****************************************************************
+ * Function Name : traceRecords
+ * Description   : Record slots of a mapped trace, record n is in
+ *                 slot n % numRecs
+ * Returns       : The first slot
+ * Params        @pHdr: From traceMapFile()
+ ****************************************************************/
+const tTraceRec *traceRecords(const tTraceHdr *pHdr)
+{
+    return ((const tTraceRec*)((const uint8_t*)pHdr + SBL_TRACE_HDR_SIZE));
+}
+
+/* Current time of a clock in ns */
+static uint64_t clockNs(clockid_t clk)
+{
+    struct timespec ts;
+
+    clock_gettime(clk, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
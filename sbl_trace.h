@@ -0,0 +1,54 @@
+/*
+ * sbl_trace.h
+ *
+ *  Created on: 18/10/2026
+ */
+
+#ifndef SBL_TRACE_H_
+#define SBL_TRACE_H_
+#include <stdint.h>
+#include <stddef.h>
+
+#define SBL_TRACE_MAGIC             "SBLTRC1"
+#define SBL_TRACE_VERSION           1
+#define SBL_TRACE_HDR_SIZE          4096
+/* Bytes per record, longer writes/reads take several */
+#define SBL_TRACE_REC_DATA          22
+/* Ring size in records, 4 MB */
+#define SBL_TRACE_DEFAULT_RECORDS   (128 * 1024)
+
+typedef enum {
+    TRACE_TX = 1,
+    TRACE_RX,
+    TRACE_FLUSH,        /* RX discarded, no data */
+} tTraceDir;
+
+/* One record, 32 bytes */
+typedef struct {
+    uint64_t tNs;       /* CLOCK_MONOTONIC */
+    uint8_t  dir;       /* tTraceDir */
+    uint8_t  len;
+    uint8_t  data[SBL_TRACE_REC_DATA];
+} tTraceRec;
+
+/* Start of a trace file, host byte order. Records follow at
+ * SBL_TRACE_HDR_SIZE, record n in slot n % numRecs. */
+typedef struct {
+    char     magic[8];
+    uint32_t version;
+    uint32_t recSize;
+    uint32_t numRecs;
+    uint32_t reserved;
+    uint64_t startRealNs;   /* CLOCK_REALTIME at startMonoNs */
+    uint64_t startMonoNs;
+    uint64_t seq;           /* Records written so far */
+    char     port[256];
+} tTraceHdr;
+
+extern int traceOpen(const char *pcPath, uint32_t ui32NumRecs, const char *pcPort);
+extern void traceClose(void);
+extern void traceBytes(tTraceDir dir, const uint8_t *pcData, uint32_t ui32Len);
+extern const tTraceHdr *traceMapFile(const char *pcPath, size_t *pMapLen);
+extern const tTraceRec *traceRecords(const tTraceHdr *pHdr);
+
+#endif /* SBL_TRACE_H_ */
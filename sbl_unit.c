@@ -0,0 +1,242 @@
+/*
+ * sbl_unit.c
+ *
+ *  Created on: 18/10/2026
+ *  Description: Per-device state cache. A unit is told apart by its
+ *               chip ID and the IEEE address in its FCFG1, and what
+ *               a session learned about it is kept one line per unit:
+ *               <chip id>-<ieee> flash=131072 ram=20480 sessions=3
+ *                   addr=0x0 size=20000 crc=0x... pages=<crc>,<crc>,...
+ *               The next session on that unit skips the size reads
+ *               and, reflashing, programs only the pages that differ
+ *               from the image it last got.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/file.h>
+#include "sbl_unit.h"
+#include "sbl_device_cc2640.h"
+#include "myFile.h"
+
+/* Longest line we write, key, fields and page CRCs */
+#define UNIT_LINE_MAX       (SBL_UNIT_KEY_MAX + 256 + SBL_UNIT_MAX_PAGES * 9)
+
+/* Static variables */
+static char m_dbPath[PATH_MAX];
+
+/* Static functions */
+static bool parseUnit(char *pcLine, tUnitState *pUnit);
+static void formatUnit(const tUnitState *pUnit, char *pcLine, uint32_t ui32Len);
+
+/****************************************************************
+ * Function Name : getUnitDbPath
+ * Description   : Where units live: $SBL_UNIT_DB, else
+ *                 $XDG_CACHE_HOME/sbl_out/units, else
+ *                 ~/.cache/sbl_out/units
+ * Returns       : The path, NULL if there is no home
+ * Params        @None
+ ****************************************************************/
+const char *getUnitDbPath(void)
+{
+    const char *pcEnv;
+
+    if(m_dbPath[0])
+        return (m_dbPath);
+
+    if((pcEnv = getenv("SBL_UNIT_DB")) && pcEnv[0])
+        snprintf(m_dbPath, sizeof(m_dbPath), "%s", pcEnv);
+    else if((pcEnv = getenv("XDG_CACHE_HOME")) && pcEnv[0])
+        snprintf(m_dbPath, sizeof(m_dbPath), "%s/sbl_out/units", pcEnv);
+    else if((pcEnv = getenv("HOME")) && pcEnv[0])
+        snprintf(m_dbPath, sizeof(m_dbPath), "%s/.cache/sbl_out/units", pcEnv);
+    else
+        return (NULL);
+    return (m_dbPath);
+}
+
+/****************************************************************
+ * Function Name : makeUnitKey
+ * Description   : Starts the state of a unit from its identity,
+ *                 nothing else known
+ * Returns       : None
+ * Params        @ui32ChipId: GET_CHIP_ID
+ *               @ui64Ieee: IEEE address from FCFG1
+ *               @pUnit: Populated
+ ****************************************************************/
+void makeUnitKey(uint32_t ui32ChipId, uint64_t ui64Ieee, tUnitState *pUnit)
+{
+    memset(pUnit, 0, sizeof(*pUnit));
+    pUnit->chipId = ui32ChipId;
+    pUnit->ieee = ui64Ieee;
+    snprintf(pUnit->key, sizeof(pUnit->key), "%08x-%016" PRIx64, ui32ChipId, ui64Ieee);
+}
+
+/****************************************************************
+ * Function Name : loadUnitState
+ * Description   : Looks up what is known about a unit
+ * Returns       : SBL_SUCCESS if it was seen before, SBL_ERROR if
+ *                 not (pUnit keeps its key then)
+ * Params        @pUnit: Key set by makeUnitKey(), populated
+ ****************************************************************/
+tSblStatus loadUnitState(tUnitState *pUnit)
+{
+    static char pcLine[UNIT_LINE_MAX];
+    static tUnitState unit;
+    const char *pcPath = getUnitDbPath();
+    tSblStatus retCode = SBL_ERROR;
+    FILE *pFile;
+
+    if(!pcPath || !(pFile = fopen(pcPath, "r")))
+        return (SBL_ERROR);
+
+    while(fgets(pcLine, sizeof(pcLine), pFile))
+    {
+        if(parseUnit(pcLine, &unit) && !strcmp(unit.key, pUnit->key))
+        {
+            unit.chipId = pUnit->chipId;
+            unit.ieee = pUnit->ieee;
+            *pUnit = unit;
+            retCode = SBL_SUCCESS;
+            break;
+        }
+    }
+    fclose(pFile);
+    return (retCode);
+}
+
+/****************************************************************
+ * Function Name : saveUnitState
+ * Description   : Stores the state of a unit, replacing what it had.
+ *                 Sessions on other units may save at the same
+ *                 time, the database is locked meanwhile.
+ * Returns       : SBL_SUCCESS, ...
+ * Params        @pUnit: The unit
+ ****************************************************************/
+tSblStatus saveUnitState(const tUnitState *pUnit)
+{
+    static char pcLine[UNIT_LINE_MAX];
+    char pcLock[PATH_MAX + 8], pcTmp[PATH_MAX + 32];
+    const char *pcPath = getUnitDbPath();
+    FILE *pIn, *pOut;
+    int lockFd;
+
+    if(!pcPath)
+        return (SBL_ERROR);
+    makeParentDirs(pcPath);
+
+    /* The database itself gets replaced, lock a file next to it */
+    snprintf(pcLock, sizeof(pcLock), "%s.lock", pcPath);
+    if((lockFd = open(pcLock, O_RDWR | O_CREAT | O_CLOEXEC, 0644)) < 0 ||
+       flock(lockFd, LOCK_EX) < 0)
+    {
+        perror("Units: ERROR LOCKING DATABASE |");
+        if(lockFd >= 0)
+            close(lockFd);
+        return (SBL_ERROR);
+    }
+
+    snprintf(pcTmp, sizeof(pcTmp), "%s.%d.tmp", pcPath, (int)getpid());
+    if(!(pOut = fopen(pcTmp, "w")))
+    {
+        perror("Units: ERROR WRITING DATABASE |");
+        close(lockFd);
+        return (SBL_ERROR);
+    }
+
+    /* Every other unit as it was, this one last */
+    if((pIn = fopen(pcPath, "r")))
+    {
+        while(fgets(pcLine, sizeof(pcLine), pIn))
+        {
+            char pcKey[SBL_UNIT_KEY_MAX];
+            if(sscanf(pcLine, "%31s", pcKey) == 1 && pcKey[0] != '#' && strcmp(pcKey, pUnit->key))
+                fputs(pcLine, pOut);
+        }
+        fclose(pIn);
+    }
+    formatUnit(pUnit, pcLine, sizeof(pcLine));
+    fputs(pcLine, pOut);
+
+    if(fclose(pOut) != 0 || rename(pcTmp, pcPath) < 0)
+    {
+        perror("Units: ERROR WRITING DATABASE |");
+        unlink(pcTmp);
+        close(lockFd);
+        return (SBL_ERROR);
+    }
+    close(lockFd);
+    return (SBL_SUCCESS);
+}
+
+/* One database line, false if it isn't a unit. Tokenizes pcLine. */
+static bool parseUnit(char *pcLine, tUnitState *pUnit)
+{
+    char *pcTok;
+
+    memset(pUnit, 0, sizeof(*pUnit));
+    if(!(pcTok = strtok(pcLine, " \t\r\n")) || pcTok[0] == '#' ||
+       strlen(pcTok) >= sizeof(pUnit->key))
+        return false;
+    strcpy(pUnit->key, pcTok);
+
+    /* name=value pairs, unknown names are skipped */
+    while((pcTok = strtok(NULL, " \t\r\n")))
+    {
+        char *pcValue = strchr(pcTok, '=');
+        uint32_t value;
+
+        if(!pcValue)
+            continue;
+        *pcValue++ = '\0';
+        value = (uint32_t)strtoul(pcValue, NULL, 0);
+        if(!strcmp(pcTok, "flash"))             pUnit->flashSize = value;
+        else if(!strcmp(pcTok, "ram"))          pUnit->ramSize = value;
+        else if(!strcmp(pcTok, "sessions"))     pUnit->sessions = value;
+        else if(!strcmp(pcTok, "addr"))         pUnit->imageAddr = value;
+        else if(!strcmp(pcTok, "size"))         pUnit->imageSize = value;
+        else if(!strcmp(pcTok, "crc"))          pUnit->imageCrc = value;
+        else if(!strcmp(pcTok, "pages"))
+        {
+            char *pcEnd = pcValue;
+            while(*pcEnd && pUnit->numPages < SBL_UNIT_MAX_PAGES)
+            {
+                pUnit->pageCrc[pUnit->numPages++] = (uint32_t)strtoul(pcEnd, &pcEnd, 16);
+                if(*pcEnd == ',')
+                    pcEnd++;
+            }
+        }
+    }
+
+    /* An image whose pages don't add up is as good as none */
+    if(pUnit->numPages != (pUnit->imageSize + SBL_CC2650_PAGE_ERASE_SIZE - 1) /
+                           SBL_CC2650_PAGE_ERASE_SIZE)
+    {
+        pUnit->imageSize = 0;
+        pUnit->numPages = 0;
+    }
+    return true;
+}
+
+/* The database line of a unit */
+static void formatUnit(const tUnitState *pUnit, char *pcLine, uint32_t ui32Len)
+{
+    int n = snprintf(pcLine, ui32Len, "%s flash=%u ram=%u sessions=%u", pUnit->key,
+                     pUnit->flashSize, pUnit->ramSize, pUnit->sessions);
+
+    if(pUnit->imageSize)
+    {
+        n += snprintf(&pcLine[n], ui32Len - n, " addr=0x%X size=%u crc=0x%08X pages=",
+                      pUnit->imageAddr, pUnit->imageSize, pUnit->imageCrc);
+        for(uint32_t i = 0; i < pUnit->numPages; i++)
+            n += snprintf(&pcLine[n], ui32Len - n, "%s%08x", i ? "," : "", pUnit->pageCrc[i]);
+    }
+    snprintf(&pcLine[n], ui32Len - n, "\n");
+}
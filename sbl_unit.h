@@ -0,0 +1,40 @@
+/*
+ * sbl_unit.h
+ *
+ *  Created on: 18/10/2026
+ */
+
+#ifndef SBL_UNIT_H_
+#define SBL_UNIT_H_
+#include <stdint.h>
+#include <stdbool.h>
+#include "sbl_device.h"
+
+/* "<chip id>-<IEEE address>", hex */
+#define SBL_UNIT_KEY_MAX        32
+/* Page CRCs kept of the last image, 512 KB of 4 KB pages */
+#define SBL_UNIT_MAX_PAGES      128
+
+/* What we know about one device, see identifyUnit() in main.c */
+typedef struct {
+    char     key[SBL_UNIT_KEY_MAX];
+    uint32_t chipId;
+    uint64_t ieee;          /* FCFG1 MAC_15_4 */
+    uint32_t flashSize;
+    uint32_t ramSize;
+    uint32_t sessions;
+
+    /* Last image written to it, imageSize 0 if not known */
+    uint32_t imageAddr;
+    uint32_t imageSize;
+    uint32_t imageCrc;
+    uint32_t numPages;
+    uint32_t pageCrc[SBL_UNIT_MAX_PAGES];
+} tUnitState;
+
+extern const char *getUnitDbPath(void);
+extern void makeUnitKey(uint32_t ui32ChipId, uint64_t ui64Ieee, tUnitState *pUnit);
+extern tSblStatus loadUnitState(tUnitState *pUnit);
+extern tSblStatus saveUnitState(const tUnitState *pUnit);
+
+#endif /* SBL_UNIT_H_ */
@@ -0,0 +1,399 @@
+/*
+ * tracedump.c
+ *
+ *  Created on: 18/10/2026
+ *  Description: Decodes a wire trace recorded with --trace into
+ *               bootloader frames: commands with their arguments,
+ *               ACK/NAK with the turnaround of the command they
+ *               answer, data responses with status names. Ends with
+ *               turnaround statistics per command and the longest
+ *               silences on the wire.
+ *
+ *               sbl_tracedump <trace> [--raw]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <sys/mman.h>
+#include "sbl_trace.h"
+#include "sbl_device.h"
+
+#define DUMP_MAX_PENDING        8       /* Commands awaiting their ACK */
+#define DUMP_TOP_GAPS           5
+#define DUMP_WHAT_MAX           96
+#define DUMP_AUTOBAUD           0x55    /* Pseudo command for 0x55 0x55 */
+
+/* One direction's bytes, reassembled across records */
+typedef struct {
+    uint8_t  buf[256];
+    uint32_t len;
+    uint32_t want;
+    bool     bZero;         /* RX: 0x00 seen, ACK/NAK may follow */
+    uint64_t firstNs;
+} tStream;
+
+/* ACK turnaround of one command */
+typedef struct {
+    uint32_t count;
+    uint32_t naks;
+    uint64_t sumNs;
+    uint64_t minNs;
+    uint64_t maxNs;
+} tTurnStat;
+
+/* A silence on the wire and what ended it */
+typedef struct {
+    uint64_t gapNs;
+    uint64_t atNs;
+    char     what[DUMP_WHAT_MAX];
+} tGap;
+
+/* Static variables */
+static const tTraceHdr *m_pHdr;
+static tStream m_tx, m_rx;
+static uint64_t m_lastEndNs;
+static uint8_t m_pendingCmd[DUMP_MAX_PENDING];
+static uint64_t m_pendingNs[DUMP_MAX_PENDING];
+static uint32_t m_numPending;
+static uint8_t m_dataCmd;
+static tTurnStat m_turn[256];
+static tGap m_gaps[DUMP_TOP_GAPS];
+static uint32_t m_frames;
+
+/* Static functions */
+static void feedTx(uint8_t b, uint64_t tNs);
+static void feedRx(uint8_t b, uint64_t tNs);
+static void txFrame(uint64_t t1Ns);
+static void rxAck(bool bAck, uint64_t t0Ns, uint64_t t1Ns);
+static void rxData(uint64_t t1Ns);
+static void emit(uint64_t t0Ns, uint64_t t1Ns, const char *pcDir, const char *pcWhat);
+static void printSummary(void);
+static const char *cmdName(uint8_t cmd);
+static uint32_t be32(const uint8_t *p);
+
+int main(int argc, char **argv)
+{
+    const tTraceRec *pRecs;
+    uint64_t first, seq;
+    bool bRaw = (argc > 2 && strcmp(argv[2], "--raw") == 0);
+    char pcStart[64];
+    time_t startS;
+    size_t mapLen;
+
+    if(argc < 2)
+    {
+        printf("Usage: sbl_tracedump <trace> [--raw]\n");
+        return (EXIT_FAILURE);
+    }
+    if(!(m_pHdr = traceMapFile(argv[1], &mapLen)))
+        return (EXIT_FAILURE);
+    pRecs = traceRecords(m_pHdr);
+
+    seq = m_pHdr->seq;
+    first = (seq > m_pHdr->numRecs) ? seq - m_pHdr->numRecs : 0;
+    startS = m_pHdr->startRealNs / 1000000000ULL;
+    strftime(pcStart, sizeof(pcStart), "%Y-%m-%d %H:%M:%S", localtime(&startS));
+    printf("Port %s, started %s, %llu records", m_pHdr->port, pcStart, (unsigned long long)seq);
+    if(first)
+        printf(" (oldest %llu overwritten)", (unsigned long long)first);
+    printf("\n\n        time ms       gap ms  dir\n");
+
+    m_lastEndNs = m_pHdr->startMonoNs;
+    for(uint64_t i = first; i < seq; i++)
+    {
+        const tTraceRec *pRec = &pRecs[i % m_pHdr->numRecs];
+
+        if(bRaw)
+        {
+            printf("%15.6f  %s ", (pRec->tNs - m_pHdr->startMonoNs) / 1e6,
+                   (pRec->dir == TRACE_TX) ? "TX" : (pRec->dir == TRACE_RX) ? "RX" : "--");
+            for(uint32_t j = 0; j < pRec->len; j++)
+                printf(" %02X", pRec->data[j]);
+            printf("\n");
+            continue;
+        }
+
+        if(pRec->dir == TRACE_FLUSH)
+        {
+            memset(&m_rx, 0, sizeof(m_rx));
+            m_numPending = 0;
+            emit(pRec->tNs, pRec->tNs, "--", "RX flushed");
+        }
+        for(uint32_t j = 0; j < pRec->len && j < SBL_TRACE_REC_DATA; j++)
+        {
+            if(pRec->dir == TRACE_TX)
+                feedTx(pRec->data[j], pRec->tNs);
+            else if(pRec->dir == TRACE_RX)
+                feedRx(pRec->data[j], pRec->tNs);
+        }
+    }
+
+    if(!bRaw)
+        printSummary();
+    munmap((void*)m_pHdr, mapLen);
+    return (EXIT_SUCCESS);
+}
+
+/* Host to device: 0x55 0x55, 0x00 0xCC/0x33 or <len> <cksum> <cmd> ... */
+static void feedTx(uint8_t b, uint64_t tNs)
+{
+    if(m_tx.len == 0)
+    {
+        m_tx.firstNs = tNs;
+        m_tx.want = (b == DUMP_AUTOBAUD || b == 0x00) ? 2 : b;
+        if(m_tx.want < 3 && b != DUMP_AUTOBAUD && b != 0x00)
+        {
+            char pcWhat[DUMP_WHAT_MAX];
+            snprintf(pcWhat, sizeof(pcWhat), "stray 0x%02X", b);
+            emit(tNs, tNs, "TX", pcWhat);
+            return;
+        }
+    }
+    m_tx.buf[m_tx.len++] = b;
+    if(m_tx.len == m_tx.want)
+    {
+        txFrame(tNs);
+        m_tx.len = 0;
+    }
+}
+
+/* Device to host: 0x00 0xCC/0x33, or <len> <cksum> <data> */
+static void feedRx(uint8_t b, uint64_t tNs)
+{
+    if(m_rx.len == 0)
+    {
+        if(b == 0x00)
+        {
+            if(!m_rx.bZero)
+                m_rx.firstNs = tNs;
+            m_rx.bZero = true;
+            return;
+        }
+        if(m_rx.bZero && (b == 0xCC || b == 0x33))
+        {
+            m_rx.bZero = false;
+            rxAck(b == 0xCC, m_rx.firstNs, tNs);
+            return;
+        }
+        m_rx.bZero = false;
+        if(b < 3)
+        {
+            char pcWhat[DUMP_WHAT_MAX];
+            snprintf(pcWhat, sizeof(pcWhat), "stray 0x%02X", b);
+            emit(tNs, tNs, "RX", pcWhat);
+            return;
+        }
+        m_rx.firstNs = tNs;
+        m_rx.want = b;
+    }
+    m_rx.buf[m_rx.len++] = b;
+    if(m_rx.len == m_rx.want)
+    {
+        rxData(tNs);
+        m_rx.len = 0;
+    }
+}
+
+/* A complete host frame */
+static void txFrame(uint64_t t1Ns)
+{
+    char pcWhat[DUMP_WHAT_MAX];
+    const uint8_t *p = m_tx.buf;
+    uint8_t cmd, sum = 0;
+    int n;
+
+    if(p[0] == DUMP_AUTOBAUD)
+    {
+        cmd = DUMP_AUTOBAUD;
+        snprintf(pcWhat, sizeof(pcWhat), "AUTOBAUD");
+    }
+    else if(p[0] == 0x00)
+    {
+        emit(m_tx.firstNs, t1Ns, "TX", (p[1] == 0xCC) ? "host ACK" : "host NAK");
+        return;
+    }
+    else
+    {
+        cmd = p[2];
+        for(uint32_t i = 2; i < m_tx.len; i++)
+            sum += p[i];
+        n = snprintf(pcWhat, sizeof(pcWhat), "%s", cmdName(cmd));
+        p += 3;
+        switch(cmd)
+        {
+        case CMD_DOWNLOAD:
+        case CMD_CRC32:
+            n += snprintf(&pcWhat[n], sizeof(pcWhat) - n, " addr=0x%08X size=%u",
+                          be32(p), be32(&p[4]));
+            break;
+        case CMD_SECTOR_ERASE:
+            n += snprintf(&pcWhat[n], sizeof(pcWhat) - n, " addr=0x%08X", be32(p));
+            break;
+        case CMD_MEMORY_READ:
+            n += snprintf(&pcWhat[n], sizeof(pcWhat) - n, " addr=0x%08X %s x%u",
+                          be32(p), (p[4]) ? "word" : "byte", p[5]);
+            break;
+        case CMD_MEMORY_WRITE:
+            n += snprintf(&pcWhat[n], sizeof(pcWhat) - n, " addr=0x%08X %u bytes",
+                          be32(p), m_tx.len - 8);
+            break;
+        case CMD_SEND_DATA:
+            n += snprintf(&pcWhat[n], sizeof(pcWhat) - n, " %u bytes", m_tx.len - 3);
+            break;
+        case CMD_SET_CCFG:
+            n += snprintf(&pcWhat[n], sizeof(pcWhat) - n, " field=%u value=0x%08X",
+                          be32(p), be32(&p[4]));
+            break;
+        default:
+            break;
+        }
+        if(sum != m_tx.buf[1])
+            snprintf(&pcWhat[n], sizeof(pcWhat) - n, " BAD CHECKSUM");
+    }
+
+    if(m_numPending == DUMP_MAX_PENDING)
+    {
+        memmove(m_pendingCmd, &m_pendingCmd[1], DUMP_MAX_PENDING - 1);
+        memmove(m_pendingNs, &m_pendingNs[1], (DUMP_MAX_PENDING - 1) * sizeof(m_pendingNs[0]));
+        m_numPending--;
+    }
+    m_pendingCmd[m_numPending] = cmd;
+    m_pendingNs[m_numPending++] = t1Ns;
+    emit(m_tx.firstNs, t1Ns, "TX", pcWhat);
+}
+
+/* ACK/NAK, answers the oldest command in flight */
+static void rxAck(bool bAck, uint64_t t0Ns, uint64_t t1Ns)
+{
+    char pcWhat[DUMP_WHAT_MAX];
+
+    if(!m_numPending)
+    {
+        emit(t0Ns, t1Ns, "RX", (bAck) ? "ACK (nothing pending)" : "NAK (nothing pending)");
+        return;
+    }
+
+    uint8_t cmd = m_pendingCmd[0];
+    uint64_t turnNs = t1Ns - m_pendingNs[0];
+    tTurnStat *pStat = &m_turn[cmd];
+
+    memmove(m_pendingCmd, &m_pendingCmd[1], m_numPending - 1);
+    memmove(m_pendingNs, &m_pendingNs[1], (m_numPending - 1) * sizeof(m_pendingNs[0]));
+    m_numPending--;
+
+    if(bAck)
+    {
+        if(!pStat->count || turnNs < pStat->minNs)
+            pStat->minNs = turnNs;
+        if(turnNs > pStat->maxNs)
+            pStat->maxNs = turnNs;
+        pStat->sumNs += turnNs;
+        pStat->count++;
+        if(cmd == CMD_GET_STATUS || cmd == CMD_CRC32 || cmd == CMD_GET_CHIP_ID ||
+           cmd == CMD_MEMORY_READ)
+            m_dataCmd = cmd;
+    }
+    else
+        pStat->naks++;
+
+    snprintf(pcWhat, sizeof(pcWhat), "%s %s after %.3f ms", (bAck) ? "ACK" : "NAK",
+             cmdName(cmd), turnNs / 1e6);
+    emit(t0Ns, t1Ns, "RX", pcWhat);
+}
+
+/* Data response of the last command ACKed */
+static void rxData(uint64_t t1Ns)
+{
+    char pcWhat[DUMP_WHAT_MAX];
+    const uint8_t *p = &m_rx.buf[2];
+    uint32_t len = m_rx.len - 2;
+    uint8_t sum = 0;
+    int n;
+
+    for(uint32_t i = 0; i < len; i++)
+        sum += p[i];
+
+    switch(m_dataCmd)
+    {
+    case CMD_GET_STATUS:
+        n = snprintf(pcWhat, sizeof(pcWhat), "status 0x%02X %s", p[0],
+                     getCmdStatusString((cmdRespStatus_t)p[0]));
+        break;
+    case CMD_CRC32:
+        n = snprintf(pcWhat, sizeof(pcWhat), "crc 0x%08X", (len >= 4) ? be32(p) : 0);
+        break;
+    case CMD_GET_CHIP_ID:
+        n = snprintf(pcWhat, sizeof(pcWhat), "chip id 0x%08X", (len >= 4) ? be32(p) : 0);
+        break;
+    default:
+        n = snprintf(pcWhat, sizeof(pcWhat), "data %u bytes", len);
+        for(uint32_t i = 0; i < len && i < 8; i++)
+            n += snprintf(&pcWhat[n], sizeof(pcWhat) - n, " %02X", p[i]);
+        break;
+    }
+    if(sum != m_rx.buf[1])
+        snprintf(&pcWhat[n], sizeof(pcWhat) - n, " BAD CHECKSUM");
+    m_dataCmd = 0;
+    emit(m_rx.firstNs, t1Ns, "RX", pcWhat);
+}
+
+/* Prints a frame and keeps the longest silences */
+static void emit(uint64_t t0Ns, uint64_t t1Ns, const char *pcDir, const char *pcWhat)
+{
+    uint64_t gapNs = (t0Ns > m_lastEndNs) ? t0Ns - m_lastEndNs : 0;
+
+    printf("%15.6f %12.3f  %s  %s\n", (t0Ns - m_pHdr->startMonoNs) / 1e6, gapNs / 1e6,
+           pcDir, pcWhat);
+    m_frames++;
+
+    for(uint32_t i = 0; i < DUMP_TOP_GAPS; i++)
+    {
+        if(gapNs <= m_gaps[i].gapNs)
+            continue;
+        memmove(&m_gaps[i + 1], &m_gaps[i], (DUMP_TOP_GAPS - 1 - i) * sizeof(m_gaps[0]));
+        m_gaps[i].gapNs = gapNs;
+        m_gaps[i].atNs = t0Ns;
+        snprintf(m_gaps[i].what, sizeof(m_gaps[i].what), "%s %s", pcDir, pcWhat);
+        break;
+    }
+    m_lastEndNs = t1Ns;
+}
+
+/* Turnaround per command, longest silences */
+static void printSummary(void)
+{
+    printf("\n%u frames\n\nACK turnaround     count  naks     min ms     avg ms     max ms\n", m_frames);
+    for(uint32_t cmd = 0; cmd < 256; cmd++)
+    {
+        const tTurnStat *pStat = &m_turn[cmd];
+        if(!pStat->count && !pStat->naks)
+            continue;
+        printf("%-18s %5u %5u %10.3f %10.3f %10.3f\n", cmdName(cmd), pStat->count, pStat->naks,
+               pStat->minNs / 1e6, (pStat->count) ? pStat->sumNs / 1e6 / pStat->count : 0,
+               pStat->maxNs / 1e6);
+    }
+    if(m_numPending)
+        printf("%u command(s) never answered, last %s\n", m_numPending,
+               cmdName(m_pendingCmd[m_numPending - 1]));
+
+    printf("\nLongest gaps         ms         at ms  before\n");
+    for(uint32_t i = 0; i < DUMP_TOP_GAPS && m_gaps[i].gapNs; i++)
+        printf("%17.3f %13.3f  %s\n", m_gaps[i].gapNs / 1e6,
+               (m_gaps[i].atNs - m_pHdr->startMonoNs) / 1e6, m_gaps[i].what);
+}
+
+/* Command name, with autobaud */
+static const char *cmdName(uint8_t cmd)
+{
+    return (cmd == DUMP_AUTOBAUD) ? "AUTOBAUD" : getCmdString((cmd_t)cmd);
+}
+
+/* Big endian word off the wire */
+static uint32_t be32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}